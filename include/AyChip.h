@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef AyChip_h
+#define AyChip_h
+
+#include <inttypes.h>
+
+// AY-3-8912 clock on Spectrum 128K and later models (3.5469MHz / 2)
+#define AY_CLOCK 1773400
+
+// stereo panning presets
+#define AY_STEREO_MONO 0
+#define AY_STEREO_ABC  1
+#define AY_STEREO_ACB  2
+
+// Emulation of a single AY-3-8912 chip: registers, tone/noise/envelope
+// generators, and block rendering into signed 8 bit samples (-128..127)
+// stored as int16_t, which is what FabGL's sound generator mixes.
+// Everything is done with integer counters. Mixer, volume and period
+// registers are decoded when written. A block is rendered in two passes:
+// each generator the output depends on jumps from one edge (tone toggle,
+// noise shift, envelope step) to the next, setting bits in a mask of its
+// output per sample, then the masks index a table of output levels for
+// each tone/noise state, rebuilt only when a register or the envelope
+// level changes. Generators nothing depends on are left idle.
+class AyChip
+{
+public:
+    AyChip();
+
+    void reset();
+
+    // set output sample rate (and optionally the chip clock, in Hz)
+    void setSampleRate(uint32_t sampleRate, uint32_t clock = AY_CLOCK);
+
+    // one of AY_STEREO_MONO, AY_STEREO_ABC, AY_STEREO_ACB
+    void setStereoMode(uint8_t mode);
+    uint8_t getStereoMode() { return stereoMode; }
+
+    // register access, as seen from ports 0xFFFD / 0xBFFD
+    void selectRegister(uint8_t reg) { selectedRegister = reg; }
+    uint8_t getSelectedRegister() { return selectedRegister; }
+    uint8_t getRegisterData() { return readRegister(selectedRegister); }
+    void setRegisterData(uint8_t data) { writeRegister(selectedRegister, data); }
+
+    uint8_t readRegister(uint8_t reg);
+    void writeRegister(uint8_t reg, uint8_t data);
+
+    // render n mono samples into buf
+    void render(int16_t* buf, int n);
+    // render n stereo frames into buf (2 * n samples, interleaved left, right)
+    void renderStereo(int16_t* buf, int n);
+
+private:
+    template <bool STEREO> void renderBlock(int16_t* buf, int n);
+
+    void advanceNoise(uint32_t delta);
+    void advanceEnvelope(uint32_t samples);
+    void shiftNoise(uint32_t shifts);
+    void syncTone(uint8_t channel);
+    void syncNoise();
+    void syncEnvelope();
+
+    void updateTonePeriod(uint8_t channel);
+    void updateNoisePeriod();
+    void updateEnvelopePeriod();
+    void updateMixer();
+    void updateVolume(uint8_t channel);
+    void updateLive();
+    template <bool STEREO> void updateLevels(uint8_t envLevel);
+    void updatePairs();
+    void updateEnvelopeLevel();
+    void stepEnvelope(uint32_t steps);
+    void restartEnvelope();
+
+    uint8_t regs[16];
+    uint8_t selectedRegister;
+    uint8_t stereoMode;
+
+    // counters are 16.16 fixed point, in units of the tone clock (AY clock / 8)
+    uint32_t step;
+    uint32_t toneCount[3];
+    uint32_t tonePeriod[3];
+    uint32_t toneQuot[3];   // whole samples per period
+    uint32_t toneWait[3];   // samples to the next edge, 0 if not known
+    uint8_t  toneOut[3];
+
+    // output samples not yet applied to the counters of generators the
+    // output does not depend on, caught up when it does or a period changes
+    uint16_t toneIdle[3];
+    uint16_t noiseIdle;
+    uint16_t envIdle;
+    uint16_t idleMax;
+
+    // decoded mixer and volume registers: tone / noise disabled, envelope
+    // controlled, and fixed amplitude from the DAC table
+    uint8_t toneOff[3];
+    uint8_t noiseOff[3];
+    uint8_t volEnv[3];
+    int16_t volAmp[3];
+    // generators the output depends on, from the above
+    uint8_t toneLive[3];
+    uint8_t noiseLive;
+    uint8_t envUsed;
+
+    uint32_t noiseCount;
+    uint32_t noisePeriod;
+    uint32_t noiseQuot;
+    uint32_t noiseWait;
+    uint32_t noiseShift;
+
+    uint32_t envCount;
+    uint32_t envPeriod;
+    uint32_t envStep;
+    uint32_t envQuot;
+    uint32_t envWait;
+    uint8_t  envPos;
+    uint8_t  envAttack;
+    uint8_t  envHold;
+    uint8_t  envLevel;
+
+    // panning weights per channel, in 1/256 units, for left and right outputs
+    uint16_t panLeft[3];
+    uint16_t panRight[3];
+
+    // output for each state of the tone A, B, C and noise bits: mono, or
+    // left and right, as last rendered (levelsValid 1 or 2). Rebuilt when
+    // mixer, volume, panning or envelope level change.
+    int16_t levels[3][16];
+    uint8_t levelsEnv;
+    uint8_t levelsValid;
+    // mono levels of two consecutive states, indexed by both
+    uint32_t pairs[256];
+    uint8_t pairsValid;
+};
+
+#endif // AyChip_h
@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef AyRecorder_h
+#define AyRecorder_h
+
+#include <Arduino.h>
+
+// PSG format: 16 byte header, then (register, value) pairs,
+// 0xFF marks the end of a 50 Hz frame, 0xFE n skips n * 4 frames
+#define PSG_END_OF_FRAME 0xFF
+#define PSG_SKIP_FRAMES  0xFE
+#define PSG_HEADER_SIZE  16
+
+#define AY_REC_DIR "/rec"
+
+// size of each of the two buffers between emulation and SD writer
+#define AY_REC_BUFFER_SIZE 1024
+
+// Streams AY register writes to a PSG file.
+//
+// The emulation side only appends bytes to one of two RAM buffers; when it is
+// full, it is handed to a writer task on core 0 which writes it to storage
+// while the other buffer fills. If both are busy data is dropped (and counted)
+// rather than stalling the emulation loop.
+class AyRecorder
+{
+public:
+    // first unused file name in AY_REC_DIR for the given snapshot name
+    static String nextFileName(String snaName);
+
+    // start recording to a new file
+    static bool start(String filename);
+    // flush and close the file, log the measured cost
+    static void stop();
+
+    static bool isRecording() { return recording; }
+
+    // called on every AY register write of the first chip
+    static inline void registerWrite(uint8_t reg, uint8_t data);
+
+    // called once per emulated frame (50 Hz interrupt)
+    static void endFrame();
+
+    // write buffers handed over by the emulation side; run by the writer task
+    // (the host harness calls it directly, as it has no tasks)
+    static void writePending();
+
+    // name of the file being recorded, or last recorded
+    static String fileName() { return filename; }
+
+private:
+    static void record(uint8_t reg, uint8_t data);
+    static bool reserve(uint16_t size);
+    static void put(uint8_t data) { buffer[active][fill++] = data; }
+    static void flushFrameMarkers();
+    static void writerTask(void* unused);
+
+    static volatile bool recording;
+    static String filename;
+
+    static uint8_t buffer[2][AY_REC_BUFFER_SIZE];
+    static uint8_t active;
+    static uint16_t fill;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+inline void AyRecorder::registerWrite(uint8_t reg, uint8_t data)
+{
+    if (recording && reg < 16)
+        record(reg, data);
+}
+
+#endif // AyRecorder_h
@@ -31,55 +31,58 @@
 #define AySound_h
 
 #include "hardconfig.h"
+#include <inttypes.h>
+#include "AyChip.h"
+
+// number of emulated AY chips: 2 for TurboSound
+#define AY_NUM_CHIPS 2
 
 class AySound
 {
 public:
 #ifndef USE_AY_SOUND
     static void initialize() {}
-    static void update() {}
     static void reset() {}
     static void disable() {}
     static void enable() {}
     static uint8_t getRegisterData() { return 0; }
     static void selectRegister(uint8_t data) {}
     static void setRegisterData(uint8_t data) {}
+    static void setStereoMode(uint8_t mode) {}
+    static uint8_t getStereoMode() { return AY_STEREO_MONO; }
+    static const uint16_t* renderBlock(int* frames) { *frames = 0; return 0; }
+    static bool isStereoOutput() { return false; }
+    static int sampleRate() { return 16000; }
 #else
     static void initialize();
 
-    static void update();
-
     static void reset();
 
     static void disable();
     static void enable();
 
     static uint8_t getRegisterData();
+    // register select; writing 0xFF / 0xFE selects TurboSound chip 0 / 1
     static void selectRegister(uint8_t data);
     static void setRegisterData(uint8_t data);
 
-private:
-    static uint8_t finePitchChannelA;
-    static uint8_t coarsePitchChannelA;
-    static uint8_t finePitchChannelB;
-    static uint8_t coarsePitchChannelB;
-    static uint8_t finePitchChannelC;
-    static uint8_t coarsePitchChannelC;
-    static uint8_t noisePitch;
-    static uint8_t mixer;
-    static uint8_t volumeChannelA;
-    static uint8_t volumeChannelB;
-    static uint8_t volumeChannelC;
-    static uint8_t envelopeFineDuration;
-    static uint8_t envelopeCoarseDuration;
-    static uint8_t envelopeShape;
-    static uint8_t ioPortA;
+    // one of AY_STEREO_MONO, AY_STEREO_ABC, AY_STEREO_ACB
+    static void setStereoMode(uint8_t mode);
+    static uint8_t getStereoMode() { return stereoMode; }
 
-    // Status
-    static uint8_t selectedRegister;
-    static uint8_t channelVolume[3];
-    static uint16_t channelFrequency[3];
+    // mix one block through the same mixer used for the DAC, without playing it
+    // (offline rendering); sample format as in SoundGenerator::renderBlock()
+    static const uint16_t* renderBlock(int* frames);
+    // true when built with AY_STEREO (interleaved L,R output)
+    static bool isStereoOutput();
+    static int sampleRate();
+
+    static AyChip chip[AY_NUM_CHIPS];
+
+private:
+    static uint8_t selectedChip;
+    static uint8_t stereoMode;
 #endif
 };
 
-#endif // AySound_h
\ No newline at end of file
+#endif // AySound_h
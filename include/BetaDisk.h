@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef BetaDisk_h
+#define BetaDisk_h
+
+#include <Arduino.h>
+#include "Mem.h"
+
+// TR-DOS ROM, paged in place of the BASIC ROM while TR-DOS runs
+#define TRDOS_ROM_FILE "/rom/trdos.rom"
+
+// a data byte every 32 us at 250 kbit/s MFM, in 3.5 MHz T-states
+#define BETA_BYTE_TSTATES 112
+#define BETA_MS_TSTATES 3500
+// a turn of the disk at 300 rpm, and the index pulse in it
+#define BETA_REVOLUTION_TSTATES (200 * BETA_MS_TSTATES)
+#define BETA_INDEX_TSTATES (4 * BETA_MS_TSTATES)
+// frames without disk access before changes are written to storage
+#define BETA_FLUSH_FRAMES 50
+
+// Beta 128 disk interface: a WD1793 controller and the TR-DOS ROM.
+//
+// The ROM pages in when the CPU fetches an instruction from 0x3D00-0x3DFF
+// with the 48K BASIC ROM selected, and out when it fetches one from RAM.
+// Only while it is in are the interface ports decoded: the WD1793 command
+// or status (0x1F), track (0x3F), sector (0x5F) and data (0x7F) registers,
+// and the system register (0xFF) selecting drive, side and density and
+// returning the INTRQ and DRQ lines. Drive A holds the FileTRD image.
+//
+// At normal speed seeks take their step rate and data comes at the drive's
+// bit rate. In fast mode seeks end at once and DRQ is up whenever the CPU
+// polls for a byte: sector transfers take no more emulated time than the
+// TR-DOS loop moving the bytes.
+class BetaDisk
+{
+public:
+    // load the TR-DOS ROM; without it there is no interface
+    static bool loadRom(String path);
+    static bool hasRom() { return Mem::rom[MEM_ROM_TRDOS] != NULL; }
+
+    static void reset();
+
+    // called before each instruction, with the address it is fetched from
+    static inline void trap(uint16_t pc) {
+        if (active) {
+            if (pc >= 0x4000) page(false);
+        }
+        else if ((pc & 0xFF00) == 0x3D00 && Mem::romInUse == basicRom) {
+            page(true);
+        }
+    }
+    static void page(bool in);
+
+    // ports, while the ROM is paged in
+    static uint8_t input(uint8_t portLow);
+    static void output(uint8_t portLow, uint8_t data);
+
+    // called after each emulated frame
+    static void endFrame(uint32_t statesPerFrame);
+
+    // the machine has the interface (48K and 128K, with the ROM)
+    static bool present;
+    // the TR-DOS ROM is paged in
+    static bool active;
+    // ROM that TR-DOS pages out: the 48K BASIC of the machine
+    static uint8_t basicRom;
+    // sector transfers in zero emulated time
+    static bool fast;
+};
+
+#endif // BetaDisk_h
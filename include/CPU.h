@@ -53,6 +53,10 @@ public:
     // CPU Tstates elapsed in current frame
     static uint32_t tstates;
 
+    // Tstates the next frame starts at, instead of 0
+    // (restoring a snapshot taken in the middle of a frame)
+    static uint32_t nextFrameStart;
+
     // Delay Contention: for emulating CPU slowing due to sharing bus with ULA
     // NOTE: Only 48K spectrum contention implemented. This function must be called
     // only when dealing with affected memory (use ADDRESS_IN_LOW_RAM macro)
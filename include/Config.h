@@ -43,19 +43,13 @@ public:
     static const String& getRomSet() { return romSet; }
     static String   ram_file;
     static bool     slog_on;
+    static uint8_t  ay_stereo;
+    static bool     fast_disk;
 
     // config persistence
     static void           load();
     static void IRAM_ATTR save();
 
-    // list of snapshot file names
-    static String   sna_file_list;
-    // list of snapshot display names
-    static String   sna_name_list;
-
-    // load lists of snapshots
-    static void loadSnapshotLists();
-
 private:
     static String   arch;
     static String   romSet;
@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef Deflater_h
+#define Deflater_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// compressed data is written to the file through a buffer of this size
+#define DEFLATE_OUTPUT_BUFFER_SIZE 512
+// hash table entries for finding matches (16 bit each)
+#define DEFLATE_HASH_BITS 12
+
+// Deflate encoder (RFC 1951) with zlib wrapper (RFC 1950), for blocks of up
+// to 64K held in memory, e.g. RAM pages.
+//
+// Greedy LZ77 matching with a single hash probe, one block with the fixed
+// Huffman codes: fast and small rather than the best possible ratio.
+// Output can be read by any inflater.
+class Deflater
+{
+public:
+    // compress len bytes of src as a zlib stream written to f;
+    // returns the number of bytes written, or -1 on error
+    static int32_t deflateZlib(const uint8_t* src, uint32_t len, File f);
+};
+
+#endif // Deflater_h
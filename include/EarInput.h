@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef EarInput_h
+#define EarInput_h
+
+#include <Arduino.h>
+
+// number of edges buffered between the EAR pin interrupt and the emulation,
+// must be a power of 2; 2048 edges hold 0.5 s of ROM loader data
+#define EAR_RING_SIZE 2048
+#define EAR_RING_MASK (EAR_RING_SIZE - 1)
+
+// edges are played this many microseconds after they are first seen,
+// absorbing the jitter between real time and emulated frames
+#define EAR_LATENCY_MICROS 20000
+
+// EAR input sampled into a ring buffer of timestamped edges.
+//
+// Each level change of EAR_PIN is stored by an interrupt handler with its
+// micros() timestamp. Reads of port 0xFE do not touch the pin: the edges are
+// mapped to emulated T-states (relative to the first edge seen after silence,
+// plus a fixed latency) and the level is looked up at the current CPU::tstates.
+class EarInput
+{
+public:
+    // attach the pin interrupt (device) and clear the buffer
+    static void initialize();
+
+    // store an edge; called by the pin interrupt, or by the host harness
+    // when replaying a recorded input stream
+    static void IRAM_ATTR pushEdge(uint32_t timeMicros, uint8_t level);
+
+    // EAR level at the given T-state of the current frame
+    static uint8_t read(uint32_t tstates);
+
+    // called after each emulated frame
+    static void endFrame(uint32_t statesPerFrame);
+
+    // edges lost because the emulation did not consume them in time
+    static uint32_t overruns() { return overrunCount; }
+
+private:
+    static void IRAM_ATTR interruptHandler();
+
+    struct Edge {
+        uint32_t time;
+        uint8_t level;
+    };
+
+    static Edge ring[EAR_RING_SIZE];
+    static volatile uint32_t head;
+    static uint32_t tail;
+
+    static uint8_t level;
+    static uint64_t frameStart;     // emulated T-states of current frame start
+    static bool anchored;
+    static uint64_t anchorStates;   // emulated time where anchorMicros is played
+    static uint32_t anchorMicros;
+    static uint32_t overrunCount;
+};
+
+#endif // EarInput_h
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FDC_h
+#define FDC_h
+
+#include <Arduino.h>
+
+// a data byte every 32 us at 250 kbit/s MFM, in 3.5 MHz T-states
+#define FDC_BYTE_TSTATES 112
+#define FDC_MS_TSTATES 3500
+// head settling after a seek
+#define FDC_SETTLE_MS 15
+
+// NEC uPD765A floppy disk controller of the +3.
+//
+// The main status register is read at port 0x2FFD and commands, data and
+// results go through port 0x3FFD; the motor of the drives is bit 3 of port
+// 0x1FFD. Drive A holds the FileDSK image, drive B is not connected. Data is
+// moved by the CPU, byte by byte, in the execution phase of a command.
+//
+// At normal speed seeks take the step rate given by SPECIFY and data comes
+// at the drive's bit rate, so disk software sees the timing of the machine.
+// In fast mode seeks end at once and every byte is ready when the CPU polls
+// for it: sector transfers take no more emulated time than the loop moving
+// the bytes. Both read sectors from PSRAM only; changes to the disk are
+// written back to storage between frames, after the motor stops.
+class FDC
+{
+public:
+    static void reset();
+
+    // port 0x2FFD: main status register
+    static uint8_t readStatus();
+    // port 0x3FFD: data register
+    static uint8_t readData();
+    static void writeData(uint8_t data);
+    // port 0x1FFD, bit 3
+    static void motor(bool on);
+
+    // called after each emulated frame
+    static void endFrame(uint32_t statesPerFrame);
+
+    // the machine has a disk drive (+3)
+    static bool present;
+    // sector transfers in zero emulated time
+    static bool fast;
+};
+
+#endif // FDC_h
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileCatalog_h
+#define FileCatalog_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// index of a snapshot directory, kept in the directory itself (next to it,
+// hidden, for a zip archive browsed as a directory)
+#define CATALOG_FILE_NAME ".catalog"
+#define CATALOG_MAGIC "ZXCI"
+#define CATALOG_VERSION 7
+// room for a FAT long file name and its terminator; a longer name (only
+// possible with multibyte characters) is skipped
+#define CATALOG_NAME_LEN 256
+// directories checked against their index in this session
+#define CATALOG_VERIFIED_MAX 16
+
+// entry types; files of no known type are left out of the index
+#define CATALOG_TYPE_OTHER 0
+#define CATALOG_TYPE_DIR   1
+#define CATALOG_TYPE_SNA   2
+#define CATALOG_TYPE_Z80   3
+#define CATALOG_TYPE_SZX   4
+#define CATALOG_TYPE_TAP   5
+#define CATALOG_TYPE_TZX   6
+#define CATALOG_TYPE_RZX   7
+#define CATALOG_TYPE_DSK   8
+#define CATALOG_TYPE_TRD   9
+
+// machine a snapshot is for
+#define CATALOG_MACHINE_UNKNOWN 0
+#define CATALOG_MACHINE_48K     1
+#define CATALOG_MACHINE_128K    2
+
+// one record of the index file, 268 bytes; records are sorted by name,
+// ignoring case
+struct CatalogEntry
+{
+    char     name[CATALOG_NAME_LEN];    // zero padded
+    uint32_t size;
+    uint32_t mtime;
+    uint8_t  type;
+    uint8_t  machine;
+    uint8_t  reserved[2];
+};
+
+// Entries are read from the index file on demand, so memory use does not
+// depend on the directory size. Only building or updating an index needs
+// a table of the whole directory, freed when done.
+class FileCatalog
+{
+public:
+    // open the index of dir, building it if missing; the first time a
+    // directory is opened in a session it is checked against its index,
+    // which is updated if files were added, removed or changed
+    static bool open(String dir);
+    static void close();
+
+    static const String& dir() { return dirPath; }
+    static uint16_t count() { return entryCount; }
+    // read n entries starting at first, returns the number read
+    static uint16_t read(uint16_t first, uint16_t n, CatalogEntry* dst);
+    // binary search by name, -1 if not found
+    static int32_t find(const char* name);
+    // index of the first entry whose name is not before prefix
+    static uint16_t lowerBound(const char* prefix);
+
+private:
+    static CatalogEntry* readTable(uint16_t* count, uint32_t* signature);
+    static bool writeIndex(const CatalogEntry* table, uint16_t count, uint32_t signature);
+    static CatalogEntry* scan(const CatalogEntry* old, uint16_t oldCount, uint16_t* count, uint32_t* signature);
+    static void probe(File f, CatalogEntry& e);
+    static bool isVerified(const String& dir);
+
+    static String dirPath;
+    static File indexFile;
+    static uint16_t entryCount;
+    static uint32_t verified[CATALOG_VERIFIED_MAX];
+    static uint8_t verifiedCount;
+};
+
+#endif // FileCatalog_h
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileDSK_h
+#define FileDSK_h
+
+#include <Arduino.h>
+
+// largest image kept in PSRAM; a +3 disk is 180K, a double sided one 360K
+#define DSK_MAX_SIZE (1024 * 1024)
+// track entries of an image: cylinders times sides
+#define DSK_MAX_TRACKS 204
+// sector entries that fit in a track information block
+#define DSK_MAX_SECTORS 29
+
+// a sector as recorded in the image: ID field, FDC status flags and data
+struct DSKSector
+{
+    uint8_t c, h, r, n;
+    uint8_t st1, st2;       // as the FDC reported them when imaging
+    uint16_t size;          // bytes of data in the image
+    uint8_t* data;          // in the image, written in place
+    uint8_t* id;            // its entry in the track information, in place
+};
+
+// Disk in drive A of the +3, standard or extended CPCEMU .dsk image.
+//
+// The whole image is read into PSRAM when inserted and indexed by track, so
+// the FDC finds any sector in memory and storage is never accessed while
+// the CPU runs a disk operation. Writes change the image in PSRAM and are
+// written back to the file by flush(), when the drive motor stops or the
+// disk is ejected. Images inside zip archives are write protected.
+class FileDSK
+{
+public:
+    static bool open(String dsk_fn);
+    static void close();
+    static void flush();
+
+    static bool isInserted() { return inserted; }
+    static bool isWriteProtected() { return writeProtected; }
+    static uint8_t cylinders() { return numCylinders; }
+    static uint8_t sides() { return numSides; }
+
+    // sectors of a track in the order they pass under the head, 0 if the
+    // track is not formatted
+    static uint8_t sectorCount(uint8_t cyl, uint8_t head);
+    static bool sector(uint8_t cyl, uint8_t head, uint8_t index, DSKSector& s);
+    // after writing to the data of a sector
+    static void written() { changed = true; }
+    // lay out a track with count sectors of 128 << n bytes, ids holding C, H,
+    // R, N for each; false if it does not fit in the space of the track
+    static bool format(uint8_t cyl, uint8_t head, uint8_t n, uint8_t count, uint8_t gap,
+                       uint8_t filler, const uint8_t* ids);
+
+private:
+    static uint8_t* track(uint8_t cyl, uint8_t head);
+
+    static bool inserted;
+    static bool writeProtected;
+    static bool changed;
+    static bool extended;
+    static uint8_t numCylinders;
+    static uint8_t numSides;
+    static String fileName;
+    static uint8_t* image;
+    static uint32_t imageSize;
+    static uint32_t trackOffset[DSK_MAX_TRACKS];   // of the track info, 0 if none
+    static uint32_t trackSpace[DSK_MAX_TRACKS];    // bytes for it in the image
+};
+
+#endif // FileDSK_h
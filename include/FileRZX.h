@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileRZX_h
+#define FileRZX_h
+
+#include <Arduino.h>
+
+// RZX input recording format, version 0.13
+#define RZX_MAJOR_VERSION 0
+#define RZX_MINOR_VERSION 13
+
+// recordings go to a directory of the snapshot browser, so they can be played
+#define RZX_REC_DIR "/sna/rzx"
+
+// port reads kept for one frame; more are dropped, and playback of that
+// frame will go out of sync
+#define RZX_FRAME_MAX_INPUTS 4096
+// size of each of the two buffers between emulation and SD writer, room
+// for the largest frame record
+#define RZX_REC_BUFFER_SIZE (2 * RZX_FRAME_MAX_INPUTS)
+// largest input recording block played, read into PSRAM at once
+#define RZX_PLAY_MEMORY (1024 * 1024)
+
+// RZX recording and playback.
+//
+// A recording is a snapshot of the running machine (an embedded SZX) followed
+// by, for every frame, the number of opcode fetches and the values returned by
+// every port read. Playback loads the snapshot and feeds the recorded values
+// back instead of reading the keyboard, joystick and EAR, so the session runs
+// again exactly the same: a fixed workload for timing and, as the fetch and
+// read counts are checked every frame, a check that emulation still does the
+// same thing.
+//
+// Frame records are built in RAM and handed to a writer task on core 0 in
+// double buffers, as AyRecorder does; an input recording block is played from
+// PSRAM, read at once. Tape traps write memory without port reads, so tapes
+// should be loaded before recording starts. Blocks compressed by other
+// emulators, and snapshots other than SZX, are not supported.
+class FileRZX
+{
+public:
+    // first unused file name in RZX_REC_DIR for the given snapshot name
+    static String nextFileName(String snaName);
+
+    // start recording the running machine to a new file
+    static bool record(String rzx_fn);
+    // load the snapshot of a recording and start playing its input
+    static bool play(String rzx_fn);
+    // end recording (flush and close the file) or playback
+    static void stop();
+
+    static bool isRecording() { return recording; }
+    static bool isPlaying() { return playing; }
+
+    // port read while recording or playing: the value read, recorded, or
+    // the recorded one
+    static inline bool isActive() { return recording || playing; }
+    static uint8_t input(uint8_t portLow, uint8_t portHigh);
+
+    // called after each emulated frame
+    static void endFrame();
+
+    // write buffers handed over by the emulation side; run by the writer task
+    // (the host harness calls it directly, as it has no tasks)
+    static void writePending();
+
+    // true once when playback has reached the end of the recording
+    static bool pollEnded();
+
+    // name of the file being recorded or played, or the last one
+    static String fileName() { return filename; }
+    // frames recorded or played, and played frames whose fetch or port read
+    // count did not match the recording
+    static uint32_t frames() { return frameCount; }
+    static uint32_t desyncs() { return desyncCount; }
+
+    // opcode fetches in the current frame, counted by the CPU
+    static uint32_t fetches;
+
+private:
+    static bool nextFrame();
+    static void writerTask(void* unused);
+
+    static volatile bool recording;
+    static volatile bool playing;
+    static String filename;
+    static uint32_t frameCount;
+    static uint32_t desyncCount;
+};
+
+#endif // FileRZX_h
@@ -36,6 +36,8 @@ class FileSNA
 {
 public:
     static bool IRAM_ATTR load(String sna_fn);
+    // read the screen shown by a snapshot (6912 bytes), without loading it
+    static bool loadScreen(String sna_fn, uint8_t* screen);
 
     // save snapshot in SNA format to disk using specified filename.
     // this function tries to save using pages, 
@@ -43,16 +45,12 @@ public:
     // using this function you can choose whether to write pages block by block, or byte by byte.
     static bool IRAM_ATTR save(String sna_fn, bool blockMode);
 
-    static bool IRAM_ATTR loadQuick();
-    static bool IRAM_ATTR saveQuick();
-
     static bool IRAM_ATTR loadFromMem(uint8_t* srcBuffer, uint32_t size);
     static bool IRAM_ATTR saveToMem(uint8_t* dstBuffer, uint32_t size);
 
     static bool IRAM_ATTR loadQuick48();
     static bool IRAM_ATTR saveQuick48();
 
-    static bool IRAM_ATTR isQuickAvailable();
     static bool IRAM_ATTR isPersistAvailable();
 };
 
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileSZX_h
+#define FileSZX_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// SZX (zx-state) snapshot format, version 1.4
+#define SZX_MAJOR_VERSION 1
+#define SZX_MINOR_VERSION 4
+
+// machine ids
+#define SZX_MID_48K     1
+#define SZX_MID_128K    2
+#define SZX_MID_PLUS2   3
+#define SZX_MID_PLUS2A  4
+#define SZX_MID_PLUS3   5
+#define SZX_MID_PLUS3E  6
+
+// room for the file header and the chunks before the RAM pages
+#define SZX_HEAD_MAX 160
+
+// machine state captured for writing: the start of the file, then the RAM
+// pages, either copies or the live Mem::ram[] ones
+struct SZXImage
+{
+    uint8_t head[SZX_HEAD_MAX];
+    uint16_t headLen;
+    uint8_t pageCount;
+    uint8_t pageIds[8];
+    const uint8_t* pages[8];
+};
+
+// background save states
+#define SZX_SAVE_IDLE   0
+#define SZX_SAVE_BUSY   1
+#define SZX_SAVE_DONE   2
+#define SZX_SAVE_FAILED 3
+
+class FileSZX
+{
+public:
+    // load snapshot, RAM pages are inflated straight into memory
+    static bool IRAM_ATTR load(String szx_fn);
+    // load a snapshot of size bytes embedded in another file, from its
+    // current position
+    static bool load(File f, uint32_t size);
+    // read the screen shown by a snapshot (6912 bytes), without loading it
+    static bool loadScreen(String szx_fn, uint8_t* screen);
+    // save snapshot with complete machine state: registers, frame position,
+    // paging, border, AY registers and deflated RAM pages
+    static bool IRAM_ATTR save(String szx_fn);
+
+    // capture the machine state; the RAM pages are copied to pageCopies
+    // (8 x 16 KB) if given, else the image points at the live ones
+    static void capture(SZXImage& image, uint8_t* pageCopies);
+    // write a captured state as a snapshot file, from any core
+    static bool write(String szx_fn, const SZXImage& image);
+    // same, at the current position of an open file
+    static bool write(File f, const SZXImage& image);
+    // put a captured state of the running machine back, false if it was
+    // taken on another machine
+    static bool restore(const SZXImage& image);
+
+    // capture the machine state into PSRAM and return; a low priority task on
+    // core 0 writes it to a temporary file and renames it over szx_fn.
+    // false if a save is still running or there is no memory for the copy
+    static bool saveAsync(String szx_fn);
+    // SZX_SAVE_DONE or SZX_SAVE_FAILED once when a background save ends,
+    // else SZX_SAVE_IDLE or SZX_SAVE_BUSY
+    static uint8_t pollSave();
+    // block until a background save, if any, has ended
+    static void waitForSave();
+    // finish a background save cut short between removing szx_fn and
+    // renaming the complete temporary file over it; true if szx_fn exists
+    static bool recoverSave(String szx_fn);
+};
+
+#endif // FileSZX_h
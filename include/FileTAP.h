@@ -0,0 +1,66 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileTAP_h
+#define FileTAP_h
+
+#include <Arduino.h>
+
+// entry point of the ROM LD-BYTES routine, trapped while a tape is inserted
+#define ROM_LD_BYTES 0x0556
+// SA/LD-RET: restores border, enables interrupts and returns to the caller
+#define ROM_SA_LD_RET 0x053F
+
+class FileTAP
+{
+public:
+    // insert a .tap file; blocks are read from it on demand
+    static bool IRAM_ATTR open(String tap_fn);
+    // eject tape
+    static void close();
+    // go back to first block
+    static void rewind();
+
+    static bool isInserted() { return inserted; }
+
+    // true if the ROM paged in has the genuine LD-BYTES routine at
+    // ROM_LD_BYTES, and not other code (TR-DOS, +3DOS, a custom ROM)
+    static bool isLoadBytes();
+
+    // called when PC reaches ROM_LD_BYTES: copies the next block from the
+    // file into memory as the ROM would, and leaves PC at ROM_SA_LD_RET.
+    // returns false (and does nothing) if the routine cannot be trapped,
+    // so that the ROM runs normally.
+    static bool IRAM_ATTR trapLoadBytes();
+
+private:
+    static bool inserted;
+};
+
+#endif
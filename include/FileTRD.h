@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileTRD_h
+#define FileTRD_h
+
+#include <Arduino.h>
+
+// TR-DOS disks: 16 sectors of 256 bytes per track
+#define TRD_SECTOR_SIZE 256
+#define TRD_SECTORS 16
+#define TRD_TRACK_SIZE (TRD_SECTORS * TRD_SECTOR_SIZE)
+// cylinders an image may have
+#define TRD_MAX_TRACKS 86
+#define TRD_MAX_SIZE (TRD_MAX_TRACKS * 2 * TRD_TRACK_SIZE)
+
+// Disk in drive A of the Beta 128 interface, a .trd or .scl image.
+//
+// A .trd holds the sectors of the disk in order, side by side. A .scl holds
+// only the files: it is laid out on a blank 80 track double sided disk, as
+// TR-DOS would write them. Either way the whole disk is kept in PSRAM, so
+// the WD1793 reads any sector from memory. Writes change the image in PSRAM
+// and are written back to a .trd by flush(), after the disk has been idle
+// for a while or when it is ejected; .scl images, and images inside zip
+// archives, are write protected.
+class FileTRD
+{
+public:
+    static bool open(String trd_fn);
+    static void close();
+    static void flush();
+
+    static bool isInserted() { return inserted; }
+    static bool isWriteProtected() { return writeProtected; }
+    static uint8_t tracks() { return numTracks; }
+    static uint8_t sides() { return numSides; }
+
+    // data of sector 1 to 16 of a track, NULL if the disk has no such sector
+    static uint8_t* sector(uint8_t track, uint8_t side, uint8_t sector);
+    // after writing to the data of a sector
+    static void written() { changed = true; }
+    static bool isChanged() { return changed; }
+
+private:
+    static bool loadSCL(const uint8_t* scl, uint32_t size);
+
+    static bool inserted;
+    static bool writeProtected;
+    static bool changed;
+    static uint8_t numTracks;
+    static uint8_t numSides;
+    static String fileName;
+    static uint8_t* image;
+    static uint32_t imageSize;
+};
+
+#endif // FileTRD_h
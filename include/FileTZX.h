@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef FileTZX_h
+#define FileTZX_h
+
+#include <Arduino.h>
+
+// TZX file data is read through a buffer of this size
+#define TZX_BUFFER_SIZE 256
+
+// TZX tape player.
+//
+// Blocks are turned into EAR level changes on the emulated T-state clock,
+// so custom and turbo loaders see the same signal as from a real tape.
+// Supported blocks: standard speed (0x10), turbo (0x11), pure tone (0x12),
+// pulse sequence (0x13), pure data (0x14), direct recording (0x15),
+// pause/stop (0x20), loops (0x24/0x25), stop if 48K (0x2A), signal level (0x2B);
+// informational blocks are skipped.
+//
+// Playback starts when the ROM LD-BYTES routine is entered with a tape
+// inserted, and stops at a "stop the tape" block or at the end of the tape.
+// It goes on from there on the next LD-BYTES entry, or from the OSD (F9)
+// for loaders of their own.
+class FileTZX
+{
+public:
+    // insert a .tzx file, without playing it
+    static bool open(String tzx_fn);
+    // eject tape
+    static void close();
+    // go back to first block and stop
+    static void rewind();
+
+    // start playing from current block, at current CPU::tstates
+    static void play();
+    static void stop();
+
+    static bool isInserted() { return inserted; }
+    static bool isPlaying() { return playing; }
+
+    // EAR level at the given T-state of the current frame
+    static uint8_t IRAM_ATTR read(uint32_t tstates);
+
+    // called after each emulated frame
+    static void endFrame(uint32_t statesPerFrame);
+
+private:
+    static bool inserted;
+    static bool playing;
+};
+
+#endif // FileTZX_h
@@ -49,11 +49,20 @@ public:
     static File IRAM_ATTR safeOpenFileRead(String filename);
     static String         getFileEntriesFromDir(String path);
     static uint16_t       countFileEntriesFromDir(String path);
-    static String         getSortedSnaFileList();
     static String         getSnaFileList();
 
     static bool           hasSNAextension(String filename);
     static bool           hasZ80extension(String filename);
+    static bool           hasSZXextension(String filename);
+    static bool           hasTAPextension(String filename);
+    static bool           hasTZXextension(String filename);
+    static bool           hasRZXextension(String filename);
+    static bool           hasDSKextension(String filename);
+    static bool           hasTRDextension(String filename);
+    static bool           hasZIPextension(String filename);
+
+    // CRC-32 (as in zip and png) of data, continuing from crc (0 to start)
+    static uint32_t       crc32(uint32_t crc, const uint8_t* data, size_t len);
 
 private:
     friend class          Config;
@@ -63,7 +72,7 @@ private:
 #define DISK_BOOT_FILENAME "/boot.cfg"
 #define DISK_ROM_DIR "/rom"
 #define DISK_SNA_DIR "/sna"
-#define DISK_PSNA_FILE "/persist/persist.sna"
+#define DISK_PSNA_FILE "/persist/persist.szx"
 #define NO_RAM_FILE "none"
 #define SNA_48K_SIZE 49179
 #define SNA_128K_SIZE1 131103
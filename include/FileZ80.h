@@ -33,15 +33,24 @@
 #include <Arduino.h>
 #include <FS.h>
 
+// file data is read in chunks of this size, from a buffer allocated while loading
+#define Z80_CHUNK_SIZE 4096
+// compressed pages are written through a buffer of this size
+#define Z80_OUT_BUFFER_SIZE 512
+
 class FileZ80
 {
 public:
     static bool IRAM_ATTR load(String z80_fn);
-    // static bool IRAM_ATTR save(String z80_fn);
+    // read the screen shown by a snapshot (6912 bytes), without loading it
+    static bool loadScreen(String z80_fn, uint8_t* screen);
+    // save snapshot in version 3 format, RAM pages compressed
+    static bool IRAM_ATTR save(String z80_fn);
 
 private:
-    static void loadCompressedMemData(File f, uint16_t dataLen, uint16_t memStart, uint16_t memlen);
-    static void loadCompressedMemPage(File f, uint16_t dataLen, uint8_t* memPage, uint16_t memlen);
+    static uint32_t readChunked(File f, uint8_t* dst, uint32_t count);
+    static uint32_t loadCompressed(File f, uint32_t dataLen, uint8_t* const* pages, uint32_t memlen);
+    static uint32_t loadPage(File f, uint16_t compDataLen, uint8_t* memPage);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef Inflater_h
+#define Inflater_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// compressed data is read from the file through a buffer of this size
+#define INFLATE_INPUT_BUFFER_SIZE 512
+// window needed to decode any deflate stream piece by piece
+#define INFLATE_WINDOW_SIZE 32768
+
+// canonical Huffman code: number of codes of each length, symbols by code
+struct InflateHuffman
+{
+    uint16_t count[16];
+    uint16_t symbol[288];
+};
+
+// Streaming deflate decoder (RFC 1951), with optional zlib wrapper (RFC 1950).
+//
+// Input is read from the current position of a file. The one-call decoders
+// write the output straight to a memory area (e.g. a RAM page) which also
+// serves as the window for back references, so no other output buffer is
+// needed. An Inflater object decodes a raw stream a piece at a time instead,
+// through a circular window of its own, for output that is not kept in
+// memory (e.g. a member of a zip archive being read by a loader).
+class Inflater
+{
+public:
+    // decompress a zlib stream of srcLen bytes into dst (at most dstLen bytes);
+    // returns the number of bytes written, or -1 if the data is not valid
+    static int32_t inflateZlib(File f, uint32_t srcLen, uint8_t* dst, uint32_t dstLen);
+
+    // same for a raw deflate stream, without zlib header and checksum
+    static int32_t inflateRaw(File f, uint32_t srcLen, uint8_t* dst, uint32_t dstLen);
+
+    // window of INFLATE_WINDOW_SIZE bytes, owned by the caller
+    Inflater(uint8_t* window = NULL);
+
+    // decode the raw deflate stream of srcLen bytes at the current position
+    // of f; the file may be read elsewhere meanwhile
+    void begin(File f, uint32_t srcLen);
+    // next bytes of output, at most len; returns the number of bytes, less
+    // than len only at the end of the stream, or -1 if the data is not valid
+    int32_t read(uint8_t* buf, uint32_t len);
+
+private:
+    enum State { BLOCK_HEADER, BLOCK_STORED, BLOCK_CODES, STREAM_END, STREAM_ERROR };
+
+    void beginOutput(uint8_t* dst, uint32_t size, uint32_t limit);
+    void decode(uint32_t target);
+    bool header();
+    bool stored(uint32_t target);
+    bool codes(uint32_t target);
+    bool dynamicTables();
+    int16_t decodeSymbol(const InflateHuffman& h);
+    uint32_t bits(uint8_t need);
+    uint8_t nextByte();
+    void endInput();
+
+    // input
+    File inFile;
+    uint8_t inBuffer[INFLATE_INPUT_BUFFER_SIZE];
+    uint16_t inPos;
+    uint16_t inLen;
+    uint32_t inNext;            // file position of the next buffer
+    uint32_t inLeft;            // bytes of the stream not yet in the buffer
+    bool inError;               // read past the end of the stream
+    uint32_t bitBuf;
+    uint8_t bitCnt;
+
+    // blocks
+    State state;
+    bool lastBlock;
+    uint16_t storedLeft;        // bytes of the stored block still to copy
+    const InflateHuffman* lenCode;
+    const InflateHuffman* distCode;
+    InflateHuffman dynLen, dynDist;
+
+    // output, also the window for back references
+    uint8_t* ownWindow;
+    uint8_t* out;
+    uint32_t outSize;           // size of out, output wraps around at the end
+    uint32_t outPos;            // where the next byte goes
+    uint32_t outTotal;          // bytes decoded since begin
+    uint32_t outLimit;          // error if the stream decodes to more
+    uint32_t pending;           // decoded but not returned by read() yet
+};
+
+#endif // Inflater_h
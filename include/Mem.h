@@ -36,6 +36,16 @@
 
 #define MEM_PG_SZ 0x4000
 
+// dirty tracking granularity: 64 blocks of 256 bytes per RAM page
+#define MEM_BLOCK_SHIFT 8
+#define MEM_BLOCKS_PER_PAGE (MEM_PG_SZ >> MEM_BLOCK_SHIFT)
+
+// users of the dirty flags, each clears its own bit
+#define MEM_DIRTY_REWIND 0x01
+
+// ROM slot of the Beta 128 interface, after the four of the machine
+#define MEM_ROM_TRDOS 4
+
 class Mem
 {
 public:
@@ -44,7 +54,10 @@ public:
     static uint8_t* rom2;
     static uint8_t* rom3;
 
-    static uint8_t* rom[4];
+    static uint8_t* rom[5];
+    // ROMs in the set loaded to rom[0..3]: 4 on the +2A / +3, 2 on the
+    // 128K, 1 on the 48K
+    static uint8_t romCount;
 
     static uint8_t* ram0;
     static uint8_t* ram1;
@@ -65,6 +78,17 @@ public:
     static uint8_t romSP3;
     static uint8_t romInUse;
 
+    // one byte per 256 byte block of each RAM page, a bit per user: writes
+    // set them all, each user clears its bit once it has what changed
+    static uint8_t dirty[8][MEM_BLOCKS_PER_PAGE];
+
+    static bool isPageDirty(uint8_t page, uint8_t user);
+    static bool isBlockDirty(uint8_t page, uint8_t block, uint8_t user) { return dirty[page][block] & user; }
+    static void clearPageDirty(uint8_t page, uint8_t user);
+    // for bulk loaders writing pages directly
+    static void markPageDirty(uint8_t page);
+    static void markAllDirty();
+
     static uint8_t readbyte(uint16_t addr);
     static uint16_t readword(uint16_t addr);
     static void writebyte(uint16_t addr, uint8_t data);
@@ -84,7 +108,7 @@ inline uint8_t Mem::readbyte(uint16_t addr) {
         return ram5[addr - 0x4000];
     case 2:
         return ram2[addr - 0x8000];
-    case 3:
+    default:
         return ram[bankLatch][addr - 0xC000];
     }
 }
@@ -101,12 +125,15 @@ inline void Mem::writebyte(uint16_t addr, uint8_t data)
         return;
     case 1:
         ram5[addr - 0x4000] = data;
+        dirty[5][(addr >> MEM_BLOCK_SHIFT) & (MEM_BLOCKS_PER_PAGE - 1)] = 0xFF;
         break;
     case 2:
         ram2[addr - 0x8000] = data;
+        dirty[2][(addr >> MEM_BLOCK_SHIFT) & (MEM_BLOCKS_PER_PAGE - 1)] = 0xFF;
         break;
     case 3:
         ram[bankLatch][addr - 0xC000] = data;
+        dirty[bankLatch][(addr >> MEM_BLOCK_SHIFT) & (MEM_BLOCKS_PER_PAGE - 1)] = 0xFF;
         break;
     }
     return;
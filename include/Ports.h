@@ -41,6 +41,13 @@ public:
     // keyboard ports read from Wiimote
     static volatile uint8_t wii[128];
 
+    // +2A / +3 secondary memory control at 0x1FFD
+    static bool plus2A;
+
+    // last byte written to the ULA port 0xFE: border, MIC (bit 3) and
+    // EAR / speaker (bit 4), kept for snapshots
+    static uint8_t lastFE;
+
     // read port
     static uint8_t input(uint8_t portLow, uint8_t portHigh);
 
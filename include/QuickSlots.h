@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef QuickSlots_h
+#define QuickSlots_h
+
+#include <Arduino.h>
+
+// number of quick snapshot slots
+#define QUICK_SLOTS 4
+
+// Quick snapshots kept in PSRAM, SnapPack compressed.
+//
+// The state is taken with FileSNA::saveToMem into a scratch buffer and
+// packed into the slot, which only holds the packed size; loading unpacks
+// into the scratch buffer and goes through FileSNA::loadFromMem.
+class QuickSlots
+{
+public:
+    static bool save(uint8_t slot);
+    static bool load(uint8_t slot);
+    static bool isUsed(uint8_t slot) { return data[slot] != NULL; }
+
+    // slot used by F2/F3
+    static uint8_t selected() { return current; }
+    static void select(uint8_t slot) { current = slot % QUICK_SLOTS; }
+
+    // "<n> <arch> <packed KB> KB", or "<n> empty", for menus
+    static String describe(uint8_t slot);
+
+    // measured on the last save and load of each slot
+    static uint32_t packedSize(uint8_t slot) { return sizes[slot]; }
+    static uint32_t saveMicros(uint8_t slot) { return saveTimes[slot]; }
+    static uint32_t loadMicros(uint8_t slot) { return loadTimes[slot]; }
+
+private:
+    static bool allocScratch();
+
+    static uint8_t* data[QUICK_SLOTS];
+    static uint32_t sizes[QUICK_SLOTS];
+    static uint32_t rawSizes[QUICK_SLOTS];
+    static uint32_t saveTimes[QUICK_SLOTS];
+    static uint32_t loadTimes[QUICK_SLOTS];
+    static uint8_t current;
+};
+
+#endif // QuickSlots_h
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef Rewind_h
+#define Rewind_h
+
+#include <Arduino.h>
+#include "FileSZX.h"
+
+// frames between snapshots, 0.5 s
+#define REWIND_INTERVAL 25
+// snapshots kept: 30 s
+#define REWIND_ENTRIES 60
+// one snapshot in this many holds full pages, the others deltas
+#define REWIND_KEYFRAME_EVERY 10
+// PSRAM for packed snapshots; oldest ones are dropped beyond it
+#define REWIND_MEMORY (1024 * 1024)
+// packing work per frame, at least one page is packed every frame
+#define REWIND_FRAME_BUDGET 1500
+
+// Ring of periodic machine states in PSRAM for rewinding.
+//
+// Every REWIND_INTERVAL frames the state is captured with FileSZX::capture()
+// into a staging buffer; its pages are then packed a few at a time at the
+// end of the following frames, within REWIND_FRAME_BUDGET us. Keyframes hold
+// SnapPack'ed pages, the snapshots in between the pages XORed with those of
+// the last keyframe, which are mostly zero and pack to almost nothing. The
+// Mem dirty flags tell which 256 byte blocks were written since the keyframe:
+// only those are copied and XORed, and untouched pages are not stored at all.
+class Rewind
+{
+public:
+    // called at the end of every emulated frame
+    static void endFrame();
+
+    // drop every snapshot, e.g. when another program or machine is loaded
+    static void clear();
+
+    // snapshots available, 0 is the newest
+    static uint8_t count() { return entries; }
+    // frames elapsed since snapshot n was taken
+    static uint32_t age(uint8_t n);
+
+    // go back to snapshot n; newer ones are dropped
+    static bool restore(uint8_t n);
+
+    // snapshots taken so far, and PSRAM held by the packed ones
+    static uint32_t captures() { return captureCount; }
+    static uint32_t memory();
+
+private:
+    static void capture();
+    static bool packPage();
+    static void finishEntry();
+    static void dropOldest();
+
+    static uint8_t entries;
+    static uint32_t captureCount;
+};
+
+#endif // Rewind_h
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef RomCache_h
+#define RomCache_h
+
+#include <Arduino.h>
+
+// installed ROM sets kept in memory
+#define ROM_CACHE_SETS 16
+#define ROM_CACHE_MAX_ROMS 4
+
+// Every ROM set under /rom, read once into PSRAM so a machine switch only
+// repoints Mem::rom[].
+class RomCache
+{
+public:
+    // cache every installed set, false if none could be (no PSRAM)
+    static bool preload();
+    // cache one set from /rom, returns its number of ROMs, 0 on failure
+    static uint8_t load(const String& arch, const String& romset);
+    // point pages[0..3] at the ROMs of a cached set (its first one for the
+    // slots past its end), returns how many, 0 if the set is not cached
+    static uint8_t map(const String& arch, const String& romset, uint8_t** pages);
+
+private:
+    static int8_t find(const String& arch, const String& romset);
+
+    static String names[ROM_CACHE_SETS];        // "<arch>/<romset>"
+    static uint8_t* data[ROM_CACHE_SETS];       // the ROMs, 16 KB each
+    static uint8_t roms[ROM_CACHE_SETS];
+    static uint8_t count;
+};
+
+#endif // RomCache_h
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef RomPartition_h
+#define RomPartition_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+// ROM image layout, built by tools/mkromimage.py:
+//   header  16 bytes: "ZXRS", version (16 bit), set count (16 bit), reserved
+//   sets    32 bytes each, from offset 16 (see RomImageSet)
+//   ROMs    16 KB each, the ROMs of a set one after the other
+// all little endian
+#define ROM_IMAGE_VERSION 1
+#define ROM_IMAGE_HEADER_SIZE 16
+#define ROM_IMAGE_MAX_ROMS 4
+
+struct RomImageSet
+{
+    char arch[8];           // "48K", "128K"
+    char romset[16];        // "SINCLAIR", "PLUS2A", ...
+    uint8_t roms;           // number of 16 KB ROMs
+    uint8_t reserved[3];
+    uint32_t offset;        // of the first ROM, from the start of the image
+};
+
+// ROM sets read straight from a flash data partition mapped into the data
+// address space: Mem::rom[] points into the flash, nothing is copied.
+class RomPartition
+{
+public:
+    // map the partition, false if it is missing or holds no ROM image
+    static bool begin();
+    static bool isMapped() { return image != NULL; }
+    // point pages[0..3] at the ROMs of a set (its first one for the slots
+    // past its end), returns how many, 0 if the set is not in the image
+    static uint8_t map(const String& arch, const String& romset, uint8_t** pages);
+
+private:
+    static const uint8_t* image;
+    static uint32_t imageSize;
+    static spi_flash_mmap_handle_t handle;
+};
+
+#endif // RomPartition_h
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef ScreenPreview_h
+#define ScreenPreview_h
+
+#include <Arduino.h>
+#include "FileCatalog.h"
+
+// snapshot screens scaled down to half size
+#define PREVIEW_W 128
+#define PREVIEW_H 96
+// 4 bits per pixel (bright << 3 | colour), two pixels per byte, left one
+// in the high nibble
+#define PREVIEW_BYTES (PREVIEW_W * PREVIEW_H / 2)
+
+// decoded previews kept in memory
+#ifdef BOARD_HAS_PSRAM
+#define PREVIEW_CACHE_ENTRIES 32
+#else
+#define PREVIEW_CACHE_ENTRIES 2
+#endif
+
+class ScreenPreview
+{
+public:
+    // preview of a catalogue entry in dir, NULL if it has none; read from
+    // the snapshot and decoded only if it is not in the cache
+    static const uint8_t* get(const String& dir, const CatalogEntry& e);
+    // same, but only if already in the cache
+    static const uint8_t* cached(const String& dir, const CatalogEntry& e);
+    // whether the entry can have a preview
+    static bool hasPreview(const CatalogEntry& e);
+
+    // scale a 6912 byte screen down into a preview
+    static void decode(const uint8_t* screen, uint8_t* preview);
+
+private:
+    static uint8_t* cache;
+    static uint32_t keys[PREVIEW_CACHE_ENTRIES];
+    static uint32_t lastUse[PREVIEW_CACHE_ENTRIES];
+    static uint32_t useCounter;
+};
+
+#endif // ScreenPreview_h
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef SnapPack_h
+#define SnapPack_h
+
+#include <Arduino.h>
+
+// hash table entries for finding matches (32 bit each)
+#define SNAPPACK_HASH_BITS 12
+
+// Byte oriented LZ compressor for machine state held in memory.
+//
+// Spectrum RAM is mostly long runs of one byte (zeroed or attribute areas)
+// and repeated code/graphics, so there are two kinds of copies besides
+// literals: fills of one byte and matches up to 64K back. Every token starts
+// with a control byte c:
+//   0x00-0x7F  c + 1 literal bytes follow
+//   0x80-0xBF  fill, length (c & 0x3F) + 3, then the byte
+//   0xC0-0xFF  match, length (c & 0x3F) + 4, then the distance (16 bit LE)
+// A length field of 0x3F means the length follows as 16 bit LE instead.
+class SnapPack
+{
+public:
+    // worst case packed size of len bytes
+    static uint32_t bound(uint32_t len) { return len + len / 128 + 16; }
+
+    // compress len bytes of src into dst, which holds at least bound(len);
+    // returns the packed size, 0 if out of memory
+    static uint32_t pack(const uint8_t* src, uint32_t len, uint8_t* dst);
+
+    // expand packed data into dst (capacity bytes); returns the unpacked
+    // size, 0 if the data is corrupt or does not fit
+    static uint32_t unpack(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t capacity);
+};
+
+#endif // SnapPack_h
@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef VFS_h
+#define VFS_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Storage used by every loader and saver, chosen in hardconfig.h.
+//
+// Files are Arduino File handles on one of three backends: the SD card
+// (USE_SD_CARD), the internal flash SPIFFS (USE_INT_FLASH) or a directory
+// through stdio (USE_POSIX_FS, PosixFS), which is how the host harness runs
+// every file path on a PC. Paths are absolute from the storage root, e.g.
+// "/sna/game.sna". Block reads and writes, seeking and directory iteration
+// (File::openNextFile()) are those of File, so anything layered on file
+// access goes in one place, here.
+//
+// Files opened for reading go through a read-ahead cache of a few blocks
+// aligned to the start of the file: the loaders read a byte or a word at a
+// time, and each call reaching the SD card is an SPI transaction at 4 MHz.
+// Reads of a whole block or more skip the cache. Blocks belong to an open
+// file and are dropped when it is closed, so a file written and read again
+// is never served stale. The cache is used from the main task only.
+//
+// Storage is shared by the main task and the writers on core 0 (background
+// SZX saves, AY and RZX recordings): every call reaching the backend, on a
+// path or on an open file, holds one storage lock, so their accesses to the
+// card and the FAT are never interleaved.
+//
+// Zip archives are browsed as directories and their members read as files
+// (ZipFS), e.g. "/sna/games.zip/Game.z80"; they cannot be written to.
+#define VFS_CACHE_BLOCKS        8
+#define VFS_CACHE_BLOCK_SIZE    4096
+
+class VFS
+{
+public:
+    // mount the storage; false if it cannot be used
+    static bool begin();
+    // directory used as root with USE_POSIX_FS, set before begin()
+    static void setRoot(const char* dir) { posixRoot = dir; }
+    // backend name, for the log
+    static const char* name();
+
+    static File open(const String& path, const char* mode = FILE_READ);
+    static bool exists(const String& path);
+    static bool remove(const String& path);
+    static bool rename(const String& pathFrom, const String& pathTo);
+    static bool mkdir(const String& path);
+    static bool rmdir(const String& path);
+
+private:
+    // file on the backend, through the cache if read
+    static File openFile(const String& path, const char* mode);
+
+    static fs::FS* storage;
+    static const char* posixRoot;
+};
+
+#endif // VFS_h
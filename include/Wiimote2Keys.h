@@ -38,4 +38,4 @@ void updateWiimote2Keys();      // normal operation
 
 void updateWiimote2KeysOSD();   // OSD operation
 
-#endif WIIMOTE2KEYS_H 
\ No newline at end of file
+#endif // WIIMOTE2KEYS_H 
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include "../CPU.h"
 #include "../Mem.h"
 #include "../Ports.h"
+#include "../FileRZX.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -128,7 +129,10 @@ extern "C" {
 
 #define Z80_INPUT_BYTE(portLow, portHigh, x)               \
 {                                                          \
-    (x) = Ports::input(portLow, portHigh);                 \
+    if (FileRZX::isActive())                               \
+        (x) = FileRZX::input(portLow, portHigh);           \
+    else                                                   \
+        (x) = Ports::input(portLow, portHigh);             \
 }
 
 #define Z80_OUTPUT_BYTE(portLow, portHigh, x)              \
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef ZipFS_h
+#define ZipFS_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+// longest archive comment looked past for the end of the central directory
+#define ZIP_COMMENT_MAX 1024
+
+// Zip archives seen as read-only directories, for VFS.
+//
+// "/sna/games.zip" lists the members and "/sna/games.zip/Game.z80" reads one,
+// inflated while it is read through a window of INFLATE_WINDOW_SIZE bytes,
+// so nothing is unpacked to storage and members need not fit in memory.
+// Members are listed by file name, without the directories they may be in
+// inside the archive; either name finds them. Stored and deflated members
+// are supported, and checked against their CRC-32 once read to the end.
+// Seeking back restarts inflating from the start of the member.
+class ZipFS
+{
+public:
+    // split path at the first component ending in .zip; member is empty for
+    // the archive itself. False if path is not in an archive
+    static bool split(const String& path, String& archive, String& member);
+
+    // the archive as a directory (member empty) or one of its members, zip
+    // being the archive file open for reading; an invalid File if not found
+    static File open(File zip, const String& archive, const String& member);
+    static bool exists(File zip, const String& member);
+};
+
+#endif // ZipFS_h
@@ -152,18 +152,38 @@
 // define ONLY one of these
 // USE_INT_FLASH for internal flash storage
 // USE_SD_CARD for external SD card
+// USE_POSIX_FS for a directory through stdio (VFS_POSIX_ROOT): a filesystem
+//   mounted in the ESP-IDF VFS, or any directory when built for a PC
+//   (the host harness defines it)
 ///////////////////////////////////////////////////////////////////////////////
 
 //#define USE_INT_FLASH 1
+#ifndef USE_POSIX_FS
 #define USE_SD_CARD 1
+#endif
+
+#define VFS_POSIX_ROOT "/sd"
 
 // check: only one must be defined
-#if defined(USE_INT_FLASH) && defined(USE_SD_CARD)
-#error "Only one of (USE_INT_FLASH, USE_SD_CARD) must be defined"
+#if defined(USE_INT_FLASH) + defined(USE_SD_CARD) + defined(USE_POSIX_FS) != 1
+#error "Only one of (USE_INT_FLASH, USE_SD_CARD, USE_POSIX_FS) must be defined"
 #endif
 ///////////////////////////////////////////////////////////////////////////////
 
 
+///////////////////////////////////////////////////////////////////////////////
+// ROM storage
+//
+// define ROM_PARTITION as the label of a flash data partition holding a ROM
+// image (see partitions.csv and tools/mkromimage.py) to map the ROM sets
+// straight from flash instead of copying them from /rom into RAM pages.
+// Sets missing from the image, or all of them when the partition is
+// missing, are still loaded from /rom.
+
+#define ROM_PARTITION "romsets"
+///////////////////////////////////////////////////////////////////////////////
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // PS/2 Keyboard
 //
@@ -216,6 +236,8 @@
 //
 // define SPEAKER_PRESENT if you want the speaker to be present.
 // define EAR_PRESENT if you want the ear input port to be present.
+//   EAR_PIN edges are timestamped by an interrupt into a ring buffer and
+//   replayed against emulated T-states (see EarInput.h).
 // define MIC_PRESENT if you want the mic output port to be present.
 // 
 
@@ -224,13 +246,32 @@
 //#define MIC_PRESENT
 ///////////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////////
+// Tape
+//
+// define TAPE_FAST_LOAD to run the emulation unthrottled while a TZX tape
+// is playing, drawing only one frame out of TAPE_FAST_LOAD_DRAW_EVERY.
+// 
+
+#define TAPE_FAST_LOAD
+#define TAPE_FAST_LOAD_DRAW_EVERY 16
+///////////////////////////////////////////////////////////////////////////////
+
 ///////////////////////////////////////////////////////////////////////////////
 // Audio I/O
 //
 // define USE_AY_SOUND if you want to use AY-3-891X emulation thru FabGL.
+// Two chips are emulated (TurboSound), the second one is only mixed
+// once a program selects it by writing 0xFE to port 0xFFFD.
+//
+// define AY_STEREO for stereo output through both ESP32 DAC channels,
+// GPIO25 (right) and GPIO26 (left). Panning (ABC / ACB / mono) is selected
+// from the OSD. NOTE: GPIO26 is the default PS/2 keyboard clock pin,
+// move KEYBOARD_CLK in hardpins.h before defining this.
 // 
 
 #define USE_AY_SOUND
+// #define AY_STEREO
 ///////////////////////////////////////////////////////////////////////////////
 
 ///////////////////////////////////////////////////////////////////////////////
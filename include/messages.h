@@ -34,6 +34,8 @@
 #define MSG_LOADING "Loading file"
 #define MSG_LOADING_SNA "Loading SNA file"
 #define MSG_LOADING_Z80 "Loading Z80 file"
+#define MSG_LOADING_SZX "Loading SZX file"
+#define MSG_LOADING_RZX "Loading RZX file"
 #define MSG_SAVE_CONFIG "Saving config file"
 #define MSG_CHIP_SETUP "Chip setup"
 #define MSG_VGA_INIT "Initalizing VGA"
@@ -72,25 +74,60 @@
 #define OSD_QSNA_LOADED "Quick Snapshot Loaded"
 #define OSD_QSNA_LOAD_ERR "ERROR Loading Quick Snapshot"
 #define OSD_QSNA_SAVED "Quick Snapshot Saved"
+#define OSD_QSNA_SLOT "Quick Slot"
 
 #define OSD_PSNA_NOT_AVAIL "No Persist Snapshot Available"
 #define OSD_PSNA_LOADING "Loading Persist Snapshot..."
 #define OSD_PSNA_SAVING "Saving Persist Snapshot..."
+#define OSD_PSNA_SAVING_BG "Saving Persist Snapshot in background"
 #define OSD_PSNA_SAVE_WARN "Disk error. Trying slow mode, be patient"
 #define OSD_PSNA_SAVE_ERR "ERROR Saving Persist Snapshot"
 #define OSD_PSNA_LOADED "Persist Snapshot Loaded"
 #define OSD_PSNA_LOAD_ERR "ERROR Loading Persist Snapshot"
 #define OSD_PSNA_SAVED "Persist Snapshot Saved"
 
+#define OSD_AYREC_STARTED "AY Recording Started"
+#define OSD_AYREC_SAVED "AY Recording Saved"
+#define OSD_AYREC_ERR "ERROR Starting AY Recording"
+
+#define OSD_REWIND_NOT_AVAIL "Nothing to Rewind Yet"
+#define OSD_REWIND_ERR "ERROR Rewinding"
+#define OSD_REWIND_DONE "Rewound"
+
+#define OSD_RZX_STARTED "Input Recording Started"
+#define OSD_RZX_SAVED "Input Recording Saved"
+#define OSD_RZX_ERR "ERROR Starting Input Recording"
+#define OSD_RZX_PLAY_ERR "ERROR Playing Input Recording"
+#define OSD_RZX_STOPPED "Playback Stopped"
+#define OSD_RZX_ENDED "Playback Ended"
+
+#define OSD_TAPE_INSERTED "Tape Inserted, type LOAD \"\""
+#define OSD_TAPE_ERR "ERROR Opening Tape"
+#define OSD_TAPE_PLAYING "Tape Playing"
+#define OSD_TAPE_PAUSED "Tape Paused"
+#define OSD_TAPE_END "End of Tape"
+#define OSD_TAPE_NONE "No TZX Tape Inserted"
+
+#define OSD_DISK_INSERTED "Disk Inserted, select Loader"
+#define OSD_DISK_ERR "ERROR Opening Disk"
+#define OSD_DISK_EJECTED "Disk Ejected"
+#define OSD_TRD_INSERTED "Disk Inserted, RANDOMIZE USR 15616"
+#define OSD_TRDOS_ROM_ERR "ERROR No TR-DOS ROM"
+
 #define MENU_SNA_TITLE "Select Snapshot"
 #define MENU_MAIN \
     "Main Menu\n"\
     "Load Snapshot to RAM\n"\
     "Select ROM\n"\
-    "Quick Save (F2)\n"\
-    "Quick Load (F3)\n"\
+    "Quick Save (F2, F6 slot)\n"\
+    "Quick Load (F3, F6 slot)\n"\
     "Persist Save (F4)\n"\
     "Persist Load (F5)\n"\
+    "Rewind (F7)\n"\
+    "Record Input RZX (F8)\n"\
+    "Sound Options\n"\
+    "Disk Options\n"\
+    "Tape Play/Pause (F9)\n"\
     "Reset\n"\
     "About...\n"\
     "Return\n"
@@ -100,7 +137,28 @@
     "Hard reset\n"\
     "ESP host reset\n"\
     "Cancel\n"
+#define MENU_SOUND \
+    "Sound Options\n"\
+    "AY Mono\n"\
+    "AY Stereo ABC\n"\
+    "AY Stereo ACB\n"\
+    "AY Record PSG Start/Stop\n"\
+    "Cancel\n"
+// without AY_STEREO there is a single output, panning does not apply
+#define MENU_SOUND_MONO \
+    "Sound Options\n"\
+    "AY Record PSG Start/Stop\n"\
+    "Cancel\n"
+#define MENU_DISK \
+    "Disk Options\n"\
+    "Fast disk\n"\
+    "Normal speed disk\n"\
+    "Eject disk\n"\
+    "Cancel\n"
 #define MENU_DEMO "Demo mode\nOFF\n 1 minute\n 3 minutes\n 5 minutes\n15 minutes\n30 minutes\n 1 hour\n"
+#define MENU_QSLOT_SAVE "Quick Save to Slot\n"
+#define MENU_QSLOT_LOAD "Quick Load from Slot\n"
+#define MENU_REWIND "Rewind to\n"
 #define MENU_ARCH "Select Arch\n"
 #define MENU_ROMSET "Select Rom Set\n"
 #define OSD_HELP \
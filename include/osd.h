@@ -79,6 +79,9 @@ public:
     static void menuScrollBar();
     static String getTestMenu(unsigned short n_lines);
 
+    // File browser
+    static String fileBrowser();
+
     // Rows
     static unsigned short rowCount(String menu);
     static String rowGet(String menu, unsigned short row_number);
@@ -52,6 +52,42 @@ namespace fabgl {
 
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WaveformGenerator
+
+
+void WaveformGenerator::render(int16_t * buf, int n)
+{
+  for (int i = 0; i < n; ++i)
+    buf[i] = getSample();
+}
+
+
+void WaveformGenerator::renderStereo(int16_t * buf, int n)
+{
+  // render mono into the upper half, then spread it; never overwrites a sample not read yet
+  render(buf + n, n);
+  for (int i = 0; i < n; ++i) {
+    int16_t sample = buf[n + i];
+    buf[2 * i]     = sample;
+    buf[2 * i + 1] = sample;
+  }
+}
+
+
+// volume in 0..127 range as a 1.7 fixed point multiplier: (sample * vol) >> 7 is sample * volume / 128,
+// within one step of the sample * volume / 127 it replaces
+static inline int fixedVolume(int volume)
+{
+  return volume;
+}
+
+
+// WaveformGenerator
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SineWaveformGenerator
 
@@ -123,6 +159,30 @@ int SineWaveformGenerator::getSample() {
 }
 
 
+void SineWaveformGenerator::render(int16_t * buf, int n)
+{
+  // silent, or about to expire: per sample path handles fade out and auto disable
+  if (m_frequency == 0 || duration() <= (uint32_t)n) {
+    WaveformGenerator::render(buf, n);
+    return;
+  }
+
+  int vol = fixedVolume(volume());
+  uint32_t phaseAcc = m_phaseAcc;
+  uint32_t phaseInc = m_phaseInc;
+
+  for (int i = 0; i < n; ++i) {
+    uint32_t index = phaseAcc >> 11;
+    int sample = sinTable[index] + (((sinTable[index + 1] - sinTable[index]) * (int)(phaseAcc & 0x7ff)) >> 11);
+    buf[i] = (sample * vol) >> 7;
+    phaseAcc = (phaseAcc + phaseInc) & 0x7ffff;
+  }
+
+  m_phaseAcc = phaseAcc;
+  m_lastSample = buf[n - 1];
+  decDuration(n);
+}
+
 // SineWaveformGenerator
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -183,6 +243,31 @@ int SquareWaveformGenerator::getSample() {
   return sample;
 }
 
+
+void SquareWaveformGenerator::render(int16_t * buf, int n)
+{
+  // silent, or about to expire: per sample path handles fade out and auto disable
+  if (m_frequency == 0 || duration() <= (uint32_t)n) {
+    WaveformGenerator::render(buf, n);
+    return;
+  }
+
+  int vol = fixedVolume(volume());
+  int16_t hi = ( 127 * vol) >> 7;
+  int16_t lo = (-127 * vol) >> 7;
+  uint32_t phaseAcc = m_phaseAcc;
+  uint32_t phaseInc = m_phaseInc;
+  uint32_t dutyCycle = m_dutyCycle;
+
+  for (int i = 0; i < n; ++i) {
+    buf[i] = (phaseAcc >> 11) <= dutyCycle ? hi : lo;
+    phaseAcc = (phaseAcc + phaseInc) & 0x7ffff;
+  }
+
+  m_phaseAcc = phaseAcc;
+  m_lastSample = buf[n - 1];
+  decDuration(n);
+}
 // SquareWaveformGenerator
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -234,6 +319,30 @@ int TriangleWaveformGenerator::getSample() {
   return sample;
 }
 
+
+void TriangleWaveformGenerator::render(int16_t * buf, int n)
+{
+  // silent, or about to expire: per sample path handles fade out and auto disable
+  if (m_frequency == 0 || duration() <= (uint32_t)n) {
+    WaveformGenerator::render(buf, n);
+    return;
+  }
+
+  int vol = fixedVolume(volume());
+  uint32_t phaseAcc = m_phaseAcc;
+  uint32_t phaseInc = m_phaseInc;
+
+  for (int i = 0; i < n; ++i) {
+    uint32_t index = phaseAcc >> 11;
+    int sample = (index & 0x80 ? -1 : 1) * ((index & 0x3F) * 2 - (index & 0x40 ? 0 : 127));
+    buf[i] = (sample * vol) >> 7;
+    phaseAcc = (phaseAcc + phaseInc) & 0x7ffff;
+  }
+
+  m_phaseAcc = phaseAcc;
+  m_lastSample = buf[n - 1];
+  decDuration(n);
+}
 // TriangleWaveformGenerator
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -286,6 +395,28 @@ int SawtoothWaveformGenerator::getSample() {
   return sample;
 }
 
+
+void SawtoothWaveformGenerator::render(int16_t * buf, int n)
+{
+  // silent, or about to expire: per sample path handles fade out and auto disable
+  if (m_frequency == 0 || duration() <= (uint32_t)n) {
+    WaveformGenerator::render(buf, n);
+    return;
+  }
+
+  int vol = fixedVolume(volume());
+  uint32_t phaseAcc = m_phaseAcc;
+  uint32_t phaseInc = m_phaseInc;
+
+  for (int i = 0; i < n; ++i) {
+    buf[i] = ((int)(phaseAcc >> 11) - 128) * vol >> 7;
+    phaseAcc = (phaseAcc + phaseInc) & 0x7ffff;
+  }
+
+  m_phaseAcc = phaseAcc;
+  m_lastSample = buf[n - 1];
+  decDuration(n);
+}
 // TriangleWaveformGenerator
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -325,6 +456,26 @@ int NoiseWaveformGenerator::getSample()
 }
 
 
+void NoiseWaveformGenerator::render(int16_t * buf, int n)
+{
+  // about to expire: per sample path handles auto disable
+  if (duration() <= (uint32_t)n) {
+    WaveformGenerator::render(buf, n);
+    return;
+  }
+
+  int vol = fixedVolume(volume());
+  uint16_t noise = m_noise;
+
+  for (int i = 0; i < n; ++i) {
+    noise = (noise >> 1) ^ (-(noise & 1) & 0xB400u);
+    buf[i] = ((127 - (noise >> 8)) * vol) >> 7;
+  }
+
+  m_noise = noise;
+  decDuration(n);
+}
+
 // NoiseWaveformGenerator
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -454,12 +605,15 @@ int SamplesGenerator::getSample() {
 // SoundGenerator
 
 
-SoundGenerator::SoundGenerator(int sampleRate)
+SoundGenerator::SoundGenerator(int sampleRate, bool stereo)
   : m_waveGenTaskHandle(nullptr),
     m_channels(nullptr),
     m_sampleBuffer(nullptr),
+    m_renderBuffer(nullptr),
+    m_mixBuffer(nullptr),
     m_volume(100),
     m_sampleRate(sampleRate),
+    m_stereo(stereo),
     m_play(false),
     m_state(SoundGeneratorState::Stop)
 {
@@ -473,6 +627,8 @@ SoundGenerator::~SoundGenerator()
   clear();
   vTaskDelete(m_waveGenTaskHandle);
   heap_caps_free(m_sampleBuffer);
+  heap_caps_free(m_renderBuffer);
+  heap_caps_free(m_mixBuffer);
   vSemaphoreDelete(m_mutex);
 }
 
@@ -496,7 +652,7 @@ void SoundGenerator::i2s_audio_init()
   #else
     i2s_config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
   #endif
-  i2s_config.channel_format       = I2S_CHANNEL_FMT_ONLY_RIGHT;
+  i2s_config.channel_format       = m_stereo ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_RIGHT;
   i2s_config.intr_alloc_flags     = 0;
   i2s_config.dma_buf_count        = 2;
   i2s_config.dma_buf_len          = FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t);
@@ -506,9 +662,12 @@ void SoundGenerator::i2s_audio_init()
   // install and start i2s driver
   i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
   // init DAC pad
-  i2s_set_dac_mode(I2S_DAC_CHANNEL_RIGHT_EN); // GPIO25
+  i2s_set_dac_mode(m_stereo ? I2S_DAC_CHANNEL_BOTH_EN : I2S_DAC_CHANNEL_RIGHT_EN); // GPIO25 (+ GPIO26)
 
-  m_sampleBuffer = (uint16_t*) heap_caps_malloc(FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+  int channels = m_stereo ? 2 : 1;
+  m_sampleBuffer = (uint16_t*) heap_caps_malloc(channels * FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+  m_renderBuffer = (int16_t*) heap_caps_malloc(channels * FABGL_SAMPLE_BUFFER_SIZE * sizeof(int16_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+  m_mixBuffer = (int32_t*) heap_caps_malloc(channels * FABGL_SAMPLE_BUFFER_SIZE * sizeof(int32_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
 }
 
 
@@ -621,9 +780,10 @@ void SoundGenerator::waveGenTask(void * arg)
 {
   SoundGenerator * soundGenerator = (SoundGenerator*) arg;
 
-  i2s_set_clk(I2S_NUM_0, soundGenerator->m_sampleRate, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_MONO);
+  i2s_set_clk(I2S_NUM_0, soundGenerator->m_sampleRate, I2S_BITS_PER_SAMPLE_16BIT, soundGenerator->m_stereo ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
 
   uint16_t * buf = soundGenerator->m_sampleBuffer;
+  size_t bufSize = (soundGenerator->m_stereo ? 2 : 1) * FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t);
 
   // number of mute (without channels to play) cycles
   int muteCyclesCount = 0;
@@ -646,45 +806,81 @@ void SoundGenerator::waveGenTask(void * arg)
 
     soundGenerator->m_state = SoundGeneratorState::Playing;
 
-    int mainVolume = soundGenerator->volume();
-
-    for (int i = 0; i < FABGL_SAMPLE_BUFFER_SIZE; ++i) {
-      int sample = 0, tvol = 0;
-      for (auto g = soundGenerator->m_channels; g; ) {
-        if (g->enabled()) {
-          sample += g->getSample();
-          tvol += g->volume();
-        } else if (g->duration() == 0 && g->autoDetach()) {
-          auto curr = g;
-          g = g->next;  // setup next item before detaching this one
-          soundGenerator->detachNoSuspend(curr);
-          continue; // bypass "g = g->next;"
-        }
-        g = g->next;
-      }
-
-      int avol = tvol ? imin(127, 127 * 127 / tvol) : 127;
-      sample = sample * avol / 127;
-      sample = sample * mainVolume / 127;
-
-      buf[i + (i & 1 ? -1 : 1)] = (127 + sample) << 8;
-    }
+    soundGenerator->mixBlock(soundGenerator->volume());
 
     size_t bytes_written;
-    i2s_write(I2S_NUM_0, buf, FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t), &bytes_written, portMAX_DELAY);
+    i2s_write(I2S_NUM_0, buf, bufSize, &bytes_written, portMAX_DELAY);
 
     muteCyclesCount = soundGenerator->m_channels == nullptr ? muteCyclesCount + 1 : 0;
   }
 }
 
 
+// Mixes one block of FABGL_SAMPLE_BUFFER_SIZE samples (or stereo frames) into m_sampleBuffer.
+// Each enabled generator renders its whole block with a single render() call,
+// blocks are summed in 32 bit, then scaled in fixed point and saturated.
+void SoundGenerator::mixBlock(int mainVolume)
+{
+  int32_t * mix = m_mixBuffer;
+  int16_t * block = m_renderBuffer;
+  uint16_t * buf = m_sampleBuffer;
+  int count = (m_stereo ? 2 : 1) * FABGL_SAMPLE_BUFFER_SIZE;
+
+  memset(mix, 0, count * sizeof(int32_t));
+
+  int tvol = 0;
+  for (auto g = m_channels; g; ) {
+    if (g->enabled()) {
+      if (m_stereo)
+        g->renderStereo(block, FABGL_SAMPLE_BUFFER_SIZE);
+      else
+        g->render(block, FABGL_SAMPLE_BUFFER_SIZE);
+      for (int i = 0; i < count; ++i)
+        mix[i] += block[i];
+      tvol += g->volume();
+    } else if (g->duration() == 0 && g->autoDetach()) {
+      auto curr = g;
+      g = g->next;  // setup next item before detaching this one
+      detachNoSuspend(curr);
+      continue; // bypass "g = g->next;"
+    }
+    g = g->next;
+  }
+
+  // overall gain as 16.16 fixed point: (avol / 127) * (mainVolume / 127)
+  int avol = tvol ? imin(127, 127 * 127 / tvol) : 127;
+  int32_t gain = (avol * mainVolume << 16) / (127 * 127);
+
+  // samples are swapped in pairs: in mono mode because of I2S_CHANNEL_FMT_ONLY_RIGHT,
+  // in stereo mode because the DAC takes left channel (GPIO26) from the high half word.
+  for (int i = 0; i < count; ++i) {
+    int sample = (mix[i] * gain) >> 16;
+    if (sample > 128)
+      sample = 128;
+    else if (sample < -127)
+      sample = -127;
+    buf[i ^ 1] = (127 + sample) << 8;
+  }
+}
+
+
+uint16_t const * SoundGenerator::renderBlock(int * frames)
+{
+  AutoSemaphore autoSemaphore(m_mutex);
+  mixBlock(volume());
+  *frames = FABGL_SAMPLE_BUFFER_SIZE;
+  return m_sampleBuffer;
+}
+
+
 void SoundGenerator::mutizeOutput()
 {
-  for (int i = 0; i < FABGL_SAMPLE_BUFFER_SIZE; ++i)
+  int count = (m_stereo ? 2 : 1) * FABGL_SAMPLE_BUFFER_SIZE;
+  for (int i = 0; i < count; ++i)
     m_sampleBuffer[i] = 127 << 8;
   size_t bytes_written;
   for (int i = 0; i < 4; ++i)
-    i2s_write(I2S_NUM_0, m_sampleBuffer, FABGL_SAMPLE_BUFFER_SIZE * sizeof(uint16_t), &bytes_written, portMAX_DELAY);
+    i2s_write(I2S_NUM_0, m_sampleBuffer, count * sizeof(uint16_t), &bytes_written, portMAX_DELAY);
 }
 
 
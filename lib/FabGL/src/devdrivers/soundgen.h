@@ -107,6 +107,28 @@ public:
    */
   virtual int getSample() = 0;
 
+  /**
+   * @brief Renders a block of samples
+   *
+   * Default implementation calls getSample() for each sample. Generators override it
+   * to produce a whole block with a single virtual call.
+   *
+   * @param buf Destination buffer. Samples are signed 8 bit values (-128..127) stored as int16_t.
+   * @param n Number of samples to render. All n samples are always written.
+   */
+  virtual void render(int16_t * buf, int n);
+
+  /**
+   * @brief Renders a block of stereo frames
+   *
+   * Used when the sound generator runs in stereo mode. Default implementation renders
+   * a mono block and duplicates each sample on both channels.
+   *
+   * @param buf Destination buffer, 2 * n samples interleaved as left, right.
+   * @param n Number of frames to render.
+   */
+  virtual void renderStereo(int16_t * buf, int n);
+
   /**
    * @brief Sets volume of this generator
    *
@@ -159,6 +181,8 @@ protected:
 
   void decDuration() { --m_duration; if (m_duration == 0) m_enabled = false; }
 
+  void decDuration(uint32_t count) { m_duration -= count; if (m_duration == 0) m_enabled = false; }
+
 private:
   uint16_t m_sampleRate;
   int8_t   m_volume;
@@ -178,6 +202,8 @@ public:
 
   int getSample();
 
+  void render(int16_t * buf, int n);
+
 private:
   uint32_t m_phaseInc;
   uint32_t m_phaseAcc;
@@ -202,6 +228,8 @@ public:
 
   int getSample();
 
+  void render(int16_t * buf, int n);
+
 private:
   uint32_t m_phaseInc;
   uint32_t m_phaseAcc;
@@ -220,6 +248,8 @@ public:
 
   int getSample();
 
+  void render(int16_t * buf, int n);
+
 private:
   uint32_t m_phaseInc;
   uint32_t m_phaseAcc;
@@ -237,6 +267,8 @@ public:
 
   int getSample();
 
+  void render(int16_t * buf, int n);
+
 private:
   uint32_t m_phaseInc;
   uint32_t m_phaseAcc;
@@ -254,6 +286,8 @@ public:
 
   int getSample();
 
+  void render(int16_t * buf, int n);
+
 private:
   uint16_t m_noise;
 };
@@ -340,8 +374,11 @@ public:
 
   /**
    * @brief Creates an instance of the sound generator. Only one instance is allowed
+   *
+   * @param sampleRate Sample rate in Hertz.
+   * @param stereo If true, output goes to both DAC channels (GPIO-25 right, GPIO-26 left) and generators are mixed with renderStereo().
    */
-  SoundGenerator(int sampleRate = DEFAULT_SAMPLE_RATE);
+  SoundGenerator(int sampleRate = DEFAULT_SAMPLE_RATE, bool stereo = false);
 
   ~SoundGenerator();
 
@@ -455,6 +492,33 @@ public:
    */
   int volume() { return m_volume; }
 
+  /**
+   * @brief Determines whether output is stereo
+   *
+   * @return True when generators are mixed in stereo
+   */
+  bool stereo() { return m_stereo; }
+
+  /**
+   * @brief Determines the sample rate
+   *
+   * @return Sample rate in Hertz
+   */
+  int sampleRate() { return m_sampleRate; }
+
+  /**
+   * @brief Mixes one block of samples without sending it to the DAC
+   *
+   * Used for offline rendering (WAV export, regression tests). Must not be called while playing.
+   * Samples have the same format sent to I2S: unsigned 8 bit in the high byte, swapped in pairs
+   * (sample i is at index i ^ 1), interleaved when stereo.
+   *
+   * @param frames Receives the number of samples (or stereo frames) in the block.
+   *
+   * @return Pointer to the mixed block, valid until next call.
+   */
+  uint16_t const * renderBlock(int * frames);
+
 
 private:
 
@@ -464,6 +528,7 @@ private:
   void mutizeOutput();
   void detachNoSuspend(WaveformGenerator * value);
   bool actualPlaying();
+  void mixBlock(int mainVolume);
 
 
   TaskHandle_t        m_waveGenTaskHandle;
@@ -472,10 +537,18 @@ private:
 
   uint16_t *          m_sampleBuffer;
 
+  // one block of a single generator, as returned by WaveformGenerator::render() (or renderStereo())
+  int16_t *           m_renderBuffer;
+
+  // sum of all generator blocks, before volume scaling and saturation
+  int32_t *           m_mixBuffer;
+
   int8_t              m_volume;
 
   uint16_t            m_sampleRate;
 
+  bool                m_stereo;
+
   bool                m_play;
   SoundGeneratorState m_state;
   SemaphoreHandle_t   m_mutex;
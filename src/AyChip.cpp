@@ -0,0 +1,677 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "AyChip.h"
+#include <string.h>
+
+#pragma GCC optimize ("O3")
+
+// AY-3-8912 output levels (logarithmic DAC), scaled to 0..127
+static const int16_t volTable[16] = {
+    0, 1, 2, 3, 5, 8, 11, 17, 21, 33, 45, 57, 72, 87, 108, 127
+};
+
+// panning weights (left, right) per channel A, B, C, in 1/256 units
+static const uint16_t panPresets[3][2][3] = {
+    { {  85,  85,  86 }, {  85,  85,  86 } },   // AY_STEREO_MONO
+    { { 171,  85,   0 }, {   0,  85, 171 } },   // AY_STEREO_ABC
+    { { 171,   0,  85 }, {   0, 171,  85 } },   // AY_STEREO_ACB
+};
+
+// valid bits for each register, AY-3-8912 returns unused bits as 0
+static const uint8_t regMask[16] = {
+    0xFF, 0x0F, 0xFF, 0x0F, 0xFF, 0x0F, 0x1F, 0xFF,
+    0x1F, 0x1F, 0x1F, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF
+};
+
+// samples rendered in one pass (one bit each in a level mask), longer blocks
+// are split
+#define AY_MAX_RUN 32
+
+AyChip::AyChip()
+{
+    step = 0;
+    envStep = 0;
+    idleMax = 0;
+    levelsValid = 0;
+    pairsValid = 0;
+    setStereoMode(AY_STEREO_MONO);
+    reset();
+}
+
+void AyChip::reset()
+{
+    memset(regs, 0, sizeof(regs));
+    selectedRegister = 0;
+
+    for (uint8_t channel = 0; channel < 3; channel++) {
+        toneCount[channel] = 0;
+        toneOut[channel] = 0;
+        toneIdle[channel] = 0;
+        updateTonePeriod(channel);
+        updateVolume(channel);
+    }
+    updateMixer();
+
+    noiseCount = 0;
+    noiseShift = 1;
+    noiseIdle = 0;
+    updateNoisePeriod();
+
+    envIdle = 0;
+    updateEnvelopePeriod();
+    restartEnvelope();
+}
+
+void AyChip::setSampleRate(uint32_t sampleRate, uint32_t clock)
+{
+    for (uint8_t channel = 0; channel < 3; channel++)
+        syncTone(channel);
+    syncNoise();
+    syncEnvelope();
+
+    // tone clock is chip clock / 8, expressed in 16.16 units per output sample
+    step = (uint32_t)(((uint64_t)(clock / 8) << 16) / sampleRate);
+    // envelope counter runs at half the tone clock, in 24.8 units
+    envStep = step >> 9;
+    // samples a generator is left behind at most: a counter below its
+    // period (< 2^28) plus idle * step must not wrap
+    uint32_t idle = step ? 0xF0000000 / step : 0xFFFF;
+    if (idle > 0xFFFF) idle = 0xFFFF;
+    idleMax = idle > 2 * AY_MAX_RUN ? idle - AY_MAX_RUN : AY_MAX_RUN;
+
+    for (uint8_t channel = 0; channel < 3; channel++)
+        updateTonePeriod(channel);
+    updateNoisePeriod();
+    updateEnvelopePeriod();
+}
+
+void AyChip::setStereoMode(uint8_t mode)
+{
+    if (mode > AY_STEREO_ACB) mode = AY_STEREO_MONO;
+    stereoMode = mode;
+    for (uint8_t channel = 0; channel < 3; channel++) {
+        panLeft[channel]  = panPresets[mode][0][channel];
+        panRight[channel] = panPresets[mode][1][channel];
+    }
+    levelsValid = 0;
+}
+
+uint8_t AyChip::readRegister(uint8_t reg)
+{
+    if (reg > 15) return 0xFF;
+    return regs[reg];
+}
+
+void AyChip::writeRegister(uint8_t reg, uint8_t data)
+{
+    if (reg > 15) return;   // invalid register - do nothing
+
+    data &= regMask[reg];
+    regs[reg] = data;
+
+    switch (reg)
+    {
+    case 0: case 1: case 2: case 3: case 4: case 5:
+        // counters run on with the new period from where they are
+        syncTone(reg >> 1);
+        updateTonePeriod(reg >> 1);
+        break;
+    case 6:
+        syncNoise();
+        updateNoisePeriod();
+        break;
+    case 7:
+        updateMixer();
+        break;
+    case 8: case 9: case 10:
+        updateVolume(reg - 8);
+        break;
+    case 11: case 12:
+        syncEnvelope();
+        updateEnvelopePeriod();
+        break;
+    case 13:
+        envIdle = 0;
+        restartEnvelope();
+        break;
+    }
+}
+
+void AyChip::updateTonePeriod(uint8_t channel)
+{
+    uint32_t period = regs[channel * 2] | (regs[channel * 2 + 1] << 8);
+    tonePeriod[channel] = (period ? period : 1) << 16;
+    toneQuot[channel] = step ? tonePeriod[channel] / step : 0;
+    toneWait[channel] = 0;
+}
+
+void AyChip::updateNoisePeriod()
+{
+    // noise shift register is clocked at half the tone clock
+    uint32_t period = regs[6];
+    noisePeriod = (period ? period : 1) << 17;
+    noiseQuot = step ? noisePeriod / step : 0;
+    noiseWait = 0;
+}
+
+void AyChip::updateEnvelopePeriod()
+{
+    // envelope counter is clocked at half the tone clock, 24.8 fixed point
+    uint32_t period = regs[11] | (regs[12] << 8);
+    envPeriod = (period ? period : 1) << 8;
+    envQuot = envStep ? envPeriod / envStep : 0;
+    envWait = 0;
+}
+
+void AyChip::updateMixer()
+{
+    // mixer bits set mean tone / noise disabled, which keeps the channel "on"
+    uint8_t mixer = regs[7];
+    for (uint8_t channel = 0; channel < 3; channel++) {
+        toneOff[channel]  = (mixer >> channel) & 1;
+        noiseOff[channel] = (mixer >> (channel + 3)) & 1;
+    }
+    updateLive();
+}
+
+void AyChip::updateVolume(uint8_t channel)
+{
+    uint8_t vol = regs[8 + channel];
+    volEnv[channel] = (vol & 0x10) ? 1 : 0;
+    volAmp[channel] = volTable[vol & 0x0F];
+    updateLive();
+}
+
+void AyChip::updateLive()
+{
+    // generators that can change the output are followed edge by edge, the
+    // others are left idle. Silent channels never change it, and the
+    // envelope only matters to channels using it.
+    noiseLive = 0;
+    envUsed = 0;
+    for (uint8_t channel = 0; channel < 3; channel++) {
+        uint8_t audible = volEnv[channel] || volAmp[channel];
+        toneLive[channel] = audible && !toneOff[channel];
+        noiseLive |= audible && !noiseOff[channel];
+        envUsed |= volEnv[channel];
+    }
+    levelsValid = 0;
+}
+
+template <bool STEREO>
+void AyChip::updateLevels(uint8_t envLevel)
+{
+    int amp[3];
+    for (uint8_t channel = 0; channel < 3; channel++)
+        amp[channel] = volEnv[channel] ? volTable[envLevel] : volAmp[channel];
+
+    for (uint8_t state = 0; state < 16; state++) {
+        int level[3];
+        uint8_t noiseOut = state >> 3;
+        for (uint8_t channel = 0; channel < 3; channel++) {
+            uint8_t on = (((state >> channel) & 1) | toneOff[channel]) & (noiseOut | noiseOff[channel]);
+            level[channel] = on ? amp[channel] : -amp[channel];
+        }
+        if (STEREO) {
+            levels[1][state] = (level[0] * panLeft[0]  + level[1] * panLeft[1]  + level[2] * panLeft[2])  >> 8;
+            levels[2][state] = (level[0] * panRight[0] + level[1] * panRight[1] + level[2] * panRight[2]) >> 8;
+        }
+        else {
+            levels[0][state] = ((level[0] + level[1] + level[2]) * 85) >> 8;
+        }
+    }
+
+    levelsEnv = envLevel;
+    levelsValid = STEREO ? 2 : 1;
+    pairsValid = 0;
+}
+
+void AyChip::updatePairs()
+{
+    // first sample in the low half word, as it is stored little endian
+    for (uint16_t states = 0; states < 256; states++)
+        pairs[states] = (uint16_t)levels[0][states & 0x0F] | ((uint32_t)(uint16_t)levels[0][states >> 4] << 16);
+    pairsValid = 1;
+}
+
+void AyChip::restartEnvelope()
+{
+    envCount = 0;
+    envWait = 0;
+    envPos = 0;
+    envHold = 0;
+    // level = envPos ^ envAttack, so 0x00 ramps up and 0x0F ramps down
+    envAttack = (regs[13] & 0x04) ? 0x00 : 0x0F;
+    updateEnvelopeLevel();
+}
+
+void AyChip::updateEnvelopeLevel()
+{
+    envLevel = envPos ^ envAttack;
+}
+
+void AyChip::stepEnvelope(uint32_t steps)
+{
+    uint8_t shape = regs[13];
+
+    // continuous shapes repeat every 32 steps at most
+    if ((shape & 0x09) == 0x08)
+        steps &= 0x1F;
+
+    while (steps-- && !envHold)
+    {
+        if (++envPos < 16) {
+            updateEnvelopeLevel();
+            continue;
+        }
+
+        // end of a ramp
+        if (!(shape & 0x08)) {
+            // shapes 0-7: drop to 0 and stay there
+            envHold = 1;
+            envLevel = 0;
+        }
+        else if (shape & 0x01) {
+            // hold: stay at the ramp's final level, flipped if alternating
+            envHold = 1;
+            envLevel = (envAttack ? 0x00 : 0x0F) ^ ((shape & 0x02) ? 0x0F : 0x00);
+        }
+        else {
+            // repeat, reversing direction if alternating
+            envPos = 0;
+            if (shape & 0x02) envAttack ^= 0x0F;
+            updateEnvelopeLevel();
+        }
+    }
+}
+
+void AyChip::shiftNoise(uint32_t shifts)
+{
+    // 17 bit LFSR, bit 0 ^ bit 3 enters at bit 16. The next 14 bits only
+    // depend on bits already in the register, so they go in at once.
+    uint32_t shift = noiseShift;
+    for (; shifts >= 14; shifts -= 14)
+        shift = (shift >> 14) | (((shift ^ (shift >> 3)) & 0x3FFF) << 3);
+    if (shifts)
+        shift = (shift >> shifts) | (((shift ^ (shift >> 3)) & ((1 << shifts) - 1)) << (17 - shifts));
+    noiseShift = shift;
+}
+
+// tone counter forward by delta, toggling the output at each period
+static inline void advanceTone(uint32_t& count, uint32_t period, uint8_t& out, uint32_t delta)
+{
+    count += delta;
+    if (count >= period) {
+        count -= period;
+        out ^= 1;
+        if (count >= period) {
+            // very high pitch: several toggles at once
+            uint32_t toggles = count / period;
+            count -= toggles * period;
+            out ^= toggles & 1;
+        }
+    }
+}
+
+void AyChip::advanceNoise(uint32_t delta)
+{
+    noiseCount += delta;
+    if (noiseCount >= noisePeriod) {
+        uint32_t shifts = 1;
+        noiseCount -= noisePeriod;
+        if (noiseCount >= noisePeriod) {
+            uint32_t more = noiseCount / noisePeriod;
+            noiseCount -= more * noisePeriod;
+            shifts += more;
+        }
+        shiftNoise(shifts);
+    }
+}
+
+void AyChip::advanceEnvelope(uint32_t samples)
+{
+    if (envHold) return;
+    envCount += envStep * samples;
+    if (envCount >= envPeriod) {
+        uint32_t steps = envCount / envPeriod;
+        envCount -= steps * envPeriod;
+        stepEnvelope(steps);
+    }
+}
+
+void AyChip::syncTone(uint8_t channel)
+{
+    if (!toneIdle[channel]) return;
+    advanceTone(toneCount[channel], tonePeriod[channel], toneOut[channel], toneIdle[channel] * step);
+    toneIdle[channel] = 0;
+    toneWait[channel] = 0;
+}
+
+void AyChip::syncNoise()
+{
+    if (!noiseIdle) return;
+    advanceNoise(noiseIdle * step);
+    noiseIdle = 0;
+    noiseWait = 0;
+}
+
+void AyChip::syncEnvelope()
+{
+    if (!envIdle) return;
+    advanceEnvelope(envIdle);
+    envIdle = 0;
+    envWait = 0;
+}
+
+// output samples until a counter reaches its period, at least 1. After a
+// period ends the counter is below step, and then it is quot or quot + 1
+// with quot = period / step, which saves the division.
+static inline uint32_t samplesTo(uint32_t count, uint32_t period, uint32_t step, uint32_t quot)
+{
+    if (count + step >= period) return 1;
+    if (count < step) return count + quot * step >= period ? quot : quot + 1;
+    return (period - count + step - 1) / step;
+}
+
+// bit i of a byte moved to bit 4 * i, spreads eight samples of a mask to one
+// bit per nibble
+static const uint32_t spreadNibbles[256] = {
+    0x00000000, 0x00000001, 0x00000010, 0x00000011, 0x00000100, 0x00000101, 0x00000110, 0x00000111,
+    0x00001000, 0x00001001, 0x00001010, 0x00001011, 0x00001100, 0x00001101, 0x00001110, 0x00001111,
+    0x00010000, 0x00010001, 0x00010010, 0x00010011, 0x00010100, 0x00010101, 0x00010110, 0x00010111,
+    0x00011000, 0x00011001, 0x00011010, 0x00011011, 0x00011100, 0x00011101, 0x00011110, 0x00011111,
+    0x00100000, 0x00100001, 0x00100010, 0x00100011, 0x00100100, 0x00100101, 0x00100110, 0x00100111,
+    0x00101000, 0x00101001, 0x00101010, 0x00101011, 0x00101100, 0x00101101, 0x00101110, 0x00101111,
+    0x00110000, 0x00110001, 0x00110010, 0x00110011, 0x00110100, 0x00110101, 0x00110110, 0x00110111,
+    0x00111000, 0x00111001, 0x00111010, 0x00111011, 0x00111100, 0x00111101, 0x00111110, 0x00111111,
+    0x01000000, 0x01000001, 0x01000010, 0x01000011, 0x01000100, 0x01000101, 0x01000110, 0x01000111,
+    0x01001000, 0x01001001, 0x01001010, 0x01001011, 0x01001100, 0x01001101, 0x01001110, 0x01001111,
+    0x01010000, 0x01010001, 0x01010010, 0x01010011, 0x01010100, 0x01010101, 0x01010110, 0x01010111,
+    0x01011000, 0x01011001, 0x01011010, 0x01011011, 0x01011100, 0x01011101, 0x01011110, 0x01011111,
+    0x01100000, 0x01100001, 0x01100010, 0x01100011, 0x01100100, 0x01100101, 0x01100110, 0x01100111,
+    0x01101000, 0x01101001, 0x01101010, 0x01101011, 0x01101100, 0x01101101, 0x01101110, 0x01101111,
+    0x01110000, 0x01110001, 0x01110010, 0x01110011, 0x01110100, 0x01110101, 0x01110110, 0x01110111,
+    0x01111000, 0x01111001, 0x01111010, 0x01111011, 0x01111100, 0x01111101, 0x01111110, 0x01111111,
+    0x10000000, 0x10000001, 0x10000010, 0x10000011, 0x10000100, 0x10000101, 0x10000110, 0x10000111,
+    0x10001000, 0x10001001, 0x10001010, 0x10001011, 0x10001100, 0x10001101, 0x10001110, 0x10001111,
+    0x10010000, 0x10010001, 0x10010010, 0x10010011, 0x10010100, 0x10010101, 0x10010110, 0x10010111,
+    0x10011000, 0x10011001, 0x10011010, 0x10011011, 0x10011100, 0x10011101, 0x10011110, 0x10011111,
+    0x10100000, 0x10100001, 0x10100010, 0x10100011, 0x10100100, 0x10100101, 0x10100110, 0x10100111,
+    0x10101000, 0x10101001, 0x10101010, 0x10101011, 0x10101100, 0x10101101, 0x10101110, 0x10101111,
+    0x10110000, 0x10110001, 0x10110010, 0x10110011, 0x10110100, 0x10110101, 0x10110110, 0x10110111,
+    0x10111000, 0x10111001, 0x10111010, 0x10111011, 0x10111100, 0x10111101, 0x10111110, 0x10111111,
+    0x11000000, 0x11000001, 0x11000010, 0x11000011, 0x11000100, 0x11000101, 0x11000110, 0x11000111,
+    0x11001000, 0x11001001, 0x11001010, 0x11001011, 0x11001100, 0x11001101, 0x11001110, 0x11001111,
+    0x11010000, 0x11010001, 0x11010010, 0x11010011, 0x11010100, 0x11010101, 0x11010110, 0x11010111,
+    0x11011000, 0x11011001, 0x11011010, 0x11011011, 0x11011100, 0x11011101, 0x11011110, 0x11011111,
+    0x11100000, 0x11100001, 0x11100010, 0x11100011, 0x11100100, 0x11100101, 0x11100110, 0x11100111,
+    0x11101000, 0x11101001, 0x11101010, 0x11101011, 0x11101100, 0x11101101, 0x11101110, 0x11101111,
+    0x11110000, 0x11110001, 0x11110010, 0x11110011, 0x11110100, 0x11110101, 0x11110110, 0x11110111,
+    0x11111000, 0x11111001, 0x11111010, 0x11111011, 0x11111100, 0x11111101, 0x11111110, 0x11111111
+};
+
+// states of samples i to i + 7 from the output masks, one per nibble
+static inline uint32_t spreadStates(const uint32_t* mask, int i)
+{
+    return spreadNibbles[(mask[0] >> i) & 0xFF]
+        | (spreadNibbles[(mask[1] >> i) & 0xFF] << 1)
+        | (spreadNibbles[(mask[2] >> i) & 0xFF] << 2)
+        | (spreadNibbles[(mask[3] >> i) & 0xFF] << 3);
+}
+
+template <bool STEREO>
+void AyChip::renderBlock(int16_t* buf, int n)
+{
+    for (; n > AY_MAX_RUN; n -= AY_MAX_RUN) {
+        renderBlock<STEREO>(buf, AY_MAX_RUN);
+        buf += STEREO ? 2 * AY_MAX_RUN : AY_MAX_RUN;
+    }
+    if (n <= 0) return;
+    if (!step) {
+        // no sample rate yet
+        memset(buf, 0, (STEREO ? 2 : 1) * n * sizeof(int16_t));
+        return;
+    }
+
+    // first pass: the output of each live generator as a mask, bit i set
+    // when it is high at sample i (tone A, B, C, noise), and the samples
+    // where the envelope steps to which level
+    uint32_t mask[4] = { 0, 0, 0, 0 };
+    uint32_t envMask = 0;
+    uint32_t moved = 0;     // non zero if any edge falls within the block
+    uint8_t envAt[AY_MAX_RUN];
+    uint8_t level = envLevel;
+
+    for (uint8_t channel = 0; channel < 3; channel++) {
+        if (!toneLive[channel]) {
+            toneIdle[channel] += n;
+            if (toneIdle[channel] >= idleMax) syncTone(channel);
+            continue;
+        }
+        syncTone(channel);
+        uint32_t count = toneCount[channel];
+        uint32_t period = tonePeriod[channel];
+        uint32_t quot = toneQuot[channel];
+        uint8_t out = toneOut[channel];
+        uint32_t bits = -(uint32_t)out;
+        uint32_t pos = 0;
+        uint32_t next = toneWait[channel];
+        if (!next) next = samplesTo(count, period, step, quot);
+        if (!quot || count >= period) {
+            // very high pitch, or a period just written below the count:
+            // several toggles may fall within one sample
+            while (pos + next <= (uint32_t)n) {
+                pos += next;
+                uint8_t last = out;
+                advanceTone(count, period, out, next * step);
+                bits ^= (uint32_t)-(last ^ out) << (pos - 1);
+                next = samplesTo(count, period, step, quot);
+                if (quot) break;
+            }
+        }
+        if (quot) {
+            // one toggle per edge, every quot or quot + 1 samples: the counter
+            // moves by one of two amounts, depending on where it restarts
+            uint32_t span = quot * step;
+            uint32_t limit = period - span;
+            uint32_t shortMove = span - period;
+            uint32_t longMove = shortMove + step;
+            uint32_t move = next * step - period;
+            while (pos + next <= (uint32_t)n) {
+                pos += next;
+                count += move;
+                bits ^= ~0u << (pos - 1);
+                uint32_t more = count < limit;
+                next = quot + more;
+                move = more ? longMove : shortMove;
+            }
+            out = bits >> (n - 1) & 1;
+        }
+        mask[channel] = bits;
+        moved |= pos;
+        toneWait[channel] = pos + next - n;
+        toneCount[channel] = count + (n - pos) * step;
+        toneOut[channel] = out;
+    }
+
+    if (!noiseLive) {
+        noiseIdle += n;
+        if (noiseIdle >= idleMax) syncNoise();
+    }
+    else {
+        syncNoise();
+        uint32_t bits = -(noiseShift & 1);
+        uint32_t pos = 0;
+        uint32_t next = noiseWait;
+        if (!next) next = samplesTo(noiseCount, noisePeriod, step, noiseQuot);
+        if (!noiseQuot || noiseCount >= noisePeriod) {
+            while (pos + next <= (uint32_t)n) {
+                pos += next;
+                uint32_t last = noiseShift;
+                advanceNoise(next * step);
+                bits ^= -((last ^ noiseShift) & 1) << (pos - 1);
+                next = samplesTo(noiseCount, noisePeriod, step, noiseQuot);
+                if (noiseQuot) break;
+            }
+        }
+        if (noiseQuot) {
+            // one shift per edge, every quot or quot + 1 samples
+            uint32_t count = noiseCount;
+            uint32_t period = noisePeriod;
+            uint32_t quot = noiseQuot;
+            // the register followed by the bits it shifts in next: output
+            // after k shifts is bit k, it changes where bit k ^ bit k + 1 is set
+            uint64_t seq = noiseShift;
+            seq |= ((seq ^ (seq >> 3)) & 0x3FFF) << 17;
+            seq |= ((seq ^ (seq >> 3)) & (0x3FFFull << 14)) << 17;
+            uint64_t changes = seq ^ (seq >> 1);
+            uint32_t shifts = 0;
+            uint32_t span = quot * step;
+            uint32_t limit = period - span;
+            uint32_t shortMove = span - period;
+            uint32_t longMove = shortMove + step;
+            uint32_t move = next * step - period;
+            while (pos + next <= (uint32_t)n) {
+                pos += next;
+                count += move;
+                bits ^= -(uint32_t)((changes >> shifts) & 1) << (pos - 1);
+                shifts++;
+                uint32_t more = count < limit;
+                next = quot + more;
+                move = more ? longMove : shortMove;
+            }
+            noiseCount = count;
+            shiftNoise(shifts);
+        }
+        mask[3] = bits;
+        moved |= pos;
+        noiseWait = pos + next - n;
+        noiseCount += (n - pos) * step;
+    }
+
+    if (!envUsed) {
+        envIdle += n;
+        if (envIdle >= idleMax) syncEnvelope();
+    }
+    else {
+        syncEnvelope();
+        level = envLevel;
+        uint32_t pos = 0;
+        uint32_t next = envWait;
+        if (!next && !envHold) next = samplesTo(envCount, envPeriod, envStep, envQuot);
+        while (!envHold && pos + next <= (uint32_t)n) {
+            pos += next;
+            advanceEnvelope(next);
+            envMask |= 1u << (pos - 1);
+            envAt[pos - 1] = envLevel;
+            if (!envHold) next = samplesTo(envCount, envPeriod, envStep, envQuot);
+        }
+        if (!envHold) {
+            envCount += (n - pos) * envStep;
+            envWait = pos + next - n;
+        }
+    }
+
+    // second pass: output levels of the states, eight samples at a time
+    if (levelsValid != (STEREO ? 2 : 1) || (envUsed && levelsEnv != level)) updateLevels<STEREO>(level);
+    const int16_t* mono = levels[0];
+    const int16_t* left = levels[1];
+    const int16_t* right = levels[2];
+
+    // nothing changes within the block (silent or slow generators): one level
+    if (!(moved | envMask)) {
+        uint8_t state = (mask[0] & 1) | ((mask[1] & 1) << 1) | ((mask[2] & 1) << 2) | ((mask[3] & 1) << 3);
+        int16_t first = STEREO ? left[state] : mono[state];
+        int16_t second = right[state];
+        for (int k = 0; k < n; k++) {
+            if (STEREO) {
+                buf[2 * k] = first;
+                buf[2 * k + 1] = second;
+            }
+            else {
+                buf[k] = first;
+            }
+        }
+        return;
+    }
+
+    int i = 0;
+    if (!STEREO && !envUsed) {
+        // levels only change on register writes: two samples per lookup
+        if (!pairsValid) updatePairs();
+        for (; i + 8 <= n; i += 8) {
+            uint32_t states = spreadStates(mask, i);
+            for (uint8_t k = 0; k < 4; k++, states >>= 8, buf += 2)
+                memcpy(buf, &pairs[states & 0xFF], sizeof(uint32_t));
+        }
+    }
+
+    for (; i < n; i += 8)
+    {
+        uint32_t states = spreadStates(mask, i);
+        uint32_t steps = (envMask >> i) & 0xFF;
+        int run = n - i < 8 ? n - i : 8;
+        if (!steps && run == 8) {
+            for (uint8_t k = 0; k < 8; k++, states >>= 4) {
+                if (STEREO) {
+                    buf[0] = left[states & 0x0F];
+                    buf[1] = right[states & 0x0F];
+                    buf += 2;
+                }
+                else {
+                    *buf++ = mono[states & 0x0F];
+                }
+            }
+            continue;
+        }
+        // the envelope steps within these samples, or the last few
+        for (int k = 0; k < run; k++, states >>= 4, steps >>= 1) {
+            if (steps & 1) updateLevels<STEREO>(envAt[i + k]);
+            if (STEREO) {
+                buf[0] = left[states & 0x0F];
+                buf[1] = right[states & 0x0F];
+                buf += 2;
+            }
+            else {
+                *buf++ = mono[states & 0x0F];
+            }
+        }
+    }
+}
+
+void AyChip::render(int16_t* buf, int n)
+{
+    renderBlock<false>(buf, n);
+}
+
+void AyChip::renderStereo(int16_t* buf, int n)
+{
+    renderBlock<true>(buf, n);
+}
@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "AyRecorder.h"
+
+#include "hardconfig.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "VFS.h"
+#include <FS.h>
+
+volatile bool AyRecorder::recording = false;
+String AyRecorder::filename;
+uint8_t AyRecorder::buffer[2][AY_REC_BUFFER_SIZE];
+uint8_t AyRecorder::active = 0;
+uint16_t AyRecorder::fill = 0;
+
+static File recFile;
+static TaskHandle_t writerTaskHandle = NULL;
+static SemaphoreHandle_t fileMutex = NULL;
+
+// bytes of each buffer waiting to be written, 0 when free
+static volatile uint16_t pendingSize[2];
+
+// frames ended since last register write, not yet written as markers
+static uint32_t pendingFrames;
+
+// cost measurement
+static uint32_t frames;
+static uint32_t writes;
+static uint32_t dropped;
+static uint32_t bytesWritten;
+static uint32_t blocksWritten;
+static uint64_t emuCycles;          // spent on the emulation core
+static uint64_t writerMicros;       // spent in file writes on the writer task
+static uint32_t maxWriteMicros;
+
+String AyRecorder::nextFileName(String snaName)
+{
+    String base = snaName;
+    if (base == NO_RAM_FILE || base.length() == 0) base = "ay";
+    int dot = base.lastIndexOf('.');
+    if (dot > 0) base = base.substring(0, dot);
+
+    for (int n = 0; n < 100; n++) {
+        String name = (String)AY_REC_DIR + "/" + base + "_" + (n < 10 ? "0" : "") + n + ".psg";
+        if (!VFS::exists(name))
+            return name;
+    }
+    return (String)AY_REC_DIR + "/" + base + "_99.psg";
+}
+
+bool AyRecorder::start(String fname)
+{
+    if (recording) return false;
+
+    KB_INT_STOP;
+    if (!VFS::exists(AY_REC_DIR))
+        VFS::mkdir(AY_REC_DIR);
+    recFile = VFS::open(fname, FILE_WRITE);
+    if (!recFile) {
+        Serial.printf("AY recorder: cannot create %s\n", fname.c_str());
+        KB_INT_START;
+        return false;
+    }
+
+    // header: signature, version, interrupt frequency, padding
+    uint8_t header[PSG_HEADER_SIZE] = { 'P', 'S', 'G', 0x1A, 0x10, 50 };
+    recFile.write(header, PSG_HEADER_SIZE);
+    KB_INT_START;
+
+    if (fileMutex == NULL)
+        fileMutex = xSemaphoreCreateMutex();
+    if (writerTaskHandle == NULL)
+        xTaskCreatePinnedToCore(&AyRecorder::writerTask, "ayRecTask", 1024 * 3, NULL, 2, &writerTaskHandle, 0);
+
+    filename = fname;
+    active = 0;
+    fill = 0;
+    pendingSize[0] = pendingSize[1] = 0;
+    pendingFrames = 0;
+    frames = writes = dropped = 0;
+    bytesWritten = PSG_HEADER_SIZE;
+    blocksWritten = 0;
+    emuCycles = writerMicros = 0;
+    maxWriteMicros = 0;
+
+    Serial.printf("AY recorder: recording to %s\n", filename.c_str());
+    recording = true;
+    return true;
+}
+
+// make room for size bytes in the active buffer, handing it to the writer
+// when full; returns false if the writer has not finished with the other one
+bool AyRecorder::reserve(uint16_t size)
+{
+    if (fill + size <= AY_REC_BUFFER_SIZE)
+        return true;
+
+    uint8_t other = active ^ 1;
+    if (pendingSize[other] != 0)
+        return false;
+
+    pendingSize[active] = fill;
+    active = other;
+    fill = 0;
+    if (writerTaskHandle != NULL)
+        xTaskNotifyGive(writerTaskHandle);
+    return true;
+}
+
+void AyRecorder::flushFrameMarkers()
+{
+    while (pendingFrames >= 4) {
+        if (!reserve(2)) return;
+        uint32_t n = pendingFrames / 4;
+        if (n > 255) n = 255;
+        put(PSG_SKIP_FRAMES);
+        put(n);
+        pendingFrames -= n * 4;
+    }
+    while (pendingFrames > 0) {
+        if (!reserve(1)) return;
+        put(PSG_END_OF_FRAME);
+        pendingFrames--;
+    }
+}
+
+void AyRecorder::record(uint8_t reg, uint8_t data)
+{
+    uint32_t cycles = ESP.getCycleCount();
+
+    flushFrameMarkers();
+    if (pendingFrames == 0 && reserve(2)) {
+        put(reg);
+        put(data);
+        writes++;
+    }
+    else dropped++;
+
+    emuCycles += ESP.getCycleCount() - cycles;
+}
+
+void AyRecorder::endFrame()
+{
+    if (!recording) return;
+    uint32_t cycles = ESP.getCycleCount();
+
+    // markers are written lazily, so runs of silent frames become 0xFE n
+    pendingFrames++;
+    frames++;
+
+    emuCycles += ESP.getCycleCount() - cycles;
+}
+
+void AyRecorder::writePending()
+{
+    if (fileMutex == NULL) return;
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    // at most one buffer is pending while recording, so order is preserved
+    for (uint8_t i = 0; i < 2; i++) {
+        uint16_t size = pendingSize[i];
+        if (size == 0) continue;
+        uint32_t ts_start = micros();
+        recFile.write(buffer[i], size);
+        uint32_t elapsed = micros() - ts_start;
+        writerMicros += elapsed;
+        if (elapsed > maxWriteMicros) maxWriteMicros = elapsed;
+        bytesWritten += size;
+        blocksWritten++;
+        pendingSize[i] = 0;
+    }
+    xSemaphoreGive(fileMutex);
+}
+
+void AyRecorder::writerTask(void* unused)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        writePending();
+    }
+}
+
+void AyRecorder::stop()
+{
+    if (!recording) return;
+
+    KB_INT_STOP;
+    flushFrameMarkers();
+    recording = false;
+
+    // write the buffer already handed over first, then the active one
+    writePending();
+    pendingSize[active] = fill;
+    writePending();
+    fill = 0;
+    recFile.close();
+    KB_INT_START;
+
+    uint32_t cpuMHz = ESP.getCpuFreqMHz();
+    uint32_t cyclesPerFrame = frames ? emuCycles / frames : 0;
+    Serial.printf("AY recorder: saved %s\n", filename.c_str());
+    Serial.printf("  %u frames, %u register writes, %u dropped, %u bytes\n", frames, writes, dropped, bytesWritten);
+    Serial.printf("  emulation side: %u cycles/frame (%u.%02u us/frame)\n",
+        cyclesPerFrame, cyclesPerFrame / cpuMHz, (cyclesPerFrame % cpuMHz) * 100 / cpuMHz);
+    Serial.printf("  writer: %u blocks, %u us/block average, %u us max\n",
+        blocksWritten, blocksWritten ? (uint32_t)(writerMicros / blocksWritten) : 0, maxWriteMicros);
+}
@@ -30,50 +30,65 @@
 #include "hardconfig.h"
 #include <Arduino.h>
 #include "AySound.h"
+#include "AyRecorder.h"
 
 #ifdef USE_AY_SOUND
 
 #include "fabgl.h"
 
-static SoundGenerator _soundGenerator;
-static SquareWaveformGenerator _channel[3];
+#ifdef AY_STEREO
+#define AY_STEREO_OUTPUT true
+#else
+#define AY_STEREO_OUTPUT false
+#endif
+
+// adapter for mixing an AyChip through FabGL's sound generator:
+// a whole block of three channels is produced by a single render() call
+class AyChipGenerator : public WaveformGenerator
+{
+public:
+    AyChipGenerator(AyChip& chip) : chip(chip) {}
+
+    void setFrequency(int value) {}
+
+    int getSample() {
+        int16_t sample;
+        chip.render(&sample, 1);
+        return sample;
+    }
+
+    void render(int16_t* buf, int n) { chip.render(buf, n); }
+    void renderStereo(int16_t* buf, int n) { chip.renderStereo(buf, n); }
+
+private:
+    AyChip& chip;
+};
 
-// Registers
-uint8_t AySound::finePitchChannelA = 0xFF;
-uint8_t AySound::coarsePitchChannelA = 0xFF;
-uint8_t AySound::finePitchChannelB = 0xFF;
-uint8_t AySound::coarsePitchChannelB = 0xFF;
-uint8_t AySound::finePitchChannelC = 0xFF;
-uint8_t AySound::coarsePitchChannelC = 0xFF;
-uint8_t AySound::noisePitch = 0xFF;
-uint8_t AySound::mixer = 0xFF;
-uint8_t AySound::volumeChannelA = 0xFF;
-uint8_t AySound::volumeChannelB = 0xFF;
-uint8_t AySound::volumeChannelC = 0xFF;
-uint8_t AySound::envelopeFineDuration = 0xFF;
-uint8_t AySound::envelopeCoarseDuration = 0xFF;
-uint8_t AySound::envelopeShape = 0xFF;
-uint8_t AySound::ioPortA = 0xFF;
+static SoundGenerator _soundGenerator(DEFAULT_SAMPLE_RATE, AY_STEREO_OUTPUT);
 
-// Status
-uint8_t AySound::selectedRegister = 0xFF;
-uint8_t AySound::channelVolume[3] = { 0xFF, 0xFF, 0xFF };
-uint16_t AySound::channelFrequency[3] = { 0xFFFF, 0xFFFF, 0xFFFF };
+AyChip AySound::chip[AY_NUM_CHIPS];
+uint8_t AySound::selectedChip = 0;
+uint8_t AySound::stereoMode = AY_STEREO_MONO;
 
-const unsigned char volume[] = {
-	0, 8, 17, 25, 34, 42, 51, 59, 68, 76, 85, 93, 102, 110, 119, 127
+static AyChipGenerator _generator[AY_NUM_CHIPS] = {
+    AyChipGenerator(AySound::chip[0]),
+    AyChipGenerator(AySound::chip[1])
 };
 
 void AySound::initialize()
 {
     _soundGenerator.setVolume(126);
     _soundGenerator.play(true);
-	for (int8_t channel = 0; channel < 3; channel++)
-	{
-        _soundGenerator.attach(&_channel[channel]);
-        _channel[channel].enable(true);
-        _channel[channel].setVolume(0);
-	}
+    for (uint8_t i = 0; i < AY_NUM_CHIPS; i++)
+    {
+        _soundGenerator.attach(&_generator[i]);
+        _generator[i].setVolume(127);
+        chip[i].setSampleRate(_soundGenerator.sampleRate());
+        chip[i].setStereoMode(stereoMode);
+    }
+    // second chip is only mixed once a program selects it
+    _generator[0].enable(true);
+    _generator[1].enable(false);
 }
 
 void AySound::enable()
@@ -86,229 +101,58 @@ void AySound::disable()
     _soundGenerator.play(false);
 }
 
-// Reference frequency is calculated like this:
-// for a AY-3-8912 running at 4MHz, reference frequency is 125000 Hz.
-// But on a Spectrum 128K, it runs at 3.5469MHz, so the
-// frequency is 125000 * 3.5469 / 4 = 110840
-#define FREQUENCY_REFERENCE 110840
-
-inline int fixPitch(int p)
+void AySound::setStereoMode(uint8_t mode)
 {
-	int fixed = (p > 0) ? (FREQUENCY_REFERENCE / p) : 0;
-	if (fixed > 15000) fixed = 15000;
-	return fixed;
+    stereoMode = mode;
+    for (uint8_t i = 0; i < AY_NUM_CHIPS; i++)
+        chip[i].setStereoMode(mode);
 }
 
-void AySound::update()
+uint8_t AySound::getRegisterData()
 {
-	uint16_t oldChannelFrequency[3];
-	uint8_t oldChannelVolume[3];
-
-	for (uint8_t channel = 0; channel < 3; channel++)
-	{
-		uint8_t chVolume = channelVolume[channel];
-		oldChannelFrequency[channel] = chVolume ? channelFrequency[channel] : 0xFFFF;
-		oldChannelVolume[channel] = chVolume;
-	}
-
-	int16_t pitch;
-
-	switch (selectedRegister)
-	{
-	case 0:
-	case 1:
-		pitch = ((coarsePitchChannelA << 8) | finePitchChannelA) & 0x0FFF;
-		channelFrequency[0] = pitch;
-		break;
-	case 2:
-	case 3:
-		pitch = ((coarsePitchChannelB << 8) | finePitchChannelB) & 0x0FFF;
-		channelFrequency[1] = pitch;
-		break;
-	case 4:
-	case 5:
-		pitch = ((coarsePitchChannelC << 8) | finePitchChannelC) & 0x0FFF;
-		channelFrequency[2] = pitch;
-		break;
-	case 6:
-		// noisePitch - ignored for now
-		break;
-	case 7:
-		channelVolume[0] = (mixer & 0x01) ? 0 : volume[volumeChannelA & 0x0F];
-		channelVolume[1] = (mixer & 0x02) ? 0 : volume[volumeChannelB & 0x0F];
-		channelVolume[2] = (mixer & 0x04) ? 0 : volume[volumeChannelC & 0x0F];
-		break;
-	case 8:
-		channelVolume[0] = (mixer & 0x01) ? 0 : volume[volumeChannelA & 0x0F];
-		break;
-	case 9:
-		channelVolume[1] = (mixer & 0x02) ? 0 : volume[volumeChannelB & 0x0F];
-		break;
-	case 10:
-		channelVolume[2] = (mixer & 0x04) ? 0 : volume[volumeChannelC & 0x0F];
-		break;
-	case 11:
-		// envelopeFineDuration - ignored for now
-		break;
-	case 12:
-		// envelopeCoarseDuration - ignored for now
-		break;
-	case 13:
-		// envelopeShape - ignored for now
-		break;
-	case 14:
-		// ioPortA - ignored for now
-		break;
-	}
-
-	for (int8_t channel = 0; channel < 3; channel++)
-	{
-		if (channelVolume[channel] != oldChannelVolume[channel])
-		{
-            _channel[channel].setVolume(channelVolume[channel]);
-		}
-
-		if (channelVolume[channel] == 0)
-		{
-            _channel[channel].setVolume(0);
-
-			continue;
-		}
+    return chip[selectedChip].getRegisterData();
+}
 
-		if (channelFrequency[channel] != oldChannelFrequency[channel])
-		{
-            _channel[channel].setFrequency(fixPitch(channelFrequency[channel]));
-		}
-	}
+void AySound::selectRegister(uint8_t data)
+{
+    // TurboSound: 0xFF selects first chip, 0xFE selects second chip
+    if (data >= 0xFE) {
+        selectedChip = 0xFF - data;
+        if (selectedChip) _generator[selectedChip].enable(true);
+        return;
+    }
+    chip[selectedChip].selectRegister(data);
 }
 
-uint8_t AySound::getRegisterData()
+void AySound::setRegisterData(uint8_t data)
 {
-	switch (selectedRegister)
-	{
-	case 0:
-		return finePitchChannelA;
-	case 1:
-		return coarsePitchChannelA;
-	case 2:
-		return finePitchChannelB;
-	case 3:
-		return coarsePitchChannelB;
-	case 4:
-		return finePitchChannelC;
-	case 5:
-		return coarsePitchChannelC;
-	case 6:
-		return noisePitch;
-	case 7:
-		return mixer;
-	case 8:
-		return volumeChannelA;
-	case 9:
-		return volumeChannelB;
-	case 10:
-		return volumeChannelC;
-	case 11:
-		return envelopeFineDuration;
-	case 12:
-		return envelopeCoarseDuration;
-	case 13:
-		return envelopeShape;
-	case 14:
-		return ioPortA;
-	default:
-		return 0;
-	}
+    chip[selectedChip].setRegisterData(data);
+    // PSG files hold a single chip
+    if (selectedChip == 0)
+        AyRecorder::registerWrite(chip[0].getSelectedRegister(), data);
 }
 
-void AySound::selectRegister(uint8_t registerNumber)
+const uint16_t* AySound::renderBlock(int* frames)
 {
-	selectedRegister = registerNumber;
+    return _soundGenerator.renderBlock(frames);
 }
 
-void AySound::setRegisterData(uint8_t data)
+bool AySound::isStereoOutput()
 {
-	switch (selectedRegister)
-	{
-        case 0:
-            finePitchChannelA = data;
-            break;
-        case 1:
-            coarsePitchChannelA = data;
-            break;
-        case 2:
-            finePitchChannelB = data;
-            break;
-        case 3:
-            coarsePitchChannelB = data;
-            break;
-        case 4:
-            finePitchChannelC = data;
-            break;
-        case 5:
-            coarsePitchChannelC = data;
-            break;
-        case 6:
-            noisePitch = data;
-            break;
-        case 7:
-            mixer = data;
-            break;
-        case 8:
-            volumeChannelA = data;
-            break;
-        case 9:
-            volumeChannelB = data;
-            break;
-        case 10:
-            volumeChannelC = data;
-            break;
-        case 11:
-            envelopeFineDuration = data;
-            break;
-        case 12:
-            envelopeCoarseDuration = data;
-            break;
-        case 13:
-            envelopeShape = data;
-            break;
-        case 14:
-            ioPortA = data;
-            break;
-        default:
-            // invalid register - do nothing
-            return;
-    }
+    return _soundGenerator.stereo();
+}
 
-    update();
+int AySound::sampleRate()
+{
+    return _soundGenerator.sampleRate();
 }
 
 void AySound::reset()
 {
-	finePitchChannelA = 0xFF;
-	coarsePitchChannelA = 0xFF;
-	finePitchChannelB = 0xFF;
-	coarsePitchChannelB = 0xFF;
-	finePitchChannelC = 0xFF;
-	coarsePitchChannelC = 0xFF;
-	noisePitch = 0xFF;
-	mixer = 0xFF;
-	volumeChannelA = 0xFF;
-	volumeChannelB = 0xFF;
-	volumeChannelC = 0xFF;
-	envelopeFineDuration = 0xFF;
-	envelopeCoarseDuration = 0xFF;
-	envelopeShape = 0xFF;
-	ioPortA = 0xFF;
-
-	// Status
-	selectedRegister = 0xFF;
-    for (int channel = 0; channel < 3; channel++)
-    {
-	    channelVolume[channel] = 0xFF;
-	    channelFrequency[channel] = 0xFFFF;
-        _channel[channel].setVolume(0);
-    }
+    for (uint8_t i = 0; i < AY_NUM_CHIPS; i++)
+        chip[i].reset();
+    selectedChip = 0;
+    _generator[1].enable(false);
 }
 
 #endif
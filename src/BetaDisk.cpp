@@ -0,0 +1,563 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "BetaDisk.h"
+#include "FileTRD.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "CPU.h"
+#include "VFS.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define BETA_ALLOC(size) ps_malloc(size)
+#else
+#define BETA_ALLOC(size) malloc(size)
+#endif
+
+// status register
+#define WD_BUSY      0x01
+#define WD_INDEX     0x02   // type I
+#define WD_DRQ       0x02   // type II and III
+#define WD_TRACK0    0x04   // type I
+#define WD_LOST      0x04   // type II and III
+#define WD_CRC       0x08
+#define WD_SEEK_ERR  0x10   // type I
+#define WD_RNF       0x10   // type II and III, record not found
+#define WD_HEAD      0x20   // type I, head loaded
+#define WD_DELETED   0x20   // type II read, record type
+#define WD_WP        0x40
+#define WD_NOT_READY 0x80
+
+// command flags
+#define WD_CMD_VERIFY   0x04    // type I
+#define WD_CMD_HEAD     0x08    // type I
+#define WD_CMD_UPDATE   0x10    // type I step: update the track register
+#define WD_CMD_MULTIPLE 0x10    // type II
+#define WD_CMD_DELAY    0x04    // type II and III, 15 ms head settle
+#define WD_CMD_COMPARE  0x02    // type II, compare side
+#define WD_CMD_SIDE     0x08
+
+// system register
+#define BETA_SYS_DRIVE  0x03
+#define BETA_SYS_RESET  0x04    // low: controller reset
+#define BETA_SYS_SIDE   0x10    // low: side 1
+
+#define WD_SETTLE_MS 15
+// bytes in a track read or written whole: 6250 at 250 kbit/s
+#define WD_RAW_TRACK 6250
+// layout of a sector in a raw TR-DOS track: sync, ID field, gap, sync, data
+// field and gap, each field starting with three 0xA1 and its address mark
+#define WD_RAW_ID      15
+#define WD_RAW_DATA    (WD_RAW_ID + 4 + 2 + 22 + 15)
+#define WD_RAW_SECTOR  (WD_RAW_DATA + TRD_SECTOR_SIZE + 2 + 54)
+
+bool    BetaDisk::present = false;
+bool    BetaDisk::active = false;
+uint8_t BetaDisk::basicRom = 0;
+bool    BetaDisk::fast = false;
+
+enum Operation { OP_NONE, OP_SEEK, OP_FAIL, OP_READ, OP_WRITE, OP_READ_ADDRESS, OP_READ_TRACK, OP_WRITE_TRACK };
+
+static uint8_t status = 0;
+static uint8_t trackReg = 0;
+static uint8_t sectorReg = 1;
+static uint8_t dataReg = 0;
+static uint8_t command = 0;
+static uint8_t systemReg = 0;
+static bool intrq = false;
+static bool typeI = true;           // status shows the type I bits
+
+static uint8_t headTrack[4];        // cylinder under the head of each drive
+static int8_t stepDirection = 1;
+static uint8_t stepMs = 6;
+static uint64_t frameStart = 0;     // emulated T-states of current frame start
+static uint32_t idleFrames = 0;
+
+// command in progress
+static Operation operation = OP_NONE;
+static uint8_t endStatus;           // OP_SEEK, OP_FAIL: status when done
+static uint64_t operationEnd;       // OP_SEEK, OP_FAIL: when done
+static uint8_t* sectorData;
+static uint8_t idField[6];
+static uint16_t dataPos, dataLen;
+static uint64_t nextByte;           // when DRQ comes up
+static uint8_t idSector = 0;        // next ID passing under the head
+// write track: where the byte stream is
+static uint8_t formatState;
+static uint8_t formatId[4];
+static uint16_t formatPos;
+static uint8_t* formatData;
+
+static const uint8_t stepRates[4] = { 6, 12, 20, 30 };
+
+static inline uint64_t now()
+{
+    return frameStart + CPU::tstates;
+}
+
+static inline uint8_t drive()
+{
+    return systemReg & BETA_SYS_DRIVE;
+}
+
+static inline uint8_t side()
+{
+    return (systemReg & BETA_SYS_SIDE) ? 0 : 1;
+}
+
+static inline bool isReady()
+{
+    return drive() == 0 && FileTRD::isInserted();
+}
+
+// CRC-CCITT of an address mark and the bytes after it, as the WD1793 writes it
+static uint16_t crc16(uint8_t mark, const uint8_t* data, uint16_t len)
+{
+    uint16_t crc = 0xCDB4;      // after the three 0xA1 syncs
+    for (int32_t i = -1; i < len; i++) {
+        crc ^= (i < 0 ? mark : data[i]) << 8;
+        for (uint8_t b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void finish(uint8_t st)
+{
+    operation = OP_NONE;
+    status = st;
+    intrq = true;
+}
+
+// time-based progress: seeks ending, sectors not found
+static void update()
+{
+    if ((operation == OP_SEEK || operation == OP_FAIL) && now() >= operationEnd)
+        finish(endStatus);
+}
+
+static inline bool dataRequest()
+{
+    if (operation < OP_READ || dataPos >= dataLen) return false;
+    return BetaDisk::fast || now() >= nextByte;
+}
+
+static void startData(uint16_t len, bool settle)
+{
+    dataPos = 0;
+    dataLen = len;
+    nextByte = now();
+    if (!BetaDisk::fast)
+        nextByte += BETA_BYTE_TSTATES + (settle ? WD_SETTLE_MS * BETA_MS_TSTATES : 0);
+}
+
+static void byteDone()
+{
+    dataPos++;
+    if (!BetaDisk::fast) {
+        uint64_t t = now();
+        nextByte = (nextByte > t ? nextByte : t) + BETA_BYTE_TSTATES;
+    }
+    idleFrames = 0;
+}
+
+static void fail(uint8_t st)
+{
+    // a sector is looked for during five turns of the disk
+    operation = OP_FAIL;
+    endStatus = st;
+    operationEnd = now() + (BetaDisk::fast ? 0 : 5 * BETA_REVOLUTION_TSTATES);
+    status = WD_BUSY;
+}
+
+// TR-DOS sectors: ID track is the cylinder, side 0, sectors 1 to 16 of 256
+static bool startSector()
+{
+    uint8_t track = headTrack[0];
+    sectorData = NULL;
+    if (trackReg == track && (!(command & WD_CMD_COMPARE) || !(command & WD_CMD_SIDE)))
+        sectorData = FileTRD::sector(track, side(), sectorReg);
+    if (sectorData == NULL) {
+        fail(WD_RNF);
+        return false;
+    }
+    idSector = sectorReg % TRD_SECTORS;
+    status = WD_BUSY;
+    startData(TRD_SECTOR_SIZE, command & WD_CMD_DELAY);
+    return true;
+}
+
+static void sectorDone()
+{
+    if (operation == OP_WRITE)
+        FileTRD::written();
+    if (command & WD_CMD_MULTIPLE) {
+        sectorReg++;
+        // ends when there is no next sector
+        if (FileTRD::sector(headTrack[0], side(), sectorReg) != NULL) {
+            startSector();
+            return;
+        }
+        finish(WD_RNF);
+        return;
+    }
+    finish(0);
+}
+
+// byte of the raw track read by READ TRACK
+static uint8_t rawTrackByte(uint16_t pos)
+{
+    uint16_t s = pos / WD_RAW_SECTOR;
+    uint16_t i = pos % WD_RAW_SECTOR;
+    if (s >= TRD_SECTORS) return 0x4E;
+    uint8_t id[4] = { headTrack[0], 0, (uint8_t)(s + 1), 1 };
+    uint8_t* data = FileTRD::sector(headTrack[0], side(), s + 1);
+    if (i < WD_RAW_ID - 3) return 0x00;
+    if (i < WD_RAW_ID) return 0xA1;
+    if (i == WD_RAW_ID) return 0xFE;
+    i -= WD_RAW_ID + 1;
+    if (i < 4) return id[i];
+    if (i < 6) {
+        uint16_t crc = crc16(0xFE, id, 4);
+        return i == 4 ? crc >> 8 : crc & 0xFF;
+    }
+    i = pos % WD_RAW_SECTOR;
+    if (i < WD_RAW_DATA - 15) return 0x4E;
+    if (i < WD_RAW_DATA - 3) return 0x00;
+    if (i < WD_RAW_DATA) return 0xA1;
+    if (i == WD_RAW_DATA) return 0xFB;
+    i -= WD_RAW_DATA + 1;
+    if (i < TRD_SECTOR_SIZE) return data ? data[i] : 0x00;
+    if (i < TRD_SECTOR_SIZE + 2) {
+        uint16_t crc = data ? crc16(0xFB, data, TRD_SECTOR_SIZE) : 0;
+        return i == TRD_SECTOR_SIZE ? crc >> 8 : crc & 0xFF;
+    }
+    return 0x4E;
+}
+
+// byte written by WRITE TRACK: the ID fields tell which sector the data
+// fields that follow are for, the image keeps its TR-DOS layout
+static void formatByte(uint8_t b)
+{
+    if (formatState == 1) {
+        formatId[formatPos++] = b;
+        if (formatPos == 4) formatState = 0;
+    }
+    else if (formatState == 2) {
+        if (formatData) formatData[formatPos] = b;
+        if (++formatPos == TRD_SECTOR_SIZE) formatState = 0;
+    }
+    else if (b == 0xFE) {
+        formatState = 1;
+        formatPos = 0;
+    }
+    else if (b == 0xFB || b == 0xF8) {
+        formatState = 2;
+        formatPos = 0;
+        formatData = formatId[3] == 1 ? FileTRD::sector(headTrack[0], side(), formatId[2]) : NULL;
+    }
+}
+
+static void startCommand(uint8_t cmd)
+{
+    update();
+    if ((cmd & 0xF0) == 0xD0) {
+        // force interrupt: stop whatever runs, INTRQ now if asked to
+        operation = OP_NONE;
+        status &= ~WD_BUSY;
+        typeI = true;
+        intrq = (cmd & 0x0F) != 0;
+        return;
+    }
+    if (status & WD_BUSY) return;
+    command = cmd;
+    intrq = false;
+    idleFrames = 0;
+
+    if (!(cmd & 0x80)) {
+        // type I: restore, seek, step, step in, step out
+        typeI = true;
+        uint8_t track = headTrack[drive()];
+        uint8_t target;
+        if ((cmd & 0xF0) == 0x00) {
+            target = 0;
+            trackReg = 0;
+        }
+        else if ((cmd & 0xF0) == 0x10) {
+            target = track + (int16_t)(dataReg - trackReg);
+            if ((int16_t)track + (int16_t)(dataReg - trackReg) < 0) target = 0;
+            trackReg = dataReg;
+        }
+        else {
+            if ((cmd & 0xE0) == 0x40) stepDirection = 1;
+            if ((cmd & 0xE0) == 0x60) stepDirection = -1;
+            target = (stepDirection < 0 && track == 0) ? 0 : track + stepDirection;
+            if (cmd & WD_CMD_UPDATE) trackReg += stepDirection;
+        }
+        if (target >= TRD_MAX_TRACKS) target = TRD_MAX_TRACKS - 1;
+        uint8_t steps = target > track ? target - track : track - target;
+        headTrack[drive()] = target;
+        stepMs = stepRates[cmd & 0x03];
+
+        endStatus = 0;
+        if (cmd & WD_CMD_VERIFY) {
+            endStatus |= WD_HEAD;
+            if (!isReady() || trackReg != target || target >= FileTRD::tracks())
+                endStatus |= WD_SEEK_ERR;
+        }
+        operation = OP_SEEK;
+        operationEnd = now();
+        if (!BetaDisk::fast)
+            operationEnd += ((uint32_t)steps * stepMs + ((cmd & WD_CMD_VERIFY) ? WD_SETTLE_MS : 0)) * BETA_MS_TSTATES;
+        status = WD_BUSY | ((cmd & WD_CMD_HEAD) ? WD_HEAD : 0);
+        update();
+        return;
+    }
+
+    typeI = false;
+    if (!isReady()) {
+        finish(WD_NOT_READY);
+        return;
+    }
+    bool writing = (cmd & 0xE0) == 0xA0 || (cmd & 0xF0) == 0xF0;
+    if (writing && FileTRD::isWriteProtected()) {
+        finish(WD_WP);
+        return;
+    }
+
+    switch (cmd & 0xF0) {
+    case 0x80: case 0x90:
+        operation = OP_READ;
+        startSector();
+        break;
+    case 0xA0: case 0xB0:
+        operation = OP_WRITE;
+        startSector();
+        break;
+    case 0xC0:
+        // the next ID under the head; its track goes to the sector register
+        if (headTrack[0] >= FileTRD::tracks()) {
+            fail(WD_RNF);
+            break;
+        }
+        idField[0] = headTrack[0];
+        idField[1] = 0;
+        idField[2] = idSector + 1;
+        idField[3] = 1;
+        {
+            uint16_t crc = crc16(0xFE, idField, 4);
+            idField[4] = crc >> 8;
+            idField[5] = crc & 0xFF;
+        }
+        idSector = (idSector + 1) % TRD_SECTORS;
+        sectorReg = headTrack[0];
+        operation = OP_READ_ADDRESS;
+        status = WD_BUSY;
+        startData(6, cmd & WD_CMD_DELAY);
+        break;
+    case 0xE0:
+        operation = OP_READ_TRACK;
+        status = WD_BUSY;
+        startData(WD_RAW_TRACK, cmd & WD_CMD_DELAY);
+        break;
+    case 0xF0:
+        operation = OP_WRITE_TRACK;
+        formatState = 0;
+        formatData = NULL;
+        memset(formatId, 0, sizeof(formatId));
+        status = WD_BUSY;
+        startData(WD_RAW_TRACK, cmd & WD_CMD_DELAY);
+        break;
+    }
+}
+
+static uint8_t readStatus()
+{
+    update();
+    intrq = false;
+    uint8_t st = status;
+    if (typeI) {
+        st &= ~(WD_NOT_READY | WD_WP | WD_TRACK0 | WD_INDEX);
+        if (!isReady()) st |= WD_NOT_READY;
+        else {
+            if (FileTRD::isWriteProtected()) st |= WD_WP;
+            if (now() % BETA_REVOLUTION_TSTATES < BETA_INDEX_TSTATES) st |= WD_INDEX;
+        }
+        if (headTrack[drive()] == 0) st |= WD_TRACK0;
+    }
+    else {
+        st &= ~WD_DRQ;
+        if (dataRequest()) st |= WD_DRQ;
+    }
+    return st;
+}
+
+static uint8_t readDataReg()
+{
+    update();
+    if (!dataRequest())
+        return dataReg;
+    switch (operation) {
+    case OP_READ:
+        dataReg = sectorData[dataPos];
+        break;
+    case OP_READ_ADDRESS:
+        dataReg = idField[dataPos];
+        break;
+    case OP_READ_TRACK:
+        dataReg = rawTrackByte(dataPos);
+        break;
+    default:
+        return dataReg;
+    }
+    byteDone();
+    if (dataPos == dataLen) {
+        if (operation == OP_READ)
+            sectorDone();
+        else
+            finish(0);
+    }
+    return dataReg;
+}
+
+static void writeDataReg(uint8_t data)
+{
+    update();
+    dataReg = data;
+    if (operation == OP_WRITE && dataPos < dataLen) {
+        sectorData[dataPos] = data;
+        byteDone();
+        if (dataPos == dataLen)
+            sectorDone();
+    }
+    else if (operation == OP_WRITE_TRACK && dataPos < dataLen) {
+        formatByte(data);
+        byteDone();
+        if (dataPos == dataLen) {
+            FileTRD::written();
+            finish(0);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool BetaDisk::loadRom(String path)
+{
+    KB_INT_STOP;
+    File f = VFS::open(path, FILE_READ);
+    if (!f) {
+        KB_INT_START;
+        Serial.printf("BetaDisk: no TR-DOS ROM at %s\n", path.c_str());
+        return false;
+    }
+    if (Mem::rom[MEM_ROM_TRDOS] == NULL)
+        Mem::rom[MEM_ROM_TRDOS] = (uint8_t*)BETA_ALLOC(0x4000);
+    bool ok = Mem::rom[MEM_ROM_TRDOS] != NULL;
+    if (ok) {
+        memset(Mem::rom[MEM_ROM_TRDOS], 0xFF, 0x4000);
+        readBlockFile(f, Mem::rom[MEM_ROM_TRDOS], f.size() < 0x4000 ? f.size() : 0x4000);
+    }
+    f.close();
+    KB_INT_START;
+    Serial.printf("BetaDisk: TR-DOS ROM %s\n", ok ? "loaded" : "not allocated");
+    return ok;
+}
+
+void BetaDisk::reset()
+{
+    active = false;
+    operation = OP_NONE;
+    status = 0;
+    trackReg = 0;
+    sectorReg = 1;
+    dataReg = 0;
+    systemReg = 0;
+    intrq = false;
+    typeI = true;
+    for (uint8_t d = 0; d < 4; d++)
+        headTrack[d] = 0;
+    idSector = 0;
+}
+
+void BetaDisk::page(bool in)
+{
+    active = in && present;
+    if (active)
+        Mem::romInUse = MEM_ROM_TRDOS;
+    else if (Mem::romInUse == MEM_ROM_TRDOS)
+        Mem::romInUse = basicRom ? Mem::romLatch : 0;
+}
+
+uint8_t BetaDisk::input(uint8_t portLow)
+{
+    if (portLow & 0x80) {
+        // system register: INTRQ and DRQ
+        update();
+        return (intrq ? 0x80 : 0) | (dataRequest() ? 0x40 : 0) | 0x3F;
+    }
+    switch ((portLow >> 5) & 0x03) {
+    case 0: return readStatus();
+    case 1: return trackReg;
+    case 2: return sectorReg;
+    default: return readDataReg();
+    }
+}
+
+void BetaDisk::output(uint8_t portLow, uint8_t data)
+{
+    if (portLow & 0x80) {
+        systemReg = data;
+        if (!(data & BETA_SYS_RESET)) {
+            // master reset
+            operation = OP_NONE;
+            status = 0;
+            sectorReg = 1;
+            intrq = false;
+            typeI = true;
+        }
+        return;
+    }
+    switch ((portLow >> 5) & 0x03) {
+    case 0: startCommand(data); break;
+    case 1: if (!(status & WD_BUSY)) trackReg = data; break;
+    case 2: if (!(status & WD_BUSY)) sectorReg = data; break;
+    default: writeDataReg(data); break;
+    }
+}
+
+void BetaDisk::endFrame(uint32_t statesPerFrame)
+{
+    frameStart += statesPerFrame;
+    // there is no motor line: write back once the disk has been left alone
+    if (FileTRD::isChanged() && operation == OP_NONE && ++idleFrames >= BETA_FLUSH_FRAMES) {
+        idleFrames = 0;
+        FileTRD::flush();
+    }
+}
@@ -38,6 +38,10 @@
 #include "PS2Kbd.h"
 #include "CPU.h"
 #include "Config.h"
+#include "FileTAP.h"
+#include "FileTZX.h"
+#include "FileRZX.h"
+#include "BetaDisk.h"
 
 #pragma GCC optimize ("O3")
 
@@ -109,6 +113,7 @@ uint32_t CPU::microsPerFrame()
 ///////////////////////////////////////////////////////////////////////////////
 
 uint32_t CPU::tstates = 0;
+uint32_t CPU::nextFrameStart = 0;
 
 void CPU::setup()
 {
@@ -161,17 +166,53 @@ void CPU::loop()
         uint32_t partTstates = 0;
         #define PIT_PERIOD 50
         begin_timing(statesInFrame, microsPerFrame());
+        #ifdef TAPE_FAST_LOAD
+            // run as fast as possible while a tape is playing
+            bool paced = !FileTZX::isPlaying();
+        #else
+            bool paced = true;
+        #endif
     #endif
 
-    tstates = 0;
+    tstates = nextFrameStart;
+    nextFrameStart = 0;
+    #ifdef CPU_PER_INSTRUCTION_TIMING
+        prevTstates = tstates;
+    #endif
 
 	while (tstates < statesInFrame)
 	{
+        #ifdef CPU_JLSANCHEZ
+            if (Z80::getRegPC() == ROM_LD_BYTES) {
+                // TAP inserted: blocks are fed to LD-BYTES straight from the file
+                if (FileTAP::isInserted())
+                    FileTAP::trapLoadBytes();
+                // TZX inserted: the ROM is going to read the tape, press play
+                else if (FileTZX::isInserted() && FileTAP::isLoadBytes())
+                    FileTZX::play();
+            }
+            // TR-DOS ROM paging on instruction fetch
+            if (BetaDisk::present)
+                BetaDisk::trap(Z80::getRegPC());
+        #endif
+
+        #ifdef CPU_LINKEFONG
+            // one instruction per call here too, so the fetch address is
+            // the PC before it (the LD-BYTES trap is not available)
+            if (BetaDisk::present)
+                BetaDisk::trap(_zxCpu.pc);
+        #endif
+
 		DO_Z80_INSTRUCTION;
 
+        #ifdef CPU_LINKEFONG
+            // no opcode fetch hook in this core: RZX counts instructions
+            FileRZX::fetches++;
+        #endif
+
         #ifdef CPU_PER_INSTRUCTION_TIMING
             if (partTstates > PIT_PERIOD) {
-                delay_instruction(tstates);
+                if (paced) delay_instruction(tstates);
                 partTstates -= PIT_PERIOD;
             } 
             else {
@@ -181,7 +222,7 @@ void CPU::loop()
         #endif
 	}
     #ifdef CPU_PER_INSTRUCTION_TIMING
-        delay_instruction(tstates);
+        if (paced) delay_instruction(tstates);
     #endif
 
     DO_Z80_INTERRUPT;
@@ -198,6 +239,7 @@ uint8_t Z80Ops::fetchOpcode(uint16_t address) {
         CPU::tstates += CPU::delayContention(CPU::tstates);
 
     CPU::tstates += 4;
+    FileRZX::fetches++;
     return Mem::readbyte(address);
 }
 
@@ -238,6 +280,8 @@ uint8_t Z80Ops::inPort(uint16_t port) {
     CPU::tstates += 3;
     uint8_t hiport = port >> 8;
     uint8_t loport = port & 0xFF;
+    if (FileRZX::isActive())
+        return FileRZX::input(loport, hiport);
     return Ports::input(loport, hiport);
 }
 void Z80Ops::outPort(uint16_t port, uint8_t value) {
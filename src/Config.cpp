@@ -27,33 +27,31 @@
 // DEALINGS IN THE SOFTWARE.
 //
 
+#include "hardconfig.h"
 #include "Config.h"
 #include <FS.h>
 #include "PS2Kbd.h"
 #include "FileUtils.h"
 #include "messages.h"
-
-#ifdef USE_INT_FLASH
-// using internal storage (spi flash)
-#include <SPIFFS.h>
-// set The Filesystem to SPIFFS
-#define THE_FS SPIFFS
-#endif
-
-#ifdef USE_SD_CARD
-// using external storage (SD card)
-#include <SD.h>
-// set The Filesystem to SD
-#define THE_FS SD
-static SPIClass customSPI;
-#endif
+#include "AyChip.h"
+#include "VFS.h"
+#include "Ports.h"
+#include "Mem.h"
+#include "FDC.h"
+#include "BetaDisk.h"
 
 String   Config::arch = "128K";
 String   Config::ram_file = NO_RAM_FILE;
 String   Config::romSet = "SINCLAIR";
-String   Config::sna_file_list; // list of file names
-String   Config::sna_name_list; // list of names (without ext, '_' -> ' ')
 bool     Config::slog_on = true;
+bool     Config::fast_disk = true;
+#ifdef AY_STEREO
+uint8_t  Config::ay_stereo = AY_STEREO_ABC;
+#else
+uint8_t  Config::ay_stereo = AY_STEREO_MONO;
+#endif
+
+static const char* ayStereoNames[] = { "MONO", "ABC", "ACB" };
 
 // Read config from FS
 void Config::load() {
@@ -64,7 +62,7 @@ void Config::load() {
     // Boot config file
     Serial.printf("Loading config file '%s':\n", DISK_BOOT_FILENAME);
     f = FileUtils::safeOpenFileRead(DISK_BOOT_FILENAME);
-    for (int i = 0; i < f.size(); i++) {
+    for (size_t i = 0; i < f.size(); i++) {
         char c = (char)f.read();
         if (c == '\n') {
             if (line.compareTo("slog:false") == 0) {
@@ -84,6 +82,14 @@ void Config::load() {
             } else if (line.startsWith("slog:")) {
                 slog_on = (line.substring(line.lastIndexOf(':') + 1) == "true");
                 Serial.printf("  + slog_on: '%s'\n", (slog_on ? "true" : "false"));
+            } else if (line.startsWith("aystereo:")) {
+                String mode = line.substring(line.lastIndexOf(':') + 1);
+                for (uint8_t m = AY_STEREO_MONO; m <= AY_STEREO_ACB; m++)
+                    if (mode == ayStereoNames[m]) ay_stereo = m;
+                Serial.printf("  + aystereo: '%s'\n", ayStereoNames[ay_stereo]);
+            } else if (line.startsWith("diskfast:")) {
+                fast_disk = (line.substring(line.lastIndexOf(':') + 1) == "true");
+                Serial.printf("  + diskfast: '%s'\n", (fast_disk ? "true" : "false"));
             }
             line = "";
         } else {
@@ -95,25 +101,11 @@ void Config::load() {
     KB_INT_START;
 }
 
-void Config::loadSnapshotLists()
-{
-    KB_INT_STOP;
-    sna_file_list = (String)MENU_SNA_TITLE + "\n" + FileUtils::getSortedSnaFileList();
-    sna_name_list = String(sna_file_list);
-    sna_name_list.replace(".SNA", "");
-    sna_name_list.replace(".sna", "");
-    sna_name_list.replace(".Z80", "");
-    sna_name_list.replace(".z80", "");
-    sna_name_list.replace("_", " ");
-    sna_name_list.replace("-", " ");
-    KB_INT_START;
-}
-
 // Dump actual config to FS
 void Config::save() {
     KB_INT_STOP;
     Serial.printf("Saving config file '%s':\n", DISK_BOOT_FILENAME);
-    File f = THE_FS.open(DISK_BOOT_FILENAME, FILE_WRITE);
+    File f = VFS::open(DISK_BOOT_FILENAME, FILE_WRITE);
     // Architecture
     Serial.printf("  + arch:%s\n", arch.c_str());
     f.printf("arch:%s\n", arch.c_str());
@@ -126,6 +118,12 @@ void Config::save() {
     // Serial logging
     Serial.printf("  + slog:%s\n", (slog_on ? "true" : "false"));
     f.printf("slog:%s\n", (slog_on ? "true" : "false"));
+    // AY stereo mode
+    Serial.printf("  + aystereo:%s\n", ayStereoNames[ay_stereo]);
+    f.printf("aystereo:%s\n", ayStereoNames[ay_stereo]);
+    // Disk speed
+    Serial.printf("  + diskfast:%s\n", (fast_disk ? "true" : "false"));
+    f.printf("diskfast:%s\n", (fast_disk ? "true" : "false"));
     f.close();
     vTaskDelay(5);
     Serial.println("Config saved OK");
@@ -133,7 +131,6 @@ void Config::save() {
 
     // do not reload after saving
     // load();
-    // loadSnapshotLists();
 }
 
 void Config::requestMachine(String newArch, String newRomSet, bool force)
@@ -146,4 +143,13 @@ void Config::requestMachine(String newArch, String newRomSet, bool force)
     arch = newArch;
     romSet = newRomSet;
     FileUtils::loadRom(arch, romSet);
+
+    // ports of the +2A / +3 models, whose paging needs all four ROMs: a
+    // two ROM set (e.g. a +2 dump) runs as a 128K
+    Ports::plus2A = (arch == "128K" && romSet.startsWith("PLUS") && Mem::romCount == 4);
+    FDC::present = (Ports::plus2A && romSet.startsWith("PLUS3"));
+    // Beta 128 on the others, if there is a TR-DOS ROM
+    BetaDisk::present = !Ports::plus2A && BetaDisk::hasRom();
+    BetaDisk::basicRom = (arch == "48K") ? 0 : 1;
+    BetaDisk::page(false);
 }
@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "Deflater.h"
+#include "FileUtils.h"
+
+#pragma GCC optimize ("O3")
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define MAX_DIST 32768
+#define HASH_SIZE (1 << DEFLATE_HASH_BITS)
+
+///////////////////////////////////////////////////////////////////////////////
+// output
+
+static File outFile;
+static uint8_t outBuffer[DEFLATE_OUTPUT_BUFFER_SIZE];
+static uint16_t outLen;
+static uint32_t outTotal;
+static bool outError;
+
+static uint32_t bitBuf;
+static uint8_t bitCnt;
+
+static void flushOut()
+{
+    if (outLen > 0 && writeBlockFile(outBuffer, outFile, outLen) != outLen)
+        outError = true;
+    outTotal += outLen;
+    outLen = 0;
+}
+
+static inline void putByte(uint8_t value)
+{
+    outBuffer[outLen++] = value;
+    if (outLen == DEFLATE_OUTPUT_BUFFER_SIZE)
+        flushOut();
+}
+
+// value's bits go out least significant first
+static inline void putBits(uint32_t value, uint8_t count)
+{
+    bitBuf |= value << bitCnt;
+    bitCnt += count;
+    while (bitCnt >= 8) {
+        putByte(bitBuf);
+        bitBuf >>= 8;
+        bitCnt -= 8;
+    }
+}
+
+// Huffman codes go out most significant first
+static inline void putCode(uint32_t code, uint8_t count)
+{
+    uint32_t reversed = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    putBits(reversed, count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fixed Huffman codes
+
+static void putLiteral(uint16_t symbol)
+{
+    if      (symbol < 144) putCode(0x30 + symbol, 8);
+    else if (symbol < 256) putCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280) putCode(symbol - 256, 7);
+    else                   putCode(0xC0 + symbol - 280, 8);
+}
+
+static const uint16_t lenBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lenExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void putMatch(uint16_t len, uint16_t dist)
+{
+    uint8_t code = 28;
+    while (lenBase[code] > len) code--;
+    putLiteral(257 + code);
+    putBits(len - lenBase[code], lenExtra[code]);
+
+    code = 29;
+    while (distBase[code] > dist) code--;
+    putCode(code, 5);
+    putBits(dist - distBase[code], distExtra[code]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static inline uint16_t hash3(const uint8_t* p)
+{
+    uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+    return (uint32_t)(v * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+}
+
+int32_t Deflater::deflateZlib(const uint8_t* src, uint32_t len, File f)
+{
+    if (len > 0xFFFF) return -1;
+
+    // last position + 1 of each hash, 0 for none
+    uint16_t* head = (uint16_t*)calloc(HASH_SIZE, sizeof(uint16_t));
+    if (head == NULL) return -1;
+
+    outFile = f;
+    outLen = 0;
+    outTotal = 0;
+    outError = false;
+    bitBuf = 0;
+    bitCnt = 0;
+
+    // zlib header: deflate, 32K window, fastest compression
+    putByte(0x78);
+    putByte(0x01);
+
+    // single final block with fixed codes
+    putBits(1, 1);
+    putBits(1, 2);
+
+    uint32_t pos = 0;
+    while (pos < len) {
+        uint16_t matchLen = 0;
+        uint32_t matchPos = 0;
+
+        if (pos + MIN_MATCH <= len) {
+            uint16_t h = hash3(src + pos);
+            uint32_t candidate = head[h];
+            head[h] = pos + 1;
+            if (candidate > 0 && pos - (candidate - 1) <= MAX_DIST) {
+                matchPos = candidate - 1;
+                uint32_t maxLen = len - pos;
+                if (maxLen > MAX_MATCH) maxLen = MAX_MATCH;
+                const uint8_t* a = src + matchPos;
+                const uint8_t* b = src + pos;
+                while (matchLen < maxLen && a[matchLen] == b[matchLen]) matchLen++;
+            }
+        }
+
+        if (matchLen >= MIN_MATCH) {
+            putMatch(matchLen, pos - matchPos);
+            // keep the hash table up to date inside the match
+            uint32_t end = pos + matchLen;
+            for (pos++; pos < end; pos++)
+                if (pos + MIN_MATCH <= len)
+                    head[hash3(src + pos)] = pos + 1;
+        }
+        else {
+            putLiteral(src[pos]);
+            pos++;
+        }
+    }
+
+    putLiteral(256);
+    if (bitCnt > 0) putBits(0, 8 - bitCnt);
+
+    // Adler-32, big endian
+    uint32_t a = 1, b = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        a += src[i];
+        if (a >= 65521) a -= 65521;
+        b += a;
+        if (b >= 65521) b -= 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    putByte(adler >> 24);
+    putByte(adler >> 16);
+    putByte(adler >> 8);
+    putByte(adler);
+
+    flushOut();
+    free(head);
+
+    return outError ? -1 : outTotal;
+}
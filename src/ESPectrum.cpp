@@ -46,11 +46,20 @@
 #include "FileSNA.h"
 #include "Config.h"
 #include "FileUtils.h"
+#include "RomPartition.h"
+#include "RomCache.h"
 #include "osd.h"
 
 #include "Ports.h"
 #include "Mem.h"
 #include "AySound.h"
+#include "AyRecorder.h"
+#include "EarInput.h"
+#include "FileTZX.h"
+#include "Rewind.h"
+#include "FileRZX.h"
+#include "FDC.h"
+#include "BetaDisk.h"
 
 // works, but not needed for now
 #pragma GCC optimize ("O3")
@@ -138,7 +147,6 @@ void ESPectrum::setup()
 
     FileUtils::initFileSystem();
     Config::load();
-    Config::loadSnapshotLists();
 
     Serial.printf("Free heap after filesystem: %d\n", ESP.getFreeHeap());
 
@@ -167,12 +175,16 @@ void ESPectrum::setup()
 
     Serial.printf("Free heap after vga: %d \n", ESP.getFreeHeap());
 
+    // ROMs mapped from flash or cached in PSRAM need no RAM pages
+    bool romMapped = RomPartition::begin() || RomCache::preload();
+
 #ifdef BOARD_HAS_PSRAM
     Mem::ram5 = staticMemPage;
     Serial.printf("Page RAM5 statically allocated (fastest)\n");
     tryAllocateSRamThenPSRam(Mem::ram2, "RAM2");
     tryAllocateSRamThenPSRam(Mem::ram0, "RAM0");
-    tryAllocateSRamThenPSRam(Mem::rom0, "ROM0");
+    if (!romMapped)
+        tryAllocateSRamThenPSRam(Mem::rom0, "ROM0");
 
     tryAllocateSRamThenPSRam(Mem::ram7, "RAM7");
     tryAllocateSRamThenPSRam(Mem::ram1, "RAM1");
@@ -180,12 +192,15 @@ void ESPectrum::setup()
     tryAllocateSRamThenPSRam(Mem::ram4, "RAM4");
     tryAllocateSRamThenPSRam(Mem::ram6, "RAM6");
 
-    tryAllocateSRamThenPSRam(Mem::rom1, "ROM1");
-    tryAllocateSRamThenPSRam(Mem::rom2, "ROM2");
-    tryAllocateSRamThenPSRam(Mem::rom3, "ROM3");
+    if (!romMapped) {
+        tryAllocateSRamThenPSRam(Mem::rom1, "ROM1");
+        tryAllocateSRamThenPSRam(Mem::rom2, "ROM2");
+        tryAllocateSRamThenPSRam(Mem::rom3, "ROM3");
+    }
 
 #else
-    Mem::rom0 = (byte *)malloc(16384);
+    if (!romMapped)
+        Mem::rom0 = (byte *)malloc(16384);
 
     Mem::ram0 = (byte *)malloc(16384);
     Mem::ram2 = (byte *)malloc(16384);
@@ -213,7 +228,7 @@ void ESPectrum::setup()
     digitalWrite(SPEAKER_PIN, LOW);
 #endif
 #ifdef EAR_PRESENT
-    pinMode(EAR_PIN, INPUT);
+    EarInput::initialize();
 #endif
 #ifdef MIC_PRESENT
     pinMode(MIC_PIN, OUTPUT);
@@ -238,6 +253,10 @@ void ESPectrum::setup()
     xTaskCreatePinnedToCore(&ESPectrum::videoTask, "videoTask", 1024 * 4, NULL, 5, &videoTaskHandle, 0);
 
     AySound::initialize();
+    AySound::setStereoMode(Config::ay_stereo);
+    FDC::fast = Config::fast_disk;
+    BetaDisk::fast = Config::fast_disk;
+    BetaDisk::loadRom(TRDOS_ROM_FILE);
 
     Config::requestMachine(Config::getArch(), Config::getRomSet(), true);
     if ((String)Config::ram_file != (String)NO_RAM_FILE) {
@@ -267,6 +286,7 @@ void ESPectrum::reset()
         Ports::wii[i] == 0x1F;
     }
     ESPectrum::borderColor = 7;
+    Ports::lastFE = 7;
     Mem::bankLatch = 0;
     Mem::videoLatch = 0;
     Mem::romLatch = 0;
@@ -276,6 +296,11 @@ void ESPectrum::reset()
     Mem::romInUse = 0;
 
     CPU::reset();
+    FDC::reset();
+    BetaDisk::reset();
+    Rewind::clear();
+    // a recording cannot go on past a reset, nor a playback
+    FileRZX::stop();
 }
 
 #define NUM_SPECTRUM_COLORS 16
@@ -546,6 +571,10 @@ void ESPectrum::loop() {
     updateWiimote2Keys();
     OSD::do_OSD();
 
+#ifdef TAPE_FAST_LOAD
+    // while a tape is playing frames run unthrottled: draw only some of them
+    if (!FileTZX::isPlaying() || (sp_int_ctr % TAPE_FAST_LOAD_DRAW_EVERY) == 0)
+#endif
     xQueueSend(vidQueue, &param, portMAX_DELAY);
     uint32_t ts_start = micros();
 
@@ -553,6 +582,16 @@ void ESPectrum::loop() {
 
     uint32_t ts_end = micros();
 
+    AyRecorder::endFrame();
+#ifdef EAR_PRESENT
+    EarInput::endFrame(CPU::statesPerFrame());
+#endif
+    FileTZX::endFrame(CPU::statesPerFrame());
+    FileRZX::endFrame();
+    FDC::endFrame(CPU::statesPerFrame());
+    BetaDisk::endFrame(CPU::statesPerFrame());
+    Rewind::endFrame();
+
 #ifdef LOG_DEBUG_TIMING
     uint32_t elapsed = ts_end - ts_start;
     uint32_t target = CPU::microsPerFrame();
@@ -568,8 +607,6 @@ void ESPectrum::loop() {
     else ctr--;
 #endif
 
-    AySound::update();
-
     while (videoTaskIsRunning) {
     }
 
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "EarInput.h"
+#include "hardconfig.h"
+#include "hardpins.h"
+#include "CPU.h"
+
+#pragma GCC optimize ("O3")
+
+EarInput::Edge EarInput::ring[EAR_RING_SIZE];
+volatile uint32_t EarInput::head = 0;
+uint32_t EarInput::tail = 0;
+uint8_t EarInput::level = 1;
+uint64_t EarInput::frameStart = 0;
+bool EarInput::anchored = false;
+uint64_t EarInput::anchorStates = 0;
+uint32_t EarInput::anchorMicros = 0;
+uint32_t EarInput::overrunCount = 0;
+
+void EarInput::initialize()
+{
+    head = tail = 0;
+    anchored = false;
+    overrunCount = 0;
+    frameStart = 0;
+    level = 1;
+
+#ifdef EAR_PRESENT
+    pinMode(EAR_PIN, INPUT);
+    level = digitalRead(EAR_PIN);
+    attachInterrupt(digitalPinToInterrupt(EAR_PIN), EarInput::interruptHandler, CHANGE);
+#endif
+}
+
+void IRAM_ATTR EarInput::interruptHandler()
+{
+#ifdef EAR_PRESENT
+    pushEdge(micros(), digitalRead(EAR_PIN));
+#endif
+}
+
+void IRAM_ATTR EarInput::pushEdge(uint32_t timeMicros, uint8_t edgeLevel)
+{
+    uint32_t h = head;
+    ring[h & EAR_RING_MASK].time = timeMicros;
+    ring[h & EAR_RING_MASK].level = edgeLevel;
+    head = h + 1;
+}
+
+uint8_t EarInput::read(uint32_t tstates)
+{
+    uint32_t h = head;
+    if (tail == h) return level;
+
+    if (h - tail > EAR_RING_SIZE) {
+        // interrupt overwrote edges not yet played
+        overrunCount += h - tail - EAR_RING_SIZE;
+        tail = h - EAR_RING_SIZE;
+        anchored = false;
+    }
+
+    uint64_t now = frameStart + tstates;
+    uint32_t statesPerFrame = CPU::statesPerFrame();
+    uint32_t microsPerFrame = CPU::microsPerFrame();
+
+    while (tail != h) {
+        Edge& edge = ring[tail & EAR_RING_MASK];
+        if (!anchored) {
+            // first edge after silence or an overrun: play it after a fixed latency
+            anchorStates = now + (uint64_t)EAR_LATENCY_MICROS * statesPerFrame / microsPerFrame;
+            anchorMicros = edge.time;
+            anchored = true;
+        }
+        uint64_t edgeStates = anchorStates + (uint64_t)(edge.time - anchorMicros) * statesPerFrame / microsPerFrame;
+        if (edgeStates > now) break;
+        level = edge.level;
+        tail++;
+    }
+    return level;
+}
+
+void EarInput::endFrame(uint32_t statesPerFrame)
+{
+    frameStart += statesPerFrame;
+
+    // all edges played and the line has been quiet for a while:
+    // next edge starts a new timeline
+    if (anchored && tail == head) {
+        uint64_t lastStates = anchorStates + (uint64_t)(ring[(tail - 1) & EAR_RING_MASK].time - anchorMicros)
+                              * statesPerFrame / CPU::microsPerFrame();
+        if (frameStart > lastStates + 2 * (uint64_t)statesPerFrame * EAR_LATENCY_MICROS / CPU::microsPerFrame())
+            anchored = false;
+    }
+}
@@ -0,0 +1,613 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "FDC.h"
+#include "FileDSK.h"
+#include "CPU.h"
+
+// main status register
+#define MSR_RQM 0x80    // data register ready
+#define MSR_DIO 0x40    // data register to the CPU
+#define MSR_EXM 0x20    // execution phase
+#define MSR_CB  0x10    // command in progress
+
+// status register 0
+#define ST0_IC  0x80    // invalid command
+#define ST0_AT  0x40    // abnormal termination
+#define ST0_SE  0x20    // seek end
+#define ST0_EC  0x10    // equipment check
+#define ST0_NR  0x08    // not ready
+// status register 1
+#define ST1_EN  0x80    // end of cylinder
+#define ST1_DE  0x20    // data error
+#define ST1_ND  0x04    // no data
+#define ST1_NW  0x02    // not writable
+#define ST1_MA  0x01    // missing address mark
+// status register 2
+#define ST2_CM  0x40    // control mark, deleted data
+#define ST2_DD  0x20    // data error in data field
+#define ST2_WC  0x10    // wrong cylinder
+#define ST2_BC  0x02    // bad cylinder
+#define ST2_MD  0x01    // missing data address mark
+// status register 3
+#define ST3_WP  0x40    // write protected
+#define ST3_RY  0x20    // ready
+#define ST3_T0  0x10    // track 0
+#define ST3_TS  0x08    // two sided
+
+// first command byte: flags and code
+#define CMD_MT  0x80    // multi-track
+#define CMD_SK  0x20    // skip deleted data
+#define CMD_CODE 0x1F
+
+#define CMD_READ_TRACK      0x02
+#define CMD_SPECIFY         0x03
+#define CMD_SENSE_DRIVE     0x04
+#define CMD_WRITE_DATA      0x05
+#define CMD_READ_DATA       0x06
+#define CMD_RECALIBRATE     0x07
+#define CMD_SENSE_INT       0x08
+#define CMD_WRITE_DELETED   0x09
+#define CMD_READ_ID         0x0A
+#define CMD_READ_DELETED    0x0C
+#define CMD_FORMAT          0x0D
+#define CMD_SEEK            0x0F
+
+// bytes of each command, by code; scans are taken in full and rejected
+static const uint8_t commandLength[32] = {
+    1, 1, 9, 3, 2, 9, 9, 2, 1, 9, 2, 1, 9, 6, 1, 3,
+    1, 9, 1, 1, 1, 1, 1, 1, 1, 9, 1, 1, 1, 9, 1, 1
+};
+
+// read from sector data missing in the image
+#define FDC_FILLER 0xE5
+
+bool FDC::present = false;
+bool FDC::fast = false;
+
+enum Phase { PHASE_COMMAND, PHASE_EXECUTION, PHASE_RESULT };
+enum Transfer { XFER_READ, XFER_WRITE, XFER_FORMAT };
+
+static Phase phase = PHASE_COMMAND;
+static uint8_t command[9];
+static uint8_t commandPos = 0;
+static uint8_t result[7];
+static uint8_t resultLen = 0;
+static uint8_t resultPos = 0;
+
+// drives A and B
+static uint8_t cylinder[2];
+static uint8_t seekTarget[2];
+static bool seeking[2];
+static uint64_t seekEnd[2];
+static bool seekInterrupt[2];       // for SENSE INTERRUPT STATUS
+static uint8_t seekST0[2];
+// next sector passing under the head of drive A, for READ ID
+static uint8_t idIndex = 0;
+
+static bool motorOn = false;
+static bool flushPending = false;
+static uint8_t stepMs = 12;
+static uint64_t frameStart = 0;     // emulated T-states of current frame start
+
+// execution phase
+static Transfer transfer;
+static uint8_t unit, head;
+static uint8_t st0, st1, st2;
+static DSKSector sector;
+static uint16_t dataPos, dataLen;
+static bool lastSector;             // terminate after this one
+static bool readTrack;
+static uint8_t trackIndex;          // READ TRACK: physical position
+static uint64_t nextByte;           // when the data register is ready
+static uint8_t formatIds[4 * DSK_MAX_SECTORS];
+
+static inline uint64_t now()
+{
+    return frameStart + CPU::tstates;
+}
+
+static inline bool isReady(uint8_t drive)
+{
+    return drive == 0 && FileDSK::isInserted() && (motorOn || FDC::fast);
+}
+
+static void updateSeeks()
+{
+    for (uint8_t d = 0; d < 2; d++) {
+        if (seeking[d] && now() >= seekEnd[d]) {
+            seeking[d] = false;
+            cylinder[d] = seekTarget[d];
+            seekInterrupt[d] = true;
+        }
+    }
+}
+
+static void setResult(uint8_t len)
+{
+    resultLen = len;
+    resultPos = 0;
+    phase = PHASE_RESULT;
+}
+
+// result phase of the read, write and format commands
+static void finish(uint8_t c, uint8_t h, uint8_t r, uint8_t n)
+{
+    result[0] = st0 | (head << 2) | unit;
+    result[1] = st1;
+    result[2] = st2;
+    result[3] = c;
+    result[4] = h;
+    result[5] = r;
+    result[6] = n;
+    setResult(7);
+}
+
+static inline void finishAtCommandId()
+{
+    finish(command[2], command[3], command[4], command[5]);
+}
+
+static void startSeek(uint8_t target, bool recalibrate)
+{
+    uint8_t d = unit & 1;
+    uint8_t steps = target > cylinder[d] ? target - cylinder[d] : cylinder[d] - target;
+    seekST0[d] = ST0_SE | unit;
+    if (d == 1) {
+        // no drive: no track 0 signal, never ready
+        seekST0[d] |= ST0_AT | (recalibrate ? ST0_EC : ST0_NR);
+        target = 0;
+    }
+    else if (!FileDSK::isInserted()) {
+        seekST0[d] |= ST0_AT | ST0_NR;
+    }
+    seekTarget[d] = target;
+    seekEnd[d] = now() + (FDC::fast ? 0 : ((uint32_t)steps * stepMs + FDC_SETTLE_MS) * FDC_MS_TSTATES);
+    seeking[d] = true;
+    seekInterrupt[d] = false;
+    if (d == 0) idIndex = 0;
+}
+
+// look for the sector with the ID of the command on the current track
+static bool findSector()
+{
+    uint8_t count = FileDSK::sectorCount(cylinder[0], head);
+    if (count == 0) {
+        st0 |= ST0_AT;
+        st1 |= ST1_MA;
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        DSKSector s;
+        if (!FileDSK::sector(cylinder[0], head, i, s)) continue;
+        if (s.c == command[2] && s.h == command[3] && s.r == command[4] && s.n == command[5]) {
+            sector = s;
+            idIndex = (i + 1) % count;
+            return true;
+        }
+        if (s.r == command[4] && s.c != command[2])
+            st2 |= s.c == 0xFF ? ST2_BC : ST2_WC;
+    }
+    st0 |= ST0_AT;
+    st1 |= ST1_ND;
+    return false;
+}
+
+static uint16_t transferLength(uint8_t n)
+{
+    // N = 0 sectors are DTL bytes long
+    if (n == 0) return command[8] ? command[8] : 0x80;
+    return n > 7 ? 0x4000 : 0x80 << n;
+}
+
+static void beginTransfer()
+{
+    dataPos = 0;
+    nextByte = now() + (FDC::fast ? 0 : FDC_BYTE_TSTATES);
+    phase = PHASE_EXECUTION;
+}
+
+static void nextSector();
+
+static void beginSector()
+{
+    if (transfer == XFER_WRITE) {
+        dataLen = transferLength(command[5]);
+        beginTransfer();
+        return;
+    }
+
+    if (sector.st2 & ST2_MD) {
+        // ID without data
+        st0 |= ST0_AT;
+        st1 |= ST1_MA;
+        st2 |= ST2_MD;
+        finishAtCommandId();
+        return;
+    }
+    if (!readTrack) {
+        bool deleted = sector.st2 & ST2_CM;
+        if (deleted != ((command[0] & CMD_CODE) == CMD_READ_DELETED)) {
+            st2 |= ST2_CM;
+            if (command[0] & CMD_SK) {
+                nextSector();
+                return;
+            }
+            lastSector = true;
+        }
+    }
+    if ((sector.st1 & ST1_DE) || (sector.st2 & ST2_DD)) {
+        // recorded with a CRC error: read as it is, then stop
+        st1 |= sector.st1 & ST1_DE;
+        st2 |= sector.st2 & ST2_DD;
+        if (!readTrack) {
+            st0 |= ST0_AT;
+            lastSector = true;
+        }
+    }
+    dataLen = transferLength(command[5]);
+    beginTransfer();
+}
+
+static void nextSector()
+{
+    uint8_t c = command[2], h = command[3], r = command[4], n = command[5];
+    bool mt = command[0] & CMD_MT;
+
+    if (readTrack) {
+        command[4] = r + 1;
+        uint8_t count = FileDSK::sectorCount(cylinder[0], head);
+        if (++trackIndex >= count || r == command[6]) {
+            st0 |= ST0_AT;
+            st1 |= ST1_EN;
+            finish(c, h, r, n);
+            return;
+        }
+        FileDSK::sector(cylinder[0], head, trackIndex, sector);
+        if (sector.c != command[2] || sector.h != command[3] || sector.r != command[4] || sector.n != command[5])
+            st1 |= ST1_ND;
+        beginSector();
+        return;
+    }
+
+    if (r == command[6]) {
+        // end of track: on to side 1, or end of cylinder
+        if (mt && head == 0) {
+            head = 1;
+            command[3] = h ^ 1;
+            command[4] = 1;
+            if (findSector())
+                beginSector();
+            else
+                finishAtCommandId();
+            return;
+        }
+        // there is no terminal count on the +3: reads end here
+        st0 |= ST0_AT;
+        st1 |= ST1_EN;
+        finish(c + 1, mt ? h ^ 1 : h, 1, n);
+        return;
+    }
+
+    command[4] = r + 1;
+    if (findSector())
+        beginSector();
+    else
+        finishAtCommandId();
+}
+
+static void sectorDone()
+{
+    if (transfer == XFER_WRITE) {
+        // the new data has a good CRC and the mark of the command
+        sector.id[4] &= ~ST1_DE;
+        sector.id[5] &= ~(ST2_DD | ST2_CM);
+        if ((command[0] & CMD_CODE) == CMD_WRITE_DELETED)
+            sector.id[5] |= ST2_CM;
+        FileDSK::written();
+    }
+    if (lastSector) {
+        finishAtCommandId();
+        return;
+    }
+    nextSector();
+}
+
+static void formatDone()
+{
+    uint8_t count = command[3];
+    if (!FileDSK::format(cylinder[0], head, command[2], count, command[4], command[5], formatIds)) {
+        st0 |= ST0_AT;
+        st1 |= ST1_NW;
+    }
+    uint8_t last = count && count <= DSK_MAX_SECTORS ? 4 * (count - 1) : 0;
+    finish(formatIds[last], formatIds[last + 1], formatIds[last + 2], command[2]);
+}
+
+static void execute()
+{
+    uint8_t code = command[0] & CMD_CODE;
+    unit = command[1] & 0x03;
+    head = (command[1] >> 2) & 0x01;
+    uint8_t drive = unit & 1;
+    st0 = st1 = st2 = 0;
+    lastSector = false;
+    readTrack = false;
+
+    switch (code) {
+
+    case CMD_SPECIFY:
+        // step rate in 2 ms units with the 4 MHz clock of the +3
+        stepMs = (16 - (command[1] >> 4)) * 2;
+        phase = PHASE_COMMAND;
+        return;
+
+    case CMD_SENSE_DRIVE:
+    {
+        uint8_t st3 = (head << 2) | unit;
+        if (drive == 0) {
+            if (isReady(0)) st3 |= ST3_RY;
+            if (cylinder[0] == 0) st3 |= ST3_T0;
+            if (FileDSK::sides() == 2) st3 |= ST3_TS;
+            if (!FileDSK::isInserted() || FileDSK::isWriteProtected()) st3 |= ST3_WP;
+        }
+        result[0] = st3;
+        setResult(1);
+        return;
+    }
+
+    case CMD_RECALIBRATE:
+        startSeek(0, true);
+        phase = PHASE_COMMAND;
+        return;
+
+    case CMD_SEEK:
+        startSeek(command[2], false);
+        phase = PHASE_COMMAND;
+        return;
+
+    case CMD_SENSE_INT:
+        for (uint8_t d = 0; d < 2; d++) {
+            if (seekInterrupt[d]) {
+                seekInterrupt[d] = false;
+                result[0] = seekST0[d];
+                result[1] = cylinder[d];
+                setResult(2);
+                return;
+            }
+        }
+        result[0] = ST0_IC;
+        setResult(1);
+        return;
+
+    case CMD_READ_ID:
+    {
+        uint8_t count = isReady(drive) ? FileDSK::sectorCount(cylinder[0], head) : 0;
+        if (!isReady(drive)) {
+            st0 = ST0_AT | ST0_NR;
+        }
+        else if (count == 0) {
+            st0 = ST0_AT;
+            st1 = ST1_MA;
+        }
+        else {
+            DSKSector s;
+            FileDSK::sector(cylinder[0], head, idIndex % count, s);
+            idIndex = (idIndex + 1) % count;
+            finish(s.c, s.h, s.r, s.n);
+            return;
+        }
+        finish(cylinder[drive], head, 0, 0);
+        return;
+    }
+
+    case CMD_READ_DATA:
+    case CMD_READ_DELETED:
+    case CMD_READ_TRACK:
+    case CMD_WRITE_DATA:
+    case CMD_WRITE_DELETED:
+        transfer = (code == CMD_WRITE_DATA || code == CMD_WRITE_DELETED) ? XFER_WRITE : XFER_READ;
+        if (!isReady(drive)) {
+            st0 = ST0_AT | ST0_NR;
+            finishAtCommandId();
+            return;
+        }
+        if (transfer == XFER_WRITE && FileDSK::isWriteProtected()) {
+            st0 = ST0_AT;
+            st1 = ST1_NW;
+            finishAtCommandId();
+            return;
+        }
+        if (code == CMD_READ_TRACK) {
+            // sectors in the order they are on the track, from the index hole
+            readTrack = true;
+            trackIndex = 0;
+            if (!FileDSK::sector(cylinder[0], head, 0, sector)) {
+                st0 = ST0_AT;
+                st1 = ST1_MA;
+                finishAtCommandId();
+                return;
+            }
+            if (sector.c != command[2] || sector.h != command[3] || sector.r != command[4] || sector.n != command[5])
+                st1 |= ST1_ND;
+            beginSector();
+            return;
+        }
+        if (findSector())
+            beginSector();
+        else
+            finishAtCommandId();
+        return;
+
+    case CMD_FORMAT:
+        transfer = XFER_FORMAT;
+        if (!isReady(drive)) {
+            st0 = ST0_AT | ST0_NR;
+            finish(0, 0, 0, command[2]);
+            return;
+        }
+        if (FileDSK::isWriteProtected()) {
+            st0 = ST0_AT;
+            st1 = ST1_NW;
+            finish(0, 0, 0, command[2]);
+            return;
+        }
+        // C, H, R, N of each sector
+        memset(formatIds, 0, sizeof(formatIds));
+        dataLen = 4 * command[3];
+        if (dataLen)
+            beginTransfer();
+        else
+            formatDone();
+        return;
+
+    default:
+        result[0] = ST0_IC;
+        setResult(1);
+        return;
+    }
+}
+
+static inline bool byteReady()
+{
+    return FDC::fast || now() >= nextByte;
+}
+
+static inline void byteDone()
+{
+    dataPos++;
+    if (!FDC::fast) {
+        uint64_t t = now();
+        nextByte = (nextByte > t ? nextByte : t) + FDC_BYTE_TSTATES;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FDC::reset()
+{
+    motor(false);
+    phase = PHASE_COMMAND;
+    commandPos = 0;
+    for (uint8_t d = 0; d < 2; d++) {
+        cylinder[d] = 0;
+        seeking[d] = false;
+        seekInterrupt[d] = false;
+    }
+    idIndex = 0;
+    stepMs = 12;
+}
+
+uint8_t FDC::readStatus()
+{
+    updateSeeks();
+    uint8_t msr = (seeking[0] ? 0x01 : 0) | (seeking[1] ? 0x02 : 0);
+    switch (phase) {
+    case PHASE_COMMAND:
+        msr |= MSR_RQM;
+        if (commandPos) msr |= MSR_CB;
+        break;
+    case PHASE_EXECUTION:
+        msr |= MSR_CB | MSR_EXM;
+        if (transfer == XFER_READ) msr |= MSR_DIO;
+        if (byteReady()) msr |= MSR_RQM;
+        break;
+    case PHASE_RESULT:
+        msr |= MSR_RQM | MSR_DIO | MSR_CB;
+        break;
+    }
+    return msr;
+}
+
+uint8_t FDC::readData()
+{
+    updateSeeks();
+    if (phase == PHASE_RESULT) {
+        uint8_t data = result[resultPos++];
+        if (resultPos == resultLen) {
+            phase = PHASE_COMMAND;
+            commandPos = 0;
+        }
+        return data;
+    }
+    if (phase == PHASE_EXECUTION && transfer == XFER_READ) {
+        uint8_t data = dataPos < sector.size ? sector.data[dataPos] : FDC_FILLER;
+        byteDone();
+        if (dataPos == dataLen)
+            sectorDone();
+        return data;
+    }
+    return 0xFF;
+}
+
+void FDC::writeData(uint8_t data)
+{
+    updateSeeks();
+    if (phase == PHASE_COMMAND) {
+        command[commandPos++] = data;
+        if (commandPos == commandLength[command[0] & CMD_CODE]) {
+            commandPos = 0;
+            execute();
+        }
+        return;
+    }
+    if (phase != PHASE_EXECUTION) return;
+
+    if (transfer == XFER_WRITE) {
+        if (dataPos < sector.size)
+            sector.data[dataPos] = data;
+        byteDone();
+        if (dataPos == dataLen)
+            sectorDone();
+    }
+    else if (transfer == XFER_FORMAT) {
+        if (dataPos < sizeof(formatIds))
+            formatIds[dataPos] = data;
+        byteDone();
+        if (dataPos == dataLen)
+            formatDone();
+    }
+}
+
+void FDC::motor(bool on)
+{
+    // write back the disk once it stops, between frames
+    if (motorOn && !on)
+        flushPending = true;
+    motorOn = on;
+}
+
+void FDC::endFrame(uint32_t statesPerFrame)
+{
+    frameStart += statesPerFrame;
+    if (flushPending) {
+        flushPending = false;
+        FileDSK::flush();
+    }
+}
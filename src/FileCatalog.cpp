@@ -0,0 +1,400 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "FileCatalog.h"
+#include "FileUtils.h"
+#include "FileSZX.h"
+#include "PS2Kbd.h"
+#include "VFS.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define CATALOG_ALLOC(size) ps_malloc(size)
+#define CATALOG_REALLOC(ptr, size) ps_realloc(ptr, size)
+#else
+#define CATALOG_ALLOC(size) malloc(size)
+#define CATALOG_REALLOC(ptr, size) realloc(ptr, size)
+#endif
+
+// index file: magic, version, count, signature, reserved, then the entries
+#define CATALOG_HEADER_LEN 16
+
+String   FileCatalog::dirPath;
+File     FileCatalog::indexFile;
+uint16_t FileCatalog::entryCount = 0;
+uint32_t FileCatalog::verified[CATALOG_VERIFIED_MAX];
+uint8_t  FileCatalog::verifiedCount = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int compareEntries(const void* a, const void* b)
+{
+    return strcasecmp(((const CatalogEntry*)a)->name, ((const CatalogEntry*)b)->name);
+}
+
+static uint32_t hashName(const char* name, uint32_t h = 2166136261U)
+{
+    for (const char* p = name; *p; p++)
+        h = (h ^ (uint8_t)*p) * 16777619U;
+    return h;
+}
+
+// order independent, so the directory order does not matter
+static uint32_t entrySignature(const CatalogEntry& e)
+{
+    return hashName(e.name) ^ (e.size * 2654435761U) ^ e.mtime;
+}
+
+static int32_t tableFind(const CatalogEntry* table, uint16_t count, const char* name)
+{
+    int32_t lo = 0;
+    int32_t hi = (int32_t)count - 1;
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) / 2;
+        int cmp = strcasecmp(table[mid].name, name);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+// archives cannot be written, their index is kept beside them, hidden:
+// "/sna/games.zip" has "/sna/.games.zip.catalog"
+static String indexPath(const String& dir)
+{
+    if (!FileUtils::hasZIPextension(dir))
+        return dir + "/" + CATALOG_FILE_NAME;
+    int slash = dir.lastIndexOf('/');
+    return dir.substring(0, slash + 1) + "." + dir.substring(slash + 1) + CATALOG_FILE_NAME;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FileCatalog::isVerified(const String& dir)
+{
+    uint32_t h = hashName(dir.c_str());
+    for (uint8_t i = 0; i < verifiedCount; i++)
+        if (verified[i] == h) return true;
+    // oldest forgotten when full: it will just be checked again
+    if (verifiedCount == CATALOG_VERIFIED_MAX) {
+        memmove(verified, verified + 1, (CATALOG_VERIFIED_MAX - 1) * sizeof(uint32_t));
+        verifiedCount--;
+    }
+    verified[verifiedCount++] = h;
+    return false;
+}
+
+bool FileCatalog::open(String dir)
+{
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+
+    close();
+    dirPath = dir;
+
+    String index = indexPath(dir);
+    if (!isVerified(dir) || !VFS::exists(index)) {
+        // check the directory against its index, if any
+        uint16_t oldCount = 0;
+        uint32_t oldSignature = 0;
+        CatalogEntry* old = readTable(&oldCount, &oldSignature);
+        uint16_t count;
+        uint32_t signature;
+        CatalogEntry* table = scan(old, oldCount, &count, &signature);
+        if (table != NULL && (old == NULL || count != oldCount || signature != oldSignature)) {
+            qsort(table, count, sizeof(CatalogEntry), compareEntries);
+            writeIndex(table, count, signature);
+            Serial.printf("FileCatalog::open: %s, %u entries indexed in %u us\n", dir.c_str(), count, (unsigned)(micros() - ts_start));
+        }
+        free(table);
+        free(old);
+    }
+
+    indexFile = VFS::open(index, FILE_READ);
+    uint8_t header[CATALOG_HEADER_LEN];
+    if (!indexFile || readBlockFile(indexFile, header, CATALOG_HEADER_LEN) != CATALOG_HEADER_LEN) {
+        Serial.printf("FileCatalog::open: no index for %s\n", dir.c_str());
+        close();
+        KB_INT_START;
+        return false;
+    }
+    entryCount = header[6] | (header[7] << 8);
+
+    Serial.printf("FileCatalog::open: %s, %u entries in %u us\n", dir.c_str(), entryCount, (unsigned)(micros() - ts_start));
+    KB_INT_START;
+    return true;
+}
+
+void FileCatalog::close()
+{
+    if (indexFile) indexFile.close();
+    indexFile = File();
+    entryCount = 0;
+}
+
+uint16_t FileCatalog::read(uint16_t first, uint16_t n, CatalogEntry* dst)
+{
+    if (first >= entryCount) return 0;
+    if (n > entryCount - first) n = entryCount - first;
+    KB_INT_STOP;
+    indexFile.seek(CATALOG_HEADER_LEN + (uint32_t)first * sizeof(CatalogEntry));
+    uint32_t len = readBlockFile(indexFile, (uint8_t*)dst, (uint32_t)n * sizeof(CatalogEntry));
+    KB_INT_START;
+    return len / sizeof(CatalogEntry);
+}
+
+int32_t FileCatalog::find(const char* name)
+{
+    uint16_t i = lowerBound(name);
+    CatalogEntry e;
+    if (read(i, 1, &e) == 1 && strcasecmp(e.name, name) == 0)
+        return i;
+    return -1;
+}
+
+uint16_t FileCatalog::lowerBound(const char* prefix)
+{
+    uint16_t lo = 0;
+    uint16_t hi = entryCount;
+    CatalogEntry e;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (read(mid, 1, &e) != 1) break;
+        if (strcasecmp(e.name, prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// whole index of dirPath, NULL if there is none or it is not valid
+CatalogEntry* FileCatalog::readTable(uint16_t* count, uint32_t* signature)
+{
+    String path = indexPath(dirPath);
+    if (!VFS::exists(path)) return NULL;
+    File f = VFS::open(path, FILE_READ);
+    if (!f) return NULL;
+
+    uint8_t header[CATALOG_HEADER_LEN];
+    if (readBlockFile(f, header, CATALOG_HEADER_LEN) != CATALOG_HEADER_LEN
+        || memcmp(header, CATALOG_MAGIC, 4) != 0
+        || (header[4] | (header[5] << 8)) != CATALOG_VERSION) {
+        Serial.printf("FileCatalog: %s is not valid\n", path.c_str());
+        f.close();
+        return NULL;
+    }
+
+    uint16_t n = header[6] | (header[7] << 8);
+    uint32_t len = (uint32_t)n * sizeof(CatalogEntry);
+    if (f.size() != CATALOG_HEADER_LEN + len) {
+        Serial.printf("FileCatalog: %s is truncated\n", path.c_str());
+        f.close();
+        return NULL;
+    }
+
+    CatalogEntry* table = (CatalogEntry*)CATALOG_ALLOC(len > 0 ? len : 1);
+    if (table == NULL || readBlockFile(f, (uint8_t*)table, len) != len) {
+        Serial.printf("FileCatalog: cannot read %s\n", path.c_str());
+        free(table);
+        f.close();
+        return NULL;
+    }
+    f.close();
+
+    *count = n;
+    *signature = header[8] | (header[9] << 8) | ((uint32_t)header[10] << 16) | ((uint32_t)header[11] << 24);
+    return table;
+}
+
+bool FileCatalog::writeIndex(const CatalogEntry* table, uint16_t count, uint32_t signature)
+{
+    String path = indexPath(dirPath);
+    File f = VFS::open(path, FILE_WRITE);
+    if (!f) {
+        Serial.printf("FileCatalog: cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    uint8_t header[CATALOG_HEADER_LEN];
+    memset(header, 0, sizeof(header));
+    memcpy(header, CATALOG_MAGIC, 4);
+    header[4] = CATALOG_VERSION & 0xFF;
+    header[5] = CATALOG_VERSION >> 8;
+    header[6] = count & 0xFF;
+    header[7] = count >> 8;
+    for (uint8_t i = 0; i < 4; i++)
+        header[8 + i] = (signature >> (8 * i)) & 0xFF;
+
+    uint32_t len = (uint32_t)count * sizeof(CatalogEntry);
+    bool ok = writeBlockFile(header, f, CATALOG_HEADER_LEN) == CATALOG_HEADER_LEN
+           && writeBlockFile((uint8_t*)table, f, len) == len;
+    f.close();
+
+    if (!ok) {
+        // better no index than a broken one
+        Serial.printf("FileCatalog: write error on %s\n", path.c_str());
+        VFS::remove(path);
+    }
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Walk the directory, returning its entries unsorted. Entries unchanged since
+// the old index are copied from it, only new or changed files are opened
+// to find out what they are.
+CatalogEntry* FileCatalog::scan(const CatalogEntry* old, uint16_t oldCount, uint16_t* count, uint32_t* sig)
+{
+    File root = VFS::open(dirPath);
+    if (!root || !root.isDirectory()) {
+        Serial.printf("FileCatalog: cannot open %s\n", dirPath.c_str());
+        return NULL;
+    }
+
+    uint16_t capacity = 64;
+    uint16_t n = 0;
+    uint16_t probed = 0;
+    uint32_t s = 0;
+    CatalogEntry* list = (CatalogEntry*)CATALOG_ALLOC(capacity * sizeof(CatalogEntry));
+
+    File file = root.openNextFile();
+    while (file && list) {
+        // some cores return the full path as name
+        const char* name = file.name();
+        const char* slash = strrchr(name, '/');
+        if (slash) name = slash + 1;
+
+        if (name[0] == '.' || String(name).endsWith(".txt")) {
+            // hidden or description
+        }
+        else if (strlen(name) >= CATALOG_NAME_LEN) {
+            Serial.printf("FileCatalog: name too long, skipped: %s\n", name);
+        }
+        else if (n == 0xFFFF) {
+            Serial.printf("FileCatalog: too many entries in %s\n", dirPath.c_str());
+            break;
+        }
+        else {
+            if (n == capacity) {
+                capacity = (capacity < 0x8000) ? capacity * 2 : 0xFFFF;
+                CatalogEntry* grown = (CatalogEntry*)CATALOG_REALLOC(list, capacity * sizeof(CatalogEntry));
+                if (grown == NULL) {
+                    free(list);
+                    list = NULL;
+                    break;
+                }
+                list = grown;
+            }
+
+            CatalogEntry& e = list[n++];
+            memset(&e, 0, sizeof(e));
+            strcpy(e.name, name);
+            e.size = file.isDirectory() ? 0 : file.size();
+            e.mtime = file.getLastWrite();
+
+            int32_t i = old ? tableFind(old, oldCount, e.name) : -1;
+            if (i >= 0 && old[i].size == e.size && old[i].mtime == e.mtime) {
+                e.type = old[i].type;
+                e.machine = old[i].machine;
+            }
+            else {
+                probe(file, e);
+                probed++;
+            }
+            if (e.type == CATALOG_TYPE_OTHER)
+                n--;    // nothing the browser can open
+            else
+                s += entrySignature(e);
+        }
+        file.close();
+        file = root.openNextFile();
+    }
+    root.close();
+
+    if (list == NULL) {
+        Serial.printf("FileCatalog: out of memory scanning %s\n", dirPath.c_str());
+        return NULL;
+    }
+
+    Serial.printf("FileCatalog: %u entries in %s, %u probed\n", n, dirPath.c_str(), probed);
+    *count = n;
+    *sig = s;
+    return list;
+}
+
+// find out the type of an entry and, for snapshots, the machine it needs
+void FileCatalog::probe(File f, CatalogEntry& e)
+{
+    String name = e.name;
+    uint8_t header[35];
+
+    if (f.isDirectory() || FileUtils::hasZIPextension(name)) {
+        // archives are browsed as directories
+        e.type = CATALOG_TYPE_DIR;
+    }
+    else if (FileUtils::hasSNAextension(name)) {
+        e.type = CATALOG_TYPE_SNA;
+        e.machine = (e.size == SNA_48K_SIZE) ? CATALOG_MACHINE_48K : CATALOG_MACHINE_128K;
+    }
+    else if (FileUtils::hasZ80extension(name)) {
+        e.type = CATALOG_TYPE_Z80;
+        if (readBlockFile(f, header, 35) == 35) {
+            // version 1 is 48K only; later versions tell in the hardware mode
+            uint16_t ahblen = header[30] | (header[31] << 8);
+            bool is48K = (header[6] | header[7])
+                      || (ahblen == 23 ? header[34] < 3 : header[34] < 4);
+            e.machine = is48K ? CATALOG_MACHINE_48K : CATALOG_MACHINE_128K;
+        }
+    }
+    else if (FileUtils::hasSZXextension(name)) {
+        e.type = CATALOG_TYPE_SZX;
+        if (readBlockFile(f, header, 8) == 8)
+            e.machine = (header[6] <= SZX_MID_48K) ? CATALOG_MACHINE_48K : CATALOG_MACHINE_128K;
+    }
+    else if (FileUtils::hasTAPextension(name)) {
+        e.type = CATALOG_TYPE_TAP;
+    }
+    else if (FileUtils::hasTZXextension(name)) {
+        e.type = CATALOG_TYPE_TZX;
+    }
+    else if (FileUtils::hasRZXextension(name)) {
+        e.type = CATALOG_TYPE_RZX;
+    }
+    else if (FileUtils::hasDSKextension(name)) {
+        // +3 disks
+        e.type = CATALOG_TYPE_DSK;
+        e.machine = CATALOG_MACHINE_128K;
+    }
+    else if (FileUtils::hasTRDextension(name)) {
+        // TR-DOS disks, .trd and .scl
+        e.type = CATALOG_TYPE_TRD;
+    }
+}
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "FileDSK.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "VFS.h"
+#include "ZipFS.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define DSK_ALLOC(size) ps_malloc(size)
+#else
+#define DSK_ALLOC(size) malloc(size)
+#endif
+
+#define DSK_HEADER_LEN 0x100
+#define DSK_TRACK_HEADER_LEN 0x100
+// largest sector data in a standard image, for N = 6 and above
+#define DSK_SECTOR_MAX 0x1800
+
+bool     FileDSK::inserted = false;
+bool     FileDSK::writeProtected = false;
+bool     FileDSK::changed = false;
+bool     FileDSK::extended = false;
+uint8_t  FileDSK::numCylinders = 0;
+uint8_t  FileDSK::numSides = 0;
+String   FileDSK::fileName;
+uint8_t* FileDSK::image = NULL;
+uint32_t FileDSK::imageSize = 0;
+uint32_t FileDSK::trackOffset[DSK_MAX_TRACKS];
+uint32_t FileDSK::trackSpace[DSK_MAX_TRACKS];
+
+static inline uint16_t le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t sectorSize(uint8_t n)
+{
+    return n >= 6 ? DSK_SECTOR_MAX : 0x80 << n;
+}
+
+bool FileDSK::open(String dsk_fn)
+{
+    close();
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    File f = VFS::open(dsk_fn, FILE_READ);
+    if (!f) {
+        KB_INT_START;
+        Serial.printf("FileDSK::open: cannot open %s\n", dsk_fn.c_str());
+        return false;
+    }
+    uint32_t size = f.size();
+    if (size < DSK_HEADER_LEN || size > DSK_MAX_SIZE) {
+        f.close();
+        KB_INT_START;
+        Serial.printf("FileDSK::open: bad size %u for %s\n", size, dsk_fn.c_str());
+        return false;
+    }
+    image = (uint8_t*)DSK_ALLOC(size);
+    bool ok = image != NULL && readBlockFile(f, image, size) == size;
+    f.close();
+    KB_INT_START;
+
+    if (ok) {
+        extended = memcmp(image, "EXTENDED", 8) == 0;
+        ok = extended || memcmp(image, "MV - CPC", 8) == 0;
+    }
+    if (ok) {
+        numCylinders = image[0x30];
+        numSides = image[0x31];
+        ok = numSides >= 1 && numSides <= 2 && (uint32_t)numCylinders * numSides <= DSK_MAX_TRACKS;
+    }
+    if (!ok) {
+        Serial.printf("FileDSK::open: %s is not a DSK image\n", dsk_fn.c_str());
+        free(image);
+        image = NULL;
+        return false;
+    }
+
+    // tracks follow the header in order, cylinder by cylinder, side by side
+    uint32_t offset = DSK_HEADER_LEN;
+    uint16_t formatted = 0;
+    for (uint16_t t = 0; t < numCylinders * numSides; t++) {
+        uint32_t space = extended ? image[0x34 + t] * 0x100 : le16(image + 0x32);
+        trackOffset[t] = 0;
+        trackSpace[t] = 0;
+        if (space < DSK_TRACK_HEADER_LEN || offset + space > size) {
+            // unformatted, or missing from a truncated image
+            offset += space;
+            continue;
+        }
+        if (memcmp(image + offset, "Track-Info", 10) == 0) {
+            trackOffset[t] = offset;
+            trackSpace[t] = space;
+            formatted++;
+        }
+        offset += space;
+    }
+
+    String archive, member;
+    writeProtected = ZipFS::split(dsk_fn, archive, member);
+    fileName = dsk_fn;
+    imageSize = size;
+    changed = false;
+    inserted = true;
+    Serial.printf("Disk inserted: %s (%s, %u cylinders, %u sides, %u tracks) in %u us\n", dsk_fn.c_str(),
+        extended ? "extended" : "standard", numCylinders, numSides, formatted, (unsigned)(micros() - ts_start));
+    return true;
+}
+
+void FileDSK::close()
+{
+    if (!inserted) return;
+    flush();
+    free(image);
+    image = NULL;
+    inserted = false;
+}
+
+void FileDSK::flush()
+{
+    if (!inserted || !changed || writeProtected) return;
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    File f = VFS::open(fileName, FILE_WRITE);
+    bool ok = f && writeBlockFile(image, f, imageSize) == imageSize;
+    if (f) f.close();
+    KB_INT_START;
+    if (ok) {
+        changed = false;
+        Serial.printf("FileDSK::flush: %s written in %u us\n", fileName.c_str(), (unsigned)(micros() - ts_start));
+    }
+    else {
+        Serial.printf("FileDSK::flush: cannot write %s\n", fileName.c_str());
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint8_t* FileDSK::track(uint8_t cyl, uint8_t head)
+{
+    if (!inserted || cyl >= numCylinders || head >= numSides) return NULL;
+    uint16_t t = cyl * numSides + head;
+    return trackOffset[t] ? image + trackOffset[t] : NULL;
+}
+
+uint8_t FileDSK::sectorCount(uint8_t cyl, uint8_t head)
+{
+    uint8_t* info = track(cyl, head);
+    if (info == NULL) return 0;
+    return info[0x15] < DSK_MAX_SECTORS ? info[0x15] : DSK_MAX_SECTORS;
+}
+
+bool FileDSK::sector(uint8_t cyl, uint8_t head, uint8_t index, DSKSector& s)
+{
+    uint8_t* info = track(cyl, head);
+    if (info == NULL || index >= sectorCount(cyl, head)) return false;
+
+    // data is stored in the order of the sector list
+    uint32_t pos = DSK_TRACK_HEADER_LEN;
+    for (uint8_t i = 0; i <= index; i++) {
+        uint8_t* si = info + 0x18 + 8 * i;
+        uint32_t size = extended ? le16(si + 6) : sectorSize(info[0x14]);
+        if (i == index) {
+            uint32_t space = trackSpace[cyl * numSides + head];
+            if (pos > space) return false;
+            s.c = si[0];
+            s.h = si[1];
+            s.r = si[2];
+            s.n = si[3];
+            s.st1 = si[4];
+            s.st2 = si[5];
+            s.size = (pos + size <= space) ? size : space - pos;
+            s.data = info + pos;
+            s.id = si;
+        }
+        pos += size;
+    }
+    return true;
+}
+
+bool FileDSK::format(uint8_t cyl, uint8_t head, uint8_t n, uint8_t count, uint8_t gap,
+                     uint8_t filler, const uint8_t* ids)
+{
+    // the image layout stays as it is: the new track has to fit in the old
+    uint8_t* info = track(cyl, head);
+    uint32_t size = sectorSize(n);
+    if (info == NULL || writeProtected || count > DSK_MAX_SECTORS
+        || DSK_TRACK_HEADER_LEN + count * size > trackSpace[cyl * numSides + head])
+        return false;
+
+    info[0x14] = n;
+    info[0x15] = count;
+    info[0x16] = gap;
+    info[0x17] = filler;
+    memset(info + 0x18, 0, DSK_TRACK_HEADER_LEN - 0x18);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t* si = info + 0x18 + 8 * i;
+        memcpy(si, ids + 4 * i, 4);
+        if (extended) {
+            si[6] = size & 0xFF;
+            si[7] = size >> 8;
+        }
+    }
+    memset(info + DSK_TRACK_HEADER_LEN, filler, count * size);
+    changed = true;
+    return true;
+}
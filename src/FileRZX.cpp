@@ -0,0 +1,501 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "FileRZX.h"
+
+#include "hardconfig.h"
+#include "FileUtils.h"
+#include "FileSZX.h"
+#include "PS2Kbd.h"
+#include "CPU.h"
+#include "Ports.h"
+#include "VFS.h"
+#include <FS.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// blocks; lengths include the id and the length itself
+
+#define RZX_BLOCK_CREATOR  0x10
+#define RZX_BLOCK_SNAPSHOT 0x30
+#define RZX_BLOCK_INPUT    0x80
+
+#define RZX_HEADER_LEN        10
+#define RZX_CREATOR_LEN       29
+#define RZX_SNAPSHOT_HEAD_LEN 17
+#define RZX_INPUT_HEAD_LEN    18
+
+// snapshot block flags
+#define RZX_SNAP_EXTERNAL   0x01
+#define RZX_SNAP_COMPRESSED 0x02
+
+// input block flags
+#define RZX_INPUT_COMPRESSED 0x02
+
+// port read count of a frame which read the same values as the one before
+#define RZX_REPEAT_INPUTS 0xFFFF
+
+static uint16_t getWord(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t getDword(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putWord(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void putDword(uint8_t* p, uint32_t value) {
+    putWord(p, value & 0xFFFF);
+    putWord(p + 2, value >> 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+volatile bool FileRZX::recording = false;
+volatile bool FileRZX::playing = false;
+String FileRZX::filename;
+uint32_t FileRZX::frameCount = 0;
+uint32_t FileRZX::desyncCount = 0;
+uint32_t FileRZX::fetches = 0;
+
+static File rzxFile;
+
+// port reads of the current frame
+static uint16_t inCount;
+
+// recording: two buffers for the writer, then this frame's and the last
+// frame's port reads, in one PSRAM allocation
+static uint8_t* buffer[2] = { NULL, NULL };
+static uint8_t* frameIn[2];
+static uint8_t active;
+static uint16_t fill;
+static volatile uint16_t pendingSize[2];
+static uint8_t current;
+static uint16_t lastCount;
+static uint32_t inputBlockStart;
+static uint32_t inputBytes;
+static TaskHandle_t writerTaskHandle = NULL;
+static SemaphoreHandle_t fileMutex = NULL;
+
+// recording cost
+static uint32_t dropped;
+static uint32_t repeated;
+static uint32_t stalls;
+static uint64_t emuCycles;
+
+// playback: the frame records of the input block
+static uint8_t* playData = NULL;
+static uint32_t playLen;
+static uint32_t playPos;
+static uint32_t playFrames;
+static const uint8_t* inValues;
+static uint32_t inPos;
+static uint16_t fetchesRecorded;
+static bool ended = false;
+
+String FileRZX::nextFileName(String snaName)
+{
+    String base = snaName;
+    if (base == NO_RAM_FILE || base.length() == 0) base = "rzx";
+    int slash = base.lastIndexOf('/');
+    if (slash >= 0) base = base.substring(slash + 1);
+    int dot = base.lastIndexOf('.');
+    if (dot > 0) base = base.substring(0, dot);
+
+    for (int n = 0; n < 100; n++) {
+        String name = (String)RZX_REC_DIR + "/" + base + "_" + (n < 10 ? "0" : "") + n + ".rzx";
+        if (!VFS::exists(name))
+            return name;
+    }
+    return (String)RZX_REC_DIR + "/" + base + "_99.rzx";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// recording
+
+bool FileRZX::record(String rzx_fn)
+{
+    if (recording || playing) return false;
+
+    if (buffer[0] == NULL) {
+        buffer[0] = (uint8_t*)ps_malloc(2 * RZX_REC_BUFFER_SIZE + 2 * RZX_FRAME_MAX_INPUTS);
+        if (buffer[0] == NULL) {
+            Serial.println("FileRZX::record: out of memory");
+            return false;
+        }
+        buffer[1] = buffer[0] + RZX_REC_BUFFER_SIZE;
+        frameIn[0] = buffer[1] + RZX_REC_BUFFER_SIZE;
+        frameIn[1] = frameIn[0] + RZX_FRAME_MAX_INPUTS;
+    }
+
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    if (!VFS::exists(RZX_REC_DIR))
+        VFS::mkdir(RZX_REC_DIR);
+    rzxFile = VFS::open(rzx_fn, FILE_WRITE);
+    if (!rzxFile) {
+        Serial.printf("FileRZX::record: cannot create %s\n", rzx_fn.c_str());
+        KB_INT_START;
+        return false;
+    }
+
+    // file header and creator block
+    uint8_t head[RZX_HEADER_LEN + RZX_CREATOR_LEN];
+    memset(head, 0, sizeof(head));
+    memcpy(head, "RZX!", 4);
+    head[4] = RZX_MAJOR_VERSION;
+    head[5] = RZX_MINOR_VERSION;
+    uint8_t* creator = head + RZX_HEADER_LEN;
+    creator[0] = RZX_BLOCK_CREATOR;
+    putDword(creator + 1, RZX_CREATOR_LEN);
+    strncpy((char*)creator + 5, "ZX-ESPectrum", 20);
+    bool ok = (writeBlockFile(head, rzxFile, sizeof(head)) == sizeof(head));
+
+    // snapshot block, its length known once the SZX data is written
+    uint8_t snap[RZX_SNAPSHOT_HEAD_LEN];
+    memset(snap, 0, sizeof(snap));
+    snap[0] = RZX_BLOCK_SNAPSHOT;
+    memcpy(snap + 9, "szx", 3);
+    uint32_t snapStart = rzxFile.position();
+    ok = ok && writeBlockFile(snap, rzxFile, sizeof(snap)) == sizeof(snap);
+
+    SZXImage image;
+    FileSZX::capture(image, NULL);
+    ok = ok && FileSZX::write(rzxFile, image);
+
+    uint32_t snapEnd = rzxFile.position();
+    putDword(snap + 1, snapEnd - snapStart);
+    putDword(snap + 13, snapEnd - snapStart - RZX_SNAPSHOT_HEAD_LEN);
+    rzxFile.seek(snapStart);
+    ok = ok && writeBlockFile(snap, rzxFile, sizeof(snap)) == sizeof(snap);
+    rzxFile.seek(snapEnd);
+
+    // input recording block, length and frame count written on stop
+    uint8_t input[RZX_INPUT_HEAD_LEN];
+    memset(input, 0, sizeof(input));
+    input[0] = RZX_BLOCK_INPUT;
+    putDword(input + 10, CPU::tstates % CPU::statesPerFrame());
+    inputBlockStart = snapEnd;
+    ok = ok && writeBlockFile(input, rzxFile, sizeof(input)) == sizeof(input);
+
+    if (!ok) {
+        Serial.printf("FileRZX::record: write error on %s\n", rzx_fn.c_str());
+        rzxFile.close();
+        KB_INT_START;
+        return false;
+    }
+    KB_INT_START;
+
+    if (fileMutex == NULL)
+        fileMutex = xSemaphoreCreateMutex();
+    if (writerTaskHandle == NULL)
+        xTaskCreatePinnedToCore(&FileRZX::writerTask, "rzxRecTask", 1024 * 3, NULL, 2, &writerTaskHandle, 0);
+
+    filename = rzx_fn;
+    active = 0;
+    fill = 0;
+    pendingSize[0] = pendingSize[1] = 0;
+    current = 0;
+    inCount = lastCount = 0;
+    inputBytes = 0;
+    frameCount = 0;
+    dropped = repeated = stalls = 0;
+    emuCycles = 0;
+    fetches = 0;
+
+    Serial.printf("FileRZX: recording to %s, snapshot %u bytes in %u us\n", filename.c_str(),
+        snapEnd - snapStart, (unsigned)(micros() - ts_start));
+    recording = true;
+    return true;
+}
+
+void FileRZX::writePending()
+{
+    if (fileMutex == NULL) return;
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    // at most one buffer is pending while recording, so order is preserved
+    for (uint8_t i = 0; i < 2; i++) {
+        uint16_t size = pendingSize[i];
+        if (size == 0) continue;
+        rzxFile.write(buffer[i], size);
+        pendingSize[i] = 0;
+    }
+    xSemaphoreGive(fileMutex);
+}
+
+void FileRZX::writerTask(void* unused)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        writePending();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// playback
+
+bool FileRZX::play(String rzx_fn)
+{
+    if (recording || playing) return false;
+
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    File f = VFS::open(rzx_fn, FILE_READ);
+    uint8_t head[RZX_HEADER_LEN];
+    if (!f || readBlockFile(f, head, RZX_HEADER_LEN) != RZX_HEADER_LEN || memcmp(head, "RZX!", 4) != 0) {
+        Serial.printf("FileRZX::play: %s is not an RZX file\n", rzx_fn.c_str());
+        if (f) f.close();
+        KB_INT_START;
+        return false;
+    }
+
+    uint32_t file_size = f.size();
+    bool loaded = false;
+    bool ok = false;
+    while (f.position() + 5 <= file_size) {
+        uint8_t block[RZX_INPUT_HEAD_LEN];
+        uint32_t start = f.position();
+        readBlockFile(f, block, 5);
+        uint32_t len = getDword(block + 1);
+        // a recording cut short has no input block length yet
+        if (len == 0 && block[0] == RZX_BLOCK_INPUT)
+            len = file_size - start;
+        if (len < 5 || start + len > file_size)
+            break;
+
+        if (block[0] == RZX_BLOCK_SNAPSHOT && !loaded && len > RZX_SNAPSHOT_HEAD_LEN) {
+            readBlockFile(f, block + 5, RZX_SNAPSHOT_HEAD_LEN - 5);
+            uint32_t flags = getDword(block + 5);
+            if ((flags & (RZX_SNAP_EXTERNAL | RZX_SNAP_COMPRESSED)) || strncasecmp((char*)block + 9, "szx", 3) != 0) {
+                Serial.printf("FileRZX::play: unsupported snapshot (%.3s, flags %u)\n", (char*)block + 9, flags);
+                break;
+            }
+            if (!FileSZX::load(f, len - RZX_SNAPSHOT_HEAD_LEN))
+                break;
+            loaded = true;
+        }
+        else if (block[0] == RZX_BLOCK_INPUT && loaded && len >= RZX_INPUT_HEAD_LEN) {
+            readBlockFile(f, block + 5, RZX_INPUT_HEAD_LEN - 5);
+            uint32_t flags = getDword(block + 14);
+            uint32_t dataLen = len - RZX_INPUT_HEAD_LEN;
+            playFrames = getDword(block + 5);
+            if (playFrames == 0) playFrames = 0xFFFFFFFF;
+            if (flags & RZX_INPUT_COMPRESSED) {
+                Serial.println("FileRZX::play: compressed input blocks are not supported");
+                break;
+            }
+            if (dataLen > RZX_PLAY_MEMORY) {
+                Serial.printf("FileRZX::play: input block of %u bytes is too large\n", dataLen);
+                break;
+            }
+            if (playData != NULL) free(playData);
+            playData = (uint8_t*)ps_malloc(dataLen + 1);
+            if (playData == NULL || readBlockFile(f, playData, dataLen) != dataLen)
+                break;
+            playLen = dataLen;
+            ok = true;
+            break;
+        }
+        // creator and anything else is skipped
+        f.seek(start + len);
+    }
+    f.close();
+    KB_INT_START;
+
+    if (!ok) {
+        Serial.printf("FileRZX::play: no playable recording in %s\n", rzx_fn.c_str());
+        return false;
+    }
+
+    filename = rzx_fn;
+    playPos = 0;
+    frameCount = 0;
+    desyncCount = 0;
+    fetches = 0;
+    ended = false;
+    if (!nextFrame()) {
+        Serial.printf("FileRZX::play: %s has no frames\n", rzx_fn.c_str());
+        return false;
+    }
+
+    Serial.printf("FileRZX: playing %s, %u bytes of input, loaded in %u us\n", filename.c_str(),
+        playLen, (unsigned)(micros() - ts_start));
+    playing = true;
+    return true;
+}
+
+// set up the port reads of the next recorded frame
+bool FileRZX::nextFrame()
+{
+    if (frameCount >= playFrames || playPos + 4 > playLen)
+        return false;
+
+    fetchesRecorded = getWord(playData + playPos);
+    uint16_t n = getWord(playData + playPos + 2);
+    playPos += 4;
+    // a repeated frame keeps the values of the one before
+    if (n != RZX_REPEAT_INPUTS) {
+        if (playPos + n > playLen)
+            return false;
+        inValues = playData + playPos;
+        inCount = n;
+        playPos += n;
+    }
+    inPos = 0;
+    return true;
+}
+
+bool FileRZX::pollEnded()
+{
+    bool result = ended;
+    ended = false;
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint8_t FileRZX::input(uint8_t portLow, uint8_t portHigh)
+{
+    if (playing) {
+        if (inPos < inCount)
+            return inValues[inPos++];
+        // more reads than recorded: out of sync, let the ports answer
+        inPos++;
+        return Ports::input(portLow, portHigh);
+    }
+
+    uint8_t value = Ports::input(portLow, portHigh);
+    if (inCount < RZX_FRAME_MAX_INPUTS)
+        frameIn[current][inCount++] = value;
+    else
+        dropped++;
+    return value;
+}
+
+void FileRZX::endFrame()
+{
+    if (recording) {
+        uint32_t cycles = ESP.getCycleCount();
+
+        bool repeat = inCount > 0 && inCount == lastCount
+                   && memcmp(frameIn[current], frameIn[current ^ 1], inCount) == 0;
+        uint16_t size = 4 + (repeat ? 0 : inCount);
+
+        if (fill + size > RZX_REC_BUFFER_SIZE) {
+            uint8_t other = active ^ 1;
+            // the writer is late: write its buffer from here, the input
+            // cannot be dropped without spoiling the recording
+            if (pendingSize[other] != 0) {
+                stalls++;
+                writePending();
+            }
+            pendingSize[active] = fill;
+            active = other;
+            fill = 0;
+            if (writerTaskHandle != NULL)
+                xTaskNotifyGive(writerTaskHandle);
+        }
+
+        uint8_t* p = buffer[active] + fill;
+        putWord(p, fetches);
+        if (repeat) {
+            putWord(p + 2, RZX_REPEAT_INPUTS);
+            repeated++;
+        }
+        else {
+            putWord(p + 2, inCount);
+            memcpy(p + 4, frameIn[current], inCount);
+            lastCount = inCount;
+            current ^= 1;
+        }
+        fill += size;
+        inputBytes += size;
+        inCount = 0;
+        frameCount++;
+
+        emuCycles += ESP.getCycleCount() - cycles;
+    }
+    else if (playing) {
+        if (inPos != inCount || (uint16_t)fetches != fetchesRecorded) {
+            if (desyncCount == 0)
+                Serial.printf("FileRZX: out of sync at frame %u: %u fetches, %u port reads, recorded %u and %u\n",
+                    frameCount, fetches, inPos, fetchesRecorded, inCount);
+            desyncCount++;
+        }
+        frameCount++;
+        if (!nextFrame()) {
+            stop();
+            ended = true;
+        }
+    }
+    fetches = 0;
+}
+
+void FileRZX::stop()
+{
+    if (playing) {
+        playing = false;
+        free(playData);
+        playData = NULL;
+        Serial.printf("FileRZX: played %u frames of %s, %u out of sync\n", frameCount, filename.c_str(), desyncCount);
+        return;
+    }
+    if (!recording) return;
+
+    KB_INT_STOP;
+    recording = false;
+
+    // write the buffer already handed over first, then the active one
+    writePending();
+    pendingSize[active] = fill;
+    writePending();
+    fill = 0;
+
+    // the input block length and frame count are only known now
+    uint32_t end = rzxFile.position();
+    uint8_t patch[8];
+    putDword(patch, RZX_INPUT_HEAD_LEN + inputBytes);
+    putDword(patch + 4, frameCount);
+    rzxFile.seek(inputBlockStart + 1);
+    writeBlockFile(patch, rzxFile, sizeof(patch));
+    rzxFile.seek(end);
+    rzxFile.close();
+    KB_INT_START;
+
+    uint32_t cpuMHz = ESP.getCpuFreqMHz();
+    uint32_t cyclesPerFrame = frameCount ? emuCycles / frameCount : 0;
+    Serial.printf("FileRZX: saved %s\n", filename.c_str());
+    Serial.printf("  %u frames (%u repeating the one before), %u bytes of input, %u reads dropped\n",
+        frameCount, repeated, inputBytes, dropped);
+    Serial.printf("  emulation side: %u cycles/frame (%u.%02u us/frame), %u writer stalls\n",
+        cyclesPerFrame, cyclesPerFrame / cpuMHz, (cyclesPerFrame % cpuMHz) * 100 / cpuMHz, stalls);
+}
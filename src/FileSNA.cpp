@@ -35,10 +35,12 @@
 #include "ESPectrum.h"
 #include "messages.h"
 #include "osd.h"
+#include "VFS.h"
 #include <FS.h>
 #include "Wiimote2Keys.h"
 #include "Config.h"
 #include "FileSNA.h"
+#include "BetaDisk.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -145,28 +147,9 @@ extern Z80_STATE _zxCpu;
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifdef USE_INT_FLASH
-// using internal storage (spi flash)
-#include <SPIFFS.h>
-// set The Filesystem to SPIFFS
-#define THE_FS SPIFFS
-#endif
-
-///////////////////////////////////////////////////////////////////////////////
-
-#ifdef USE_SD_CARD
-// using external storage (SD card)
-#include <SD.h>
-// set The Filesystem to SD
-#define THE_FS SD
-#endif
-
-///////////////////////////////////////////////////////////////////////////////
-
 bool FileSNA::load(String sna_fn)
 {
     File file;
-    uint16_t retaddr;
     int sna_size;
     ESPectrum::reset();
 
@@ -187,6 +170,7 @@ bool FileSNA::load(String sna_fn)
     }
 
     String snapshotArch = "48K";
+    bool trdosPaged = false;
 
     Mem::bankLatch = 0;
     Mem::pagingLock = 1;
@@ -249,7 +233,7 @@ bool FileSNA::load(String sna_fn)
         // copy what was read into page 0 to correct page
         memcpy(Mem::ram[tmp_latch], Mem::ram[0], 0x4000);
 
-        uint8_t tr_dos = readByteFile(file);     // unused
+        trdosPaged = readByteFile(file) == 1;
         
         // read remaining pages
         for (int page = 0; page < 8; page++) {
@@ -267,6 +251,7 @@ bool FileSNA::load(String sna_fn)
 
     }
     file.close();
+    Mem::markAllDirty();
 
     // just architecturey things
     if (Config::getArch() == "128K")
@@ -290,16 +275,59 @@ bool FileSNA::load(String sna_fn)
         }
     }
 
+    // after any machine switch, which pages it out
+    BetaDisk::page(trdosPaged);
+
     KB_INT_START;
     return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool FileSNA::loadScreen(String sna_fn, uint8_t* screen)
+{
+    KB_INT_STOP;
+    File file = VFS::open(sna_fn, FILE_READ);
+    if (!file || file.size() < SNA_48K_SIZE) {
+        KB_INT_START;
+        return false;
+    }
+
+    // page 5, right after the header
+    uint32_t offset = 27;
+
+    if (file.size() > SNA_48K_SIZE) {
+        file.seek(SNA_48K_SIZE + 2);
+        uint8_t tmp_port = readByteFile(file);
+        uint8_t tmp_latch = tmp_port & 0x07;
+        if (bitRead(tmp_port, 3)) {
+            // shadow screen in page 7, either at 0xC000 or in the remaining pages
+            if (tmp_latch == 7) {
+                offset = 27 + 0x8000;
+            }
+            else {
+                offset = SNA_48K_SIZE + 4;
+                for (int page = 0; page < 7; page++)
+                    if (page != tmp_latch && page != 2 && page != 5)
+                        offset += 0x4000;
+            }
+        }
+    }
+
+    file.seek(offset);
+    bool ok = readBlockFile(file, screen, 6912) == 6912;
+    file.close();
+
+    KB_INT_START;
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 bool FileSNA::isPersistAvailable()
 {
     String filename = DISK_PSNA_FILE;
-    return THE_FS.exists(filename.c_str());
+    return VFS::exists(filename);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -369,7 +397,7 @@ bool FileSNA::save(String sna_file, bool blockMode) {
     KB_INT_STOP;
 
     // open file
-    File file = THE_FS.open(sna_file, FILE_WRITE);
+    File file = VFS::open(sna_file, FILE_WRITE);
     if (!file) {
         Serial.printf("FileSNA::save: failed to open %s for writing\n", sna_file.c_str());
         KB_INT_START;
@@ -439,7 +467,7 @@ bool FileSNA::save(String sna_file, bool blockMode) {
         bitWrite(tmp_port, 5, Mem::pagingLock);
         writeByteFile(tmp_port, file);
 
-        writeByteFile(0, file);     // TR-DOS not paged
+        writeByteFile(BetaDisk::active ? 1 : 0, file);     // TR-DOS paged in
 
         // write remaining ram pages
         for (int page = 0; page < 8; page++) {
@@ -460,61 +488,6 @@ bool FileSNA::save(String sna_file, bool blockMode) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-static uint8_t* quick_sna_buffer = NULL;
-static uint32_t quick_sna_size   = 0;
-
-bool FileSNA::isQuickAvailable()
-{
-    return quick_sna_buffer != NULL;
-}
-
-bool FileSNA::saveQuick()
-{
-    KB_INT_STOP;
-
-    // deallocate buffer if it does not fit required size
-    if (quick_sna_buffer != NULL)
-    {
-        if (quick_sna_size == SNA_48K_SIZE && Config::getArch() != "48K") {
-            free(quick_sna_buffer);
-            quick_sna_buffer = NULL;
-            quick_sna_size = 0;
-        }
-        else if (quick_sna_size != SNA_48K_SIZE && Config::getArch() == "48K") {
-            free(quick_sna_buffer);
-            quick_sna_buffer = NULL;
-            quick_sna_size = 0;
-        }
-    } 
-
-    // allocate buffer it not allocated
-    if (quick_sna_buffer == NULL)
-    {
-        uint32_t requested_sna_size = 0;
-        if (Config::getArch() == "48K")
-            requested_sna_size = SNA_48K_SIZE;
-        else
-            requested_sna_size = SNA_128K_SIZE2;
-
-        #ifdef BOARD_HAS_PSRAM
-            quick_sna_buffer = (uint8_t*)ps_calloc(1, requested_sna_size);
-        #else
-            quick_sna_buffer = (uint8_t*)calloc(1, requested_sna_size);
-        #endif
-        if (quick_sna_buffer == NULL) {
-            Serial.printf("FileSNA::saveQuick: cannot allocate %d bytes for snapshot buffer\n", requested_sna_size);
-            KB_INT_START;
-            return false;
-        }
-        quick_sna_size = requested_sna_size;
-        Serial.printf("saveQuick: allocated %d bytes for snapshot buffer\n", quick_sna_size);
-    }
-
-    bool result = saveToMem(quick_sna_buffer, quick_sna_size);
-    KB_INT_START;
-    return result;
-}
-
 bool FileSNA::saveToMem(uint8_t* dstBuffer, uint32_t size)
 {
     uint8_t* snaptr = dstBuffer;
@@ -578,7 +551,7 @@ bool FileSNA::saveToMem(uint8_t* dstBuffer, uint32_t size)
         bitWrite(tmp_port, 5, Mem::pagingLock);
         writeByteMem(tmp_port, snaptr);
 
-        writeByteMem(0, snaptr);     // TR-DOS not paged
+        writeByteMem(BetaDisk::active ? 1 : 0, snaptr);     // TR-DOS paged in
 
         // write remaining ram pages
         for (int page = 0; page < 8; page++) {
@@ -593,29 +566,12 @@ bool FileSNA::saveToMem(uint8_t* dstBuffer, uint32_t size)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool FileSNA::loadQuick()
-{
-    KB_INT_STOP;
-
-    if (NULL == quick_sna_buffer) {
-        // nothing to read
-        Serial.println("FileSNA::loadQuick(): nothing to load");
-        KB_INT_START;
-        return false;
-    }
-
-    bool result = loadFromMem(quick_sna_buffer, quick_sna_size);
-    KB_INT_START;
-    return result;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-
 bool FileSNA::loadFromMem(uint8_t* srcBuffer, uint32_t size)
 {
     uint8_t* snaptr = srcBuffer;
 
     String snapshotArch = "48K";
+    bool trdosPaged = false;
 
     Mem::bankLatch = 0;
     Mem::pagingLock = 1;
@@ -677,7 +633,7 @@ bool FileSNA::loadFromMem(uint8_t* srcBuffer, uint32_t size)
         // copy what was read into page 0 to correct page
         memcpy(Mem::ram[tmp_latch], Mem::ram[0], 0x4000);
 
-        uint8_t tr_dos = readByteMem(snaptr);     // unused
+        trdosPaged = readByteMem(snaptr) == 1;
         
         // read remaining pages
         for (int page = 0; page < 8; page++) {
@@ -693,6 +649,7 @@ bool FileSNA::loadFromMem(uint8_t* srcBuffer, uint32_t size)
         Mem::bankLatch = tmp_latch;
         Mem::romInUse = Mem::romLatch;
     }
+    Mem::markAllDirty();
 
     // just architecturey things
     if (Config::getArch() == "128K")
@@ -716,6 +673,9 @@ bool FileSNA::loadFromMem(uint8_t* srcBuffer, uint32_t size)
         }
     }
 
+    // after any machine switch, which pages it out
+    BetaDisk::page(trdosPaged);
+
     return true;
 }
 
@@ -0,0 +1,728 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "FileSZX.h"
+#include <FS.h>
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "CPU.h"
+#include "Mem.h"
+#include "ESPectrum.h"
+#include "Wiimote2Keys.h"
+#include "Config.h"
+#include "AySound.h"
+#include "Inflater.h"
+#include "Deflater.h"
+#include "VFS.h"
+#include "Ports.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef CPU_LINKEFONG
+#include "Z80_LKF/z80emu.h"
+extern Z80_STATE _zxCpu;
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef CPU_JLSANCHEZ
+#include "Z80_JLS/z80.h"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// chunks
+
+#define SZX_ID(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define SZX_ID_ZXST SZX_ID('Z', 'X', 'S', 'T')
+#define SZX_ID_CRTR SZX_ID('C', 'R', 'T', 'R')
+#define SZX_ID_Z80R SZX_ID('Z', '8', '0', 'R')
+#define SZX_ID_SPCR SZX_ID('S', 'P', 'C', 'R')
+#define SZX_ID_AY   SZX_ID('A', 'Y',  0,   0 )
+#define SZX_ID_RAMP SZX_ID('R', 'A', 'M', 'P')
+
+#define SZX_CRTR_LEN 36
+#define SZX_Z80R_LEN 37
+#define SZX_SPCR_LEN 8
+#define SZX_AY_LEN   18
+
+// Z80R flags
+#define SZX_Z80R_EILAST 0x01
+#define SZX_Z80R_HALTED 0x02
+
+// RAMP flags
+#define SZX_RAMP_COMPRESSED 0x0001
+
+// AY flags
+#define SZX_AY_128AY 0x02
+
+static uint16_t getWord(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t getDword(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putWord(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void putDword(uint8_t* p, uint32_t value) {
+    putWord(p, value & 0xFFFF);
+    putWord(p + 2, value >> 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// arch and rom set for a machine id, false if not supported
+static bool machineFromId(uint8_t machineId, String& arch, String& romSet)
+{
+    switch (machineId) {
+    case SZX_MID_48K:
+        arch = "48K";
+        // any 48K rom set will do
+        romSet = (Config::getArch() == "48K") ? Config::getRomSet() : String("SINCLAIR");
+        return true;
+    case SZX_MID_128K:
+    case SZX_MID_PLUS2:
+        arch = "128K";
+        romSet = "SINCLAIR";
+        return true;
+    case SZX_MID_PLUS2A:
+        arch = "128K";
+        romSet = "PLUS2A";
+        return true;
+    case SZX_MID_PLUS3:
+        arch = "128K";
+        romSet = "PLUS3";
+        return true;
+    case SZX_MID_PLUS3E:
+        arch = "128K";
+        romSet = "PLUS3E";
+        return true;
+    }
+    return false;
+}
+
+static uint8_t machineToId()
+{
+    if (Config::getArch() == "48K") return SZX_MID_48K;
+    // a +2A / +3 set without its four ROMs runs as a 128K
+    if (!Ports::plus2A) return SZX_MID_128K;
+    if (Config::getRomSet() == "PLUS2A") return SZX_MID_PLUS2A;
+    if (Config::getRomSet() == "PLUS3") return SZX_MID_PLUS3;
+    if (Config::getRomSet() == "PLUS3E") return SZX_MID_PLUS3E;
+    return SZX_MID_128K;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void loadZ80R(const uint8_t* z80r)
+{
+#ifdef CPU_LINKEFONG
+    _zxCpu.registers.byte[Z80_F]  =         z80r[0];
+    _zxCpu.registers.byte[Z80_A]  =         z80r[1];
+    _zxCpu.registers.word[Z80_BC] = getWord(z80r + 2);
+    _zxCpu.registers.word[Z80_DE] = getWord(z80r + 4);
+    _zxCpu.registers.word[Z80_HL] = getWord(z80r + 6);
+    _zxCpu.alternates    [Z80_AF] = getWord(z80r + 8);
+    _zxCpu.alternates    [Z80_BC] = getWord(z80r + 10);
+    _zxCpu.alternates    [Z80_DE] = getWord(z80r + 12);
+    _zxCpu.alternates    [Z80_HL] = getWord(z80r + 14);
+    _zxCpu.registers.word[Z80_IX] = getWord(z80r + 16);
+    _zxCpu.registers.word[Z80_IY] = getWord(z80r + 18);
+    _zxCpu.registers.word[Z80_SP] = getWord(z80r + 20);
+    _zxCpu.pc                     = getWord(z80r + 22);
+    _zxCpu.i                      =         z80r[24];
+    _zxCpu.r                      =         z80r[25];
+    _zxCpu.iff1                   =         z80r[26] ? 1 : 0;
+    _zxCpu.iff2                   =         z80r[27] ? 1 : 0;
+    _zxCpu.im                     =         z80r[28] & 0x03;
+    _zxCpu.halted                 =        (z80r[34] & SZX_Z80R_HALTED) ? true : false;
+#endif // CPU_LINKEFONG
+
+#ifdef CPU_JLSANCHEZ
+    Z80::setFlags (        z80r[0]);
+    Z80::setRegA  (        z80r[1]);
+    Z80::setRegBC (getWord(z80r + 2));
+    Z80::setRegDE (getWord(z80r + 4));
+    Z80::setRegHL (getWord(z80r + 6));
+    Z80::setRegAFx(getWord(z80r + 8));
+    Z80::setRegBCx(getWord(z80r + 10));
+    Z80::setRegDEx(getWord(z80r + 12));
+    Z80::setRegHLx(getWord(z80r + 14));
+    Z80::setRegIX (getWord(z80r + 16));
+    Z80::setRegIY (getWord(z80r + 18));
+    Z80::setRegSP (getWord(z80r + 20));
+    Z80::setRegPC (getWord(z80r + 22));
+    Z80::setRegI  (        z80r[24]);
+    Z80::setRegR  (        z80r[25]);
+    Z80::setIFF1  (        z80r[26] ? true : false);
+    Z80::setIFF2  (        z80r[27] ? true : false);
+    Z80::setIM((Z80::IntMode)(z80r[28] & 0x03));
+    Z80::setPendingEI     ((z80r[34] & SZX_Z80R_EILAST) ? true : false);
+    Z80::setHalted        ((z80r[34] & SZX_Z80R_HALTED) ? true : false);
+    Z80::setMemPtr(getWord(z80r + 35));
+#endif // CPU_JLSANCHEZ
+
+    // resume at the same point of the frame
+    uint32_t cyclesStart = getDword(z80r + 29);
+    CPU::nextFrameStart = (cyclesStart < CPU::statesPerFrame()) ? cyclesStart : 0;
+}
+
+static void saveZ80R(uint8_t* z80r)
+{
+    memset(z80r, 0, SZX_Z80R_LEN);
+
+#ifdef CPU_LINKEFONG
+    z80r[0] = _zxCpu.registers.byte[Z80_F];
+    z80r[1] = _zxCpu.registers.byte[Z80_A];
+    putWord(z80r + 2,  _zxCpu.registers.word[Z80_BC]);
+    putWord(z80r + 4,  _zxCpu.registers.word[Z80_DE]);
+    putWord(z80r + 6,  _zxCpu.registers.word[Z80_HL]);
+    putWord(z80r + 8,  _zxCpu.alternates[Z80_AF]);
+    putWord(z80r + 10, _zxCpu.alternates[Z80_BC]);
+    putWord(z80r + 12, _zxCpu.alternates[Z80_DE]);
+    putWord(z80r + 14, _zxCpu.alternates[Z80_HL]);
+    putWord(z80r + 16, _zxCpu.registers.word[Z80_IX]);
+    putWord(z80r + 18, _zxCpu.registers.word[Z80_IY]);
+    putWord(z80r + 20, _zxCpu.registers.word[Z80_SP]);
+    putWord(z80r + 22, _zxCpu.pc);
+    z80r[24] = _zxCpu.i;
+    z80r[25] = _zxCpu.r;
+    z80r[26] = _zxCpu.iff1 ? 1 : 0;
+    z80r[27] = _zxCpu.iff2 ? 1 : 0;
+    z80r[28] = _zxCpu.im & 0x03;
+    if (_zxCpu.halted) z80r[34] |= SZX_Z80R_HALTED;
+#endif // CPU_LINKEFONG
+
+#ifdef CPU_JLSANCHEZ
+    z80r[0] = Z80::getFlags();
+    z80r[1] = Z80::getRegA();
+    putWord(z80r + 2,  Z80::getRegBC());
+    putWord(z80r + 4,  Z80::getRegDE());
+    putWord(z80r + 6,  Z80::getRegHL());
+    putWord(z80r + 8,  Z80::getRegAFx());
+    putWord(z80r + 10, Z80::getRegBCx());
+    putWord(z80r + 12, Z80::getRegDEx());
+    putWord(z80r + 14, Z80::getRegHLx());
+    putWord(z80r + 16, Z80::getRegIX());
+    putWord(z80r + 18, Z80::getRegIY());
+    putWord(z80r + 20, Z80::getRegSP());
+    putWord(z80r + 22, Z80::getRegPC());
+    z80r[24] = Z80::getRegI();
+    z80r[25] = Z80::getRegR();
+    z80r[26] = Z80::isIFF1() ? 1 : 0;
+    z80r[27] = Z80::isIFF2() ? 1 : 0;
+    z80r[28] = Z80::getIM() & 0x03;
+    if (Z80::isPendingEI()) z80r[34] |= SZX_Z80R_EILAST;
+    if (Z80::isHalted()) z80r[34] |= SZX_Z80R_HALTED;
+    putWord(z80r + 35, Z80::getMemPtr());
+#endif // CPU_JLSANCHEZ
+
+    // snapshots are taken between frames: T-states run past the end of
+    // the frame are where the next one starts
+    putDword(z80r + 29, CPU::tstates % CPU::statesPerFrame());
+    // length of the interrupt signal
+    z80r[33] = 32;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// machine state chunks; data holds at least the chunk's fixed size
+static void applyChunk(uint32_t id, const uint8_t* data, bool is128K)
+{
+    if (id == SZX_ID_Z80R) {
+        loadZ80R(data);
+    }
+    else if (id == SZX_ID_SPCR) {
+        // the last 0xFE write puts the speaker and MIC levels back, then
+        // the border is taken from its own byte
+        Ports::output(0xFE, 0xFF, data[3]);
+        ESPectrum::borderColor = data[0] & 0x07;
+        if (is128K) {
+            uint8_t b7ffd = data[1];
+            Mem::bankLatch = b7ffd & 0x07;
+            Mem::videoLatch = bitRead(b7ffd, 3);
+            Mem::romLatch = bitRead(b7ffd, 4);
+            Mem::pagingLock = bitRead(b7ffd, 5);
+            // 0x1FFD only exists with a four ROM +2A / +3 set loaded, as
+            // for .z80 files: a plain 128K has no ROM 2 and 3 to select
+            uint8_t b1ffd = Ports::plus2A ? data[2] : 0;
+            Mem::modeSP3 = bitRead(b1ffd, 0);
+            Mem::romSP3 = bitRead(b1ffd, 2);
+        }
+    }
+#ifdef USE_AY_SOUND
+    else if (id == SZX_ID_AY) {
+        for (uint8_t reg = 0; reg < 16; reg++)
+            AySound::chip[0].writeRegister(reg, data[2 + reg]);
+        AySound::chip[0].selectRegister(data[1]);
+    }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FileSZX::load(String szx_fn)
+{
+    KB_INT_STOP;
+
+    if (szx_fn != DISK_PSNA_FILE)
+        loadKeytableForGame(szx_fn.c_str());
+
+    Serial.println("FileSZX::load");
+    uint32_t ts_start = micros();
+    File f = FileUtils::safeOpenFileRead(szx_fn);
+    uint32_t file_size = f.size();
+
+    bool ok = load(f, file_size);
+    f.close();
+    if (ok)
+        Serial.printf("FileSZX::load: %u bytes in %u us\n", file_size, (unsigned)(micros() - ts_start));
+    else
+        Serial.printf("FileSZX::load: failed on %s\n", szx_fn.c_str());
+
+    delay(100);
+
+    KB_INT_START;
+
+    return ok;
+}
+
+bool FileSZX::load(File f, uint32_t size)
+{
+    uint32_t end = f.position() + size;
+
+    uint8_t header[8];
+    if (readBlockFile(f, header, 8) != 8 || getDword(header) != SZX_ID_ZXST || header[4] != SZX_MAJOR_VERSION) {
+        Serial.println("FileSZX::load: not a zx-state file");
+        return false;
+    }
+
+    String fileArch, fileRomSet;
+    if (!machineFromId(header[6], fileArch, fileRomSet)) {
+        Serial.printf("FileSZX::load: unsupported machine id %d\n", header[6]);
+        return false;
+    }
+
+    // switch machine first, as it reloads the ROM
+    bool keep128K = false;
+    if (fileArch == "48K" && Config::getArch() == "128K") {
+#ifdef SNAPSHOT_LOAD_FORCE_ARCH
+        Config::requestMachine(fileArch, fileRomSet, true);
+#else
+        // run it with the 48K ROM of the 128K machine
+        keep128K = true;
+#endif
+    }
+    else if (Config::getArch() != fileArch || (fileArch == "128K" && Config::getRomSet() != fileRomSet))
+        Config::requestMachine(fileArch, fileRomSet, true);
+
+    // defaults for chunks not present
+    Mem::romLatch = 0;
+    Mem::bankLatch = 0;
+    Mem::videoLatch = 0;
+    Mem::pagingLock = (fileArch == "48K") ? 1 : 0;
+    Mem::modeSP3 = 0;
+    Mem::romSP3 = 0;
+    CPU::nextFrameStart = 0;
+
+    bool ok = true;
+    uint8_t pages = 0;
+    // large enough for every fixed size chunk we read
+    uint8_t data[40];
+
+    while (f.position() + 8 <= end) {
+        uint8_t chunkHeader[8];
+        readBlockFile(f, chunkHeader, 8);
+        uint32_t id = getDword(chunkHeader);
+        uint32_t size = getDword(chunkHeader + 4);
+        uint32_t next = f.position() + size;
+
+        if (id == SZX_ID_RAMP && size >= 3) {
+            readBlockFile(f, data, 3);
+            uint16_t flags = getWord(data);
+            uint8_t page = data[2];
+            if (page < 8) {
+                int32_t len;
+                if (flags & SZX_RAMP_COMPRESSED)
+                    len = Inflater::inflateZlib(f, size - 3, Mem::ram[page], 0x4000);
+                else
+                    len = readBlockFile(f, Mem::ram[page], size - 3 < 0x4000 ? size - 3 : 0x4000);
+                if (len != 0x4000) {
+                    Serial.printf("FileSZX::load: bad RAM page %d\n", page);
+                    ok = false;
+                }
+                pages++;
+            }
+        }
+        else if (id == SZX_ID_Z80R || id == SZX_ID_SPCR || id == SZX_ID_AY) {
+            memset(data, 0, sizeof(data));
+            readBlockFile(f, data, size < sizeof(data) ? size : sizeof(data));
+            applyChunk(id, data, fileArch == "128K");
+        }
+        // anything else (creator, unknown or unsupported hardware) is skipped
+
+        f.seek(next);
+    }
+
+    if (keep128K)
+        Mem::romInUse = 1;
+    else
+        Mem::romInUse = (fileArch == "48K") ? 0 : Mem::romLatch | (Mem::romSP3 << 1);
+
+    Mem::markAllDirty();
+
+    Serial.printf("FileSZX::load: %d pages\n", pages);
+    return ok;
+}
+
+bool FileSZX::loadScreen(String szx_fn, uint8_t* screen)
+{
+    KB_INT_STOP;
+    File f = VFS::open(szx_fn, FILE_READ);
+    uint8_t header[8];
+    if (!f || readBlockFile(f, header, 8) != 8 || getDword(header) != SZX_ID_ZXST) {
+        if (f) f.close();
+        KB_INT_START;
+        return false;
+    }
+
+    uint32_t file_size = f.size();
+    uint8_t screenPage = 5;
+    bool ok = false;
+
+    while (!ok && f.position() + 8 <= file_size) {
+        uint8_t chunkHeader[8];
+        readBlockFile(f, chunkHeader, 8);
+        uint32_t id = getDword(chunkHeader);
+        uint32_t size = getDword(chunkHeader + 4);
+        uint32_t next = f.position() + size;
+
+        if (id == SZX_ID_SPCR && size >= 2 && header[6] != SZX_MID_48K) {
+            // shadow screen in page 7
+            uint8_t spcr[2];
+            readBlockFile(f, spcr, 2);
+            if (bitRead(spcr[1], 3)) screenPage = 7;
+        }
+        else if (id == SZX_ID_RAMP && size >= 3) {
+            uint8_t ramp[3];
+            readBlockFile(f, ramp, 3);
+            if (ramp[2] == screenPage) {
+                if (getWord(ramp) & SZX_RAMP_COMPRESSED) {
+                    // the inflater needs room for the whole page
+                    uint8_t* page = (uint8_t*)malloc(0x4000);
+                    if (page) {
+                        ok = Inflater::inflateZlib(f, size - 3, page, 0x4000) == 0x4000;
+                        memcpy(screen, page, 6912);
+                        free(page);
+                    }
+                }
+                else {
+                    ok = size - 3 >= 6912 && readBlockFile(f, screen, 6912) == 6912;
+                }
+            }
+        }
+        f.seek(next);
+    }
+    f.close();
+
+    KB_INT_START;
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// RAMP chunk with a deflated page; the chunk size is only known afterwards,
+// so it is written when the page is done
+static bool writePage(File f, uint8_t page, const uint8_t* data)
+{
+    uint32_t start = f.position();
+    uint8_t ramp[11];
+    putDword(ramp, SZX_ID_RAMP);
+    putDword(ramp + 4, 0);
+    putWord(ramp + 8, SZX_RAMP_COMPRESSED);
+    ramp[10] = page;
+    if (writeBlockFile(ramp, f, 11) != 11) return false;
+
+    int32_t len = Deflater::deflateZlib(data, 0x4000, f);
+    if (len < 0) return false;
+
+    uint32_t end = f.position();
+    putDword(ramp + 4, len + 3);
+    f.seek(start + 4);
+    if (writeBlockFile(ramp + 4, f, 4) != 4) return false;
+    f.seek(end);
+    return true;
+}
+
+static void putChunk(SZXImage& image, uint32_t id, const uint8_t* data, uint32_t size)
+{
+    uint8_t* p = image.head + image.headLen;
+    putDword(p, id);
+    putDword(p + 4, size);
+    memcpy(p + 8, data, size);
+    image.headLen += 8 + size;
+}
+
+// the deflater is not reentrant, and writes may come from both cores
+static SemaphoreHandle_t writeMutex = NULL;
+
+void FileSZX::capture(SZXImage& image, uint8_t* pageCopies)
+{
+    if (writeMutex == NULL)
+        writeMutex = xSemaphoreCreateMutex();
+
+    bool is128K = (Config::getArch() == "128K");
+
+    putDword(image.head, SZX_ID_ZXST);
+    image.head[4] = SZX_MAJOR_VERSION;
+    image.head[5] = SZX_MINOR_VERSION;
+    image.head[6] = machineToId();
+    image.head[7] = 0;
+    image.headLen = 8;
+
+    uint8_t crtr[SZX_CRTR_LEN];
+    memset(crtr, 0, sizeof(crtr));
+    strncpy((char*)crtr, "ZX-ESPectrum", 32);
+    putChunk(image, SZX_ID_CRTR, crtr, sizeof(crtr));
+
+    uint8_t z80r[SZX_Z80R_LEN];
+    saveZ80R(z80r);
+    putChunk(image, SZX_ID_Z80R, z80r, sizeof(z80r));
+
+    uint8_t spcr[SZX_SPCR_LEN];
+    memset(spcr, 0, sizeof(spcr));
+    spcr[0] = ESPectrum::borderColor;
+    if (is128K) {
+        uint8_t b7ffd = Mem::bankLatch;
+        bitWrite(b7ffd, 3, Mem::videoLatch);
+        bitWrite(b7ffd, 4, Mem::romLatch);
+        bitWrite(b7ffd, 5, Mem::pagingLock);
+        spcr[1] = b7ffd;
+        uint8_t b1ffd = 0;
+        bitWrite(b1ffd, 0, Mem::modeSP3);
+        bitWrite(b1ffd, 2, Mem::romSP3);
+        spcr[2] = b1ffd;
+    }
+    spcr[3] = Ports::lastFE;
+    putChunk(image, SZX_ID_SPCR, spcr, sizeof(spcr));
+
+#ifdef USE_AY_SOUND
+    uint8_t ay[SZX_AY_LEN];
+    ay[0] = is128K ? 0 : SZX_AY_128AY;
+    ay[1] = AySound::chip[0].getSelectedRegister();
+    for (uint8_t reg = 0; reg < 16; reg++)
+        ay[2 + reg] = AySound::chip[0].readRegister(reg);
+    putChunk(image, SZX_ID_AY, ay, sizeof(ay));
+#endif
+
+    // 0x4000, 0x8000 and 0xC000 as mapped in 48K mode
+    static const uint8_t pages48[3] = { 5, 2, 0 };
+    image.pageCount = is128K ? 8 : 3;
+    for (uint8_t i = 0; i < image.pageCount; i++) {
+        uint8_t page = is128K ? i : pages48[i];
+        image.pageIds[i] = page;
+        if (pageCopies) {
+            memcpy(pageCopies + i * 0x4000, Mem::ram[page], 0x4000);
+            image.pages[i] = pageCopies + i * 0x4000;
+        }
+        else image.pages[i] = Mem::ram[page];
+    }
+}
+
+bool FileSZX::write(File f, const SZXImage& image)
+{
+    xSemaphoreTake(writeMutex, portMAX_DELAY);
+    bool ok = (writeBlockFile((uint8_t*)image.head, f, image.headLen) == image.headLen);
+    for (uint8_t i = 0; i < image.pageCount && ok; i++)
+        ok &= writePage(f, image.pageIds[i], image.pages[i]);
+    xSemaphoreGive(writeMutex);
+    return ok;
+}
+
+bool FileSZX::write(String szx_fn, const SZXImage& image)
+{
+    File f = VFS::open(szx_fn, FILE_WRITE);
+    if (!f) {
+        Serial.printf("FileSZX::write: failed to open %s for writing\n", szx_fn.c_str());
+        return false;
+    }
+
+    bool ok = write(f, image);
+    uint32_t file_size = f.position();
+    f.close();
+
+    if (!ok) {
+        Serial.printf("FileSZX::write: write error on %s\n", szx_fn.c_str());
+        return false;
+    }
+    Serial.printf("FileSZX::write: %s, %u bytes\n", szx_fn.c_str(), file_size);
+    return true;
+}
+
+bool FileSZX::restore(const SZXImage& image)
+{
+    // only states of the running machine, there is no ROM switch here
+    if (image.headLen < 8 || image.head[6] != machineToId())
+        return false;
+
+    bool is128K = (Config::getArch() == "128K");
+    Mem::romLatch = 0;
+    Mem::bankLatch = 0;
+    Mem::videoLatch = 0;
+    Mem::pagingLock = is128K ? 0 : 1;
+    Mem::modeSP3 = 0;
+    Mem::romSP3 = 0;
+    CPU::nextFrameStart = 0;
+
+    uint16_t pos = 8;
+    while (pos + 8 <= image.headLen) {
+        uint32_t id = getDword(image.head + pos);
+        uint32_t size = getDword(image.head + pos + 4);
+        applyChunk(id, image.head + pos + 8, is128K);
+        pos += 8 + size;
+    }
+    for (uint8_t i = 0; i < image.pageCount; i++) {
+        memcpy(Mem::ram[image.pageIds[i]], image.pages[i], 0x4000);
+        Mem::markPageDirty(image.pageIds[i]);
+    }
+
+    Mem::romInUse = is128K ? Mem::romLatch | (Mem::romSP3 << 1) : 0;
+    // frame position as CPU::loop() will resume, so capture() sees it too
+    CPU::tstates = CPU::nextFrameStart;
+    return true;
+}
+
+bool FileSZX::save(String szx_fn)
+{
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+
+    SZXImage image;
+    capture(image, NULL);
+    bool ok = write(szx_fn, image);
+
+    if (ok)
+        Serial.printf("FileSZX::save: %u us\n", (unsigned)(micros() - ts_start));
+
+    KB_INT_START;
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// background save
+
+static TaskHandle_t saveTaskHandle = NULL;
+static volatile uint8_t saveState = SZX_SAVE_IDLE;
+static SZXImage saveImage;
+static uint8_t* savePages = NULL;
+static String saveFn;
+static uint32_t saveStarted;
+
+static void saveTask(void* unused)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // the old snapshot stays intact until the new one is complete, and
+        // the new one is only left alone as .tmp once it is (recoverSave())
+        String tmp_fn = saveFn + ".tmp";
+        bool ok = FileSZX::write(tmp_fn, saveImage);
+        if (ok) {
+            // FAT rename does not replace an existing file
+            if (VFS::exists(saveFn))
+                VFS::remove(saveFn);
+            ok = VFS::rename(tmp_fn, saveFn);
+        }
+        else VFS::remove(tmp_fn);
+
+        Serial.printf("FileSZX::saveAsync: %s %s in %u ms\n", saveFn.c_str(),
+            ok ? "written" : "FAILED", (unsigned)(millis() - saveStarted));
+        saveState = ok ? SZX_SAVE_DONE : SZX_SAVE_FAILED;
+    }
+}
+
+bool FileSZX::saveAsync(String szx_fn)
+{
+    if (saveState == SZX_SAVE_BUSY)
+        return false;
+
+    // allocated on first use and kept, 128K worth of pages
+    if (savePages == NULL) {
+        savePages = (uint8_t*)ps_malloc(8 * 0x4000);
+        if (savePages == NULL) {
+            Serial.println("FileSZX::saveAsync: no memory for page copies");
+            return false;
+        }
+    }
+    if (saveTaskHandle == NULL)
+        xTaskCreatePinnedToCore(&saveTask, "szxSaveTask", 1024 * 4, NULL, 1, &saveTaskHandle, 0);
+
+    uint32_t ts_start = micros();
+    capture(saveImage, savePages);
+    Serial.printf("FileSZX::saveAsync: captured in %u us\n", (unsigned)(micros() - ts_start));
+
+    saveFn = szx_fn;
+    saveStarted = millis();
+    saveState = SZX_SAVE_BUSY;
+    xTaskNotifyGive(saveTaskHandle);
+    return true;
+}
+
+uint8_t FileSZX::pollSave()
+{
+    uint8_t state = saveState;
+    if (state == SZX_SAVE_DONE || state == SZX_SAVE_FAILED)
+        saveState = SZX_SAVE_IDLE;
+    return state;
+}
+
+void FileSZX::waitForSave()
+{
+    while (saveState == SZX_SAVE_BUSY)
+        delay(5);
+}
+
+bool FileSZX::recoverSave(String szx_fn)
+{
+    if (VFS::exists(szx_fn))
+        return true;
+    // no snapshot but a temporary file: the save was interrupted after the
+    // old one was removed, the temporary file was complete by then
+    String tmp_fn = szx_fn + ".tmp";
+    if (!VFS::exists(tmp_fn) || !VFS::rename(tmp_fn, szx_fn))
+        return false;
+    Serial.printf("FileSZX::recoverSave: %s restored from %s\n", szx_fn.c_str(), tmp_fn.c_str());
+    return true;
+}
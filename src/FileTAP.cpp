@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "FileTAP.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "CPU.h"
+#include "Mem.h"
+#include "VFS.h"
+#include <FS.h>
+
+#ifdef CPU_JLSANCHEZ
+#include "Z80_JLS/z80.h"
+#endif
+
+// block data is streamed through this buffer, never the whole file
+#define TAP_CHUNK_SIZE 512
+
+bool FileTAP::inserted = false;
+
+static File tapFile;
+static uint8_t chunk[TAP_CHUNK_SIZE];
+
+bool FileTAP::open(String tap_fn)
+{
+    close();
+    KB_INT_STOP;
+    tapFile = FileUtils::safeOpenFileRead(tap_fn);
+    KB_INT_START;
+    if (!tapFile) {
+        Serial.printf("FileTAP::open: cannot open %s\n", tap_fn.c_str());
+        return false;
+    }
+    Serial.printf("Tape inserted: %s (%u bytes)\n", tap_fn.c_str(), (unsigned)tapFile.size());
+    inserted = true;
+    return true;
+}
+
+void FileTAP::close()
+{
+    if (inserted)
+        tapFile.close();
+    inserted = false;
+}
+
+void FileTAP::rewind()
+{
+    if (inserted)
+        tapFile.seek(0);
+}
+
+bool FileTAP::isLoadBytes()
+{
+    // INC D; EX AF,AF'; DEC D; DI
+    return Mem::readbyte(ROM_LD_BYTES    ) == 0x14 && Mem::readbyte(ROM_LD_BYTES + 1) == 0x08 &&
+           Mem::readbyte(ROM_LD_BYTES + 2) == 0x15 && Mem::readbyte(ROM_LD_BYTES + 3) == 0xF3;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef CPU_JLSANCHEZ
+
+// LD-BYTES entry:  IX = destination, DE = length, A = expected flag byte,
+//                  carry set for LOAD, reset for VERIFY.
+// on return:       carry set if ok, IX and DE advanced past the loaded data,
+//                  H = parity accumulator, L = last byte read.
+bool FileTAP::trapLoadBytes()
+{
+    // only trap the genuine routine
+    if (!isLoadBytes())
+        return false;
+
+    // end of tape: let the ROM wait for a signal (BREAK still works)
+    if (tapFile.position() + 2 > tapFile.size())
+        return false;
+
+    KB_INT_STOP;
+
+    uint16_t blockLen = readWordFileLE(tapFile);
+    uint32_t blockEnd = tapFile.position() + blockLen;
+
+    uint8_t expectedFlag = Z80::getRegA();
+    bool verify = !(Z80::getRegAF() & 0x01);
+    uint16_t addr = Z80::getRegIX();
+    uint16_t length = Z80::getRegDE();
+
+    bool ok = false;
+    uint8_t parity = 0;
+    uint8_t data = 0;
+
+    if (blockLen > 0) {
+        data = readByteFile(tapFile);
+        parity = data;
+
+        if (data == expectedFlag) {
+            // the ROM reads DE bytes, then one more (the checksum) into the parity
+            uint16_t available = blockLen - 1;
+            uint16_t count = length < available ? length : available;
+            bool mismatch = false;
+
+            while (count > 0 && !mismatch) {
+                uint16_t n = count < TAP_CHUNK_SIZE ? count : TAP_CHUNK_SIZE;
+                n = readBlockFile(tapFile, chunk, n);
+                if (n == 0) break;
+                for (uint16_t i = 0; i < n; i++) {
+                    data = chunk[i];
+                    parity ^= data;
+                    if (verify) {
+                        if (Mem::readbyte(addr) != data) { mismatch = true; break; }
+                    }
+                    else Mem::writebyte(addr, data);
+                    addr++;
+                    length--;
+                }
+                count -= n;
+            }
+
+            if (!mismatch && length == 0 && available > (uint16_t)Z80::getRegDE()) {
+                data = readByteFile(tapFile);
+                parity ^= data;
+                ok = (parity == 0);
+            }
+        }
+    }
+
+    tapFile.seek(blockEnd);
+    KB_INT_START;
+
+    Z80::setRegIX(addr);
+    Z80::setRegDE(length);
+    Z80::setRegH(parity);
+    Z80::setRegL(data);
+    // as left by LD A,H / CP 01 at the end of LD-BYTES: carry set when parity is 0
+    Z80::setRegAF(ok ? 0x0093 : (parity << 8) | 0x02);
+    Z80::setRegPC(ROM_SA_LD_RET);
+
+    return true;
+}
+
+#else // !CPU_JLSANCHEZ
+
+bool FileTAP::trapLoadBytes()
+{
+    return false;
+}
+
+#endif // CPU_JLSANCHEZ
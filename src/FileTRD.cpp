@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "FileTRD.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "VFS.h"
+#include "ZipFS.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define TRD_ALLOC(size) ps_malloc(size)
+#else
+#define TRD_ALLOC(size) malloc(size)
+#endif
+
+// disk information, in sector 9 of track 0
+#define TRD_INFO_OFFSET 0x800
+#define TRD_INFO_FIRST_SECTOR 0xE1
+#define TRD_INFO_FIRST_TRACK 0xE2
+#define TRD_INFO_TYPE 0xE3
+#define TRD_INFO_FILES 0xE4
+#define TRD_INFO_FREE 0xE5
+#define TRD_INFO_ID 0xE7
+#define TRD_INFO_LABEL 0xF5
+
+// disk types
+#define TRD_TYPE_80_DS 0x16
+#define TRD_TYPE_40_DS 0x17
+#define TRD_TYPE_80_SS 0x18
+#define TRD_TYPE_40_SS 0x19
+
+#define SCL_HEADER_LEN 14
+#define SCL_MAX_FILES 128
+
+bool     FileTRD::inserted = false;
+bool     FileTRD::writeProtected = false;
+bool     FileTRD::changed = false;
+uint8_t  FileTRD::numTracks = 0;
+uint8_t  FileTRD::numSides = 0;
+String   FileTRD::fileName;
+uint8_t* FileTRD::image = NULL;
+uint32_t FileTRD::imageSize = 0;
+
+bool FileTRD::open(String trd_fn)
+{
+    close();
+    bool scl = trd_fn.endsWith(".scl") || trd_fn.endsWith(".SCL");
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    File f = VFS::open(trd_fn, FILE_READ);
+    if (!f) {
+        KB_INT_START;
+        Serial.printf("FileTRD::open: cannot open %s\n", trd_fn.c_str());
+        return false;
+    }
+    uint32_t size = f.size();
+    if ((!scl && size < TRD_TRACK_SIZE) || size > TRD_MAX_SIZE) {
+        f.close();
+        KB_INT_START;
+        Serial.printf("FileTRD::open: bad size %u for %s\n", size, trd_fn.c_str());
+        return false;
+    }
+    // room for a whole 80 track double sided disk, or more if the file has it
+    imageSize = 80 * 2 * TRD_TRACK_SIZE;
+    if (!scl && size > imageSize)
+        imageSize = (size + 2 * TRD_TRACK_SIZE - 1) / (2 * TRD_TRACK_SIZE) * (2 * TRD_TRACK_SIZE);
+    image = (uint8_t*)TRD_ALLOC(imageSize);
+    bool ok = image != NULL;
+    if (ok) {
+        memset(image, 0, imageSize);
+        if (scl) {
+            uint8_t* buf = (uint8_t*)TRD_ALLOC(size);
+            ok = buf != NULL && readBlockFile(f, buf, size) == size && loadSCL(buf, size);
+            free(buf);
+        }
+        else {
+            ok = readBlockFile(f, image, size) == size;
+        }
+    }
+    f.close();
+    KB_INT_START;
+    if (!ok) {
+        Serial.printf("FileTRD::open: %s is not a TR-DOS disk image\n", trd_fn.c_str());
+        free(image);
+        image = NULL;
+        return false;
+    }
+
+    // geometry from the disk type, grown to what the file holds
+    switch (image[TRD_INFO_OFFSET + TRD_INFO_TYPE]) {
+    case TRD_TYPE_40_DS: numTracks = 40; numSides = 2; break;
+    case TRD_TYPE_80_SS: numTracks = 80; numSides = 1; break;
+    case TRD_TYPE_40_SS: numTracks = 40; numSides = 1; break;
+    default:             numTracks = 80; numSides = 2; break;
+    }
+    uint32_t fileTracks = (size + numSides * TRD_TRACK_SIZE - 1) / (numSides * TRD_TRACK_SIZE);
+    if (fileTracks > numTracks)
+        numTracks = fileTracks > TRD_MAX_TRACKS ? TRD_MAX_TRACKS : fileTracks;
+    if ((uint32_t)numTracks * numSides * TRD_TRACK_SIZE > imageSize)
+        numTracks = imageSize / (numSides * TRD_TRACK_SIZE);
+
+    String archive, member;
+    writeProtected = scl || ZipFS::split(trd_fn, archive, member);
+    fileName = trd_fn;
+    changed = false;
+    inserted = true;
+    Serial.printf("Disk inserted: %s (%u tracks, %u sides) in %u us\n", trd_fn.c_str(),
+        numTracks, numSides, (unsigned)(micros() - ts_start));
+    return true;
+}
+
+// lay the files of an SCL image out on a blank disk as TR-DOS does: catalogue
+// in track 0, data from track 1 on
+bool FileTRD::loadSCL(const uint8_t* scl, uint32_t size)
+{
+    if (size < 9 || memcmp(scl, "SINCLAIR", 8) != 0) return false;
+    uint8_t files = scl[8];
+    uint32_t pos = 9 + files * SCL_HEADER_LEN;
+    if (files > SCL_MAX_FILES || pos > size) return false;
+
+    uint32_t sector = TRD_SECTORS;          // logical sector, after track 0
+    uint32_t total = imageSize / TRD_SECTOR_SIZE;
+    for (uint8_t i = 0; i < files; i++) {
+        const uint8_t* header = scl + 9 + i * SCL_HEADER_LEN;
+        uint8_t length = header[13];
+        if (pos + length * TRD_SECTOR_SIZE > size || sector + length > total) return false;
+        uint8_t* entry = image + i * 16;
+        memcpy(entry, header, SCL_HEADER_LEN);
+        entry[14] = sector % TRD_SECTORS;
+        entry[15] = sector / TRD_SECTORS;
+        memcpy(image + sector * TRD_SECTOR_SIZE, scl + pos, length * TRD_SECTOR_SIZE);
+        pos += length * TRD_SECTOR_SIZE;
+        sector += length;
+    }
+
+    uint8_t* info = image + TRD_INFO_OFFSET;
+    info[TRD_INFO_FIRST_SECTOR] = sector % TRD_SECTORS;
+    info[TRD_INFO_FIRST_TRACK] = sector / TRD_SECTORS;
+    info[TRD_INFO_TYPE] = TRD_TYPE_80_DS;
+    info[TRD_INFO_FILES] = files;
+    info[TRD_INFO_FREE] = (total - sector) & 0xFF;
+    info[TRD_INFO_FREE + 1] = (total - sector) >> 8;
+    info[TRD_INFO_ID] = 0x10;
+    memset(info + 0xEA, ' ', 9);
+    memset(info + TRD_INFO_LABEL, ' ', 8);
+    return true;
+}
+
+void FileTRD::close()
+{
+    if (!inserted) return;
+    flush();
+    free(image);
+    image = NULL;
+    inserted = false;
+}
+
+void FileTRD::flush()
+{
+    if (!inserted || !changed || writeProtected) return;
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+    uint32_t size = (uint32_t)numTracks * numSides * TRD_TRACK_SIZE;
+    File f = VFS::open(fileName, FILE_WRITE);
+    bool ok = f && writeBlockFile(image, f, size) == size;
+    if (f) f.close();
+    KB_INT_START;
+    if (ok) {
+        changed = false;
+        Serial.printf("FileTRD::flush: %s written in %u us\n", fileName.c_str(), (unsigned)(micros() - ts_start));
+    }
+    else {
+        Serial.printf("FileTRD::flush: cannot write %s\n", fileName.c_str());
+    }
+}
+
+uint8_t* FileTRD::sector(uint8_t track, uint8_t side, uint8_t sector)
+{
+    if (!inserted || track >= numTracks || side >= numSides || sector < 1 || sector > TRD_SECTORS)
+        return NULL;
+    return image + ((uint32_t)track * numSides + side) * TRD_TRACK_SIZE + (sector - 1) * TRD_SECTOR_SIZE;
+}
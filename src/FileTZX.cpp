@@ -0,0 +1,466 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "FileTZX.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "CPU.h"
+#include "Config.h"
+#include "VFS.h"
+#include <FS.h>
+
+#pragma GCC optimize ("O3")
+
+// TZX timings are given in T-states of a 3.5 MHz clock
+#define TZX_STATES_PER_MS 3500
+// "ZXTape!" 0x1A, major and minor version
+#define TZX_HEADER_SIZE 10
+
+bool FileTZX::inserted = false;
+bool FileTZX::playing = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// buffered reading
+
+static File tzxFile;
+static uint8_t buffer[TZX_BUFFER_SIZE];
+static uint32_t bufferFilePos = 0;      // file position of buffer[0]
+static uint16_t bufferPos = 0;
+static uint16_t bufferLen = 0;
+static bool endOfFile = false;
+
+static void refill()
+{
+    bufferFilePos += bufferLen;
+    KB_INT_STOP;
+    bufferLen = readBlockFile(tzxFile, buffer, TZX_BUFFER_SIZE);
+    KB_INT_START;
+    bufferPos = 0;
+    if (bufferLen == 0) endOfFile = true;
+}
+
+static inline uint8_t nextByte()
+{
+    if (bufferPos >= bufferLen) {
+        refill();
+        if (bufferLen == 0) return 0;
+    }
+    return buffer[bufferPos++];
+}
+
+static inline uint16_t nextWord()
+{
+    uint16_t lo = nextByte();
+    return lo | (nextByte() << 8);
+}
+
+static inline uint32_t next24()
+{
+    uint32_t lo = nextWord();
+    return lo | ((uint32_t)nextByte() << 16);
+}
+
+static inline uint32_t next32()
+{
+    uint32_t lo = nextWord();
+    return lo | ((uint32_t)nextWord() << 16);
+}
+
+static uint8_t peekByte()
+{
+    if (bufferPos >= bufferLen) refill();
+    return bufferLen ? buffer[bufferPos] : 0;
+}
+
+static uint32_t position()
+{
+    return bufferFilePos + bufferPos;
+}
+
+static void seekTo(uint32_t pos)
+{
+    if (pos >= bufferFilePos && pos < bufferFilePos + bufferLen) {
+        bufferPos = pos - bufferFilePos;
+        return;
+    }
+    KB_INT_STOP;
+    tzxFile.seek(pos);
+    KB_INT_START;
+    bufferFilePos = pos;
+    bufferPos = bufferLen = 0;
+    endOfFile = false;
+}
+
+static void skip(uint32_t count)
+{
+    seekTo(position() + count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// player state
+
+enum TZXPhase {
+    PHASE_NEXT_BLOCK,
+    PHASE_PILOT,
+    PHASE_SYNC1,
+    PHASE_SYNC2,
+    PHASE_DATA,
+    PHASE_TONE,
+    PHASE_SEQUENCE,
+    PHASE_DIRECT,
+    PHASE_PAUSE,
+    PHASE_PAUSE_LOW,
+    PHASE_STOP,
+    PHASE_END
+};
+
+static TZXPhase phase = PHASE_NEXT_BLOCK;
+static uint8_t level = 0;
+
+static uint64_t frameStart = 0;     // emulated T-states of current frame start
+static uint64_t playStart = 0;      // emulated T-states where playing started
+static uint64_t tapeTime = 0;       // 3.5 MHz T-states played since then
+static uint64_t nextEdge = 0;       // emulated T-states of next level change
+static uint32_t clockNum = 1;       // emulated T-states = tape T-states * num / den
+static uint32_t clockDen = 1;
+
+// current block parameters
+static uint16_t pilotLen, sync1Len, sync2Len, zeroLen, oneLen;
+static uint16_t pulsesLeft;
+static uint16_t pauseMillis;
+static uint16_t directLen;
+static uint8_t usedBits;
+static uint32_t bytesLeft;
+
+// data bits
+static uint8_t curByte;
+static uint8_t bitsLeft;
+static bool curBit;
+static uint8_t bitPulses;
+
+static uint32_t loopStart;
+static uint16_t loopCount;
+
+static inline void schedule(uint32_t len)
+{
+    tapeTime += len;
+    nextEdge = playStart + tapeTime * clockNum / clockDen;
+}
+
+// level changes now, next change after len
+static inline void edge(uint32_t len)
+{
+    level ^= 1;
+    schedule(len);
+}
+
+static bool nextBit()
+{
+    if (bitsLeft == 0) {
+        if (bytesLeft == 0) return false;
+        curByte = nextByte();
+        bytesLeft--;
+        bitsLeft = (bytesLeft == 0 && usedBits > 0 && usedBits < 8) ? usedBits : 8;
+    }
+    curBit = curByte & 0x80;
+    curByte <<= 1;
+    bitsLeft--;
+    return true;
+}
+
+static void startData()
+{
+    bitsLeft = 0;
+    bitPulses = 0;
+}
+
+// read next block header and set up its phase; false at end of tape
+static bool beginBlock()
+{
+    uint8_t id = nextByte();
+    if (endOfFile) return false;
+
+    switch (id) {
+    case 0x10:  // standard speed data
+        pauseMillis = nextWord();
+        bytesLeft = nextWord();
+        pilotLen = 2168; sync1Len = 667; sync2Len = 735;
+        zeroLen = 855; oneLen = 1710; usedBits = 8;
+        pulsesLeft = peekByte() < 0x80 ? 8063 : 3223;
+        phase = PHASE_PILOT;
+        break;
+    case 0x11:  // turbo speed data
+        pilotLen = nextWord(); sync1Len = nextWord(); sync2Len = nextWord();
+        zeroLen = nextWord(); oneLen = nextWord();
+        pulsesLeft = nextWord();
+        usedBits = nextByte();
+        pauseMillis = nextWord();
+        bytesLeft = next24();
+        phase = PHASE_PILOT;
+        break;
+    case 0x12:  // pure tone
+        pilotLen = nextWord();
+        pulsesLeft = nextWord();
+        phase = PHASE_TONE;
+        break;
+    case 0x13:  // pulse sequence
+        pulsesLeft = nextByte();
+        phase = PHASE_SEQUENCE;
+        break;
+    case 0x14:  // pure data
+        zeroLen = nextWord(); oneLen = nextWord();
+        usedBits = nextByte();
+        pauseMillis = nextWord();
+        bytesLeft = next24();
+        startData();
+        phase = PHASE_DATA;
+        break;
+    case 0x15:  // direct recording
+        directLen = nextWord();
+        pauseMillis = nextWord();
+        usedBits = nextByte();
+        bytesLeft = next24();
+        startData();
+        phase = PHASE_DIRECT;
+        break;
+    case 0x20:  // pause, or stop the tape
+        pauseMillis = nextWord();
+        phase = pauseMillis ? PHASE_PAUSE : PHASE_STOP;
+        break;
+    case 0x21:  // group start
+        skip(nextByte());
+        break;
+    case 0x22:  // group end
+    case 0x27:  // return from sequence
+        break;
+    case 0x23:  // jump to block (not supported, continue with next)
+        skip(2);
+        break;
+    case 0x24:  // loop start
+        loopCount = nextWord();
+        loopStart = position();
+        break;
+    case 0x25:  // loop end
+        if (loopCount > 1) {
+            loopCount--;
+            seekTo(loopStart);
+        }
+        break;
+    case 0x26:  // call sequence (not supported)
+        skip(nextWord() * 2);
+        break;
+    case 0x28:  // select block
+    case 0x32:  // archive info
+        skip(nextWord());
+        break;
+    case 0x2A:  // stop the tape if in 48K mode
+        skip(4);
+        if (Config::getArch() == "48K") phase = PHASE_STOP;
+        break;
+    case 0x2B:  // set signal level
+        skip(4);
+        level = nextByte() ? 1 : 0;
+        break;
+    case 0x30:  // text description
+        skip(nextByte());
+        break;
+    case 0x31:  // message
+        skip(1);
+        skip(nextByte());
+        break;
+    case 0x33:  // hardware type
+        skip(nextByte() * 3);
+        break;
+    case 0x35:  // custom info
+        skip(16);
+        skip(next32());
+        break;
+    case 0x5A:  // glue block
+        skip(9);
+        break;
+    default:
+        // blocks from TZX 1.10 onwards start with their length
+        Serial.printf("TZX: skipping unsupported block 0x%02X\n", id);
+        skip(next32());
+        break;
+    }
+    return !endOfFile;
+}
+
+// emulated time has reached nextEdge: change the level as the current
+// phase requires, and schedule the next change
+static void step()
+{
+    for (;;) {
+        switch (phase) {
+        case PHASE_PILOT:
+            if (pulsesLeft) { pulsesLeft--; edge(pilotLen); return; }
+            phase = PHASE_SYNC1;
+            // fall through
+        case PHASE_SYNC1:
+            phase = PHASE_SYNC2;
+            if (sync1Len) { edge(sync1Len); return; }
+            // fall through
+        case PHASE_SYNC2:
+            phase = PHASE_DATA;
+            startData();
+            if (sync2Len) { edge(sync2Len); return; }
+            // fall through
+        case PHASE_DATA:
+            if (bitPulses == 0) {
+                if (!nextBit()) { phase = PHASE_PAUSE; break; }
+                bitPulses = 2;
+            }
+            bitPulses--;
+            edge(curBit ? oneLen : zeroLen);
+            return;
+        case PHASE_TONE:
+            if (pulsesLeft) { pulsesLeft--; edge(pilotLen); return; }
+            phase = PHASE_NEXT_BLOCK;
+            break;
+        case PHASE_SEQUENCE:
+            if (pulsesLeft) { pulsesLeft--; edge(nextWord()); return; }
+            phase = PHASE_NEXT_BLOCK;
+            break;
+        case PHASE_DIRECT:
+            if (!nextBit()) { phase = PHASE_PAUSE; break; }
+            level = curBit ? 1 : 0;
+            schedule(directLen);
+            return;
+        case PHASE_PAUSE:
+            if (pauseMillis == 0) { phase = PHASE_NEXT_BLOCK; break; }
+            // an edge ends the last pulse, the level goes low after 1 ms
+            phase = PHASE_PAUSE_LOW;
+            edge(TZX_STATES_PER_MS);
+            return;
+        case PHASE_PAUSE_LOW:
+            level = 0;
+            phase = PHASE_NEXT_BLOCK;
+            schedule((uint32_t)(pauseMillis - 1) * TZX_STATES_PER_MS);
+            return;
+        case PHASE_STOP:
+            Serial.printf("TZX: tape stopped\n");
+            phase = PHASE_NEXT_BLOCK;
+            FileTZX::stop();
+            return;
+        case PHASE_NEXT_BLOCK:
+            if (!beginBlock()) {
+                Serial.printf("TZX: end of tape\n");
+                phase = PHASE_END;
+                level = 0;
+                FileTZX::stop();
+                return;
+            }
+            break;
+        case PHASE_END:
+            FileTZX::stop();
+            return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FileTZX::open(String tzx_fn)
+{
+    close();
+    KB_INT_STOP;
+    tzxFile = FileUtils::safeOpenFileRead(tzx_fn);
+    KB_INT_START;
+    if (!tzxFile) {
+        Serial.printf("FileTZX::open: cannot open %s\n", tzx_fn.c_str());
+        return false;
+    }
+
+    inserted = true;
+    playing = false;
+    seekTo(0);
+
+    char signature[8];
+    for (int i = 0; i < 8; i++) signature[i] = nextByte();
+    uint8_t major = nextByte();
+    uint8_t minor = nextByte();
+    if (memcmp(signature, "ZXTape!\x1A", 8) != 0) {
+        Serial.printf("FileTZX::open: %s is not a TZX file\n", tzx_fn.c_str());
+        close();
+        return false;
+    }
+
+    Serial.printf("Tape inserted: %s (TZX %u.%02u, %u bytes)\n", tzx_fn.c_str(), major, minor, (unsigned)tzxFile.size());
+    rewind();
+    return true;
+}
+
+void FileTZX::close()
+{
+    if (inserted)
+        tzxFile.close();
+    inserted = false;
+    playing = false;
+}
+
+void FileTZX::rewind()
+{
+    playing = false;
+    if (!inserted) return;
+    seekTo(TZX_HEADER_SIZE);
+    phase = PHASE_NEXT_BLOCK;
+    level = 0;
+    loopCount = 0;
+}
+
+void FileTZX::play()
+{
+    if (!inserted || playing || phase == PHASE_END) return;
+    clockNum = CPU::statesPerFrame() * 2;
+    clockDen = CPU::microsPerFrame() * 7;
+    playStart = nextEdge = frameStart + CPU::tstates;
+    tapeTime = 0;
+    playing = true;
+    Serial.printf("TZX: playing\n");
+}
+
+void FileTZX::stop()
+{
+    playing = false;
+}
+
+uint8_t FileTZX::read(uint32_t tstates)
+{
+    uint64_t now = frameStart + tstates;
+    while (playing && now >= nextEdge)
+        step();
+    return level;
+}
+
+void FileTZX::endFrame(uint32_t statesPerFrame)
+{
+    frameStart += statesPerFrame;
+}
@@ -38,74 +38,32 @@
 #include "osd.h"
 #include <FS.h>
 #include "Wiimote2Keys.h"
-#include "sort.h"
 #include "FileUtils.h"
 #include "Config.h"
-
-#ifdef USE_INT_FLASH
-// using internal storage (spi flash)
-#include <SPIFFS.h>
-// set The Filesystem to SPIFFS
-#define THE_FS SPIFFS
-#endif
-
-#ifdef USE_SD_CARD
-// using external storage (SD card)
-#include <SD.h>
-// set The Filesystem to SD
-#define THE_FS SD
-static SPIClass customSPI;
-#endif
+#include "RomPartition.h"
+#include "RomCache.h"
+#include "VFS.h"
 
 void zx_reset();
 
 // Globals
 void IRAM_ATTR FileUtils::initFileSystem() {
+    Serial.printf("Initializing %s storage...\n", VFS::name());
+    if (!VFS::begin()) {
 #ifdef USE_INT_FLASH
-// using internal storage (spi flash)
-    Serial.println("Initializing internal storage...");
-    if (!SPIFFS.begin())
         OSD::errorHalt(ERR_FS_INT_FAIL);
-
-    vTaskDelay(2);
-
-#endif
-#ifdef USE_SD_CARD
-// using external storage (SD card)
-
-    Serial.println("Initializing external storage...");
-
-    customSPI.begin(SDCARD_CLK, SDCARD_MISO, SDCARD_MOSI, SDCARD_CS);
-
-    if (!SD.begin(SDCARD_CS, customSPI, 4000000, "/sd")) {
-        Serial.println("Card Mount Failed");
-        OSD::errorHalt(ERR_FS_EXT_FAIL);
-        return;
-    }
-    uint8_t cardType = SD.cardType();
-    
-    if (cardType == CARD_NONE) {
-        Serial.println("No SD card attached");
+#else
         OSD::errorHalt(ERR_FS_EXT_FAIL);
+#endif
         return;
     }
-    
-    Serial.print("SD Card Type: ");
-    if      (cardType == CARD_MMC)  Serial.println("MMC");
-    else if (cardType == CARD_SD )  Serial.println("SDSC");
-    else if (cardType == CARD_SDHC) Serial.println("SDHC");
-    else                            Serial.println("UNKNOWN");
-    
-    uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-    Serial.printf("SD Card Size: %lluMB\n", cardSize);
 
     vTaskDelay(2);
-#endif
 }
 
 String FileUtils::getAllFilesFrom(const String path) {
     KB_INT_STOP;
-    File root = THE_FS.open("/");
+    File root = VFS::open("/");
     File file = root.openNextFile();
     String listing;
 
@@ -124,7 +82,7 @@ String FileUtils::getAllFilesFrom(const String path) {
 
 void FileUtils::listAllFiles() {
     KB_INT_STOP;
-    File root = THE_FS.open("/");
+    File root = VFS::open("/");
     Serial.println("fs opened");
     File file = root.openNextFile();
     Serial.println("fs openednextfile");
@@ -150,11 +108,11 @@ File FileUtils::safeOpenFileRead(String filename)
     File f;
     if (Config::slog_on)
         Serial.printf("%s '%s'\n", MSG_LOADING, filename.c_str());
-    if (!THE_FS.exists(filename.c_str())) {
+    if (!VFS::exists(filename)) {
         KB_INT_START;
         OSD::errorHalt((String)ERR_READ_FILE + "\n" + filename);
     }
-    f = THE_FS.open(filename.c_str(), FILE_READ);
+    f = VFS::open(filename, FILE_READ);
     vTaskDelay(2);
 
     return f;
@@ -164,7 +122,7 @@ String FileUtils::getFileEntriesFromDir(String path) {
     KB_INT_STOP;
     Serial.printf("Getting entries from: '%s'\n", path.c_str());
     String filelist;
-    File root = THE_FS.open(path.c_str());
+    File root = VFS::open(path);
     if (!root || !root.isDirectory()) {
         OSD::errorHalt((String)ERR_DIR_OPEN + "\n" + root);
     }
@@ -172,7 +130,7 @@ String FileUtils::getFileEntriesFromDir(String path) {
     if (!file)
         Serial.println("No entries found!");
     while (file) {
-        Serial.printf("Found %s: %s...%ub...", (file.isDirectory() ? "DIR" : "FILE"), file.name(), file.size());
+        Serial.printf("Found %s: %s...%ub...", (file.isDirectory() ? "DIR" : "FILE"), file.name(), (unsigned)file.size());
         String filename = file.name();
         byte start = filename.indexOf("/", path.length()) + 1;
         byte end = filename.indexOf("/", start);
@@ -185,7 +143,8 @@ String FileUtils::getFileEntriesFromDir(String path) {
 //        } else if (Config::arch == "48K" & file.size() > SNA_48K_SIZE) {
 //            Serial.println("128K SKIP");
         } else {
-            if (filelist.indexOf(filename) < 0) {
+            // whole lines only: PLUS3 is not PLUS3E
+            if (("\n" + filelist).indexOf("\n" + filename + "\n") < 0) {
                 Serial.println("ADDING");
                 filelist += filename + "\n";
             } else {
@@ -212,6 +171,57 @@ bool FileUtils::hasZ80extension(String filename)
     return false;
 }
 
+bool FileUtils::hasSZXextension(String filename)
+{
+    if (filename.endsWith(".szx")) return true;
+    if (filename.endsWith(".SZX")) return true;
+    return false;
+}
+
+bool FileUtils::hasTAPextension(String filename)
+{
+    if (filename.endsWith(".tap")) return true;
+    if (filename.endsWith(".TAP")) return true;
+    return false;
+}
+
+bool FileUtils::hasTZXextension(String filename)
+{
+    if (filename.endsWith(".tzx")) return true;
+    if (filename.endsWith(".TZX")) return true;
+    return false;
+}
+
+bool FileUtils::hasRZXextension(String filename)
+{
+    if (filename.endsWith(".rzx")) return true;
+    if (filename.endsWith(".RZX")) return true;
+    return false;
+}
+
+bool FileUtils::hasDSKextension(String filename)
+{
+    if (filename.endsWith(".dsk")) return true;
+    if (filename.endsWith(".DSK")) return true;
+    return false;
+}
+
+bool FileUtils::hasTRDextension(String filename)
+{
+    if (filename.endsWith(".trd")) return true;
+    if (filename.endsWith(".TRD")) return true;
+    if (filename.endsWith(".scl")) return true;
+    if (filename.endsWith(".SCL")) return true;
+    return false;
+}
+
+bool FileUtils::hasZIPextension(String filename)
+{
+    if (filename.endsWith(".zip")) return true;
+    if (filename.endsWith(".ZIP")) return true;
+    return false;
+}
+
 
 uint16_t FileUtils::countFileEntriesFromDir(String path) {
     String entries = getFileEntriesFromDir(path);
@@ -224,84 +234,78 @@ uint16_t FileUtils::countFileEntriesFromDir(String path) {
     return count;
 }
 
+uint32_t FileUtils::crc32(uint32_t crc, const uint8_t* data, size_t len)
+{
+    // a nibble at a time, the table is small enough to stay in SRAM
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
 void FileUtils::loadRom(String arch, String romset) {
     KB_INT_STOP;
     String path = "/rom/" + arch + "/" + romset;
+
+    // zero-copy: ROM pages point into the mapped flash partition
+    byte n_roms = RomPartition::map(arch, romset, Mem::rom);
+    if (n_roms > 0) {
+        Serial.printf("ROMSET '%s' mapped from flash, %u ROMs\n", path.c_str(), n_roms);
+        Mem::romCount = n_roms;
+        KB_INT_START;
+        return;
+    }
+
+    // ROM sets cached in PSRAM are repointed too, a set installed after
+    // boot is cached on its first use
+    n_roms = RomCache::map(arch, romset, Mem::rom);
+    if (n_roms == 0 && RomCache::load(arch, romset) > 0)
+        n_roms = RomCache::map(arch, romset, Mem::rom);
+    if (n_roms > 0) {
+        Serial.printf("ROMSET '%s' from PSRAM cache, %u ROMs\n", path.c_str(), n_roms);
+        Mem::romCount = n_roms;
+        KB_INT_START;
+        return;
+    }
+
     Serial.printf("Loading ROMSET '%s'\n", path.c_str());
-    byte n_roms = countFileEntriesFromDir(path);
+    n_roms = countFileEntriesFromDir(path);
     if (n_roms < 1) {
         OSD::errorHalt("No ROMs found at " + path + "\nARCH: '" + arch + "' ROMSET: " + romset);
     }
     Serial.printf("Processing %u ROMs\n", n_roms);
-    for (byte f = 0; f < n_roms; f++) {
-        File rom_f = FileUtils::safeOpenFileRead(path + "/" + (String)f + ".rom");
-        Serial.printf("Loading ROM '%s'\n", rom_f.name());
-        for (int i = 0; i < rom_f.size(); i++) {
-            switch (f) {
-            case 0:
-                Mem::rom0[i] = rom_f.read();
-                break;
-            case 1:
-                Mem::rom1[i] = rom_f.read();
-                break;
-
+    uint8_t** romPages[4] = { &Mem::rom0, &Mem::rom1, &Mem::rom2, &Mem::rom3 };
+    Mem::romCount = 0;
+    for (byte f = 0; f < n_roms && f < 4; f++) {
+        // pages are only allocated at boot if ROMs are not mapped or cached
+        uint8_t*& page = *romPages[f];
+        if (page == NULL) {
 #ifdef BOARD_HAS_PSRAM
-
-            case 2:
-                Mem::rom2[i] = rom_f.read();
-                break;
-            case 3:
-                Mem::rom3[i] = rom_f.read();
-                break;
+            page = (uint8_t*)ps_calloc(1, 0x4000);
+#else
+            page = (uint8_t*)calloc(1, 0x4000);
 #endif
+            if (page == NULL) {
+                Serial.printf("ERROR: unable to allocate page ROM%u\n", f);
+                continue;
             }
         }
+        File rom_f = FileUtils::safeOpenFileRead(path + "/" + (String)f + ".rom");
+        Serial.printf("Loading ROM '%s'\n", rom_f.name());
+        readBlockFile(rom_f, page, rom_f.size() < 0x4000 ? rom_f.size() : 0x4000);
         rom_f.close();
+        Mem::rom[f] = page;
+        Mem::romCount = f + 1;
     }
+    // as when mapped: slots past the set repeat its first ROM
+    for (byte f = Mem::romCount; f < 4; f++)
+        Mem::rom[f] = Mem::rom[0];
 
     KB_INT_START;
 }
-
-// Get all sna files sorted alphabetically
-String FileUtils::getSortedSnaFileList()
-{
-    // get string of unsorted filenames, separated by newlines
-    String entries = getFileEntriesFromDir(DISK_SNA_DIR);
-
-    // count filenames (they always end at newline)
-    unsigned short count = 0;
-    for (unsigned short i = 0; i < entries.length(); i++) {
-        if (entries.charAt(i) == ASCII_NL) {
-            count++;
-        }
-    }
-
-    // array of filenames
-    String* filenames = (String*)malloc(count * sizeof(String));
-    // memory must be initialized to avoid crash on assign
-    memset(filenames, 0, count * sizeof(String));
-
-    // copy filenames from string to array
-    unsigned short ich = 0;
-    unsigned short ifn = 0;
-    for (unsigned short i = 0; i < entries.length(); i++) {
-        if (entries.charAt(i) == ASCII_NL) {
-            filenames[ifn++] = entries.substring(ich, i);
-            ich = i + 1;
-        }
-    }
-
-    // sort array
-    sortArray(filenames, count);
-
-    // string of sorted filenames
-    String sortedEntries = "";
-
-    // copy filenames from array to string
-    for (unsigned short i = 0; i < count; i++) {
-        sortedEntries += filenames[i] + '\n';
-    }
-
-    return sortedEntries;
-}
-
@@ -37,10 +37,13 @@
 #include "ESPectrum.h"
 #include "messages.h"
 #include "osd.h"
+#include "VFS.h"
 #include <FS.h>
 #include "Wiimote2Keys.h"
 #include "Config.h"
 #include "FileUtils.h"
+#include "AySound.h"
+#include "Ports.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -57,21 +60,121 @@ extern Z80_STATE _zxCpu;
 
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifdef USE_INT_FLASH
-// using internal storage (spi flash)
-#include <SPIFFS.h>
-// set The Filesystem to SPIFFS
-#define THE_FS SPIFFS
-#endif
-
 ///////////////////////////////////////////////////////////////////////////////
+// buffered reading
 
-#ifdef USE_SD_CARD
-// using external storage (SD card)
-#include <SD.h>
-// set The Filesystem to SD
-#define THE_FS SD
-#endif
+static uint8_t* chunk = NULL;
+static uint16_t chunkPos = 0;
+static uint16_t chunkLen = 0;
+
+static bool fillChunk(File f)
+{
+    chunkLen = readBlockFile(f, chunk, Z80_CHUNK_SIZE);
+    chunkPos = 0;
+    return chunkLen > 0;
+}
+
+// copy count bytes of the file to dst (skip them if dst is NULL),
+// returns the number of bytes available
+uint32_t FileZ80::readChunked(File f, uint8_t* dst, uint32_t count)
+{
+    uint32_t done = 0;
+    while (done < count) {
+        if (chunkPos == chunkLen) {
+            // big reads go straight to their destination
+            if (dst && count - done >= Z80_CHUNK_SIZE) {
+                uint32_t n = readBlockFile(f, dst + done, count - done);
+                done += n;
+                break;
+            }
+            if (!fillChunk(f)) break;
+        }
+        uint32_t n = chunkLen - chunkPos;
+        if (n > count - done) n = count - done;
+        if (dst) memcpy(dst + done, chunk + chunkPos, n);
+        chunkPos += n;
+        done += n;
+    }
+    return done;
+}
+
+// make at least 'count' bytes contiguous in the chunk, if the file has them
+static void ensureChunk(File f, uint16_t count)
+{
+    uint16_t left = chunkLen - chunkPos;
+    if (left >= count) return;
+    memmove(chunk, chunk + chunkPos, left);
+    chunkLen = left + readBlockFile(f, chunk + left, Z80_CHUNK_SIZE - left);
+    chunkPos = 0;
+}
+
+// Decompress dataLen bytes of the file (ED ED nn bb = nn times bb) into memlen bytes
+// of memory, made of consecutive 16K pages. Returns the number of bytes written.
+uint32_t FileZ80::loadCompressed(File f, uint32_t dataLen, uint8_t* const* pages, uint32_t memlen)
+{
+    uint32_t memidx = 0;
+
+    while (dataLen > 0 && memidx < memlen) {
+        if (chunkPos + 4 > chunkLen) {
+            ensureChunk(f, 4);
+            if (chunkPos == chunkLen) break;
+        }
+
+        uint8_t* page = pages[memidx >> 14];
+        uint16_t pageidx = memidx & 0x3FFF;
+
+        // literal bytes up to the next ED, the end of the page or the chunk
+        uint32_t n = chunkLen - chunkPos;
+        if (n > dataLen) n = dataLen;
+        if (n > 0x4000u - pageidx) n = 0x4000u - pageidx;
+        if (n > memlen - memidx) n = memlen - memidx;
+        const uint8_t* src = chunk + chunkPos;
+        const uint8_t* ed = (const uint8_t*)memchr(src, 0xED, n);
+        if (ed != src) {
+            if (ed) n = ed - src;
+            memcpy(page + pageidx, src, n);
+            chunkPos += n;
+            dataLen -= n;
+            memidx += n;
+            continue;
+        }
+
+        // a single ED is a literal
+        if (dataLen < 4 || chunkLen - chunkPos < 4 || src[1] != 0xED) {
+            page[pageidx] = 0xED;
+            chunkPos++;
+            dataLen--;
+            memidx++;
+            continue;
+        }
+
+        // ED ED nn bb: run, possibly across pages
+        uint32_t repcnt = src[2];
+        uint8_t repval = src[3];
+        chunkPos += 4;
+        dataLen -= 4;
+        if (repcnt > memlen - memidx) repcnt = memlen - memidx;
+        while (repcnt > 0) {
+            page = pages[memidx >> 14];
+            pageidx = memidx & 0x3FFF;
+            uint32_t run = 0x4000 - pageidx;
+            if (run > repcnt) run = repcnt;
+            memset(page + pageidx, repval, run);
+            memidx += run;
+            repcnt -= run;
+        }
+    }
+
+    // skip whatever was not decoded
+    if (dataLen > 0)
+        readChunked(f, NULL, dataLen);
+
+    #ifdef LOG_Z80_DETAILS
+        Serial.printf("bytes written: %d\n", memidx);
+    #endif
+
+    return memidx;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -87,9 +190,19 @@ bool FileZ80::load(String sna_fn)
         loadKeytableForGame(sna_fn.c_str());
 
     Serial.println("FileZ80::load");
+    uint32_t ts_start = micros();
     File f = FileUtils::safeOpenFileRead(sna_fn);
     uint32_t file_size = f.size();
 
+    chunk = (uint8_t*)malloc(Z80_CHUNK_SIZE);
+    if (chunk == NULL) {
+        Serial.printf("FileZ80::load: cannot allocate read buffer\n");
+        f.close();
+        KB_INT_START;
+        return false;
+    }
+    chunkPos = chunkLen = 0;
+
     uint32_t dataOffset = 0;
 
     // initially assuming version 1; this assumption may change
@@ -102,10 +215,7 @@ bool FileZ80::load(String sna_fn)
     uint8_t header[87];
 
     // read first 30 bytes
-    for (uint8_t i = 0; i < 30; i++) {
-        header[i] = f.read();
-        dataOffset ++;
-    }
+    dataOffset += readChunked(f, header, 30);
 
     // additional vars
     uint8_t b12, b29;
@@ -162,11 +272,22 @@ bool FileZ80::load(String sna_fn)
 #endif // CPU_JLSANCHEZ
 
 
+    // for compatibility, 255 has to be read as 1
+    if (b12 == 0xFF) b12 = 1;
+
+    // bit 7 of R is stored in b12
+#ifdef CPU_LINKEFONG
+    _zxCpu.r = (header[11] & 0x7F) | ((b12 & 0x01) << 7);
+#endif
+#ifdef CPU_JLSANCHEZ
+    Z80::setRegR((header[11] & 0x7F) | ((b12 & 0x01) << 7));
+#endif
+
     ESPectrum::borderColor = (b12 >> 1) & 0x07;
 
     bool dataCompressed = (b12 & 0x20) ? true : false;
     String fileArch = "48K";
-    uint8_t memPagingReg = 0;
+    String fileRomSet = "SINCLAIR";
 
 // #define LOG_Z80_DETAILS
 
@@ -186,21 +307,22 @@ bool FileZ80::load(String sna_fn)
         Serial.printf("border: %d\n", ESPectrum::borderColor);
 #endif
 
+        // 0x4000, 0x8000 and 0xC000 as mapped in 48K mode
+        uint8_t* pages[3] = { Mem::ram5, Mem::ram2, Mem::ram0 };
+
         if (dataCompressed)
         {
             // assuming stupid 00 ED ED 00 terminator present, should check for it instead of assuming
-            uint16_t dataLen = (uint16_t)(memRawLength - 4);
+            uint32_t dataLen = memRawLength - 4;
 
             // load compressed data into memory
-            loadCompressedMemData(f, dataLen, 0x4000, 0xC000);
+            loadCompressed(f, dataLen, pages, 0xC000);
         }
         else
         {
-            uint16_t dataLen = (memRawLength < 0xC000) ? memRawLength : 0xC000;
-
             // load uncompressed data into memory
-            for (int i = 0; i < dataLen; i++)
-                Mem::writebyte(0x4000 + i, f.read());
+            for (int i = 0; i < 3; i++)
+                readChunked(f, pages[i], 0x4000);
         }
 
         // latches for 48K
@@ -213,10 +335,7 @@ bool FileZ80::load(String sna_fn)
     else
     {
         // read 2 more bytes
-        for (uint8_t i = 30; i < 32; i++) {
-            header[i] = f.read();
-            dataOffset ++;
-        }
+        dataOffset += readChunked(f, header + 30, 2);
 
         // additional header block length
         uint16_t ahblen = mkword(header[30], header[31]);
@@ -226,14 +345,15 @@ bool FileZ80::load(String sna_fn)
             version = 3;
         else {
             Serial.printf("Z80.load: unknown version, ahblen = %d\n", ahblen);
+            free(chunk);
+            chunk = NULL;
+            f.close();
+            KB_INT_START;
             return false;
         }
 
         // read additional header block
-        for (uint8_t i = 32; i < 32 + ahblen; i++) {
-            header[i] = f.read();
-            dataOffset ++;
-        }
+        dataOffset += readChunked(f, header + 32, ahblen);
 
         // program counter
         RegPC = mkword(header[32], header[33]);
@@ -261,6 +381,9 @@ bool FileZ80::load(String sna_fn)
             if (b34 == 2) fileArch = "SAMRAM";
             if (b34 == 3) fileArch = "48K"; // + mgt
         }
+        // +3 (8 is written by some emulators for the same), +2A
+        if (b34 == 7 || b34 == 8) fileRomSet = "PLUS3";
+        if (b34 == 13) fileRomSet = "PLUS2A";
 
 #ifdef LOG_Z80_DETAILS
         uint32_t memRawLength = file_size - dataOffset;
@@ -281,31 +404,26 @@ bool FileZ80::load(String sna_fn)
             Mem::pagingLock = 1;
             Mem::videoLatch = 0;
 
-            uint16_t pageStart[12] = {0, 0, 0, 0, 0x8000, 0xC000, 0, 0, 0x4000, 0, 0};
+            // pages 8, 4, 5 are mapped at 0x4000, 0x8000, 0xC000
+            uint8_t* pages[12] = {
+                NULL, NULL, NULL, NULL, Mem::ram2, Mem::ram0,
+                NULL, NULL, Mem::ram5, NULL, NULL, NULL };
 
             uint32_t dataLen = file_size;
             while (dataOffset < dataLen) {
-                uint8_t hdr0 = f.read(); dataOffset ++;
-                uint8_t hdr1 = f.read(); dataOffset ++;
-                uint8_t hdr2 = f.read(); dataOffset ++;
-                uint16_t compDataLen = mkword(hdr0, hdr1);
+                uint8_t hdr[3];
+                dataOffset += readChunked(f, hdr, 3);
+                uint16_t compDataLen = mkword(hdr[0], hdr[1]);
 #ifdef LOG_Z80_DETAILS
                 Serial.printf("compressed data length: %d\n", compDataLen);
-                Serial.printf("page number: %d\n", hdr2);
-#endif
-                uint16_t memoff = pageStart[hdr2];
-#ifdef LOG_Z80_DETAILS
-                Serial.printf("page start: 0x%X\n", memoff);
+                Serial.printf("page number: %d\n", hdr[2]);
 #endif
-                loadCompressedMemData(f, compDataLen, memoff, 0x4000);
-                dataOffset += compDataLen;
+                dataOffset += loadPage(f, compDataLen, hdr[2] < 12 ? pages[hdr[2]] : NULL);
             }
 
             // great success!!!
         }
         else if (fileArch == "128K") {
-            Mem::romInUse = 1;
-
             // paging register
             uint8_t b35 = header[35];
             Mem::pagingLock = bitRead(b35, 5);
@@ -313,32 +431,40 @@ bool FileZ80::load(String sna_fn)
             Mem::videoLatch = bitRead(b35, 3);
             Mem::bankLatch = b35 & 0x07;
 
+            // +2A / +3 secondary paging register
+            uint8_t b86 = (ahblen == 55) ? header[86] : 0;
+            Mem::modeSP3 = bitRead(b86, 0);
+            Mem::romSP3 = bitRead(b86, 2);
+
+#ifdef USE_AY_SOUND
+            // AY registers, then the last register selected
+            for (uint8_t reg = 0; reg < 16; reg++)
+                AySound::chip[0].writeRegister(reg, header[39 + reg]);
+            AySound::chip[0].selectRegister(header[38]);
+#endif
+
+            // ROM pages (0-2, 11) are not loaded
             uint8_t* pages[12] = {
-                Mem::rom0, Mem::rom2, Mem::rom1,
+                NULL, NULL, NULL,
                 Mem::ram0, Mem::ram1, Mem::ram2, Mem::ram3,
                 Mem::ram4, Mem::ram5, Mem::ram6, Mem::ram7,
-                Mem::rom3 };
+                NULL };
 
+#ifdef LOG_Z80_DETAILS
             const char* pagenames[12] = { "rom0", "IDP", "rom1",
                 "ram0", "ram1", "ram2", "ram3", "ram4", "ram5", "ram6", "ram7", "MFR" };
-
-#ifdef LOG_Z80_DETAILS
-
 #endif
             uint32_t dataLen = file_size;
             while (dataOffset < dataLen) {
-                uint8_t hdr0 = f.read(); dataOffset ++;
-                uint8_t hdr1 = f.read(); dataOffset ++;
-                uint8_t hdr2 = f.read(); dataOffset ++;
-                uint16_t compDataLen = mkword(hdr0, hdr1);
+                uint8_t hdr[3];
+                dataOffset += readChunked(f, hdr, 3);
+                uint16_t compDataLen = mkword(hdr[0], hdr[1]);
+                uint8_t pageNum = hdr[2] < 12 ? hdr[2] : 0;
 #ifdef LOG_Z80_DETAILS
                 Serial.printf("compressed data length: %d\n", compDataLen);
-                Serial.printf("page: %s\n", pagenames[hdr2]);
+                Serial.printf("page: %s\n", pagenames[pageNum]);
 #endif
-                uint8_t* memPage = pages[hdr2];
-
-                loadCompressedMemPage(f, compDataLen, memPage, 0x4000);
-                dataOffset += compDataLen;
+                dataOffset += loadPage(f, compDataLen, pages[pageNum]);
             }
 
             // great success!!!
@@ -362,10 +488,30 @@ bool FileZ80::load(String sna_fn)
     {
         if (fileArch == "128K")
         {
-            Config::requestMachine("128K", "SINCLAIR", true);
-            Mem::romInUse = 1;
+            Config::requestMachine("128K", fileRomSet, true);
+            Mem::romInUse = Mem::romLatch;
         }
     }
+    // +2A / +3 snapshots need their own roms: PLUS3 also covers PLUS3E
+    if (fileArch == "128K" && fileRomSet != "SINCLAIR" && !Config::getRomSet().startsWith(fileRomSet))
+        Config::requestMachine("128K", fileRomSet, true);
+
+    // the 0x1FFD paging only exists with the four +2A / +3 roms (see
+    // Config::requestMachine()): a plain 128K has no rom 2 and 3 to select
+    if (fileArch == "128K") {
+        if (!Ports::plus2A) {
+            Mem::modeSP3 = 0;
+            Mem::romSP3 = 0;
+        }
+        Mem::romInUse = Mem::romLatch | (Mem::romSP3 << 1);
+    }
+
+    free(chunk);
+    chunk = NULL;
+    f.close();
+    Mem::markAllDirty();
+
+    Serial.printf("FileZ80::load: version %d, %u bytes in %u us\n", version, file_size, (unsigned)(micros() - ts_start));
 
     delay(100);
 
@@ -374,84 +520,315 @@ bool FileZ80::load(String sna_fn)
     return true;
 }
 
-void FileZ80::loadCompressedMemData(File f, uint16_t dataLen, uint16_t memoff, uint16_t memlen)
+// Load a 16K page block of a version 2/3 file into memPage (skip it if NULL).
+// Returns the number of file bytes used by the block.
+uint32_t FileZ80::loadPage(File f, uint16_t compDataLen, uint8_t* memPage)
 {
-    uint16_t dataOff = 0;
-    uint8_t ed_cnt = 0;
-    uint8_t repcnt = 0;
-    uint8_t repval = 0;
-    uint16_t memidx = 0;
-
-    while(dataOff < dataLen && memidx < memlen) {
-        uint8_t databyte = f.read();
-        if (ed_cnt == 0) {
-            if (databyte != 0xED)
-                Mem::writebyte(memoff + memidx++, databyte);
-            else
-                ed_cnt++;
-        }
-        else if (ed_cnt == 1) {
-            if (databyte != 0xED) {
-                Mem::writebyte(memoff + memidx++, 0xED);
-                Mem::writebyte(memoff + memidx++, databyte);
-                ed_cnt = 0;
+    // 0xFFFF: page stored uncompressed
+    uint32_t blockLen = (compDataLen == 0xFFFF) ? 0x4000 : compDataLen;
+
+    if (memPage == NULL)
+        readChunked(f, NULL, blockLen);
+    else if (compDataLen == 0xFFFF)
+        readChunked(f, memPage, 0x4000);
+    else
+        loadCompressed(f, compDataLen, &memPage, 0x4000);
+
+    return blockLen;
+}
+
+bool FileZ80::loadScreen(String z80_fn, uint8_t* screen)
+{
+    KB_INT_STOP;
+    File f = VFS::open(z80_fn, FILE_READ);
+    chunk = f ? (uint8_t*)malloc(Z80_CHUNK_SIZE) : NULL;
+    if (chunk == NULL) {
+        if (f) f.close();
+        KB_INT_START;
+        return false;
+    }
+    chunkPos = chunkLen = 0;
+
+    uint32_t file_size = f.size();
+    uint8_t header[87];
+    uint32_t dataOffset = readChunked(f, header, 30);
+    uint32_t screenLen = 0;
+
+    if (dataOffset == 30 && mkword(header[6], header[7]) != 0) {
+        // version 1: 48K memory from 0x4000, the screen comes first
+        if (header[12] & 0x20)
+            screenLen = loadCompressed(f, file_size - dataOffset, &screen, 6912);
+        else
+            screenLen = readChunked(f, screen, 6912);
+    }
+    else if (dataOffset == 30) {
+        dataOffset += readChunked(f, header + 30, 2);
+        uint16_t ahblen = mkword(header[30], header[31]);
+        if (ahblen <= sizeof(header) - 32) {
+            dataOffset += readChunked(f, header + 32, ahblen);
+
+            // page 5 is block 8 in every mode, shadow screen page 7 is block 10
+            bool is128K = (ahblen == 23) ? header[34] >= 3 : header[34] >= 4;
+            uint8_t screenPage = (is128K && bitRead(header[35], 3)) ? 10 : 8;
+
+            while (dataOffset + 3 <= file_size && screenLen == 0) {
+                uint8_t hdr[3];
+                if (readChunked(f, hdr, 3) != 3) break;
+                uint16_t compDataLen = mkword(hdr[0], hdr[1]);
+                uint32_t blockLen = (compDataLen == 0xFFFF) ? 0x4000 : compDataLen;
+                dataOffset += 3 + blockLen;
+                if (hdr[2] != screenPage) {
+                    // skip the block, seeking past it if not all buffered
+                    if (blockLen <= (uint32_t)(chunkLen - chunkPos))
+                        chunkPos += blockLen;
+                    else {
+                        f.seek(dataOffset);
+                        chunkPos = chunkLen = 0;
+                    }
+                }
+                else if (compDataLen == 0xFFFF)
+                    screenLen = readChunked(f, screen, 6912);
+                else
+                    screenLen = loadCompressed(f, compDataLen, &screen, 6912);
             }
-            else
-                ed_cnt++;
-        }
-        else if (ed_cnt == 2) {
-            repcnt = databyte;
-            ed_cnt++;
-        }
-        else if (ed_cnt == 3) {
-            repval = databyte;
-            for (uint16_t i = 0; i < repcnt; i++)
-                Mem::writebyte(memoff + memidx++, repval);
-            ed_cnt = 0;
         }
     }
-    #ifdef LOG_Z80_DETAILS
-        Serial.printf("last byte: %d\n", (memoff+memidx-1));
-    #endif
+
+    free(chunk);
+    chunk = NULL;
+    f.close();
+
+    KB_INT_START;
+    return screenLen == 6912;
 }
 
-void FileZ80::loadCompressedMemPage(File f, uint16_t dataLen, uint8_t* memPage, uint16_t memlen)
+///////////////////////////////////////////////////////////////////////////////
+// buffered writing
+
+static uint8_t outBuffer[Z80_OUT_BUFFER_SIZE];
+static uint16_t outLen = 0;
+static uint32_t outTotal = 0;
+static bool outFailed = false;
+
+static void flushOut(File f)
 {
-    uint16_t dataOff = 0;
-    uint8_t ed_cnt = 0;
-    uint8_t repcnt = 0;
-    uint8_t repval = 0;
-    uint16_t memidx = 0;
-
-    while(dataOff < dataLen && memidx < memlen) {
-        uint8_t databyte = f.read();
-        if (ed_cnt == 0) {
-            if (databyte != 0xED)
-                memPage[memidx++] = databyte;
-            else
-                ed_cnt++;
+    if (outLen > 0 && writeBlockFile(outBuffer, f, outLen) != outLen)
+        outFailed = true;
+    outTotal += outLen;
+    outLen = 0;
+}
+
+static inline void putByte(File f, uint8_t value)
+{
+    outBuffer[outLen++] = value;
+    if (outLen == Z80_OUT_BUFFER_SIZE)
+        flushOut(f);
+}
+
+// ED ED nn bb compression of a 16K page: runs of 5 or more bytes, and of 2 or
+// more EDs, are stored as nn times bb; the byte after a single ED is never
+// part of a run. Returns the compressed length; data is output only if 'emit'.
+static uint16_t compressPage(const uint8_t* page, File f, bool emit)
+{
+    uint16_t len = 0;
+    uint16_t i = 0;
+
+    while (i < 0x4000) {
+        uint8_t value = page[i];
+        uint16_t run = 1;
+        while (i + run < 0x4000 && run < 255 && page[i + run] == value)
+            run++;
+
+        if (run >= 5 || (value == 0xED && run >= 2)) {
+            if (emit) {
+                putByte(f, 0xED);
+                putByte(f, 0xED);
+                putByte(f, run);
+                putByte(f, value);
+            }
+            len += 4;
+            i += run;
         }
-        else if (ed_cnt == 1) {
-            if (databyte != 0xED) {
-                memPage[memidx++] = 0xED;
-                memPage[memidx++] = databyte;
-                ed_cnt = 0;
+        else if (value == 0xED) {
+            if (emit) putByte(f, 0xED);
+            len++;
+            i++;
+            if (i < 0x4000) {
+                if (emit) putByte(f, page[i]);
+                len++;
+                i++;
             }
-            else
-                ed_cnt++;
         }
-        else if (ed_cnt == 2) {
-            repcnt = databyte;
-            ed_cnt++;
+        else {
+            if (emit)
+                for (uint16_t n = 0; n < run; n++) putByte(f, value);
+            len += run;
+            i += run;
         }
-        else if (ed_cnt == 3) {
-            repval = databyte;
-            for (uint16_t i = 0; i < repcnt; i++)
-                memPage[memidx++] = repval;
-            ed_cnt = 0;
+    }
+    return len;
+}
+
+// write a 16K page block: length, page number, data
+static void savePage(File f, uint8_t pageNum, const uint8_t* page)
+{
+    uint16_t compLen = compressPage(page, f, false);
+    if (compLen >= 0x4000) {
+        // not worth compressing: 0xFFFF, then the page as is
+        putByte(f, 0xFF);
+        putByte(f, 0xFF);
+        putByte(f, pageNum);
+        flushOut(f);
+        if (writeBlockFile((uint8_t*)page, f, 0x4000) != 0x4000)
+            outFailed = true;
+        outTotal += 0x4000;
+        return;
+    }
+    putByte(f, compLen & 0xFF);
+    putByte(f, compLen >> 8);
+    putByte(f, pageNum);
+    compressPage(page, f, true);
+}
+
+bool FileZ80::save(String z80_fn)
+{
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+
+    File f = VFS::open(z80_fn, FILE_WRITE);
+    if (!f) {
+        Serial.printf("FileZ80::save: failed to open %s for writing\n", z80_fn.c_str());
+        KB_INT_START;
+        return false;
+    }
+
+    bool is128K = (Config::getArch() == "128K");
+
+    // version 3: 30 byte header, additional header block length, 55 bytes
+    uint8_t header[87];
+    memset(header, 0, sizeof(header));
+
+    uint16_t RegPC;
+    uint8_t RegR;
+#ifdef CPU_LINKEFONG
+    header[0]  = _zxCpu.registers.byte[Z80_A];
+    header[1]  = _zxCpu.registers.byte[Z80_F];
+    header[2]  = _zxCpu.registers.word[Z80_BC] & 0xFF; header[3]  = _zxCpu.registers.word[Z80_BC] >> 8;
+    header[4]  = _zxCpu.registers.word[Z80_HL] & 0xFF; header[5]  = _zxCpu.registers.word[Z80_HL] >> 8;
+    header[8]  = _zxCpu.registers.word[Z80_SP] & 0xFF; header[9]  = _zxCpu.registers.word[Z80_SP] >> 8;
+    header[10] = _zxCpu.i;
+    header[13] = _zxCpu.registers.word[Z80_DE] & 0xFF; header[14] = _zxCpu.registers.word[Z80_DE] >> 8;
+    header[15] = _zxCpu.alternates[Z80_BC] & 0xFF;     header[16] = _zxCpu.alternates[Z80_BC] >> 8;
+    header[17] = _zxCpu.alternates[Z80_DE] & 0xFF;     header[18] = _zxCpu.alternates[Z80_DE] >> 8;
+    header[19] = _zxCpu.alternates[Z80_HL] & 0xFF;     header[20] = _zxCpu.alternates[Z80_HL] >> 8;
+    header[21] = _zxCpu.alternates[Z80_AF] >> 8;       header[22] = _zxCpu.alternates[Z80_AF] & 0xFF; // watch out for order!!!
+    header[23] = _zxCpu.registers.word[Z80_IY] & 0xFF; header[24] = _zxCpu.registers.word[Z80_IY] >> 8;
+    header[25] = _zxCpu.registers.word[Z80_IX] & 0xFF; header[26] = _zxCpu.registers.word[Z80_IX] >> 8;
+    header[27] = _zxCpu.iff1 ? 1 : 0;
+    header[28] = _zxCpu.iff2 ? 1 : 0;
+    header[29] = _zxCpu.im & 0x03;
+    RegPC = _zxCpu.pc;
+    RegR = _zxCpu.r;
+#endif // CPU_LINKEFONG
+
+#ifdef CPU_JLSANCHEZ
+    header[0]  = Z80::getRegA();
+    header[1]  = Z80::getFlags();
+    header[2]  = Z80::getRegBC()  & 0xFF; header[3]  = Z80::getRegBC()  >> 8;
+    header[4]  = Z80::getRegHL()  & 0xFF; header[5]  = Z80::getRegHL()  >> 8;
+    header[8]  = Z80::getRegSP()  & 0xFF; header[9]  = Z80::getRegSP()  >> 8;
+    header[10] = Z80::getRegI();
+    header[13] = Z80::getRegDE()  & 0xFF; header[14] = Z80::getRegDE()  >> 8;
+    header[15] = Z80::getRegBCx() & 0xFF; header[16] = Z80::getRegBCx() >> 8;
+    header[17] = Z80::getRegDEx() & 0xFF; header[18] = Z80::getRegDEx() >> 8;
+    header[19] = Z80::getRegHLx() & 0xFF; header[20] = Z80::getRegHLx() >> 8;
+    header[21] = Z80::getRegAFx() >> 8;   header[22] = Z80::getRegAFx() & 0xFF; // watch out for order!!!
+    header[23] = Z80::getRegIY()  & 0xFF; header[24] = Z80::getRegIY()  >> 8;
+    header[25] = Z80::getRegIX()  & 0xFF; header[26] = Z80::getRegIX()  >> 8;
+    header[27] = Z80::isIFF1() ? 1 : 0;
+    header[28] = Z80::isIFF2() ? 1 : 0;
+    header[29] = Z80::getIM() & 0x03;
+    RegPC = Z80::getRegPC();
+    RegR = Z80::getRegR();
+#endif // CPU_JLSANCHEZ
+
+    // PC = 0 in the first header means version 2 or later
+    header[11] = RegR & 0x7F;
+    header[12] = (RegR >> 7) | (ESPectrum::borderColor << 1) | 0x20;
+
+    header[30] = 55;
+    header[32] = RegPC & 0xFF;
+    header[33] = RegPC >> 8;
+    // hardware mode: 128K, +3 (also for +3e) or +2A
+    header[34] = 0;
+    if (is128K) {
+        header[34] = 4;
+        if (Ports::plus2A && Config::getRomSet().startsWith("PLUS3")) header[34] = 7;
+        else if (Ports::plus2A && Config::getRomSet() == "PLUS2A") header[34] = 13;
+    }
+
+    if (is128K) {
+        uint8_t b35 = Mem::bankLatch;
+        bitWrite(b35, 3, Mem::videoLatch);
+        bitWrite(b35, 4, Mem::romLatch);
+        bitWrite(b35, 5, Mem::pagingLock);
+        header[35] = b35;
+
+        // last OUT to 0x1FFD, for +2A / +3 paging
+        uint8_t b86 = 0;
+        if (Ports::plus2A) {
+            bitWrite(b86, 0, Mem::modeSP3);
+            bitWrite(b86, 2, Mem::romSP3);
         }
+        header[86] = b86;
     }
-    #ifdef LOG_Z80_DETAILS
-        Serial.printf("last byte: %d\n", (memoff+memidx-1));
-    #endif
+
+#ifdef USE_AY_SOUND
+    // AY in use, last register selected, register contents
+    header[37] = 0x04;
+    header[38] = AySound::chip[0].getSelectedRegister();
+    for (uint8_t reg = 0; reg < 16; reg++)
+        header[39 + reg] = AySound::chip[0].readRegister(reg);
+#endif
+
+    // T-state counter: low word counts down within a quarter frame,
+    // high byte counts quarters
+    uint32_t quarter = CPU::statesPerFrame() / 4;
+    uint32_t tstates = CPU::tstates % CPU::statesPerFrame();
+    uint16_t low = quarter - (tstates % quarter) - 1;
+    header[55] = low & 0xFF;
+    header[56] = low >> 8;
+    header[57] = (tstates / quarter + 3) % 4;
+
+    outLen = 0;
+    outTotal = 0;
+    outFailed = false;
+
+    for (uint8_t i = 0; i < sizeof(header); i++)
+        putByte(f, header[i]);
+
+    if (is128K) {
+        for (uint8_t page = 0; page < 8; page++)
+            savePage(f, page + 3, Mem::ram[page]);
+    }
+    else {
+        // 0x4000, 0x8000 and 0xC000 as mapped in 48K mode
+        savePage(f, 8, Mem::ram5);
+        savePage(f, 4, Mem::ram2);
+        savePage(f, 5, Mem::ram0);
+    }
+
+    flushOut(f);
+    f.close();
+
+    if (outFailed) {
+        Serial.printf("FileZ80::save: write error on %s\n", z80_fn.c_str());
+        KB_INT_START;
+        return false;
+    }
+
+    Serial.printf("FileZ80::save: %u bytes in %u us\n", outTotal, (unsigned)(micros() - ts_start));
+
+    KB_INT_START;
+    return true;
 }
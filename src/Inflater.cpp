@@ -0,0 +1,441 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "Inflater.h"
+#include "FileUtils.h"
+
+#pragma GCC optimize ("O3")
+
+#define MAXBITS 15
+#define MAXLCODES 286
+#define MAXDCODES 30
+#define FIXLCODES 288
+// longest output of a single length/distance pair
+#define MAXMATCH 258
+
+// decoder behind the one-call functions, output goes to their buffer
+static Inflater oneShot;
+
+///////////////////////////////////////////////////////////////////////////////
+// input
+
+void Inflater::begin(File f, uint32_t srcLen)
+{
+    inFile = f;
+    inNext = f.position();
+    inPos = inLen = 0;
+    inLeft = srcLen;
+    inError = false;
+    bitBuf = 0;
+    bitCnt = 0;
+
+    state = BLOCK_HEADER;
+    lastBlock = false;
+    storedLeft = 0;
+    beginOutput(ownWindow, INFLATE_WINDOW_SIZE, 0xFFFFFFFF);
+}
+
+uint8_t Inflater::nextByte()
+{
+    if (inPos == inLen) {
+        uint16_t n = inLeft < INFLATE_INPUT_BUFFER_SIZE ? inLeft : INFLATE_INPUT_BUFFER_SIZE;
+        // the file may be shared, e.g. by the members of an archive
+        if (n && inFile.position() != inNext) inFile.seek(inNext);
+        inLen = n ? readBlockFile(inFile, inBuffer, n) : 0;
+        inNext += inLen;
+        inLeft -= inLen;
+        inPos = 0;
+        if (inLen == 0) {
+            inError = true;
+            return 0;
+        }
+    }
+    return inBuffer[inPos++];
+}
+
+// leave the file right after the stream, even if it was not fully decoded
+void Inflater::endInput()
+{
+    if (inLeft > 0 || inFile.position() != inNext)
+        inFile.seek(inNext + inLeft);
+    inLeft = 0;
+}
+
+inline uint32_t Inflater::bits(uint8_t need)
+{
+    while (bitCnt < need) {
+        bitBuf |= (uint32_t)nextByte() << bitCnt;
+        bitCnt += 8;
+    }
+    uint32_t value = bitBuf & ((1UL << need) - 1);
+    bitBuf >>= need;
+    bitCnt -= need;
+    return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// canonical Huffman codes
+
+// build decoding tables from code lengths; false if over-subscribed
+static bool construct(InflateHuffman& h, const uint8_t* length, uint16_t n)
+{
+    uint16_t offs[MAXBITS + 1];
+
+    for (uint8_t len = 0; len <= MAXBITS; len++) h.count[len] = 0;
+    for (uint16_t symbol = 0; symbol < n; symbol++) h.count[length[symbol]]++;
+    if (h.count[0] == n) return true;   // no codes: complete, but decoding will fail
+
+    int32_t left = 1;
+    for (uint8_t len = 1; len <= MAXBITS; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) return false;
+    }
+
+    offs[1] = 0;
+    for (uint8_t len = 1; len < MAXBITS; len++)
+        offs[len + 1] = offs[len] + h.count[len];
+    for (uint16_t symbol = 0; symbol < n; symbol++)
+        if (length[symbol] != 0)
+            h.symbol[offs[length[symbol]]++] = symbol;
+
+    return true;
+}
+
+// decode one symbol, -1 if the code is not valid
+int16_t Inflater::decodeSymbol(const InflateHuffman& h)
+{
+    int32_t code = 0, first = 0, index = 0;
+    for (uint8_t len = 1; len <= MAXBITS; len++) {
+        code |= bits(1);
+        int32_t count = h.count[len];
+        if (code - count < first)
+            return h.symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// blocks
+
+static const uint16_t lenBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lenExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+void Inflater::beginOutput(uint8_t* dst, uint32_t size, uint32_t limit)
+{
+    out = dst;
+    outSize = size;
+    outPos = 0;
+    outTotal = 0;
+    outLimit = limit;
+    pending = 0;
+}
+
+// decode until target bytes are pending or the stream ends
+void Inflater::decode(uint32_t target)
+{
+    while (pending < target && state != STREAM_END && state != STREAM_ERROR) {
+        bool ok;
+        if      (state == BLOCK_HEADER) ok = header();
+        else if (state == BLOCK_STORED) ok = stored(target);
+        else                            ok = codes(target);
+        if (!ok || inError) state = STREAM_ERROR;
+    }
+}
+
+bool Inflater::header()
+{
+    static bool built = false;
+    static InflateHuffman fixedLen, fixedDist;
+
+    lastBlock = bits(1);
+    uint8_t type = bits(2);
+
+    if (type == 0) {
+        // discard remaining bits of the current byte
+        bitBuf = 0;
+        bitCnt = 0;
+
+        uint16_t len = nextByte();
+        len |= nextByte() << 8;
+        uint16_t nlen = nextByte();
+        nlen |= nextByte() << 8;
+        if (len != (uint16_t)~nlen || inError) return false;
+        storedLeft = len;
+        state = BLOCK_STORED;
+        return true;
+    }
+
+    if (type == 1) {
+        if (!built) {
+            uint8_t lengths[FIXLCODES];
+            uint16_t symbol = 0;
+            for (; symbol < 144; symbol++) lengths[symbol] = 8;
+            for (; symbol < 256; symbol++) lengths[symbol] = 9;
+            for (; symbol < 280; symbol++) lengths[symbol] = 7;
+            for (; symbol < FIXLCODES; symbol++) lengths[symbol] = 8;
+            construct(fixedLen, lengths, FIXLCODES);
+            for (symbol = 0; symbol < MAXDCODES; symbol++) lengths[symbol] = 5;
+            construct(fixedDist, lengths, MAXDCODES);
+            built = true;
+        }
+        lenCode = &fixedLen;
+        distCode = &fixedDist;
+        state = BLOCK_CODES;
+        return true;
+    }
+
+    if (type == 2 && dynamicTables()) {
+        lenCode = &dynLen;
+        distCode = &dynDist;
+        state = BLOCK_CODES;
+        return true;
+    }
+
+    return false;
+}
+
+bool Inflater::stored(uint32_t target)
+{
+    while (storedLeft > 0 && pending < target) {
+        if (inPos == inLen) {
+            nextByte();
+            if (inError) return false;
+            inPos--;
+        }
+        uint32_t n = inLen - inPos;
+        if (n > storedLeft) n = storedLeft;
+        if (n > outSize - outPos) n = outSize - outPos;
+        if (n > target - pending) n = target - pending;
+        if (n == 0 || outTotal + n > outLimit) return false;
+        memcpy(out + outPos, inBuffer + inPos, n);
+        inPos += n;
+        storedLeft -= n;
+        outPos += n;
+        if (outPos == outSize) outPos = 0;
+        outTotal += n;
+        pending += n;
+    }
+    if (storedLeft == 0)
+        state = lastBlock ? STREAM_END : BLOCK_HEADER;
+    return true;
+}
+
+bool Inflater::codes(uint32_t target)
+{
+    while (pending < target) {
+        int16_t symbol = decodeSymbol(*lenCode);
+        if (symbol < 0 || inError) return false;
+
+        if (symbol < 256) {
+            if (outTotal == outLimit) return false;
+            out[outPos] = symbol;
+            if (++outPos == outSize) outPos = 0;
+            outTotal++;
+            pending++;
+        }
+        else if (symbol == 256) {
+            state = lastBlock ? STREAM_END : BLOCK_HEADER;
+            return true;
+        }
+        else {
+            symbol -= 257;
+            if (symbol >= 29) return false;
+            uint32_t len = lenBase[symbol] + bits(lenExtra[symbol]);
+
+            symbol = decodeSymbol(*distCode);
+            if (symbol < 0 || symbol >= 30) return false;
+            uint32_t dist = distBase[symbol] + bits(distExtra[symbol]);
+
+            if (dist > outTotal || dist > outSize || outTotal + len > outLimit) return false;
+            uint32_t from = (outPos >= dist) ? outPos - dist : outPos + outSize - dist;
+            outTotal += len;
+            pending += len;
+            if (from + len <= outSize && outPos + len <= outSize) {
+                const uint8_t* src = out + from;
+                uint8_t* to = out + outPos;
+                outPos += len;
+                if (outPos == outSize) outPos = 0;
+                // overlapping copy: byte by byte on purpose
+                while (len--) *to++ = *src++;
+            }
+            else {
+                // around the end of the window
+                while (len--) {
+                    out[outPos] = out[from];
+                    if (++outPos == outSize) outPos = 0;
+                    if (++from == outSize) from = 0;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool Inflater::dynamicTables()
+{
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[MAXLCODES + MAXDCODES];
+
+    uint16_t nlen = bits(5) + 257;
+    uint16_t ndist = bits(5) + 1;
+    uint16_t ncode = bits(4) + 4;
+    if (nlen > MAXLCODES || ndist > MAXDCODES) return false;
+
+    // code length code lengths
+    uint8_t index;
+    for (index = 0; index < ncode; index++) lengths[order[index]] = bits(3);
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (!construct(dynLen, lengths, 19)) return false;
+
+    // literal/length and distance code lengths
+    uint16_t i = 0;
+    while (i < nlen + ndist) {
+        int16_t symbol = decodeSymbol(dynLen);
+        if (symbol < 0 || inError) return false;
+        if (symbol < 16) {
+            lengths[i++] = symbol;
+            continue;
+        }
+        uint8_t len = 0;
+        uint8_t repeat;
+        if (symbol == 16) {
+            if (i == 0) return false;
+            len = lengths[i - 1];
+            repeat = 3 + bits(2);
+        }
+        else if (symbol == 17) repeat = 3 + bits(3);
+        else                   repeat = 11 + bits(7);
+        if (i + repeat > nlen + ndist) return false;
+        while (repeat--) lengths[i++] = len;
+    }
+    if (lengths[256] == 0) return false;
+
+    if (!construct(dynLen, lengths, nlen)) return false;
+    if (!construct(dynDist, lengths + nlen, ndist)) return false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Inflater::Inflater(uint8_t* window) : ownWindow(window)
+{
+    state = STREAM_END;
+    beginOutput(window, INFLATE_WINDOW_SIZE, 0);
+}
+
+int32_t Inflater::read(uint8_t* buf, uint32_t len)
+{
+    uint32_t done = 0;
+    while (done < len) {
+        if (pending == 0) {
+            // a match never overwrites output not returned yet
+            uint32_t want = len - done;
+            if (want > outSize - MAXMATCH) want = outSize - MAXMATCH;
+            decode(want);
+            if (state == STREAM_ERROR) return -1;
+            if (pending == 0) break;
+        }
+        // oldest byte pending, up to the end of the window
+        uint32_t from = (outPos >= pending) ? outPos - pending : outPos + outSize - pending;
+        uint32_t n = pending;
+        if (n > len - done) n = len - done;
+        if (n > outSize - from) n = outSize - from;
+        memcpy(buf + done, out + from, n);
+        done += n;
+        pending -= n;
+    }
+    return done;
+}
+
+int32_t Inflater::inflateRaw(File f, uint32_t srcLen, uint8_t* dst, uint32_t dstLen)
+{
+    Inflater& z = oneShot;
+    z.begin(f, srcLen);
+    z.beginOutput(dst, dstLen, dstLen);
+    z.decode(0xFFFFFFFF);
+    z.endInput();
+    return z.state == STREAM_END ? (int32_t)z.outTotal : -1;
+}
+
+int32_t Inflater::inflateZlib(File f, uint32_t srcLen, uint8_t* dst, uint32_t dstLen)
+{
+    Inflater& z = oneShot;
+    z.begin(f, srcLen);
+
+    // CM = 8 (deflate), no preset dictionary
+    uint8_t cmf = z.nextByte();
+    uint8_t flg = z.nextByte();
+    if ((cmf & 0x0F) != 8 || (flg & 0x20) || ((cmf << 8) | flg) % 31 != 0) {
+        z.endInput();
+        return -1;
+    }
+
+    z.beginOutput(dst, dstLen, dstLen);
+    z.decode(0xFFFFFFFF);
+    int32_t result = z.state == STREAM_END ? (int32_t)z.outTotal : -1;
+
+    if (result >= 0) {
+        // Adler-32 of the output, big endian
+        z.bitBuf = 0;
+        z.bitCnt = 0;
+        uint32_t expected = 0;
+        for (uint8_t i = 0; i < 4; i++)
+            expected = (expected << 8) | z.nextByte();
+
+        uint32_t a = 1, b = 0;
+        for (int32_t i = 0; i < result; i++) {
+            a += dst[i];
+            if (a >= 65521) a -= 65521;
+            b += a;
+            if (b >= 65521) b -= 65521;
+        }
+        if (z.inError || expected != ((b << 16) | a))
+            result = -1;
+    }
+
+    z.endInput();
+    return result;
+}
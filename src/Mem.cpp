@@ -29,12 +29,14 @@
 
 #include "Mem.h"
 #include <stddef.h>
+#include <string.h>
 
 uint8_t* Mem::rom0 = NULL;
 uint8_t* Mem::rom1 = NULL;
 uint8_t* Mem::rom2 = NULL;
 uint8_t* Mem::rom3 = NULL;
-uint8_t* Mem::rom[4];
+uint8_t* Mem::rom[5];
+uint8_t Mem::romCount = 0;
 
 uint8_t* Mem::ram0 = NULL;
 uint8_t* Mem::ram1 = NULL;
@@ -54,3 +56,33 @@ uint8_t Mem::modeSP3 = 0;
 uint8_t Mem::romSP3 = 0;
 uint8_t Mem::romInUse = 0;
 
+uint8_t Mem::dirty[8][MEM_BLOCKS_PER_PAGE] __attribute__((aligned(4)));
+
+bool Mem::isPageDirty(uint8_t page, uint8_t user)
+{
+    // four blocks at a time
+    const uint32_t* blocks = (const uint32_t*)dirty[page];
+    uint32_t mask = user * 0x01010101U;
+    for (uint8_t i = 0; i < MEM_BLOCKS_PER_PAGE / 4; i++)
+        if (blocks[i] & mask)
+            return true;
+    return false;
+}
+
+void Mem::clearPageDirty(uint8_t page, uint8_t user)
+{
+    uint32_t* blocks = (uint32_t*)dirty[page];
+    uint32_t mask = ~(user * 0x01010101U);
+    for (uint8_t i = 0; i < MEM_BLOCKS_PER_PAGE / 4; i++)
+        blocks[i] &= mask;
+}
+
+void Mem::markPageDirty(uint8_t page)
+{
+    memset(dirty[page], 0xFF, MEM_BLOCKS_PER_PAGE);
+}
+
+void Mem::markAllDirty()
+{
+    memset(dirty, 0xFF, sizeof(dirty));
+}
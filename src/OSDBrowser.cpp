@@ -0,0 +1,353 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "osd.h"
+#include "FileUtils.h"
+#include "FileCatalog.h"
+#include "ScreenPreview.h"
+#include "PS2Kbd.h"
+#include "ESPectrum.h"
+#include "messages.h"
+#include "Wiimote2Keys.h"
+
+// entry rows on screen, below the title
+#define BROWSER_ROWS 22
+// width of the entry list, the preview goes to its right
+#define BROWSER_COLS 30
+#define PREVIEW_PANEL_W (PREVIEW_W + 4)
+// previews not cached are read once the focus stops for this long
+#define PREVIEW_DELAY_MS 150
+
+extern Font Font6x8;
+
+// PS/2 scan codes of the keys for type-ahead, and their characters
+static const uint8_t jumpKeys[] = {
+    0x1C, 0x32, 0x21, 0x23, 0x24, 0x2B, 0x34, 0x33, 0x43, 0x3B, 0x42, 0x4B, 0x3A,
+    0x31, 0x44, 0x4D, 0x15, 0x2D, 0x1B, 0x2C, 0x3C, 0x2A, 0x1D, 0x22, 0x35, 0x1A,
+    0x45, 0x16, 0x1E, 0x26, 0x25, 0x2E, 0x36, 0x3D, 0x3E, 0x46 };
+static const char jumpChars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+static String dir;                      // directory shown
+static bool hasParent;                  // first row is ".."
+static uint16_t total;                  // rows in the directory
+static uint16_t pageFirst;              // first row on screen
+static uint16_t focus;                  // focused row
+static CatalogEntry page[BROWSER_ROWS]; // entries on screen
+
+static uint32_t previewDue;             // millis() to read the preview at, 0 if none
+static byte cols;                       // Width of the list in columns
+static unsigned short x;                // X position
+static unsigned short y;                // Y position
+static unsigned short w;                // Width in pixels
+static unsigned short h;                // Height in pixels
+
+///////////////////////////////////////////////////////////////////////////////
+
+// read the entries of the rows on screen
+static void loadPage()
+{
+    memset(page, 0, sizeof(page));
+    uint16_t slot = 0;
+    uint16_t first = pageFirst;
+    if (hasParent && pageFirst == 0) {
+        strcpy(page[0].name, "..");
+        page[0].type = CATALOG_TYPE_DIR;
+        slot = 1;
+        first = 1;
+    }
+    FileCatalog::read(first - (hasParent ? 1 : 0), BROWSER_ROWS - slot, page + slot);
+}
+
+// entry of a row, which must be on screen
+static const CatalogEntry& rowEntry(uint16_t row)
+{
+    return page[row - pageFirst];
+}
+
+// name shown for an entry: no snapshot extension, '_' and '-' as spaces
+static String displayName(const CatalogEntry& e)
+{
+    String name = e.name;
+    if (e.type == CATALOG_TYPE_DIR) {
+        if (name != "..") name += "/";
+        return name;
+    }
+    if (e.type == CATALOG_TYPE_SNA || e.type == CATALOG_TYPE_Z80 || e.type == CATALOG_TYPE_SZX)
+        name = name.substring(0, name.length() - 4);
+    name.replace("_", " ");
+    name.replace("-", " ");
+    return name;
+}
+
+static void printRow(byte screenRow, String text, uint16_t ink, uint16_t paper, byte margin)
+{
+    VGA& vga = ESPectrum::vga;
+    vga.setTextColor(ink, paper);
+    vga.setCursor(x + 1, y + 1 + screenRow * OSD_FONT_H);
+    vga.print(" ");
+    if (text.length() > (unsigned)(cols - margin))
+        text = text.substring(0, cols - margin);
+    vga.print(text.c_str());
+    for (byte i = text.length(); i < cols - margin; i++)
+        vga.print(" ");
+    vga.print(" ");
+}
+
+static void drawRow(uint16_t row)
+{
+    byte margin = (total > BROWSER_ROWS) ? 3 : 2;
+    if (row >= total) {
+        printRow(row - pageFirst + 1, "", OSD::zxColor(0, 1), OSD::zxColor(7, 1), margin);
+        return;
+    }
+    String text = displayName(rowEntry(row));
+    if (row == focus)
+        printRow(row - pageFirst + 1, text, OSD::zxColor(0, 1), OSD::zxColor(5, 1), margin);
+    else
+        printRow(row - pageFirst + 1, text, OSD::zxColor(0, 1), OSD::zxColor(7, 1), margin);
+}
+
+static void drawScrollBar()
+{
+    if (total <= BROWSER_ROWS) return;
+    VGA& vga = ESPectrum::vga;
+    vga.setTextColor(OSD::zxColor(7, 0), OSD::zxColor(0, 0));
+
+    // handles
+    vga.setCursor(x + 1 + (cols - 1) * OSD_FONT_W, y + 1 + OSD_FONT_H);
+    vga.print(pageFirst > 0 ? "+" : "-");
+    vga.setCursor(x + 1 + (cols - 1) * OSD_FONT_W, y + 1 + BROWSER_ROWS * OSD_FONT_H);
+    vga.print(pageFirst + BROWSER_ROWS < total ? "+" : "-");
+
+    // bar
+    unsigned short holder_x = x + (OSD_FONT_W * (cols - 1)) + 1;
+    unsigned short holder_y = y + (OSD_FONT_H * 2) + 1;
+    unsigned short holder_h = OSD_FONT_H * (BROWSER_ROWS - 2);
+    vga.fillRect(holder_x, holder_y, OSD_FONT_W, holder_h, OSD::zxColor(7, 0));
+    unsigned short bar_h = (uint32_t)holder_h * BROWSER_ROWS / total;
+    unsigned short bar_y = (uint32_t)holder_h * pageFirst / total;
+    if (bar_h < 2) bar_h = 2;
+    if (bar_y + bar_h > holder_h) bar_y = holder_h - bar_h;
+    vga.fillRect(holder_x + 1, holder_y + bar_y, OSD_FONT_W - 2, bar_h, OSD::zxColor(0, 0));
+}
+
+static void drawPreview(const uint8_t* preview)
+{
+    ESPectrum::waitForVideoTask();
+    VGA& vga = ESPectrum::vga;
+    unsigned short px = x + 1 + cols * OSD_FONT_W;
+    unsigned short py = y + 1 + OSD_FONT_H;
+    vga.fillRect(px, y + 1, PREVIEW_PANEL_W, h - 2, OSD::zxColor(0, 0));
+    if (focus >= total || (hasParent && focus == 0))
+        return;
+
+    const CatalogEntry& e = rowEntry(focus);
+    if (preview) {
+        px += 2;
+        py += 2;
+        for (uint8_t ty = 0; ty < PREVIEW_H; ty++) {
+            const uint8_t* src = preview + ty * (PREVIEW_W / 2);
+            for (uint8_t tx = 0; tx < PREVIEW_W; tx += 2) {
+                uint8_t pair = *src++;
+                vga.dot(px + tx, py + ty, OSD::zxColor((pair >> 4) & 0x07, pair >> 7));
+                vga.dot(px + tx + 1, py + ty, OSD::zxColor(pair & 0x07, (pair >> 3) & 0x01));
+            }
+        }
+        py += PREVIEW_H + 2;
+        px -= 2;
+    }
+
+    // what the entry is for
+    if (e.machine != CATALOG_MACHINE_UNKNOWN) {
+        vga.setTextColor(OSD::zxColor(7, 0), OSD::zxColor(0, 0));
+        vga.setCursor(px + 2, py + 2);
+        vga.print(e.machine == CATALOG_MACHINE_48K ? "48K" : "128K");
+    }
+}
+
+// show the preview of the focused entry now if cached, else a bit later
+static void updatePreview()
+{
+    previewDue = 0;
+    if (focus >= total || (hasParent && focus == 0) || !ScreenPreview::hasPreview(rowEntry(focus))) {
+        drawPreview(NULL);
+        return;
+    }
+    const uint8_t* preview = ScreenPreview::cached(dir, rowEntry(focus));
+    drawPreview(preview);
+    if (preview == NULL)
+        previewDue = millis() + PREVIEW_DELAY_MS;
+}
+
+static void drawAll()
+{
+    ESPectrum::waitForVideoTask();
+    VGA& vga = ESPectrum::vga;
+    vga.setFont(Font6x8);
+    vga.rect(x, y, w, h, OSD::zxColor(0, 0));
+
+    String title = (dir == DISK_SNA_DIR) ? String(MENU_SNA_TITLE) : dir.substring(strlen(DISK_SNA_DIR));
+    printRow(0, title, OSD::zxColor(7, 0), OSD::zxColor(0, 0), 2);
+
+    for (uint16_t row = pageFirst; row < pageFirst + BROWSER_ROWS; row++)
+        drawRow(row);
+    drawScrollBar();
+    updatePreview();
+}
+
+// move the focus, scrolling if it leaves the screen
+static void moveFocus(int32_t row)
+{
+    if (row >= (int32_t)total) row = (int32_t)total - 1;
+    if (row < 0) row = 0;
+
+    uint16_t oldFocus = focus;
+    uint16_t oldFirst = pageFirst;
+    focus = row;
+    if (focus < pageFirst)
+        pageFirst = focus;
+    else if (focus >= pageFirst + BROWSER_ROWS)
+        pageFirst = focus - BROWSER_ROWS + 1;
+
+    if (pageFirst != oldFirst) {
+        loadPage();
+        drawAll();
+    }
+    else if (focus != oldFocus) {
+        drawRow(oldFocus);
+        drawRow(focus);
+        updatePreview();
+    }
+}
+
+static bool openDir(String newDir, const char* focusName)
+{
+    if (!FileCatalog::open(newDir))
+        return false;
+    dir = newDir;
+    hasParent = (dir != DISK_SNA_DIR);
+    total = FileCatalog::count() + (hasParent ? 1 : 0);
+
+    int32_t found = focusName ? FileCatalog::find(focusName) : -1;
+    focus = (found >= 0) ? found + (hasParent ? 1 : 0) : 0;
+    pageFirst = (focus >= BROWSER_ROWS) ? focus - BROWSER_ROWS / 2 : 0;
+    if (pageFirst + BROWSER_ROWS > total)
+        pageFirst = (total > BROWSER_ROWS) ? total - BROWSER_ROWS : 0;
+
+    loadPage();
+    drawAll();
+    return true;
+}
+
+static void openParent()
+{
+    int slash = dir.lastIndexOf('/');
+    String child = dir.substring(slash + 1);
+    openDir(dir.substring(0, slash), child.c_str());
+}
+
+// jump to the first entry starting with c, or to the next one if the
+// focused entry already does
+static void jumpTo(char c)
+{
+    char prefix[2] = { c, 0 };
+    uint16_t offset = hasParent ? 1 : 0;
+    uint16_t target = FileCatalog::lowerBound(prefix) + offset;
+
+    CatalogEntry e;
+    if (focus >= offset && tolower(rowEntry(focus).name[0]) == c
+        && FileCatalog::read(focus - offset + 1, 1, &e) == 1 && tolower(e.name[0]) == c)
+        target = focus + 1;
+
+    moveFocus(target);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Browse the snapshot directory and its subdirectories, only the entries on
+// screen are in memory. Returns the path of the file selected, relative to
+// the snapshot directory, or an empty string if cancelled.
+String OSD::fileBrowser()
+{
+    cols = BROWSER_COLS;
+    w = (cols * OSD_FONT_W) + 2 + PREVIEW_PANEL_W;
+    h = ((BROWSER_ROWS + 1) * OSD_FONT_H) + 2;
+    x = scrAlignCenterX(w);
+    y = scrAlignCenterY(h);
+
+    if (!openDir(DISK_SNA_DIR, NULL))
+        return "";
+
+    while (1) {
+        updateWiimote2KeysOSD();
+        if (previewDue != 0 && (int32_t)(millis() - previewDue) >= 0) {
+            previewDue = 0;
+            drawPreview(ScreenPreview::get(dir, rowEntry(focus)));
+        }
+        if (PS2Keyboard::checkAndCleanKey(KEY_CURSOR_UP)) {
+            moveFocus((int32_t)focus - 1);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_CURSOR_DOWN)) {
+            moveFocus((int32_t)focus + 1);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_PAGE_UP)) {
+            moveFocus((int32_t)focus - BROWSER_ROWS);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_PAGE_DOWN)) {
+            moveFocus((int32_t)focus + BROWSER_ROWS);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_HOME)) {
+            moveFocus(0);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_END)) {
+            moveFocus((int32_t)total - 1);
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_BACKSPACE)) {
+            if (hasParent) openParent();
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_ENTER)) {
+            if (total == 0) continue;
+            const CatalogEntry& e = rowEntry(focus);
+            if (hasParent && focus == 0) {
+                openParent();
+            } else if (e.type == CATALOG_TYPE_DIR) {
+                openDir(dir + "/" + e.name, NULL);
+            } else {
+                String selected = dir.substring(strlen(DISK_SNA_DIR) + 1);
+                if (selected.length() > 0) selected += "/";
+                selected += e.name;
+                FileCatalog::close();
+                return selected;
+            }
+        } else if (PS2Keyboard::checkAndCleanKey(KEY_ESC) || PS2Keyboard::checkAndCleanKey(KEY_F1)) {
+            FileCatalog::close();
+            return "";
+        } else {
+            for (byte i = 0; i < sizeof(jumpKeys); i++) {
+                if (PS2Keyboard::checkAndCleanKey(jumpKeys[i])) {
+                    jumpTo(jumpChars[i]);
+                    break;
+                }
+            }
+        }
+    }
+}
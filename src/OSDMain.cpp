@@ -36,7 +36,18 @@
 #include "Wiimote2Keys.h"
 #include "Config.h"
 #include "FileSNA.h"
+#include "FileZ80.h"
+#include "FileSZX.h"
+#include "QuickSlots.h"
+#include "Rewind.h"
+#include "FileRZX.h"
 #include "AySound.h"
+#include "AyRecorder.h"
+#include "FileDSK.h"
+#include "FDC.h"
+#include "FileTRD.h"
+#include "BetaDisk.h"
+#include "FileTZX.h"
 
 #define MENU_REDRAW true
 #define MENU_UPDATE false
@@ -105,40 +116,61 @@ void OSD::drawOSD() {
     osdHome();
 }
 
-static void quickSave()
+static void quickSave(uint8_t slot)
 {
     OSD::osdCenteredMsg(OSD_QSNA_SAVING, LEVEL_INFO);
-    if (!FileSNA::saveQuick()) {
+    if (!QuickSlots::save(slot)) {
         OSD::osdCenteredMsg(OSD_QSNA_SAVE_ERR, LEVEL_WARN);
         delay(1000);
         return;
     }
-    OSD::osdCenteredMsg(OSD_QSNA_SAVED, LEVEL_INFO);
+    QuickSlots::select(slot);
+    OSD::osdCenteredMsg((String)OSD_QSNA_SAVED + ": " + QuickSlots::describe(slot), LEVEL_INFO);
     delay(200);
 }
 
-static void quickLoad()
+static void quickLoad(uint8_t slot)
 {
-    if (!FileSNA::isQuickAvailable()) {
+    if (!QuickSlots::isUsed(slot)) {
         OSD::osdCenteredMsg(OSD_QSNA_NOT_AVAIL, LEVEL_INFO);
         delay(1000);
         return;
     }
+    // a recording cannot reproduce a state loaded from elsewhere
+    FileRZX::stop();
     OSD::osdCenteredMsg(OSD_QSNA_LOADING, LEVEL_INFO);
-    if (!FileSNA::loadQuick()) {
+    if (!QuickSlots::load(slot)) {
         OSD::osdCenteredMsg(OSD_QSNA_LOAD_ERR, LEVEL_WARN);
         delay(1000);
         return;
     }
+    QuickSlots::select(slot);
     if (Config::getArch() == "48K") AySound::reset();
     OSD::osdCenteredMsg(OSD_QSNA_LOADED, LEVEL_INFO);
     delay(200);
 }
 
+// returns the slot chosen, or -1 if cancelled
+static int8_t quickSlotMenu(String title)
+{
+    String menu = title;
+    for (uint8_t i = 0; i < QUICK_SLOTS; i++)
+        menu += QuickSlots::describe(i) + (i == QuickSlots::selected() ? " *\n" : "\n");
+    uint8_t row = OSD::menuRun(menu);
+    return row == 0 ? -1 : row - 1;
+}
+
 static void persistSave()
 {
+    // state is copied to PSRAM and written on core 0, emulation goes on
+    if (FileSZX::saveAsync(DISK_PSNA_FILE)) {
+        OSD::osdCenteredMsg(OSD_PSNA_SAVING_BG, LEVEL_INFO);
+        delay(200);
+        return;
+    }
+    FileSZX::waitForSave();
     OSD::osdCenteredMsg(OSD_PSNA_SAVING, LEVEL_INFO);
-    if (!FileSNA::save(DISK_PSNA_FILE)) {
+    if (!FileSZX::save(DISK_PSNA_FILE)) {
         OSD::osdCenteredMsg(OSD_PSNA_SAVE_ERR, LEVEL_WARN);
         delay(1000);
         return;
@@ -149,14 +181,17 @@ static void persistSave()
 
 static void persistLoad()
 {
+    FileSZX::waitForSave();
+    FileSZX::recoverSave(DISK_PSNA_FILE);
     if (!FileSNA::isPersistAvailable()) {
         OSD::osdCenteredMsg(OSD_PSNA_NOT_AVAIL, LEVEL_INFO);
         delay(1000);
         return;
     }
+    FileRZX::stop();
     OSD::osdCenteredMsg(OSD_PSNA_LOADING, LEVEL_INFO);
-    FileSNA::load(DISK_PSNA_FILE);
-    // if (!FileSNA::load(DISK_PSNA_FILE)) {
+    FileSZX::load(DISK_PSNA_FILE);
+    // if (!FileSZX::load(DISK_PSNA_FILE)) {
     //     osdCenteredMsg(OSD_PSNA_LOAD_ERR, LEVEL_WARN);
     //     delay(1000);
     // }
@@ -165,11 +200,93 @@ static void persistLoad()
     delay(400);
 }
 
+// snapshots listed newest first, as seconds back
+static void rewind()
+{
+    if (Rewind::count() == 0) {
+        OSD::osdCenteredMsg(OSD_REWIND_NOT_AVAIL, LEVEL_INFO);
+        delay(1000);
+        return;
+    }
+    String menu = MENU_REWIND;
+    for (uint8_t n = 0; n < Rewind::count(); n++) {
+        uint32_t tenths = Rewind::age(n) / 5;
+        menu += "-" + (String)(tenths / 10) + "." + (String)(tenths % 10) + " s\n";
+    }
+    uint8_t row = OSD::menuRun(menu);
+    if (row == 0) return;
+    FileRZX::stop();
+    if (!Rewind::restore(row - 1)) {
+        OSD::osdCenteredMsg(OSD_REWIND_ERR, LEVEL_WARN);
+        delay(1000);
+        return;
+    }
+    OSD::osdCenteredMsg(OSD_REWIND_DONE, LEVEL_INFO);
+    delay(200);
+}
+
+// start or stop recording the input; stops a playback too
+static void recordInput()
+{
+    if (FileRZX::isRecording()) {
+        FileRZX::stop();
+        OSD::osdCenteredMsg((String)OSD_RZX_SAVED + ": " + FileRZX::fileName(), LEVEL_INFO);
+    }
+    else if (FileRZX::isPlaying()) {
+        FileRZX::stop();
+        OSD::osdCenteredMsg(OSD_RZX_STOPPED, LEVEL_INFO);
+    }
+    else if (FileRZX::record(FileRZX::nextFileName(Config::ram_file))) {
+        OSD::osdCenteredMsg((String)OSD_RZX_STARTED + ": " + FileRZX::fileName(), LEVEL_INFO);
+    }
+    else {
+        OSD::osdCenteredMsg(OSD_RZX_ERR, LEVEL_WARN);
+    }
+    delay(1000);
+}
+
+// press play or stop on the TZX player, e.g. to go on after a stop block
+// for a loader that does not go through LD-BYTES
+static void tapePlayPause()
+{
+    if (!FileTZX::isInserted()) {
+        OSD::osdCenteredMsg(OSD_TAPE_NONE, LEVEL_INFO);
+    }
+    else if (FileTZX::isPlaying()) {
+        FileTZX::stop();
+        OSD::osdCenteredMsg(OSD_TAPE_PAUSED, LEVEL_INFO);
+    }
+    else {
+        FileTZX::play();
+        OSD::osdCenteredMsg(FileTZX::isPlaying() ? OSD_TAPE_PLAYING : OSD_TAPE_END, LEVEL_INFO);
+    }
+    delay(400);
+}
+
 // OSD Main Loop
 void OSD::do_OSD() {
     VGA& vga = ESPectrum::vga;
     static byte last_sna_row = 0;
     static unsigned int last_demo_ts = millis() / 1000;
+
+    // completion of a background persist save
+    uint8_t saveResult = FileSZX::pollSave();
+    if (saveResult == SZX_SAVE_DONE) {
+        osdCenteredMsg(OSD_PSNA_SAVED, LEVEL_OK);
+        delay(200);
+    }
+    else if (saveResult == SZX_SAVE_FAILED) {
+        osdCenteredMsg(OSD_PSNA_SAVE_ERR, LEVEL_WARN);
+        delay(1000);
+    }
+
+    // end of an input recording being played
+    if (FileRZX::pollEnded()) {
+        osdCenteredMsg((String)OSD_RZX_ENDED + ", " + FileRZX::desyncs() + " frames out of sync",
+            FileRZX::desyncs() ? LEVEL_WARN : LEVEL_INFO);
+        delay(1000);
+    }
+
     if (PS2Keyboard::checkAndCleanKey(KEY_PAUSE)) {
         AySound::disable();
         osdCenteredMsg(OSD_PAUSE, LEVEL_INFO);
@@ -180,14 +297,19 @@ void OSD::do_OSD() {
     }
     else if (PS2Keyboard::checkAndCleanKey(KEY_F2)) {
         AySound::disable();
-        quickSave();
+        quickSave(QuickSlots::selected());
         AySound::enable();
     }
     else if (PS2Keyboard::checkAndCleanKey(KEY_F3)) {
         AySound::disable();
-        quickLoad();
+        quickLoad(QuickSlots::selected());
         AySound::enable();
     }
+    else if (PS2Keyboard::checkAndCleanKey(KEY_F6)) {
+        QuickSlots::select(QuickSlots::selected() + 1);
+        osdCenteredMsg((String)OSD_QSNA_SLOT + " " + QuickSlots::describe(QuickSlots::selected()), LEVEL_INFO);
+        delay(400);
+    }
     else if (PS2Keyboard::checkAndCleanKey(KEY_F4)) {
         AySound::disable();
         persistSave();
@@ -198,6 +320,19 @@ void OSD::do_OSD() {
         persistLoad();
         AySound::enable();
     }
+    else if (PS2Keyboard::checkAndCleanKey(KEY_F7)) {
+        AySound::disable();
+        rewind();
+        AySound::enable();
+    }
+    else if (PS2Keyboard::checkAndCleanKey(KEY_F8)) {
+        AySound::disable();
+        recordInput();
+        AySound::enable();
+    }
+    else if (PS2Keyboard::checkAndCleanKey(KEY_F9)) {
+        tapePlayPause();
+    }
     else if (PS2Keyboard::checkAndCleanKey(KEY_F1)) {
         AySound::disable();
 
@@ -205,9 +340,9 @@ void OSD::do_OSD() {
         byte opt = menuRun(MENU_MAIN);
         if (opt == 1) {
             // Change RAM
-            unsigned short snanum = menuRun(Config::sna_name_list);
-            if (snanum > 0) {
-                changeSnapshot(rowGet(Config::sna_file_list, snanum));
+            String snafile = fileBrowser();
+            if (snafile != "") {
+                changeSnapshot(snafile);
             }
         }
         else if (opt == 2) {
@@ -230,10 +365,12 @@ void OSD::do_OSD() {
             }
         }
         else if (opt == 3) {
-            quickSave();
+            int8_t slot = quickSlotMenu(MENU_QSLOT_SAVE);
+            if (slot >= 0) quickSave(slot);
         }
         else if (opt == 4) {
-            quickLoad();
+            int8_t slot = quickSlotMenu(MENU_QSLOT_LOAD);
+            if (slot >= 0) quickLoad(slot);
         }
         else if (opt == 5) {
             persistSave();
@@ -242,6 +379,61 @@ void OSD::do_OSD() {
             persistLoad();
         }
         else if (opt == 7) {
+            rewind();
+        }
+        else if (opt == 8) {
+            recordInput();
+        }
+        else if (opt == 9) {
+            // Sound options
+#ifdef AY_STEREO
+            byte opt2 = menuRun(MENU_SOUND);
+#else
+            // no panning rows: AY Record is the first one
+            byte opt2 = menuRun(MENU_SOUND_MONO);
+            if (opt2 > 0) opt2 += 3;
+#endif
+            if (opt2 >= 1 && opt2 <= 3) {
+                // menu rows follow AY_STEREO_MONO, AY_STEREO_ABC, AY_STEREO_ACB
+                Config::ay_stereo = opt2 - 1;
+                AySound::setStereoMode(Config::ay_stereo);
+                Config::save();
+            }
+            else if (opt2 == 4) {
+                // AY register recording to PSG
+                if (AyRecorder::isRecording()) {
+                    AyRecorder::stop();
+                    osdCenteredMsg((String)OSD_AYREC_SAVED + ": " + AyRecorder::fileName(), LEVEL_INFO);
+                }
+                else if (AyRecorder::start(AyRecorder::nextFileName(Config::ram_file))) {
+                    osdCenteredMsg((String)OSD_AYREC_STARTED + ": " + AyRecorder::fileName(), LEVEL_INFO);
+                }
+                else {
+                    osdCenteredMsg(OSD_AYREC_ERR, LEVEL_WARN);
+                }
+                delay(1000);
+            }
+        }
+        else if (opt == 10) {
+            // Disk options
+            byte opt2 = menuRun(MENU_DISK);
+            if (opt2 == 1 || opt2 == 2) {
+                Config::fast_disk = (opt2 == 1);
+                FDC::fast = Config::fast_disk;
+                BetaDisk::fast = Config::fast_disk;
+                Config::save();
+            }
+            else if (opt2 == 3 && (FileDSK::isInserted() || FileTRD::isInserted())) {
+                FileDSK::close();
+                FileTRD::close();
+                osdCenteredMsg(OSD_DISK_EJECTED, LEVEL_INFO);
+                delay(1000);
+            }
+        }
+        else if (opt == 11) {
+            tapePlayPause();
+        }
+        else if (opt == 12) {
             // Reset
             byte opt2 = menuRun(MENU_RESET);
             if (opt2 == 1) {
@@ -262,7 +454,7 @@ void OSD::do_OSD() {
                 ESP.restart();
             }
         }
-        else if (opt == 8) {
+        else if (opt == 13) {
             // Help
             drawOSD();
             osdAt(2, 0);
@@ -384,11 +576,81 @@ String OSD::rowGet(String menu, unsigned short row) {
 
 #include "FileSNA.h"
 #include "FileZ80.h"
+#include "FileTAP.h"
+#include "FileTZX.h"
 
 // Change running snapshot
 void OSD::changeSnapshot(String filename)
 {
-    if (FileUtils::hasSNAextension(filename))
+    if (FileUtils::hasTAPextension(filename))
+    {
+        // a tape does not replace the running program, it is loaded with LOAD ""
+        Serial.printf("Inserting TAP: %s\n", filename.c_str());
+        FileTZX::close();
+        if (FileTAP::open((String)DISK_SNA_DIR + "/" + filename))
+            osdCenteredMsg(OSD_TAPE_INSERTED, LEVEL_INFO);
+        else
+            osdCenteredMsg(OSD_TAPE_ERR, LEVEL_ERROR);
+        return;
+    }
+    else if (FileUtils::hasTZXextension(filename))
+    {
+        // played when the ROM loader starts reading the tape
+        Serial.printf("Inserting TZX: %s\n", filename.c_str());
+        FileTAP::close();
+        if (FileTZX::open((String)DISK_SNA_DIR + "/" + filename))
+            osdCenteredMsg(OSD_TAPE_INSERTED, LEVEL_INFO);
+        else
+            osdCenteredMsg(OSD_TAPE_ERR, LEVEL_ERROR);
+        return;
+    }
+    else if (FileUtils::hasDSKextension(filename))
+    {
+        // a disk goes into the drive of a +3, started from its Loader
+        Serial.printf("Inserting DSK: %s\n", filename.c_str());
+        if (!FDC::present) {
+            Config::requestMachine("128K", "PLUS3", true);
+            Config::save();
+            ESPectrum::reset();
+        }
+        if (FileDSK::open((String)DISK_SNA_DIR + "/" + filename))
+            osdCenteredMsg(OSD_DISK_INSERTED, LEVEL_INFO);
+        else
+            osdCenteredMsg(OSD_DISK_ERR, LEVEL_ERROR);
+        return;
+    }
+    else if (FileUtils::hasTRDextension(filename))
+    {
+        // TR-DOS is entered from BASIC, on any machine but the +2A/+3
+        Serial.printf("Inserting TRD: %s\n", filename.c_str());
+        if (!BetaDisk::hasRom()) {
+            osdCenteredMsg(OSD_TRDOS_ROM_ERR, LEVEL_ERROR);
+            return;
+        }
+        if (!BetaDisk::present) {
+            Config::requestMachine("128K", "SINCLAIR", true);
+            Config::save();
+            ESPectrum::reset();
+        }
+        if (FileTRD::open((String)DISK_SNA_DIR + "/" + filename))
+            osdCenteredMsg(OSD_TRD_INSERTED, LEVEL_INFO);
+        else
+            osdCenteredMsg(OSD_DISK_ERR, LEVEL_ERROR);
+        return;
+    }
+    else if (FileUtils::hasRZXextension(filename))
+    {
+        // a replay starts from its own snapshot, and is not kept as the
+        // program to boot with
+        osdCenteredMsg((String)MSG_LOADING_RZX + ": " + filename, LEVEL_INFO);
+        ESPectrum::reset();
+        Serial.printf("Playing RZX: %s\n", filename.c_str());
+        if (!FileRZX::play((String)DISK_SNA_DIR + "/" + filename))
+            osdCenteredMsg(OSD_RZX_PLAY_ERR, LEVEL_ERROR);
+        if (Config::getArch() == "48K") AySound::reset();
+        return;
+    }
+    else if (FileUtils::hasSNAextension(filename))
     {
         osdCenteredMsg((String)MSG_LOADING_SNA + ": " + filename, LEVEL_INFO);
         ESPectrum::reset();
@@ -402,6 +664,19 @@ void OSD::changeSnapshot(String filename)
         Serial.printf("Loading Z80: %s\n", filename.c_str());
         FileZ80::load((String)DISK_SNA_DIR + "/" + filename);
     }
+    else if (FileUtils::hasSZXextension(filename))
+    {
+        osdCenteredMsg((String)MSG_LOADING_SZX + ": " + filename, LEVEL_INFO);
+        ESPectrum::reset();
+        Serial.printf("Loading SZX: %s\n", filename.c_str());
+        FileSZX::load((String)DISK_SNA_DIR + "/" + filename);
+    }
+    else
+    {
+        // nothing the emulator can open: keep the program it boots with
+        Serial.printf("Unknown file type: %s\n", filename.c_str());
+        return;
+    }
     osdCenteredMsg(MSG_SAVE_CONFIG, LEVEL_WARN);
     Config::ram_file = filename;
     Config::save();
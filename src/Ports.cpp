@@ -33,12 +33,19 @@
 #include "PS2Kbd.h"
 #include "AySound.h"
 #include "ESPectrum.h"
+#include "CPU.h"
+#include "EarInput.h"
+#include "FileTZX.h"
+#include "FDC.h"
+#include "BetaDisk.h"
 
 #include <Arduino.h>
 
 // Ports
 volatile uint8_t Ports::base[128];
 volatile uint8_t Ports::wii[128];
+bool Ports::plus2A = false;
+uint8_t Ports::lastFE = 0;
 
 static uint8_t port_data = 0;
 
@@ -101,6 +108,18 @@ static void detectZXKeyCombinationForMenu()
 //        Peripheral: ZX Spectrum +2A / +3 Secondary Memory Control
 //        Port: 0001 ---- ---- --0-
 //
+//        Peripheral: ZX Spectrum +3 FDC Main Status
+//        Port: 0010 ---- ---- --0-
+//
+//        Peripheral: ZX Spectrum +3 FDC Data
+//        Port: 0011 ---- ---- --0-
+//
+//        Peripheral: Beta 128 WD1793 registers, with TR-DOS paged in
+//        Port: ---- ---- 0xx1 1111
+//
+//        Peripheral: Beta 128 System Register, with TR-DOS paged in
+//        Port: ---- ---- 1--1 1111
+//
 
 
 uint8_t Ports::input(uint8_t portLow, uint8_t portHigh)
@@ -111,13 +130,6 @@ uint8_t Ports::input(uint8_t portLow, uint8_t portHigh)
         // all result bits initially set to 1, may be set to 0 eventually
         uint8_t result = 0xFF;
 
-        #ifdef EAR_PRESENT
-        // EAR_PIN
-        if (portHigh == 0xFE) {
-            bitWrite(result, 6, digitalRead(EAR_PIN));
-        }
-        #endif
-
         // Keyboard
         if (~(portHigh | 0xFE)&0xFF) result &= (base[0] & wii[0]);
         if (~(portHigh | 0xFD)&0xFF) result &= (base[1] & wii[1]);
@@ -148,9 +160,25 @@ uint8_t Ports::input(uint8_t portLow, uint8_t portHigh)
         result &= zxkbres;
         #endif // ZX_KEYB_PRESENT
 
+        #ifdef EAR_PRESENT
+        // EAR input, as sampled at this point of the frame
+        // (after keyboard, whose row masks also clear bit 6)
+        bitWrite(result, 6, EarInput::read(CPU::tstates));
+        #endif
+
+        // a playing TZX tape takes over the EAR input
+        if (FileTZX::isPlaying())
+            bitWrite(result, 6, FileTZX::read(CPU::tstates));
+
         return result;
     }
 
+    // Beta 128, over Kempston
+    if (BetaDisk::active && (portLow & 0x1F) == 0x1F)
+    {
+        return BetaDisk::input(portLow);
+    }
+
     // Kempston
     if ((portLow & 0xE0) == 0x00) // (portLow == 0x1F)
     {
@@ -165,6 +193,15 @@ uint8_t Ports::input(uint8_t portLow, uint8_t portHigh)
     }
     #endif
 
+    // +3 FDC
+    if (FDC::present && (portLow & 0x02) == 0x00)
+    {
+        if ((portHigh & 0xF0) == 0x20)  // 0x2FFD
+            return FDC::readStatus();
+        if ((portHigh & 0xF0) == 0x30)  // 0x3FFD
+            return FDC::readData();
+    }
+
     uint8_t data = port_data;
     data |= (0xe0); /* Set bits 5-7 - as reset above */
     data &= ~0x40;
@@ -187,7 +224,7 @@ void Ports::output(uint8_t portLow, uint8_t portHigh, uint8_t data) {
         #ifdef MIC_PRESENT
         digitalWrite(MIC_PIN, bitRead(data, 3)); // tape_out
         #endif
-        base[0x20] = data; // ? 
+        lastFE = data;
     }
 
     if ((portLow & 0x02) == 0x00)
@@ -214,16 +251,28 @@ void Ports::output(uint8_t portLow, uint8_t portHigh, uint8_t data) {
             Mem::bankLatch = data & 0x7;
             bitWrite(Mem::romInUse, 1, Mem::romSP3);
             bitWrite(Mem::romInUse, 0, Mem::romLatch);
+            // TR-DOS stays paged in over any ROM
+            if (BetaDisk::active)
+                Mem::romInUse = MEM_ROM_TRDOS;
         }
         
         // +2A / +3 Secondary Memory Control
-        if ((portHigh & 0xF0) == 0x01)
+        if (plus2A && (portHigh & 0xF0) == 0x10)
         {
             Mem::modeSP3 = bitRead(data, 0);
             Mem::romSP3 = bitRead(data, 2);
             bitWrite(Mem::romInUse, 1, Mem::romSP3);
             bitWrite(Mem::romInUse, 0, Mem::romLatch);
+            if (FDC::present)
+                FDC::motor(bitRead(data, 3));
         }
+
+        // +3 FDC Data
+        if (FDC::present && (portHigh & 0xF0) == 0x30)
+            FDC::writeData(data);
     }
 
+    // Beta 128
+    if (BetaDisk::active && (portLow & 0x1F) == 0x1F)
+        BetaDisk::output(portLow, data);
 }
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "PosixFS.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// an open file or directory; path is as seen by the emulator
+class PosixFileImpl : public fs::FileImpl
+{
+public:
+    PosixFileImpl(const String& path, const String& hostPath) : path(path), hostPath(hostPath) {}
+    ~PosixFileImpl() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) { return fp ? fwrite(buf, 1, size, fp) : 0; }
+    size_t read(uint8_t* buf, size_t size) { return fp ? fread(buf, 1, size, fp) : 0; }
+    void flush() { if (fp) fflush(fp); }
+
+    bool seek(uint32_t pos, SeekMode mode)
+    {
+        if (!fp) return false;
+        return fseek(fp, pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+    }
+
+    size_t position() const { return fp ? ftell(fp) : 0; }
+
+    size_t size() const
+    {
+        if (!fp) return 0;
+        fflush(fp);
+        struct stat st;
+        if (fstat(fileno(fp), &st) != 0) return 0;
+        return st.st_size;
+    }
+
+    void close()
+    {
+        if (fp) fclose(fp);
+        if (dir) closedir(dir);
+        fp = NULL;
+        dir = NULL;
+    }
+
+    time_t getLastWrite()
+    {
+        struct stat st;
+        if (stat(hostPath.c_str(), &st) != 0) return 0;
+        return st.st_mtime;
+    }
+
+    const char* name() const { return path.c_str(); }
+    boolean isDirectory(void) { return dir != NULL; }
+
+    fs::FileImplPtr openNextFile(const char* mode)
+    {
+        if (!dir) return fs::FileImplPtr();
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+            String childPath = path;
+            if (!childPath.endsWith("/")) childPath += "/";
+            childPath += entry->d_name;
+            auto child = std::make_shared<PosixFileImpl>(childPath, hostPath + "/" + entry->d_name);
+            if (!child->openAs(FILE_READ)) continue;
+            return child;
+        }
+        return fs::FileImplPtr();
+    }
+
+    void rewindDirectory(void) { if (dir) rewinddir(dir); }
+    operator bool() { return fp != NULL || dir != NULL; }
+
+    // directories are opened for reading only; "w" also allows reading
+    // back what was written, as the writers patch headers afterwards
+    bool openAs(const char* mode)
+    {
+        if (!strcmp(mode, FILE_READ))
+            dir = opendir(hostPath.c_str());
+        if (!dir) {
+            const char* hostMode = !strcmp(mode, FILE_WRITE) ? "w+b" : !strcmp(mode, FILE_APPEND) ? "a+b" : "rb";
+            fp = fopen(hostPath.c_str(), hostMode);
+        }
+        return fp != NULL || dir != NULL;
+    }
+
+private:
+    String path;
+    String hostPath;
+    FILE* fp = NULL;
+    DIR* dir = NULL;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+fs::FileImplPtr PosixFSImpl::open(const char* path, const char* mode)
+{
+    auto file = std::make_shared<PosixFileImpl>(path, root + path);
+    if (!file->openAs(mode))
+        return fs::FileImplPtr();
+    return file;
+}
+
+bool PosixFSImpl::exists(const char* path)
+{
+    struct stat st;
+    return stat((root + path).c_str(), &st) == 0;
+}
+
+bool PosixFSImpl::rename(const char* pathFrom, const char* pathTo)
+{
+    return ::rename((root + pathFrom).c_str(), (root + pathTo).c_str()) == 0;
+}
+
+bool PosixFSImpl::remove(const char* path)
+{
+    return ::unlink((root + path).c_str()) == 0;
+}
+
+bool PosixFSImpl::mkdir(const char* path)
+{
+    return ::mkdir((root + path).c_str(), 0755) == 0;
+}
+
+bool PosixFSImpl::rmdir(const char* path)
+{
+    return ::rmdir((root + path).c_str()) == 0;
+}
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "QuickSlots.h"
+
+#include "FileUtils.h"
+#include "FileSNA.h"
+#include "SnapPack.h"
+#include "PS2Kbd.h"
+#include "Config.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define SLOT_ALLOC(size) ps_malloc(size)
+#else
+#define SLOT_ALLOC(size) malloc(size)
+#endif
+
+uint8_t* QuickSlots::data[QUICK_SLOTS];
+uint32_t QuickSlots::sizes[QUICK_SLOTS];
+uint32_t QuickSlots::rawSizes[QUICK_SLOTS];
+uint32_t QuickSlots::saveTimes[QUICK_SLOTS];
+uint32_t QuickSlots::loadTimes[QUICK_SLOTS];
+uint8_t QuickSlots::current = 0;
+
+// unpacked snapshot, and packed output before it is copied to its slot
+static uint8_t* rawBuffer = NULL;
+static uint8_t* packBuffer = NULL;
+
+bool QuickSlots::allocScratch()
+{
+    if (rawBuffer == NULL)
+        rawBuffer = (uint8_t*)SLOT_ALLOC(SNA_128K_SIZE1);
+    if (packBuffer == NULL)
+        packBuffer = (uint8_t*)SLOT_ALLOC(SnapPack::bound(SNA_128K_SIZE1));
+    if (rawBuffer == NULL || packBuffer == NULL) {
+        Serial.println("QuickSlots: cannot allocate scratch buffers");
+        return false;
+    }
+    return true;
+}
+
+bool QuickSlots::save(uint8_t slot)
+{
+    if (slot >= QUICK_SLOTS || !allocScratch())
+        return false;
+
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+
+    uint32_t rawSize = (Config::getArch() == "48K") ? SNA_48K_SIZE : SNA_128K_SIZE1;
+    FileSNA::saveToMem(rawBuffer, rawSize);
+    uint32_t ts_packed = micros();
+    uint32_t size = SnapPack::pack(rawBuffer, rawSize, packBuffer);
+
+    uint8_t* packed = size ? (uint8_t*)SLOT_ALLOC(size) : NULL;
+    if (packed == NULL) {
+        Serial.printf("QuickSlots: cannot allocate %u bytes for slot %u\n", size, slot + 1);
+        KB_INT_START;
+        return false;
+    }
+    memcpy(packed, packBuffer, size);
+    if (data[slot] != NULL) free(data[slot]);
+    data[slot] = packed;
+    sizes[slot] = size;
+    rawSizes[slot] = rawSize;
+    saveTimes[slot] = micros() - ts_start;
+
+    Serial.printf("QuickSlots: slot %u saved, %u -> %u bytes in %u us (state %u us, pack %u us)\n",
+        slot + 1, rawSize, size, saveTimes[slot], ts_packed - ts_start, (unsigned)(micros() - ts_packed));
+    KB_INT_START;
+    return true;
+}
+
+bool QuickSlots::load(uint8_t slot)
+{
+    if (slot >= QUICK_SLOTS || data[slot] == NULL || !allocScratch())
+        return false;
+
+    KB_INT_STOP;
+    uint32_t ts_start = micros();
+
+    uint32_t rawSize = SnapPack::unpack(data[slot], sizes[slot], rawBuffer, SNA_128K_SIZE1);
+    if (rawSize != rawSizes[slot]) {
+        Serial.printf("QuickSlots: slot %u is corrupt\n", slot + 1);
+        KB_INT_START;
+        return false;
+    }
+    uint32_t ts_unpacked = micros();
+    bool ok = FileSNA::loadFromMem(rawBuffer, rawSize);
+    loadTimes[slot] = micros() - ts_start;
+
+    Serial.printf("QuickSlots: slot %u loaded in %u us (unpack %u us)\n",
+        slot + 1, loadTimes[slot], ts_unpacked - ts_start);
+    KB_INT_START;
+    return ok;
+}
+
+String QuickSlots::describe(uint8_t slot)
+{
+    String desc = (String)(slot + 1) + " ";
+    if (data[slot] == NULL)
+        return desc + "empty";
+    return desc + (rawSizes[slot] == SNA_48K_SIZE ? "48K " : "128K ") + (String)((sizes[slot] + 1023) / 1024) + " KB";
+}
@@ -0,0 +1,345 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "Rewind.h"
+
+#include "SnapPack.h"
+#include "Mem.h"
+
+#ifdef BOARD_HAS_PSRAM
+#define REWIND_ALLOC(size) ps_malloc(size)
+#else
+#define REWIND_ALLOC(size) malloc(size)
+#endif
+
+#define PAGE_BOUND (SnapPack::bound(0x4000))
+
+struct RewindEntry
+{
+    SZXImage image;         // state, pages point nowhere once stored
+    uint8_t* data;          // packed pages, one after another
+    uint16_t pageSize[8];
+    uint32_t size;
+    uint32_t frame;         // frame counter when taken
+    bool keyframe;
+};
+
+uint8_t Rewind::entries = 0;
+uint32_t Rewind::captureCount = 0;
+
+static RewindEntry* ring = NULL;
+static uint8_t oldest = 0;
+static uint32_t memoryUsed = 0;
+static bool disabled = false;
+
+static uint32_t frame = 0;
+static uint32_t lastCapture = 0;
+
+// pages of the state being packed; after a keyframe is done they are
+// swapped with keyPages, the base of the following deltas
+static uint8_t* staging = NULL;
+static uint8_t* keyPages = NULL;
+static uint8_t keyPageCount = 0;
+static bool forceKeyframe = true;
+static uint8_t sinceKeyframe = 0;
+
+static uint8_t* delta = NULL;       // one page XORed with its keyframe page
+static uint8_t* work = NULL;        // packed pages of the pending entry
+static uint32_t workLen = 0;
+
+static RewindEntry pending;
+// blocks of each page copied to staging when the pending entry was taken
+static uint64_t copiedBlocks[8];
+static bool isPending = false;
+static uint8_t pendingPage = 0;
+
+// cost measurement, since the last keyframe log
+static uint32_t workFrames = 0;
+static uint64_t workMicros = 0;
+static uint32_t maxFrameMicros = 0;
+
+static inline uint8_t slotOf(uint8_t n)
+{
+    // n = 0 is the newest
+    return (oldest + Rewind::count() - 1 - n) % REWIND_ENTRIES;
+}
+
+static bool allocBuffers()
+{
+    if (ring != NULL) return true;
+    if (disabled) return false;
+
+    ring = (RewindEntry*)REWIND_ALLOC(REWIND_ENTRIES * sizeof(RewindEntry));
+    staging = (uint8_t*)REWIND_ALLOC(8 * 0x4000);
+    keyPages = (uint8_t*)REWIND_ALLOC(8 * 0x4000);
+    delta = (uint8_t*)REWIND_ALLOC(0x4000);
+    work = (uint8_t*)REWIND_ALLOC(8 * PAGE_BOUND);
+    if (ring == NULL || staging == NULL || keyPages == NULL || delta == NULL || work == NULL) {
+        Serial.println("Rewind: cannot allocate buffers, disabled");
+        free(ring); free(staging); free(keyPages); free(delta); free(work);
+        ring = NULL;
+        disabled = true;
+        return false;
+    }
+    return true;
+}
+
+void Rewind::clear()
+{
+    while (entries > 0)
+        dropOldest();
+    isPending = false;
+    forceKeyframe = true;
+    lastCapture = frame;
+}
+
+uint32_t Rewind::age(uint8_t n)
+{
+    if (n >= entries) return 0;
+    return frame - ring[slotOf(n)].frame;
+}
+
+uint32_t Rewind::memory()
+{
+    return memoryUsed;
+}
+
+void Rewind::dropOldest()
+{
+    RewindEntry& e = ring[oldest];
+    free(e.data);
+    memoryUsed -= e.size;
+    oldest = (oldest + 1) % REWIND_ENTRIES;
+    entries--;
+    if (entries == 0)
+        forceKeyframe = true;
+}
+
+void Rewind::capture()
+{
+    lastCapture = frame;
+    // pages point at the live RAM, only what changed is copied
+    FileSZX::capture(pending.image, NULL);
+    pending.frame = frame;
+    pending.keyframe = forceKeyframe || sinceKeyframe + 1 >= REWIND_KEYFRAME_EVERY
+        || keyPageCount != pending.image.pageCount;
+
+    for (uint8_t i = 0; i < pending.image.pageCount; i++) {
+        uint8_t page = pending.image.pageIds[i];
+        uint8_t* dst = staging + i * 0x4000;
+        if (pending.keyframe) {
+            memcpy(dst, pending.image.pages[i], 0x4000);
+            Mem::clearPageDirty(page, MEM_DIRTY_REWIND);
+            copiedBlocks[i] = ~0ULL;
+            continue;
+        }
+        // blocks not written since the keyframe are the same as in it
+        copiedBlocks[i] = 0;
+        for (uint8_t b = 0; b < MEM_BLOCKS_PER_PAGE; b++) {
+            if (Mem::isBlockDirty(page, b, MEM_DIRTY_REWIND)) {
+                uint16_t offset = b << MEM_BLOCK_SHIFT;
+                memcpy(dst + offset, pending.image.pages[i] + offset, 1 << MEM_BLOCK_SHIFT);
+                copiedBlocks[i] |= 1ULL << b;
+            }
+        }
+    }
+
+    pendingPage = 0;
+    workLen = 0;
+    isPending = true;
+    captureCount++;
+}
+
+// pack the next page of the pending entry; true when it was the last one
+bool Rewind::packPage()
+{
+    const uint8_t* src = staging + pendingPage * 0x4000;
+    uint64_t blocks = copiedBlocks[pendingPage];
+    uint32_t size = 0;
+
+    if (!pending.keyframe) {
+        if (blocks == 0) {
+            // 0 marks a page equal to the keyframe's
+            pending.pageSize[pendingPage] = 0;
+            pendingPage++;
+            return pendingPage == pending.image.pageCount;
+        }
+        // XOR of the copied blocks, the others are known to be zero
+        const uint8_t* key = keyPages + pendingPage * 0x4000;
+        for (uint8_t b = 0; b < MEM_BLOCKS_PER_PAGE; b++) {
+            uint16_t offset = b << MEM_BLOCK_SHIFT;
+            uint32_t* d = (uint32_t*)(delta + offset);
+            if (blocks & (1ULL << b)) {
+                const uint32_t* x = (const uint32_t*)(src + offset);
+                const uint32_t* k = (const uint32_t*)(key + offset);
+                for (uint8_t i = 0; i < (1 << MEM_BLOCK_SHIFT) / 4; i++)
+                    d[i] = x[i] ^ k[i];
+            }
+            else memset(d, 0, 1 << MEM_BLOCK_SHIFT);
+        }
+        src = delta;
+    }
+    size = SnapPack::pack(src, 0x4000, work + workLen);
+    if (size == 0) {
+        // out of memory for the hash table, try again next frame
+        return false;
+    }
+    pending.pageSize[pendingPage] = size;
+    workLen += size;
+    pendingPage++;
+    return pendingPage == pending.image.pageCount;
+}
+
+void Rewind::finishEntry()
+{
+    isPending = false;
+
+    while (entries > 0 && (entries == REWIND_ENTRIES || memoryUsed + workLen > REWIND_MEMORY)) {
+        dropOldest();
+        // deltas are of no use without their keyframe
+        while (entries > 0 && !ring[oldest].keyframe)
+            dropOldest();
+    }
+    if (!pending.keyframe && entries == 0)
+        return;
+
+    pending.data = (uint8_t*)REWIND_ALLOC(workLen);
+    if (pending.data == NULL) {
+        Serial.printf("Rewind: cannot allocate %u bytes\n", workLen);
+        forceKeyframe = true;
+        return;
+    }
+    memcpy(pending.data, work, workLen);
+    pending.size = workLen;
+
+    ring[(oldest + entries) % REWIND_ENTRIES] = pending;
+    entries++;
+    memoryUsed += workLen;
+
+    if (pending.keyframe) {
+        uint8_t* swap = keyPages;
+        keyPages = staging;
+        staging = swap;
+        keyPageCount = pending.image.pageCount;
+        forceKeyframe = false;
+        sinceKeyframe = 0;
+
+        Serial.printf("Rewind: %u snapshots, %u KB, keyframe %u bytes, %u us/frame average, %u us max\n",
+            entries, memoryUsed / 1024, workLen,
+            workFrames ? (uint32_t)(workMicros / workFrames) : 0, maxFrameMicros);
+        workFrames = 0;
+        workMicros = 0;
+        maxFrameMicros = 0;
+    }
+    else sinceKeyframe++;
+}
+
+void Rewind::endFrame()
+{
+    frame++;
+    if (!isPending && frame - lastCapture < REWIND_INTERVAL)
+        return;
+    if (!allocBuffers())
+        return;
+
+    uint32_t ts_start = micros();
+    if (isPending) {
+        while (true) {
+            if (packPage()) {
+                finishEntry();
+                break;
+            }
+            if (micros() - ts_start >= REWIND_FRAME_BUDGET)
+                break;
+        }
+    }
+    else capture();
+
+    uint32_t elapsed = micros() - ts_start;
+    workFrames++;
+    workMicros += elapsed;
+    if (elapsed > maxFrameMicros) maxFrameMicros = elapsed;
+}
+
+bool Rewind::restore(uint8_t n)
+{
+    if (n >= entries) return false;
+
+    // the staging buffer is reused, whatever was being packed is dropped
+    isPending = false;
+
+    uint8_t target = slotOf(n);
+    uint8_t key = target;
+    while (!ring[key].keyframe && key != oldest)
+        key = (key + REWIND_ENTRIES - 1) % REWIND_ENTRIES;
+    if (!ring[key].keyframe)
+        return false;
+
+    const RewindEntry& k = ring[key];
+    const uint8_t* packed = k.data;
+    for (uint8_t i = 0; i < k.image.pageCount; i++) {
+        if (SnapPack::unpack(packed, k.pageSize[i], staging + i * 0x4000, 0x4000) != 0x4000)
+            return false;
+        packed += k.pageSize[i];
+    }
+
+    RewindEntry& e = ring[target];
+    if (target != key) {
+        packed = e.data;
+        for (uint8_t i = 0; i < e.image.pageCount; i++) {
+            if (e.pageSize[i] == 0)
+                continue;
+            if (SnapPack::unpack(packed, e.pageSize[i], delta, 0x4000) != 0x4000)
+                return false;
+            packed += e.pageSize[i];
+            uint32_t* d = (uint32_t*)(staging + i * 0x4000);
+            const uint32_t* x = (const uint32_t*)delta;
+            for (uint16_t j = 0; j < 0x4000 / 4; j++)
+                d[j] ^= x[j];
+        }
+    }
+
+    SZXImage image = e.image;
+    for (uint8_t i = 0; i < image.pageCount; i++)
+        image.pages[i] = staging + i * 0x4000;
+    if (!FileSZX::restore(image))
+        return false;
+
+    // newer snapshots belong to the future that was undone
+    for (uint8_t i = 0; i < n; i++) {
+        RewindEntry& newer = ring[slotOf(0)];
+        free(newer.data);
+        memoryUsed -= newer.size;
+        entries--;
+    }
+    frame = e.frame;
+    lastCapture = frame;
+    forceKeyframe = true;
+    return true;
+}
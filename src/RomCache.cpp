@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "RomCache.h"
+#include "FileUtils.h"
+#include "PS2Kbd.h"
+#include "VFS.h"
+
+String RomCache::names[ROM_CACHE_SETS];
+uint8_t* RomCache::data[ROM_CACHE_SETS];
+uint8_t RomCache::roms[ROM_CACHE_SETS];
+uint8_t RomCache::count = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+int8_t RomCache::find(const String& arch, const String& romset)
+{
+    String name = arch + "/" + romset;
+    for (uint8_t i = 0; i < count; i++)
+        if (names[i] == name) return i;
+    return -1;
+}
+
+bool RomCache::preload()
+{
+#ifdef BOARD_HAS_PSRAM
+    String archs = FileUtils::getFileEntriesFromDir(DISK_ROM_DIR);
+    for (int a = 0, na; (na = archs.indexOf(ASCII_NL, a)) >= 0; a = na + 1) {
+        String arch = archs.substring(a, na);
+        String sets = FileUtils::getFileEntriesFromDir(DISK_ROM_DIR "/" + arch);
+        for (int s = 0, ns; (ns = sets.indexOf(ASCII_NL, s)) >= 0; s = ns + 1)
+            load(arch, sets.substring(s, ns));
+    }
+    Serial.printf("RomCache: %u ROM sets cached\n", count);
+    return count > 0;
+#else
+    return false;
+#endif
+}
+
+uint8_t RomCache::load(const String& arch, const String& romset)
+{
+#ifdef BOARD_HAS_PSRAM
+    int8_t slot = find(arch, romset);
+    if (slot >= 0) return roms[slot];
+    if (count == ROM_CACHE_SETS) return 0;
+
+    KB_INT_STOP;
+    String path = DISK_ROM_DIR "/" + arch + "/" + romset + "/";
+    uint8_t n = 0;
+    while (n < ROM_CACHE_MAX_ROMS && VFS::exists(path + (String)n + ".rom"))
+        n++;
+    uint8_t* buf = n ? (uint8_t*)ps_malloc(n * 0x4000) : NULL;
+    if (buf == NULL) {
+        KB_INT_START;
+        return 0;
+    }
+
+    bool ok = true;
+    for (uint8_t r = 0; r < n && ok; r++) {
+        uint8_t* rom = buf + r * 0x4000;
+        File f = VFS::open(path + (String)r + ".rom", FILE_READ);
+        size_t size = 0;
+        if (f) {
+            size = readBlockFile(f, rom, f.size() < 0x4000 ? f.size() : 0x4000);
+            f.close();
+        }
+        memset(rom + size, 0xFF, 0x4000 - size);
+
+        ok = size > 0;
+        Serial.printf("RomCache: %s%u.rom %u bytes%s\n", path.c_str(), r, (unsigned)size, ok ? "" : ", cannot read");
+    }
+    KB_INT_START;
+
+    if (!ok) {
+        Serial.printf("RomCache: cannot cache %s\n", path.c_str());
+        free(buf);
+        return 0;
+    }
+    names[count] = arch + "/" + romset;
+    data[count] = buf;
+    roms[count] = n;
+    count++;
+    return n;
+#else
+    return 0;
+#endif
+}
+
+uint8_t RomCache::map(const String& arch, const String& romset, uint8_t** pages)
+{
+    int8_t slot = find(arch, romset);
+    if (slot < 0) return 0;
+    // slots past the set repeat its first ROM, not the previous set's
+    for (uint8_t r = 0; r < ROM_CACHE_MAX_ROMS; r++)
+        pages[r] = data[slot] + (r < roms[slot] ? r : 0) * 0x4000;
+    return roms[slot];
+}
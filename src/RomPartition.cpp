@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "RomPartition.h"
+
+const uint8_t* RomPartition::image = NULL;
+uint32_t RomPartition::imageSize = 0;
+spi_flash_mmap_handle_t RomPartition::handle;
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool RomPartition::begin()
+{
+#ifdef ROM_PARTITION
+    if (image != NULL) return true;
+
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        ESP_PARTITION_SUBTYPE_ANY, ROM_PARTITION);
+    if (part == NULL) {
+        Serial.printf("RomPartition: no '%s' partition, ROMs load from files\n", ROM_PARTITION);
+        return false;
+    }
+
+    const void* ptr;
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        Serial.printf("RomPartition: cannot map '%s' (error %d)\n", ROM_PARTITION, err);
+        return false;
+    }
+
+    const uint8_t* p = (const uint8_t*)ptr;
+    uint16_t count = p[6] | (p[7] << 8);
+    if (memcmp(p, "ZXRS", 4) != 0 || (p[4] | (p[5] << 8)) != ROM_IMAGE_VERSION
+        || ROM_IMAGE_HEADER_SIZE + count * sizeof(RomImageSet) > part->size) {
+        Serial.printf("RomPartition: no ROM image in '%s'\n", ROM_PARTITION);
+        spi_flash_munmap(handle);
+        return false;
+    }
+
+    image = p;
+    imageSize = part->size;
+    Serial.printf("RomPartition: %u ROM sets mapped from '%s'\n", count, ROM_PARTITION);
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint8_t RomPartition::map(const String& arch, const String& romset, uint8_t** pages)
+{
+    if (image == NULL) return 0;
+
+    uint16_t count = image[6] | (image[7] << 8);
+    const RomImageSet* sets = (const RomImageSet*)(image + ROM_IMAGE_HEADER_SIZE);
+    for (uint16_t i = 0; i < count; i++) {
+        const RomImageSet& set = sets[i];
+        if (strncmp(set.arch, arch.c_str(), sizeof(set.arch)) != 0
+            || strncmp(set.romset, romset.c_str(), sizeof(set.romset)) != 0)
+            continue;
+        if (set.roms == 0 || set.roms > ROM_IMAGE_MAX_ROMS
+            || set.offset + set.roms * 0x4000 > imageSize) {
+            Serial.printf("RomPartition: bad entry for %s/%s\n", arch.c_str(), romset.c_str());
+            return 0;
+        }
+        // slots past the set repeat its first ROM, not the previous set's
+        for (uint8_t r = 0; r < ROM_IMAGE_MAX_ROMS; r++)
+            pages[r] = (uint8_t*)(image + set.offset + (r < set.roms ? r : 0) * 0x4000);
+        return set.roms;
+    }
+    return 0;
+}
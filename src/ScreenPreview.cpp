@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "hardconfig.h"
+#include "ScreenPreview.h"
+#include "FileSNA.h"
+#include "FileZ80.h"
+#include "FileSZX.h"
+
+uint8_t* ScreenPreview::cache = NULL;
+uint32_t ScreenPreview::keys[PREVIEW_CACHE_ENTRIES];
+uint32_t ScreenPreview::lastUse[PREVIEW_CACHE_ENTRIES];
+uint32_t ScreenPreview::useCounter = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// a changed file gets a new key, so stale previews are never shown
+static uint32_t entryKey(const String& dir, const CatalogEntry& e)
+{
+    uint32_t h = 2166136261U;
+    for (const char* p = dir.c_str(); *p; p++)
+        h = (h ^ (uint8_t)*p) * 16777619U;
+    h = (h ^ '/') * 16777619U;
+    for (const char* p = e.name; *p; p++)
+        h = (h ^ (uint8_t)*p) * 16777619U;
+    return h ^ (e.size * 2654435761U) ^ e.mtime;
+}
+
+bool ScreenPreview::hasPreview(const CatalogEntry& e)
+{
+    return e.type == CATALOG_TYPE_SNA || e.type == CATALOG_TYPE_Z80 || e.type == CATALOG_TYPE_SZX;
+}
+
+const uint8_t* ScreenPreview::cached(const String& dir, const CatalogEntry& e)
+{
+    if (cache == NULL || !hasPreview(e)) return NULL;
+    uint32_t key = entryKey(dir, e);
+    for (uint8_t i = 0; i < PREVIEW_CACHE_ENTRIES; i++) {
+        if (lastUse[i] != 0 && keys[i] == key) {
+            lastUse[i] = ++useCounter;
+            return cache + i * PREVIEW_BYTES;
+        }
+    }
+    return NULL;
+}
+
+const uint8_t* ScreenPreview::get(const String& dir, const CatalogEntry& e)
+{
+    if (!hasPreview(e)) return NULL;
+
+    if (cache == NULL) {
+        #ifdef BOARD_HAS_PSRAM
+            cache = (uint8_t*)ps_calloc(PREVIEW_CACHE_ENTRIES, PREVIEW_BYTES);
+        #else
+            cache = (uint8_t*)calloc(PREVIEW_CACHE_ENTRIES, PREVIEW_BYTES);
+        #endif
+        if (cache == NULL) {
+            Serial.printf("ScreenPreview: cannot allocate cache\n");
+            return NULL;
+        }
+    }
+
+    const uint8_t* preview = cached(dir, e);
+    if (preview) return preview;
+
+    uint8_t* screen = (uint8_t*)malloc(6912);
+    if (screen == NULL) return NULL;
+
+    String path = dir + "/" + e.name;
+    bool ok = false;
+    if (e.type == CATALOG_TYPE_SNA) ok = FileSNA::loadScreen(path, screen);
+    else if (e.type == CATALOG_TYPE_Z80) ok = FileZ80::loadScreen(path, screen);
+    else if (e.type == CATALOG_TYPE_SZX) ok = FileSZX::loadScreen(path, screen);
+    if (!ok) {
+        Serial.printf("ScreenPreview: no screen in %s\n", path.c_str());
+        free(screen);
+        return NULL;
+    }
+
+    // replace the least recently used preview
+    uint8_t slot = 0;
+    for (uint8_t i = 1; i < PREVIEW_CACHE_ENTRIES; i++)
+        if (lastUse[i] < lastUse[slot]) slot = i;
+
+    uint8_t* dst = cache + slot * PREVIEW_BYTES;
+    decode(screen, dst);
+    free(screen);
+    keys[slot] = entryKey(dir, e);
+    lastUse[slot] = ++useCounter;
+    return dst;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Each preview pixel is a 2x2 block of the screen, which is always inside a
+// single attribute cell: ink if 2 or more of its pixels are set, else paper.
+void ScreenPreview::decode(const uint8_t* screen, uint8_t* preview)
+{
+    for (uint8_t ty = 0; ty < PREVIEW_H; ty++) {
+        uint8_t y = ty * 2;
+        const uint8_t* row0 = screen + (((y & 0xC0) << 5) | ((y & 0x07) << 8) | ((y & 0x38) << 2));
+        const uint8_t* row1 = row0 + 0x100;
+        const uint8_t* attr = screen + 6144 + (y >> 3) * 32;
+        uint8_t* out = preview + ty * (PREVIEW_W / 2);
+
+        for (uint8_t col = 0; col < 32; col++) {
+            uint8_t a = attr[col];
+            uint8_t bright = (a & 0x40) >> 3;
+            uint8_t ink = (a & 0x07) | bright;
+            uint8_t paper = ((a >> 3) & 0x07) | bright;
+            uint8_t b0 = row0[col];
+            uint8_t b1 = row1[col];
+
+            uint8_t pix[4];
+            for (uint8_t k = 0; k < 4; k++) {
+                uint8_t shift = 6 - 2 * k;
+                uint8_t set = ((b0 >> shift) & 1) + ((b0 >> (shift + 1)) & 1)
+                            + ((b1 >> shift) & 1) + ((b1 >> (shift + 1)) & 1);
+                pix[k] = (set >= 2) ? ink : paper;
+            }
+            out[col * 2] = (pix[0] << 4) | pix[1];
+            out[col * 2 + 1] = (pix[2] << 4) | pix[3];
+        }
+    }
+}
@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "SnapPack.h"
+
+#pragma GCC optimize ("O3")
+
+#define MIN_FILL 3
+#define MIN_MATCH 4
+#define MAX_LITERALS 128
+#define MAX_LEN 0xFFFF
+#define MAX_DIST 0xFFFF
+#define LONG_LEN 0x3F
+#define HASH_SIZE (1 << SNAPPACK_HASH_BITS)
+
+static inline uint16_t hash4(const uint8_t* p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (v * 2654435761U) >> (32 - SNAPPACK_HASH_BITS);
+}
+
+// control byte for a fill or match, with the length after it if long
+static inline uint8_t* putCopy(uint8_t* out, uint8_t kind, uint32_t len, uint32_t minLen)
+{
+    if (len - minLen < LONG_LEN) {
+        *out++ = kind | (len - minLen);
+    }
+    else {
+        *out++ = kind | LONG_LEN;
+        *out++ = len & 0xFF;
+        *out++ = len >> 8;
+    }
+    return out;
+}
+
+static inline uint8_t* putLiterals(uint8_t* out, const uint8_t* src, uint32_t count)
+{
+    while (count > 0) {
+        uint32_t n = count < MAX_LITERALS ? count : MAX_LITERALS;
+        *out++ = n - 1;
+        memcpy(out, src, n);
+        out += n;
+        src += n;
+        count -= n;
+    }
+    return out;
+}
+
+uint32_t SnapPack::pack(const uint8_t* src, uint32_t len, uint8_t* dst)
+{
+    // last position + 1 of each hash, 0 for none
+    uint32_t* head = (uint32_t*)calloc(HASH_SIZE, sizeof(uint32_t));
+    if (head == NULL) return 0;
+
+    uint8_t* out = dst;
+    uint32_t literals = 0;      // start of pending literals
+    uint32_t pos = 0;
+
+    while (pos < len) {
+        uint32_t maxLen = len - pos;
+        if (maxLen > MAX_LEN) maxLen = MAX_LEN;
+
+        // fills first: cheapest to find and to expand
+        const uint8_t* p = src + pos;
+        uint32_t fill = 1;
+        while (fill < maxLen && p[fill] == p[0]) fill++;
+        if (fill >= MIN_FILL) {
+            out = putLiterals(out, src + literals, pos - literals);
+            out = putCopy(out, 0x80, fill, MIN_FILL);
+            *out++ = p[0];
+            pos += fill;
+            literals = pos;
+            continue;
+        }
+
+        uint32_t matchLen = 0;
+        uint32_t matchPos = 0;
+        if (maxLen >= MIN_MATCH) {
+            uint16_t h = hash4(p);
+            uint32_t candidate = head[h];
+            head[h] = pos + 1;
+            if (candidate > 0 && pos - (candidate - 1) <= MAX_DIST) {
+                matchPos = candidate - 1;
+                const uint8_t* m = src + matchPos;
+                while (matchLen < maxLen && m[matchLen] == p[matchLen]) matchLen++;
+            }
+        }
+
+        if (matchLen >= MIN_MATCH) {
+            out = putLiterals(out, src + literals, pos - literals);
+            out = putCopy(out, 0xC0, matchLen, MIN_MATCH);
+            uint32_t dist = pos - matchPos;
+            *out++ = dist & 0xFF;
+            *out++ = dist >> 8;
+            pos += matchLen;
+            literals = pos;
+        }
+        else pos++;
+    }
+    out = putLiterals(out, src + literals, pos - literals);
+
+    free(head);
+    return out - dst;
+}
+
+uint32_t SnapPack::unpack(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t capacity)
+{
+    const uint8_t* end = src + len;
+    uint8_t* out = dst;
+    uint8_t* outEnd = dst + capacity;
+
+    while (src < end) {
+        uint8_t c = *src++;
+        if (c < 0x80) {
+            uint32_t n = c + 1;
+            if (end - src < n || outEnd - out < n) return 0;
+            memcpy(out, src, n);
+            src += n;
+            out += n;
+            continue;
+        }
+
+        bool isMatch = (c & 0x40) != 0;
+        uint32_t n = c & LONG_LEN;
+        if (n == LONG_LEN) {
+            if (end - src < 2) return 0;
+            n = src[0] | (src[1] << 8);
+            src += 2;
+        }
+        else n += isMatch ? MIN_MATCH : MIN_FILL;
+        if (outEnd - out < n) return 0;
+
+        if (isMatch) {
+            if (end - src < 2) return 0;
+            uint32_t dist = src[0] | (src[1] << 8);
+            src += 2;
+            if (dist == 0 || dist > (uint32_t)(out - dst)) return 0;
+            // may overlap its own output, copy forwards byte by byte
+            const uint8_t* m = out - dist;
+            for (uint32_t i = 0; i < n; i++)
+                out[i] = m[i];
+        }
+        else {
+            if (src >= end) return 0;
+            memset(out, *src++, n);
+        }
+        out += n;
+    }
+    return out - dst;
+}
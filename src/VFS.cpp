@@ -0,0 +1,362 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "VFS.h"
+#include "ZipFS.h"
+
+#include <FSImpl.h>
+
+#include "hardconfig.h"
+#include "hardpins.h"
+
+#ifdef USE_INT_FLASH
+// using internal storage (spi flash)
+#include <SPIFFS.h>
+#endif
+
+#ifdef USE_SD_CARD
+// using external storage (SD card)
+#include <SD.h>
+static SPIClass customSPI;
+#endif
+
+#ifdef USE_POSIX_FS
+// using a directory through stdio
+#include "PosixFS.h"
+#endif
+
+fs::FS* VFS::storage = NULL;
+const char* VFS::posixRoot = VFS_POSIX_ROOT;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// held for each call reaching the backend; recursive so that a nested call
+// (a handle closed inside another) cannot deadlock
+static SemaphoreHandle_t storageMutex = NULL;
+
+class StorageLock
+{
+public:
+    StorageLock() { xSemaphoreTakeRecursive(storageMutex, portMAX_DELAY); }
+    ~StorageLock() { xSemaphoreGiveRecursive(storageMutex); }
+};
+
+// file on the backend, every call under the storage lock; entries of a
+// directory are handed out the same way
+class LockedFileImpl : public fs::FileImpl
+{
+public:
+    LockedFileImpl(File f) : f(f) {}
+    ~LockedFileImpl() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) { StorageLock lock; return f.write(buf, size); }
+    size_t read(uint8_t* buf, size_t size) { StorageLock lock; return f.read(buf, size); }
+    void flush() { StorageLock lock; f.flush(); }
+    bool seek(uint32_t pos, SeekMode mode) { StorageLock lock; return f.seek(pos, mode); }
+    size_t position() const { StorageLock lock; return f.position(); }
+    size_t size() const { StorageLock lock; return f.size(); }
+    void close() { StorageLock lock; f.close(); }
+    time_t getLastWrite() { StorageLock lock; return f.getLastWrite(); }
+    const char* name() const { return f.name(); }
+    boolean isDirectory(void) { StorageLock lock; return f.isDirectory(); }
+    void rewindDirectory(void) { StorageLock lock; f.rewindDirectory(); }
+    operator bool() { return f; }
+
+    fs::FileImplPtr openNextFile(const char* mode)
+    {
+        StorageLock lock;
+        File next = f.openNextFile(mode);
+        if (!next) return fs::FileImplPtr();
+        return fs::FileImplPtr(new LockedFileImpl(next));
+    }
+
+private:
+    File f;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef BOARD_HAS_PSRAM
+#define CACHE_ALLOC(size) ps_malloc(size)
+#else
+#define CACHE_ALLOC(size) malloc(size)
+#endif
+
+struct CacheBlock
+{
+    const void* owner;      // open file holding the block, NULL if free
+    uint32_t index;         // block number within the file
+    uint32_t size;          // bytes valid, less than a block at end of file
+    uint32_t lastUse;       // cacheClock when last read, for LRU
+    uint8_t* data;
+};
+
+static CacheBlock cacheBlocks[VFS_CACHE_BLOCKS];
+static uint32_t cacheClock = 0;
+
+static bool cacheInit()
+{
+    static bool ready = false;
+    if (ready) return true;
+    uint8_t* data = (uint8_t*)CACHE_ALLOC(VFS_CACHE_BLOCKS * VFS_CACHE_BLOCK_SIZE);
+    if (data == NULL) return false;
+    for (int i = 0; i < VFS_CACHE_BLOCKS; i++) {
+        cacheBlocks[i].owner = NULL;
+        cacheBlocks[i].data = data + i * VFS_CACHE_BLOCK_SIZE;
+    }
+    ready = true;
+    return true;
+}
+
+// regular file opened for reading, served from cache blocks
+class CachedFileImpl : public fs::FileImpl
+{
+public:
+    CachedFileImpl(File f) : f(f), pos(0), len(f.size()) {}
+    ~CachedFileImpl() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) { return 0; }
+    void flush() {}
+
+    size_t read(uint8_t* buf, size_t size)
+    {
+        size_t done = 0;
+        if (size > len - pos) size = len - pos;
+        while (done < size) {
+            uint32_t index = pos / VFS_CACHE_BLOCK_SIZE;
+            uint32_t offset = pos % VFS_CACHE_BLOCK_SIZE;
+            CacheBlock* b = find(index);
+            size_t n;
+            if (b == NULL && offset == 0 && size - done >= VFS_CACHE_BLOCK_SIZE) {
+                // whole blocks straight into the caller's buffer
+                n = (size - done) - (size - done) % VFS_CACHE_BLOCK_SIZE;
+                if (f.position() != pos) f.seek(pos);
+                n = f.read(buf + done, n);
+                if (n == 0) break;
+            }
+            else {
+                if (b == NULL) b = fill(index);
+                if (b == NULL || offset >= b->size) break;
+                n = b->size - offset;
+                if (n > size - done) n = size - done;
+                memcpy(buf + done, b->data + offset, n);
+            }
+            pos += n;
+            done += n;
+        }
+        return done;
+    }
+
+    bool seek(uint32_t p, SeekMode mode)
+    {
+        if (mode == SeekCur) p += pos;
+        else if (mode == SeekEnd) p += len;
+        if (p > len) return false;
+        pos = p;
+        return true;
+    }
+
+    size_t position() const { return pos; }
+    size_t size() const { return len; }
+
+    void close()
+    {
+        for (int i = 0; i < VFS_CACHE_BLOCKS; i++)
+            if (cacheBlocks[i].owner == this) cacheBlocks[i].owner = NULL;
+        f.close();
+    }
+
+    time_t getLastWrite() { return f.getLastWrite(); }
+    const char* name() const { return f.name(); }
+    boolean isDirectory(void) { return false; }
+    fs::FileImplPtr openNextFile(const char* mode) { return fs::FileImplPtr(); }
+    void rewindDirectory(void) {}
+    operator bool() { return f; }
+
+private:
+    CacheBlock* find(uint32_t index)
+    {
+        for (int i = 0; i < VFS_CACHE_BLOCKS; i++) {
+            CacheBlock* b = &cacheBlocks[i];
+            if (b->owner == this && b->index == index) {
+                b->lastUse = ++cacheClock;
+                return b;
+            }
+        }
+        return NULL;
+    }
+
+    // read a block from storage into the free or least recently used slot
+    CacheBlock* fill(uint32_t index)
+    {
+        CacheBlock* b = &cacheBlocks[0];
+        for (int i = 0; i < VFS_CACHE_BLOCKS && b->owner != NULL; i++)
+            if (cacheBlocks[i].owner == NULL || cacheBlocks[i].lastUse < b->lastUse)
+                b = &cacheBlocks[i];
+        b->owner = NULL;
+        uint32_t start = index * VFS_CACHE_BLOCK_SIZE;
+        if (f.position() != start && !f.seek(start)) return NULL;
+        b->size = f.read(b->data, VFS_CACHE_BLOCK_SIZE);
+        if (b->size == 0) return NULL;
+        b->owner = this;
+        b->index = index;
+        b->lastUse = ++cacheClock;
+        return b;
+    }
+
+    File f;
+    uint32_t pos;
+    uint32_t len;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool VFS::begin()
+{
+    if (storageMutex == NULL)
+        storageMutex = xSemaphoreCreateRecursiveMutex();
+
+#ifdef USE_INT_FLASH
+    if (!SPIFFS.begin())
+        return false;
+    storage = &SPIFFS;
+#endif
+
+#ifdef USE_SD_CARD
+    customSPI.begin(SDCARD_CLK, SDCARD_MISO, SDCARD_MOSI, SDCARD_CS);
+
+    if (!SD.begin(SDCARD_CS, customSPI, 4000000, "/sd")) {
+        Serial.println("Card Mount Failed");
+        return false;
+    }
+    uint8_t cardType = SD.cardType();
+
+    if (cardType == CARD_NONE) {
+        Serial.println("No SD card attached");
+        return false;
+    }
+
+    Serial.print("SD Card Type: ");
+    if      (cardType == CARD_MMC)  Serial.println("MMC");
+    else if (cardType == CARD_SD )  Serial.println("SDSC");
+    else if (cardType == CARD_SDHC) Serial.println("SDHC");
+    else                            Serial.println("UNKNOWN");
+
+    uint64_t cardSize = SD.cardSize() / (1024 * 1024);
+    Serial.printf("SD Card Size: %lluMB\n", cardSize);
+    storage = &SD;
+#endif
+
+#ifdef USE_POSIX_FS
+    static fs::FS posixFS(fs::FSImplPtr(new PosixFSImpl(posixRoot)));
+    if (!posixFS.exists("/")) {
+        Serial.printf("Cannot open storage root %s\n", posixRoot);
+        return false;
+    }
+    Serial.printf("Storage root: %s\n", posixRoot);
+    storage = &posixFS;
+#endif
+
+    return true;
+}
+
+const char* VFS::name()
+{
+#ifdef USE_INT_FLASH
+    return "internal";
+#endif
+#ifdef USE_SD_CARD
+    return "external";
+#endif
+#ifdef USE_POSIX_FS
+    return "directory";
+#endif
+}
+
+File VFS::open(const String& path, const char* mode)
+{
+    String archive, member;
+    if (ZipFS::split(path, archive, member)) {
+        // archives are read only
+        if (strcmp(mode, FILE_READ)) return File();
+        File zip = openFile(archive, FILE_READ);
+        if (!zip || zip.isDirectory()) return zip;
+        return ZipFS::open(zip, archive, member);
+    }
+    return openFile(path, mode);
+}
+
+File VFS::openFile(const String& path, const char* mode)
+{
+    File f;
+    {
+        StorageLock lock;
+        f = storage->open(path.c_str(), mode);
+    }
+    if (!f) return f;
+    f = File(fs::FileImplPtr(new LockedFileImpl(f)));
+    if (strcmp(mode, FILE_READ) || f.isDirectory() || !cacheInit())
+        return f;
+    return File(fs::FileImplPtr(new CachedFileImpl(f)));
+}
+
+bool VFS::exists(const String& path)
+{
+    String archive, member;
+    if (ZipFS::split(path, archive, member) && member.length() > 0) {
+        File zip = openFile(archive, FILE_READ);
+        return zip && !zip.isDirectory() && ZipFS::exists(zip, member);
+    }
+    StorageLock lock;
+    return storage->exists(path.c_str());
+}
+
+bool VFS::remove(const String& path)
+{
+    StorageLock lock;
+    return storage->remove(path.c_str());
+}
+
+bool VFS::rename(const String& pathFrom, const String& pathTo)
+{
+    StorageLock lock;
+    return storage->rename(pathFrom.c_str(), pathTo.c_str());
+}
+
+bool VFS::mkdir(const String& path)
+{
+    StorageLock lock;
+    return storage->mkdir(path.c_str());
+}
+
+bool VFS::rmdir(const String& path)
+{
+    StorageLock lock;
+    return storage->rmdir(path.c_str());
+}
@@ -0,0 +1,406 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "ZipFS.h"
+#include "Inflater.h"
+#include "FileUtils.h"
+
+#include <FSImpl.h>
+
+#ifdef BOARD_HAS_PSRAM
+#define ZIP_ALLOC(size) ps_malloc(size)
+#else
+#define ZIP_ALLOC(size) malloc(size)
+#endif
+
+#define ZIP_EOCD_SIG    0x06054b50      // end of central directory
+#define ZIP_CDIR_SIG    0x02014b50      // central directory record
+#define ZIP_LOCAL_SIG   0x04034b50      // local header, before member data
+#define ZIP_EOCD_LEN    22
+#define ZIP_CDIR_LEN    46
+#define ZIP_LOCAL_LEN   30
+
+#define ZIP_STORED      0
+#define ZIP_DEFLATED    8
+#define ZIP_ENCRYPTED   0x0001
+
+// a member, from its central directory record
+struct ZipEntry
+{
+    String name;            // as stored, may include directories
+    uint16_t method;
+    uint16_t flags;
+    uint32_t crc;
+    uint32_t compSize;
+    uint32_t size;
+    uint32_t localOffset;   // of the local header
+    uint32_t mtime;
+};
+
+static inline uint16_t le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// seconds since 1970 of an MS-DOS date and time, local time taken as UTC
+static uint32_t dosTime(uint16_t date, uint16_t time)
+{
+    int32_t y = 1980 + (date >> 9);
+    int32_t m = (date >> 5) & 0x0F;
+    int32_t d = date & 0x1F;
+    // days from civil, with the year starting in March
+    y -= m <= 2;
+    int32_t era = y / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    uint32_t days = era * 146097 + doe - 719468;
+    return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2;
+}
+
+static String baseName(const String& name)
+{
+    return name.substring(name.lastIndexOf('/') + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// offset and number of records of the central directory, false if zip is
+// not an archive (or a multi-disk or zip64 one)
+static bool findDirectory(File zip, uint32_t* offset, uint16_t* count)
+{
+    uint32_t size = zip.size();
+    if (size < ZIP_EOCD_LEN) return false;
+
+    // the end record is last but for the archive comment
+    uint32_t span = size < ZIP_EOCD_LEN + ZIP_COMMENT_MAX ? size : ZIP_EOCD_LEN + ZIP_COMMENT_MAX;
+    uint8_t* tail = (uint8_t*)malloc(span);
+    if (tail == NULL) return false;
+    bool found = false;
+    if (zip.seek(size - span) && readBlockFile(zip, tail, span) == span) {
+        for (int32_t i = span - ZIP_EOCD_LEN; i >= 0 && !found; i--) {
+            const uint8_t* e = tail + i;
+            if (le32(e) != ZIP_EOCD_SIG || (uint32_t)i + ZIP_EOCD_LEN + le16(e + 20) != span) continue;
+            if (le16(e + 4) != 0 || le16(e + 6) != 0 || le16(e + 8) != le16(e + 10)) break;
+            *count = le16(e + 10);
+            *offset = le32(e + 16);
+            found = (uint64_t)*offset + le32(e + 12) <= size - span + i;
+            break;
+        }
+    }
+    free(tail);
+    return found;
+}
+
+// central directory record at *offset, which is moved to the next one;
+// false if there is no valid record there
+static bool readEntry(File zip, uint32_t* offset, ZipEntry& e)
+{
+    uint8_t h[ZIP_CDIR_LEN];
+    if (!zip.seek(*offset) || readBlockFile(zip, h, ZIP_CDIR_LEN) != ZIP_CDIR_LEN || le32(h) != ZIP_CDIR_SIG)
+        return false;
+
+    uint16_t nameLen = le16(h + 28);
+    char name[256];
+    uint16_t n = nameLen < sizeof(name) ? nameLen : sizeof(name) - 1;
+    if (readBlockFile(zip, (uint8_t*)name, n) != n) return false;
+    name[n] = 0;
+
+    e.name = (n == nameLen) ? name : "";
+    e.flags = le16(h + 8);
+    e.method = le16(h + 10);
+    e.mtime = dosTime(le16(h + 14), le16(h + 12));
+    e.crc = le32(h + 16);
+    e.compSize = le32(h + 20);
+    e.size = le32(h + 24);
+    e.localOffset = le32(h + 42);
+    *offset += ZIP_CDIR_LEN + nameLen + le16(h + 30) + le16(h + 32);
+    return true;
+}
+
+// a file the loaders can read; directories inside the archive are not
+static bool usable(const ZipEntry& e)
+{
+    if (e.name.length() == 0 || e.name.endsWith("/") || (e.flags & ZIP_ENCRYPTED)) return false;
+    if (e.method == ZIP_STORED) return e.compSize == e.size;
+    return e.method == ZIP_DEFLATED;
+}
+
+// member by name, with or without its directory in the archive
+static bool findEntry(File zip, uint32_t offset, uint16_t count, const String& member, ZipEntry& found)
+{
+    bool byBaseName = false;
+    ZipEntry e;
+    for (uint16_t i = 0; i < count; i++) {
+        if (!readEntry(zip, &offset, e)) break;
+        if (!usable(e)) continue;
+        if (e.name == member) {
+            found = e;
+            return true;
+        }
+        if (!byBaseName && baseName(e.name) == member) {
+            found = e;
+            byBaseName = true;
+        }
+    }
+    return byBaseName;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// a member being read; shares the archive file with the directory it was
+// listed from, if any
+class ZipMemberImpl : public fs::FileImpl
+{
+public:
+    ZipMemberImpl(File zip, const String& path, const ZipEntry& e)
+        : zip(zip), path(path), e(e), dataOffset(0), pos(0), crc(0), broken(false),
+          window(NULL), inflater(NULL) {}
+    ~ZipMemberImpl() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) { return 0; }
+    void flush() {}
+
+    size_t read(uint8_t* buf, size_t size)
+    {
+        if (size > e.size - pos) size = e.size - pos;
+        if (size == 0 || broken || (dataOffset == 0 && !restart()))
+            return 0;
+
+        int32_t n;
+        if (e.method == ZIP_STORED) {
+            if (zip.position() != dataOffset + pos) zip.seek(dataOffset + pos);
+            n = readBlockFile(zip, buf, size);
+        }
+        else {
+            n = inflater->read(buf, size);
+        }
+        // the data ends before the size in the directory, or does not decode
+        if (n != (int32_t)size) {
+            Serial.printf("ZipFS: %s is damaged\n", path.c_str());
+            broken = true;
+            return 0;
+        }
+
+        pos += n;
+        crc = FileUtils::crc32(crc, buf, n);
+        if (pos == e.size && crc != e.crc) {
+            Serial.printf("ZipFS: CRC error in %s\n", path.c_str());
+            broken = true;
+            return 0;
+        }
+        return n;
+    }
+
+    bool seek(uint32_t p, SeekMode mode)
+    {
+        if (mode == SeekCur) p += pos;
+        else if (mode == SeekEnd) p += e.size;
+        if (p > e.size || broken) return false;
+        if (p < pos || dataOffset == 0) {
+            if (!restart()) return false;
+        }
+        // read up to there, keeping the CRC of everything before
+        uint8_t skip[256];
+        while (pos < p) {
+            uint32_t n = p - pos < sizeof(skip) ? p - pos : sizeof(skip);
+            if (read(skip, n) != n) return false;
+        }
+        return true;
+    }
+
+    size_t position() const { return pos; }
+    size_t size() const { return e.size; }
+
+    void close()
+    {
+        delete inflater;
+        free(window);
+        inflater = NULL;
+        window = NULL;
+        // the archive may still be open for others
+        zip = File();
+    }
+
+    time_t getLastWrite() { return e.mtime; }
+    const char* name() const { return path.c_str(); }
+    boolean isDirectory(void) { return false; }
+    fs::FileImplPtr openNextFile(const char* mode) { return fs::FileImplPtr(); }
+    void rewindDirectory(void) {}
+    operator bool() { return zip; }
+
+private:
+    // back to the start of the data, finding it the first time
+    bool restart()
+    {
+        if (!zip) return false;
+        if (dataOffset == 0) {
+            uint8_t h[ZIP_LOCAL_LEN];
+            if (!zip.seek(e.localOffset) || readBlockFile(zip, h, ZIP_LOCAL_LEN) != ZIP_LOCAL_LEN
+                || le32(h) != ZIP_LOCAL_SIG) {
+                Serial.printf("ZipFS: no local header for %s\n", path.c_str());
+                broken = true;
+                return false;
+            }
+            uint32_t start = e.localOffset + ZIP_LOCAL_LEN + le16(h + 26) + le16(h + 28);
+            if ((uint64_t)start + e.compSize > zip.size()) {
+                Serial.printf("ZipFS: %s is truncated\n", path.c_str());
+                broken = true;
+                return false;
+            }
+            dataOffset = start;
+        }
+
+        if (e.method == ZIP_DEFLATED) {
+            if (inflater == NULL) {
+                window = (uint8_t*)ZIP_ALLOC(INFLATE_WINDOW_SIZE);
+                if (window == NULL) {
+                    Serial.printf("ZipFS: no memory to inflate %s\n", path.c_str());
+                    broken = true;
+                    return false;
+                }
+                inflater = new Inflater(window);
+            }
+            zip.seek(dataOffset);
+            inflater->begin(zip, e.compSize);
+        }
+        pos = 0;
+        crc = 0;
+        return true;
+    }
+
+    File zip;
+    String path;
+    ZipEntry e;
+    uint32_t dataOffset;    // 0 until the local header is read
+    uint32_t pos;
+    uint32_t crc;           // of the output up to pos
+    bool broken;
+    uint8_t* window;
+    Inflater* inflater;
+};
+
+// the archive, listing its members
+class ZipDirImpl : public fs::FileImpl
+{
+public:
+    ZipDirImpl(File zip, const String& path, uint32_t offset, uint16_t count)
+        : zip(zip), path(path), first(offset), count(count), next(offset), index(0) {}
+    ~ZipDirImpl() { close(); }
+
+    size_t write(const uint8_t* buf, size_t size) { return 0; }
+    size_t read(uint8_t* buf, size_t size) { return 0; }
+    void flush() {}
+    bool seek(uint32_t pos, SeekMode mode) { return false; }
+    size_t position() const { return 0; }
+    size_t size() const { return 0; }
+    void close() { zip = File(); }
+    time_t getLastWrite() { return zip ? zip.getLastWrite() : 0; }
+    const char* name() const { return path.c_str(); }
+    boolean isDirectory(void) { return true; }
+
+    fs::FileImplPtr openNextFile(const char* mode)
+    {
+        ZipEntry e;
+        while (zip && index < count) {
+            index++;
+            if (!readEntry(zip, &next, e)) {
+                Serial.printf("ZipFS: bad central directory in %s\n", path.c_str());
+                index = count;
+                break;
+            }
+            if (usable(e))
+                return fs::FileImplPtr(new ZipMemberImpl(zip, path + "/" + e.name, e));
+        }
+        return fs::FileImplPtr();
+    }
+
+    void rewindDirectory(void)
+    {
+        next = first;
+        index = 0;
+    }
+
+    operator bool() { return zip; }
+
+private:
+    File zip;
+    String path;
+    uint32_t first;         // offset of the central directory
+    uint16_t count;         // records in it
+    uint32_t next;          // offset of the next record to list
+    uint16_t index;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool ZipFS::split(const String& path, String& archive, String& member)
+{
+    String lower = path;
+    lower.toLowerCase();
+    for (int i = lower.indexOf(".zip"); i >= 0; i = lower.indexOf(".zip", i + 1)) {
+        unsigned int end = i + 4;
+        if (end < path.length() && path[end] != '/') continue;
+        archive = path.substring(0, end);
+        member = (end < path.length()) ? path.substring(end + 1) : "";
+        return true;
+    }
+    return false;
+}
+
+File ZipFS::open(File zip, const String& archive, const String& member)
+{
+    uint32_t offset;
+    uint16_t count;
+    if (!zip || !findDirectory(zip, &offset, &count)) {
+        Serial.printf("ZipFS: %s is not a zip archive\n", archive.c_str());
+        return File();
+    }
+    if (member.length() == 0)
+        return File(fs::FileImplPtr(new ZipDirImpl(zip, archive, offset, count)));
+
+    ZipEntry e;
+    if (!findEntry(zip, offset, count, member, e))
+        return File();
+    return File(fs::FileImplPtr(new ZipMemberImpl(zip, archive + "/" + member, e)));
+}
+
+bool ZipFS::exists(File zip, const String& member)
+{
+    uint32_t offset;
+    uint16_t count;
+    if (!zip || !findDirectory(zip, &offset, &count)) return false;
+    ZipEntry e;
+    return member.length() == 0 || findEntry(zip, offset, count, member, e);
+}
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "HostAudio.h"
+
+#include <Arduino.h>
+#include "CPU.h"
+#include "AySound.h"
+
+// beeper is a unipolar square wave, like the speaker pin (0 V / 3.3 V)
+#define BEEPER_AMPLITUDE 12000
+
+bool HostAudio::stereo = false;
+uint32_t HostAudio::rate = 0;
+uint64_t HostAudio::synthMicros = 0;
+std::vector<int16_t> HostAudio::pcm;
+std::vector<HostAudio::BeeperEvent> HostAudio::events;
+uint8_t HostAudio::beeperLevel = 0;
+uint64_t HostAudio::frameStart = 0;
+uint64_t HostAudio::sampleIndex = 0;
+std::vector<int16_t> HostAudio::ayQueue;
+size_t HostAudio::ayQueuePos = 0;
+
+void HostAudio::begin()
+{
+    stereo = AySound::isStereoOutput();
+    rate = AySound::sampleRate();
+    synthMicros = 0;
+    pcm.clear();
+    events.clear();
+    beeperLevel = 0;
+    frameStart = 0;
+    sampleIndex = 0;
+    ayQueue.clear();
+    ayQueuePos = 0;
+}
+
+void HostAudio::beeperWrite(uint8_t level)
+{
+    level = level ? 1 : 0;
+    uint8_t last = events.empty() ? beeperLevel : events.back().level;
+    if (level == last) return;
+    events.push_back({ frameStart + CPU::tstates, level });
+}
+
+static inline int16_t clamp16(int32_t v)
+{
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return v;
+}
+
+void HostAudio::endFrame(uint32_t statesPerFrame, uint32_t microsPerFrame)
+{
+    uint32_t ts_start = micros();
+
+    int ch = channels();
+    uint64_t frameEnd = frameStart + statesPerFrame;
+
+    // sample k starts at T-state k * S / D; integer math keeps output bit exact
+    uint64_t S = (uint64_t)statesPerFrame * 1000000;
+    uint64_t D = (uint64_t)microsPerFrame * rate;
+
+    size_t evPos = 0;
+    for (;;) {
+        uint64_t s0 = sampleIndex * S / D;
+        uint64_t s1 = (sampleIndex + 1) * S / D;
+        if (s1 > frameEnd) break;
+
+        // beeper: fraction of the sample period the speaker was high
+        uint64_t t = s0;
+        uint64_t highStates = 0;
+        while (evPos < events.size() && events[evPos].time < s1) {
+            uint64_t et = events[evPos].time > t ? events[evPos].time : t;
+            if (beeperLevel) highStates += et - t;
+            t = et;
+            beeperLevel = events[evPos].level;
+            evPos++;
+        }
+        if (beeperLevel) highStates += s1 - t;
+        int32_t beeper = (int32_t)(highStates * BEEPER_AMPLITUDE / (s1 - s0));
+
+        // AY: pull another mixed block when the queue runs out
+        if (ayQueuePos >= ayQueue.size()) {
+            ayQueue.clear();
+            ayQueuePos = 0;
+            int frames;
+            const uint16_t* block = AySound::renderBlock(&frames);
+            for (int i = 0; i < frames * ch; i++)
+                ayQueue.push_back(((int)(block[i ^ 1] >> 8) - 127) << 8);
+            if (frames == 0)
+                ayQueue.resize(ch, 0);
+        }
+        for (int c = 0; c < ch; c++)
+            pcm.push_back(clamp16(ayQueue[ayQueuePos++] + beeper));
+
+        sampleIndex++;
+    }
+
+    // transitions past the last complete sample belong to the next frame
+    events.erase(events.begin(), events.begin() + evPos);
+    frameStart = frameEnd;
+
+    synthMicros += micros() - ts_start;
+}
+
+static void writeLE32(FILE* f, uint32_t v)
+{
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    fwrite(b, 1, 4, f);
+}
+
+static void writeLE16(FILE* f, uint16_t v)
+{
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    fwrite(b, 1, 2, f);
+}
+
+bool HostAudio::writeWav(const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return false;
+    }
+    uint32_t dataSize = pcm.size() * sizeof(int16_t);
+    fwrite("RIFF", 1, 4, f);
+    writeLE32(f, 36 + dataSize);
+    fwrite("WAVEfmt ", 1, 8, f);
+    writeLE32(f, 16);                       // fmt chunk size
+    writeLE16(f, 1);                        // PCM
+    writeLE16(f, channels());
+    writeLE32(f, rate);
+    writeLE32(f, rate * channels() * 2);    // byte rate
+    writeLE16(f, channels() * 2);           // block align
+    writeLE16(f, 16);                       // bits per sample
+    fwrite("data", 1, 4, f);
+    writeLE32(f, dataSize);
+    for (size_t i = 0; i < pcm.size(); i++)
+        writeLE16(f, (uint16_t)pcm[i]);
+    fclose(f);
+    return true;
+}
+
+uint64_t HostAudio::hash()
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < pcm.size(); i++) {
+        uint16_t v = (uint16_t)pcm[i];
+        h = (h ^ (v & 0xFF)) * 0x100000001b3ULL;
+        h = (h ^ (v >> 8)) * 0x100000001b3ULL;
+    }
+    return h;
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef HostAudio_h
+#define HostAudio_h
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <vector>
+
+// Offline audio capture for the host harness.
+//
+// The AY chips are mixed with the device code (AySound -> FabGL SoundGenerator),
+// the beeper is rebuilt from SPEAKER_PIN writes timestamped with CPU::tstates
+// and averaged over each output sample, as the speaker would low-pass it.
+class HostAudio
+{
+public:
+    // start a new capture, clears samples, hash and timing counters
+    static void begin();
+
+    // speaker pin changed level at CPU::tstates of the current frame
+    static void beeperWrite(uint8_t level);
+
+    // render all samples covering the frame that just ended
+    static void endFrame(uint32_t statesPerFrame, uint32_t microsPerFrame);
+
+    // write captured samples as a 16 bit PCM WAV file
+    static bool writeWav(const char* filename);
+
+    // FNV-1a 64 hash of the captured PCM data (little endian)
+    static uint64_t hash();
+
+    static int channels() { return stereo ? 2 : 1; }
+    static uint32_t sampleRate() { return rate; }
+    static size_t frameCount() { return pcm.size() / channels(); }
+
+    // host microseconds spent in synthesis (AY mixing + beeper) since begin()
+    static uint64_t synthMicros;
+
+private:
+    // time in T-states counted from begin()
+    struct BeeperEvent { uint64_t time; uint8_t level; };
+
+    static bool stereo;
+    static uint32_t rate;
+    static std::vector<int16_t> pcm;
+    static std::vector<BeeperEvent> events;
+    static uint8_t beeperLevel;
+    static uint64_t frameStart;     // first T-state of current frame, from begin()
+    static uint64_t sampleIndex;    // next sample to render
+    static std::vector<int16_t> ayQueue;
+    static size_t ayQueuePos;
+};
+
+#endif // HostAudio_h
@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "HostEar.h"
+#include "EarInput.h"
+
+#include <stdio.h>
+#include <string.h>
+
+std::vector<HostEar::Edge> HostEar::edges;
+size_t HostEar::next = 0;
+
+static uint32_t readLE(const uint8_t* p, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+bool HostEar::load(const char* filename)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return false;
+    }
+    std::vector<uint8_t> wav;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        wav.insert(wav.end(), chunk, chunk + n);
+    fclose(f);
+
+    if (wav.size() < 12 || memcmp(&wav[0], "RIFF", 4) || memcmp(&wav[8], "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", filename);
+        return false;
+    }
+
+    uint32_t rate = 0, channels = 0, bits = 0;
+    const uint8_t* data = NULL;
+    uint32_t dataSize = 0;
+    for (size_t pos = 12; pos + 8 <= wav.size(); ) {
+        uint32_t size = readLE(&wav[pos + 4], 4);
+        if (!memcmp(&wav[pos], "fmt ", 4) && size >= 16) {
+            channels = readLE(&wav[pos + 10], 2);
+            rate = readLE(&wav[pos + 12], 4);
+            bits = readLE(&wav[pos + 22], 2);
+        }
+        else if (!memcmp(&wav[pos], "data", 4)) {
+            data = &wav[pos + 8];
+            dataSize = size < wav.size() - pos - 8 ? size : wav.size() - pos - 8;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    if (data == NULL || rate == 0 || channels == 0 || (bits != 8 && bits != 16)) {
+        fprintf(stderr, "%s: unsupported WAV format\n", filename);
+        return false;
+    }
+
+    // signed samples of the first channel
+    uint32_t frameBytes = channels * bits / 8;
+    uint32_t count = dataSize / frameBytes;
+    std::vector<int> samples(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* p = data + i * frameBytes;
+        samples[i] = (bits == 8) ? ((int)p[0] - 128) << 8 : (int16_t)readLE(p, 2);
+    }
+
+    // schmitt trigger around the mean, like the EAR input comparator
+    int64_t sum = 0;
+    for (int s : samples) sum += s;
+    int mean = count ? sum / count : 0;
+    const int hysteresis = 1024;
+
+    edges.clear();
+    next = 0;
+    uint8_t level = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int s = samples[i] - mean;
+        uint8_t newLevel = level;
+        if (s > hysteresis) newLevel = 1;
+        else if (s < -hysteresis) newLevel = 0;
+        if (newLevel != level) {
+            edges.push_back({ (uint64_t)i * 1000000 / rate, newLevel });
+            level = newLevel;
+        }
+    }
+    printf("%s: %u Hz, %u edges\n", filename, rate, (unsigned)edges.size());
+    return true;
+}
+
+void HostEar::feed(uint64_t untilMicros)
+{
+    while (next < edges.size() && edges[next].time <= untilMicros) {
+        EarInput::pushEdge((uint32_t)edges[next].time, edges[next].level);
+        next++;
+    }
+}
@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef HostEar_h
+#define HostEar_h
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+
+// Replays a recorded EAR input stream (WAV file of a tape) through EarInput,
+// pushing each edge with its timestamp as the pin interrupt would on the device.
+class HostEar
+{
+public:
+    // read a PCM WAV file (8 or 16 bit, first channel) and extract its edges
+    static bool load(const char* filename);
+
+    // restart replay from the beginning
+    static void rewind() { next = 0; }
+
+    // push all edges up to the given time since replay start
+    static void feed(uint64_t untilMicros);
+
+    static bool loaded() { return !edges.empty(); }
+
+private:
+    struct Edge {
+        uint64_t time;
+        uint8_t level;
+    };
+
+    static std::vector<Edge> edges;
+    static size_t next;
+};
+
+#endif // HostEar_h
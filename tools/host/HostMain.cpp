@@ -0,0 +1,1351 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+// ZX-ESPectrum host harness
+//
+// Runs the emulator core (CPU, memory, ports, AY, snapshot loaders) on the host,
+// compiled from the same sources as the device, and captures its audio output.
+// See tools/host/README.md for usage.
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include "hardconfig.h"
+#include "hardpins.h"
+#include "ESPectrum.h"
+#include "CPU.h"
+#include "Ports.h"
+#include "Mem.h"
+#include "Config.h"
+#include "AySound.h"
+#include "fabgl.h"
+#include "AyRecorder.h"
+#include "EarInput.h"
+#include "FileTAP.h"
+#include "FileTZX.h"
+#include "FileUtils.h"
+#include "VFS.h"
+#include "FileSNA.h"
+#include "FileZ80.h"
+#include "FileSZX.h"
+#include "FileRZX.h"
+#include "FileDSK.h"
+#include "FDC.h"
+#include "FileTRD.h"
+#include "BetaDisk.h"
+#include "FileCatalog.h"
+#include "ScreenPreview.h"
+#include "RomPartition.h"
+#include "RomCache.h"
+#include "QuickSlots.h"
+#include "Rewind.h"
+#include "Z80_JLS/z80.h"
+
+#include "HostAudio.h"
+#include "HostEar.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <vector>
+
+#ifndef HOST_DATA_DIR
+#define HOST_DATA_DIR "data"
+#endif
+
+// pseudo snapshot name: no CPU, a fixed AY register sequence is written every frame
+#define AY_DEMO_NAME "@aydemo"
+
+struct RunResult
+{
+    uint32_t frames;
+    double seconds;
+    uint64_t synthMicros;
+    uint64_t emuMicros;
+    uint64_t hash;
+};
+
+static void digitalWriteHook(uint8_t pin, uint8_t val)
+{
+    #ifdef SPEAKER_PRESENT
+    if (pin == SPEAKER_PIN)
+        HostAudio::beeperWrite(val);
+    #endif
+}
+
+static void ayWrite(uint8_t reg, uint8_t value)
+{
+    Ports::output(0xFD, 0xFF, reg);     // OUT (0xFFFD), reg
+    Ports::output(0xFD, 0xBF, value);   // OUT (0xBFFD), value
+}
+
+// exercises tone, noise, envelope and the TurboSound second chip
+static void ayDemoFrame(uint32_t frame)
+{
+    static const uint16_t notes[8] = { 424, 377, 336, 317, 283, 252, 224, 212 };
+
+    if (frame == 0) {
+        ayWrite(7, 0x30);           // tone A, B, C + noise C
+        ayWrite(6, 0x08);           // noise period
+        ayWrite(8, 0x0F);           // A fixed volume
+        ayWrite(9, 0x10);           // B envelope
+        ayWrite(10, 0x08);          // C fixed volume
+        ayWrite(11, 0x00);
+        ayWrite(12, 0x04);          // envelope period
+    }
+
+    uint16_t a = notes[(frame / 10) % 8];
+    uint16_t b = notes[(frame / 25) % 8] << 1;
+    ayWrite(0, a & 0xFF); ayWrite(1, a >> 8);
+    ayWrite(2, b & 0xFF); ayWrite(3, b >> 8);
+    ayWrite(4, (frame * 7) & 0xFF); ayWrite(5, 0x01);
+    if (frame % 25 == 0)
+        ayWrite(13, 0x08 | ((frame / 25) & 0x07));  // retrigger envelope
+
+    // second chip: bass line from the third second on
+    if (frame >= 150) {
+        Ports::output(0xFD, 0xFF, 0xFE);    // select TurboSound chip 1
+        if (frame == 150) {
+            ayWrite(7, 0x3E);
+            ayWrite(8, 0x0C);
+        }
+        uint16_t bass = notes[(frame / 50) % 8] << 2;
+        ayWrite(0, bass & 0xFF); ayWrite(1, bass >> 8);
+        Ports::output(0xFD, 0xFF, 0xFF);    // back to chip 0
+    }
+}
+
+static uint64_t stateHash()
+{
+    SZXImage image;
+    FileSZX::capture(image, NULL);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint16_t i = 0; i < image.headLen; i++)
+        hash = (hash ^ image.head[i]) * 0x100000001b3ULL;
+    for (uint8_t p = 0; p < image.pageCount; p++)
+        for (uint16_t i = 0; i < 0x4000; i++)
+            hash = (hash ^ image.pages[p][i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+static bool loadSnapshot(String name)
+{
+    AySound::reset();
+    if (name == AY_DEMO_NAME) {
+        Config::requestMachine("128K", "SINCLAIR", false);
+        ESPectrum::reset();
+        return true;
+    }
+    ESPectrum::reset();
+    if (FileUtils::hasSNAextension(name)) return FileSNA::load(name);
+    if (FileUtils::hasZ80extension(name)) return FileZ80::load(name);
+    if (FileUtils::hasSZXextension(name)) return FileSZX::load(name);
+    if (FileUtils::hasRZXextension(name)) return FileRZX::play(name);
+    fprintf(stderr, "Unknown snapshot type: %s\n", name.c_str());
+    return false;
+}
+
+struct RunOptions
+{
+    const char* psgFile = NULL;     // record AY writes to this file
+    bool ear = false;               // replay the loaded EAR stream
+    const char* tapFile = NULL;     // tape inserted for the LD-BYTES trap
+    const char* tzxFile = NULL;     // tape played into the EAR input
+    const char* rzxFile = NULL;     // record the input to this file
+};
+
+static bool run(String name, double seconds, RunResult& result, const RunOptions& options = RunOptions())
+{
+    if (!loadSnapshot(name))
+        return false;
+    if (options.psgFile && !AyRecorder::start(options.psgFile))
+        return false;
+    if (options.tapFile && !FileTAP::open(options.tapFile))
+        return false;
+    if (options.tzxFile && !FileTZX::open(options.tzxFile))
+        return false;
+    if (options.rzxFile && !FileRZX::record(options.rzxFile))
+        return false;
+    bool replay = FileRZX::isPlaying();
+
+    EarInput::initialize();
+    HostEar::rewind();
+
+    bool ayDemo = (name == AY_DEMO_NAME);
+    HostAudio::begin();
+    result.frames = 0;
+    result.emuMicros = 0;
+
+    uint64_t emulatedMicros = 0;
+    while (emulatedMicros < seconds * 1000000) {
+        // edges arriving during this frame, as the pin interrupt would store them
+        if (options.ear)
+            HostEar::feed(emulatedMicros + CPU::microsPerFrame());
+
+        uint32_t ts_start = micros();
+        if (ayDemo)
+            ayDemoFrame(result.frames);
+        else
+            CPU::loop();
+        result.emuMicros += micros() - ts_start;
+
+        AyRecorder::endFrame();
+        AyRecorder::writePending();     // the writer task on the device
+        EarInput::endFrame(CPU::statesPerFrame());
+        FileTZX::endFrame(CPU::statesPerFrame());
+        FileRZX::endFrame();
+        FileRZX::writePending();        // the writer task on the device
+        FDC::endFrame(CPU::statesPerFrame());
+        BetaDisk::endFrame(CPU::statesPerFrame());
+
+        HostAudio::endFrame(CPU::statesPerFrame(), CPU::microsPerFrame());
+        emulatedMicros += CPU::microsPerFrame();
+        result.frames++;
+
+        // a replay runs as long as the recording
+        if (replay && !FileRZX::isPlaying())
+            break;
+    }
+
+    if (replay || options.rzxFile) {
+        printf("  rzx      : %u frames %s, %u out of sync, state hash %016llx\n", FileRZX::frames(),
+            replay ? "played" : "recorded", FileRZX::desyncs(), (unsigned long long)stateHash());
+    }
+    FileRZX::stop();
+
+    AyRecorder::stop();
+    FileTAP::close();
+    FileTZX::close();
+    if (EarInput::overruns())
+        printf("  EAR input: %u edges lost\n", EarInput::overruns());
+
+    result.seconds = emulatedMicros / 1000000.0;
+    result.synthMicros = HostAudio::synthMicros;
+    result.hash = HostAudio::hash();
+    return true;
+}
+
+// save the displayed screen (bitmap + attributes) as a .scr file
+static bool writeScreen(const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return false;
+    }
+    fwrite(Mem::videoLatch ? Mem::ram7 : Mem::ram5, 1, 6912, f);
+    fclose(f);
+    return true;
+}
+
+static void report(String name, const RunResult& r)
+{
+    printf("%s: %.2f s emulated (%u frames, %u Hz %s)\n", name.c_str(), r.seconds, r.frames,
+        HostAudio::sampleRate(), HostAudio::channels() == 2 ? "stereo" : "mono");
+    printf("  synthesis: %llu us per emulated second\n", (unsigned long long)(r.synthMicros / r.seconds));
+    printf("  emulation: %llu us per emulated second\n", (unsigned long long)(r.emuMicros / r.seconds));
+    printf("  pcm hash : %016llx\n", (unsigned long long)r.hash);
+}
+
+// each line: <snapshot> <seconds> <hash>, '#' starts a comment
+// load a snapshot repeatedly, timing the loader alone
+static bool benchLoad(String name, int count)
+{
+    uint64_t loadMicros = 0;
+    uint32_t readCalls = hostFileReadCalls;
+    for (int i = 0; i < count; i++) {
+        AySound::reset();
+        ESPectrum::reset();
+        uint32_t ts_start = micros();
+        bool ok = false;
+        if (FileUtils::hasSNAextension(name)) ok = FileSNA::load(name);
+        else if (FileUtils::hasZ80extension(name)) ok = FileZ80::load(name);
+        else if (FileUtils::hasSZXextension(name)) ok = FileSZX::load(name);
+        loadMicros += micros() - ts_start;
+        if (!ok) {
+            fprintf(stderr, "Cannot load %s\n", name.c_str());
+            return false;
+        }
+    }
+    printf("%s: %d loads\n", name.c_str(), count);
+    printf("  load time : %.1f us\n", (double)loadMicros / count);
+    printf("  file reads: %u calls\n", (hostFileReadCalls - readCalls) / count);
+    return true;
+}
+
+// save the loaded snapshot repeatedly in each format, timing the writer alone
+static bool benchSave(String name, int count)
+{
+    if (!loadSnapshot(name))
+        return false;
+
+    const char* formats[3] = { "/bench.sna", "/bench.z80", "/bench.szx" };
+    printf("%s: %d saves\n", name.c_str(), count);
+    for (int fmt = 0; fmt < 3; fmt++) {
+        String filename = formats[fmt];
+        uint64_t saveMicros = 0;
+        uint32_t writeCalls = hostFileWriteCalls;
+        for (int i = 0; i < count; i++) {
+            uint32_t ts_start = micros();
+            bool ok = fmt == 0 ? FileSNA::save(filename)
+                    : fmt == 1 ? FileZ80::save(filename) : FileSZX::save(filename);
+            saveMicros += micros() - ts_start;
+            if (!ok) {
+                fprintf(stderr, "Cannot save %s\n", filename.c_str());
+                return false;
+            }
+            // the 48K SNA writer pushes PC: start every save from the same state
+            if (fmt == 0 && !loadSnapshot(name))
+                return false;
+        }
+        File f = VFS::open(filename);
+        uint32_t size = f.size();
+        f.close();
+        // and load it back, through the VFS cache as the OSD does
+        uint32_t readCalls = hostFileReadCalls;
+        uint32_t ts_start = micros();
+        bool ok = fmt == 0 ? FileSNA::load(filename)
+                : fmt == 1 ? FileZ80::load(filename) : FileSZX::load(filename);
+        uint32_t loadMicros = micros() - ts_start;
+        VFS::remove(filename);
+        if (!ok || !loadSnapshot(name)) {
+            fprintf(stderr, "Cannot load %s\n", filename.c_str());
+            return false;
+        }
+        printf("  %s: %6u bytes, %8.1f us, %5u write calls; load %6u us, %5u read calls\n",
+            filename.c_str() + 7, size, (double)saveMicros / count, (hostFileWriteCalls - writeCalls) / count,
+            loadMicros, hostFileReadCalls - readCalls);
+    }
+
+    // a background save cut short after removing the old snapshot leaves
+    // only the complete temporary file, which has to be picked up
+    if (!FileSZX::save("/bench.szx.tmp") || !FileSZX::recoverSave("/bench.szx")
+        || VFS::exists("/bench.szx.tmp") || !FileSZX::load("/bench.szx")) {
+        fprintf(stderr, "Interrupted save not recovered\n");
+        return false;
+    }
+    VFS::remove("/bench.szx");
+    printf("  recover: interrupted save picked up from .tmp: OK\n");
+    return true;
+}
+
+// quick save and load the snapshot to every slot in turn, checking that the
+// RAM comes back unchanged
+static bool benchQuick(String name, int count)
+{
+    if (!loadSnapshot(name))
+        return false;
+
+    static uint8_t saved[8][0x4000];
+    uint64_t saveMicros = 0, loadMicros = 0;
+    uint32_t rawSize = (Config::getArch() == "48K") ? SNA_48K_SIZE : SNA_128K_SIZE1;
+    uint32_t packedSize = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t slot = i % QUICK_SLOTS;
+        if (!QuickSlots::save(slot)) {
+            fprintf(stderr, "Cannot save quick slot %u\n", slot + 1);
+            return false;
+        }
+        // the 48K state pushes PC, compare from after the save
+        for (int page = 0; page < 8; page++)
+            memcpy(saved[page], Mem::ram[page], 0x4000);
+        CPU::loop();
+        if (!QuickSlots::load(slot)) {
+            fprintf(stderr, "Cannot load quick slot %u\n", slot + 1);
+            return false;
+        }
+        uint8_t pages = rawSize == SNA_48K_SIZE ? 3 : 8;
+        for (int p = 0; p < pages; p++) {
+            int page = rawSize == SNA_48K_SIZE ? (p == 0 ? 5 : p == 1 ? 2 : 0) : p;
+            if (memcmp(saved[page], Mem::ram[page], 0x4000) != 0) {
+                fprintf(stderr, "Quick slot %u: page %d differs after load\n", slot + 1, page);
+                return false;
+            }
+        }
+        saveMicros += QuickSlots::saveMicros(slot);
+        loadMicros += QuickSlots::loadMicros(slot);
+        packedSize = QuickSlots::packedSize(slot);
+    }
+    printf("%s: %d quick saves and loads, %u slots\n", name.c_str(), count, QUICK_SLOTS);
+    printf("  size: %u -> %u bytes (%.1f%%)\n", rawSize, packedSize, 100.0 * packedSize / rawSize);
+    printf("  save: %.1f us\n", (double)saveMicros / count);
+    printf("  load: %.1f us\n", (double)loadMicros / count);
+    return true;
+}
+
+// run the snapshot with rewind snapshots taken, timing them, then go back
+// through every one checking the state against the one taken live
+static bool benchRewind(String name, double seconds)
+{
+    if (!loadSnapshot(name))
+        return false;
+
+    std::map<uint32_t, uint64_t> hashes;
+    uint32_t frames = seconds * 50;
+    uint64_t rewindMicros = 0;
+    uint32_t maxMicros = 0;
+    for (uint32_t f = 1; f <= frames; f++) {
+        CPU::loop();
+        uint32_t captures = Rewind::captures();
+        uint32_t ts_start = micros();
+        Rewind::endFrame();
+        uint32_t elapsed = micros() - ts_start;
+        rewindMicros += elapsed;
+        if (elapsed > maxMicros) maxMicros = elapsed;
+        if (Rewind::captures() != captures)
+            hashes[f] = stateHash();
+    }
+    uint8_t count = Rewind::count();
+    uint32_t memory = Rewind::memory();
+
+    uint32_t now = frames;
+    uint32_t restoreMicros = 0;
+    for (uint8_t n = 0; Rewind::count() > n; n = 1) {
+        uint32_t taken = now - Rewind::age(n);
+        uint32_t ts_start = micros();
+        if (!Rewind::restore(n)) {
+            fprintf(stderr, "Cannot rewind to frame %u\n", taken);
+            return false;
+        }
+        restoreMicros += micros() - ts_start;
+        if (stateHash() != hashes[taken]) {
+            fprintf(stderr, "Rewind to frame %u: state differs\n", taken);
+            return false;
+        }
+        now = taken;
+    }
+
+    printf("%s: %.2f s, %u snapshots kept of %u taken\n", name.c_str(), frames / 50.0,
+        count, (uint32_t)hashes.size());
+    printf("  memory : %u bytes, %u per snapshot\n", memory, count ? memory / count : 0);
+    printf("  cost   : %.1f us per frame average, %u us max\n", (double)rewindMicros / frames, maxMicros);
+    printf("  restore: %.1f us average, all states match\n", count ? (double)restoreMicros / count : 0.0);
+    return true;
+}
+
+// Mem::writebyte() as it was before dirty tracking, for comparison
+static inline void untrackedWrite(uint16_t addr, uint8_t data)
+{
+    switch (addr >> 14) {
+    case 1: Mem::ram5[addr - 0x4000] = data; break;
+    case 2: Mem::ram2[addr - 0x8000] = data; break;
+    case 3: Mem::ram[Mem::bankLatch][addr - 0xC000] = data; break;
+    }
+}
+
+// time n passes of byte writes over the 48K of RAM with and without dirty
+// tracking, and the queries made on them
+static bool benchMem(int count)
+{
+    uint32_t ts_start = micros();
+    for (int n = 0; n < count; n++)
+        for (uint32_t addr = 0x4000; addr < 0x10000; addr++)
+            untrackedWrite(addr, addr ^ n);
+    uint32_t untrackedMicros = micros() - ts_start;
+
+    ts_start = micros();
+    for (int n = 0; n < count; n++)
+        for (uint32_t addr = 0x4000; addr < 0x10000; addr++)
+            Mem::writebyte(addr, addr ^ n);
+    uint32_t trackedMicros = micros() - ts_start;
+
+    uint32_t found = 0;
+    ts_start = micros();
+    for (int n = 0; n < count; n++) {
+        for (uint8_t page = 0; page < 8; page++) {
+            found += Mem::isPageDirty(page, MEM_DIRTY_REWIND);
+            Mem::clearPageDirty(page, MEM_DIRTY_REWIND);
+        }
+        Mem::writebyte(0x4000 + n, n);
+    }
+    uint32_t queryMicros = micros() - ts_start;
+
+    double writes = count * 49152.0;
+    printf("memory writes: %d x 48K\n", count);
+    printf("  untracked: %.2f ns per write\n", untrackedMicros * 1000.0 / writes);
+    printf("  tracked  : %.2f ns per write\n", trackedMicros * 1000.0 / writes);
+    printf("  query and clear 8 pages: %.2f us (%u dirty)\n", (double)queryMicros / count, found);
+    return true;
+}
+
+// program the selected AY chip: three tones at 440, 554 and 659 Hz, full
+// volume; with noise and envelope, noise on A and the envelope on C
+static void programAy(bool noiseEnvelope)
+{
+    static const uint8_t tones[14] = { 252, 0, 200, 0, 168, 0, 0x10, 0x38, 15, 15, 15, 0x00, 0x04, 0x0E };
+    for (uint8_t reg = 0; reg < 14; reg++) {
+        uint8_t value = tones[reg];
+        if (noiseEnvelope && reg == 7) value = 0x30;
+        if (noiseEnvelope && reg == 10) value = 0x10;
+        AySound::selectRegister(reg);
+        AySound::setRegisterData(value);
+    }
+}
+
+// host time to mix one second of output through a sound generator, or
+// through the AY chips when gen is NULL
+static uint32_t synthCost(SoundGenerator* gen)
+{
+    uint32_t done = 0;
+    uint32_t ts_start = micros();
+    while (done < (uint32_t)AySound::sampleRate()) {
+        int frames;
+        if (gen) gen->renderBlock(&frames);
+        else AySound::renderBlock(&frames);
+        done += frames;
+    }
+    return micros() - ts_start;
+}
+
+// synthesis cost per emulated second of the AY as FabGL square wave
+// generators (the driver before AyChip), and of one and two AyChips. The
+// cases take turns one second at a time and the fastest second of each
+// is kept, so that other load on the host weighs on none of them.
+static bool benchAy(int seconds)
+{
+    // the old driver: one generator per channel, volume[15] and the pitch
+    // of the tones above, mixed by FabGL in mono
+    SoundGenerator fabgl(AySound::sampleRate(), false);
+    SquareWaveformGenerator square[3];
+    static const int freqs[3] = { 440, 554, 659 };
+    fabgl.setVolume(126);
+    for (int i = 0; i < 3; i++) {
+        fabgl.attach(&square[i]);
+        square[i].setFrequency(freqs[i]);
+        square[i].setVolume(127);
+        square[i].enable(true);
+    }
+
+    const char* names[5] = { "FabGL square generators   ",
+                             "1 chip, tones             ", "1 chip, noise and envelope",
+                             "TurboSound, tones         ", "TurboSound, noise and env " };
+    uint32_t best[5];
+    for (int i = 0; i < 5; i++) best[i] = UINT32_MAX;
+    for (int n = 0; n < seconds; n++) {
+        uint32_t elapsed = synthCost(&fabgl);
+        if (elapsed < best[0]) best[0] = elapsed;
+        for (int i = 0; i < 4; i++) {
+            AySound::reset();
+            programAy(i & 1);
+            if (i >= 2) {
+                AySound::selectRegister(0xFE);
+                programAy(i & 1);
+                AySound::selectRegister(0xFF);
+            }
+            elapsed = synthCost(NULL);
+            if (elapsed < best[i + 1]) best[i + 1] = elapsed;
+        }
+    }
+
+    printf("AY synthesis: %d s at %d Hz, AyChip output %s\n", seconds, AySound::sampleRate(),
+        AySound::isStereoOutput() ? "stereo" : "mono");
+    for (int i = 0; i < 5; i++)
+        printf("  %s: %6u us per emulated second\n", names[i], best[i]);
+    AySound::reset();
+    return true;
+}
+
+// time machine switches between 48K SINCLAIR and 128K PLUS3 through each way
+// of getting the ROMs: the phases of the loader reading /rom (directory
+// listing, opening, reading byte by byte as it used to or in one block), the
+// PSRAM cache and the flash partition, then Config::requestMachine() as set up
+static bool benchSwitch(int count)
+{
+    const char* sets[2][2] = { { "48K", "SINCLAIR" }, { "128K", "PLUS3" } };
+    uint64_t listMicros = 0, openMicros = 0, byteMicros = 0, blockMicros = 0;
+    uint64_t cacheMicros = 0, partMicros = 0, switchMicros = 0;
+    uint32_t byteReads = 0, blockReads = 0;
+    static uint8_t page[0x4000];
+    uint8_t* pages[4];
+
+    for (int i = 0; i < count * 2; i++) {
+        String arch = sets[i & 1][0];
+        String romset = sets[i & 1][1];
+        String path = "/rom/" + arch + "/" + romset;
+
+        uint32_t ts_start = micros();
+        uint16_t n_roms = FileUtils::countFileEntriesFromDir(path);
+        listMicros += micros() - ts_start;
+
+        for (uint16_t r = 0; r < n_roms; r++) {
+            String filename = path + "/" + (String)r + ".rom";
+            ts_start = micros();
+            File f = FileUtils::safeOpenFileRead(filename);
+            openMicros += micros() - ts_start;
+
+            uint32_t readCalls = hostFileReadCalls;
+            ts_start = micros();
+            for (size_t b = 0; b < f.size(); b++)
+                page[b] = f.read();
+            byteMicros += micros() - ts_start;
+            byteReads += hostFileReadCalls - readCalls;
+
+            f.seek(0);
+            readCalls = hostFileReadCalls;
+            ts_start = micros();
+            readBlockFile(f, page, f.size());
+            blockMicros += micros() - ts_start;
+            blockReads += hostFileReadCalls - readCalls;
+            f.close();
+        }
+
+        ts_start = micros();
+        RomCache::map(arch, romset, pages);
+        cacheMicros += micros() - ts_start;
+
+        ts_start = micros();
+        RomPartition::map(arch, romset, pages);
+        partMicros += micros() - ts_start;
+
+        ts_start = micros();
+        Config::requestMachine(arch, romset, true);
+        switchMicros += micros() - ts_start;
+    }
+
+    double n = count * 2;
+    printf("machine switch 48K SINCLAIR <-> 128K PLUS3, %d times each way\n", count);
+    printf("  files, listing   : %8.2f us\n", listMicros / n);
+    printf("  files, opening   : %8.2f us\n", openMicros / n);
+    printf("  files, byte reads: %8.2f us, %u read calls\n", byteMicros / n, (uint32_t)(byteReads / n));
+    printf("  files, block read: %8.2f us, %u read calls\n", blockMicros / n, (uint32_t)(blockReads / n));
+    printf("  PSRAM cache      : %8.2f us\n", cacheMicros / n);
+    if (RomPartition::isMapped())
+        printf("  flash partition  : %8.2f us\n", partMicros / n);
+    printf("  requestMachine   : %8.2f us (%s)\n", switchMicros / n,
+        RomPartition::isMapped() ? "flash partition" : "PSRAM cache");
+    return true;
+}
+
+// disk geometry of --bench-disk: a +3 format, 40 tracks of 9 x 512 bytes
+#define BENCH_DSK_FILE "/bench.dsk"
+#define BENCH_DSK_TRACKS 40
+#define BENCH_DSK_SECTORS 9
+
+static uint64_t diskStates;         // emulated T-states driving the FDC
+static uint32_t diskPolls;
+
+static uint8_t benchDiskByte(uint8_t c, uint8_t r, uint16_t i)
+{
+    return (c * 7 + r * 13 + i) & 0xFF;
+}
+
+// an extended DSK image of the geometry above, in storage
+static bool writeBenchDisk()
+{
+    uint32_t trackSize = 0x100 + BENCH_DSK_SECTORS * 512;
+    std::vector<uint8_t> image(0x100 + BENCH_DSK_TRACKS * trackSize, 0);
+    memcpy(&image[0], "EXTENDED CPC DSK File\r\nDisk-Info\r\n", 34);
+    image[0x30] = BENCH_DSK_TRACKS;
+    image[0x31] = 1;
+    for (uint8_t c = 0; c < BENCH_DSK_TRACKS; c++) {
+        image[0x34 + c] = trackSize >> 8;
+        uint8_t* info = &image[0x100 + c * trackSize];
+        memcpy(info, "Track-Info\r\n", 12);
+        info[0x10] = c;
+        info[0x14] = 2;
+        info[0x15] = BENCH_DSK_SECTORS;
+        info[0x16] = 0x2A;
+        info[0x17] = 0xE5;
+        for (uint8_t s = 0; s < BENCH_DSK_SECTORS; s++) {
+            uint8_t* si = info + 0x18 + 8 * s;
+            si[0] = c;
+            si[2] = s + 1;
+            si[3] = 2;
+            si[7] = 2;      // 512 bytes
+            for (uint16_t i = 0; i < 512; i++)
+                info[0x100 + s * 512 + i] = benchDiskByte(c, s + 1, i);
+        }
+    }
+    File f = VFS::open(BENCH_DSK_FILE, FILE_WRITE);
+    bool ok = f && writeBlockFile(&image[0], f, image.size()) == image.size();
+    if (f) f.close();
+    return ok;
+}
+
+// the CPU polling a disk controller: each port access takes an IN or OUT and a test
+static void diskTick(uint32_t states)
+{
+    CPU::tstates += states;
+    diskStates += states;
+    if (CPU::tstates >= CPU::statesPerFrame()) {
+        CPU::tstates -= CPU::statesPerFrame();
+        FDC::endFrame(CPU::statesPerFrame());
+        BetaDisk::endFrame(CPU::statesPerFrame());
+    }
+}
+
+static uint8_t fdcStatus()
+{
+    diskTick(24);
+    diskPolls++;
+    return Ports::input(0xFD, 0x2F);
+}
+
+static bool fdcWait(uint8_t mask, uint8_t value)
+{
+    for (uint32_t n = 0; n < 10000000; n++)
+        if ((fdcStatus() & mask) == value)
+            return true;
+    return false;
+}
+
+static bool fdcOut(uint8_t data)
+{
+    if (!fdcWait(0xC0, 0x80)) return false;
+    diskTick(12);
+    Ports::output(0xFD, 0x3F, data);
+    return true;
+}
+
+static bool fdcCommand(const uint8_t* bytes, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+        if (!fdcOut(bytes[i])) return false;
+    return true;
+}
+
+// bytes of the result phase
+static uint8_t fdcResult(uint8_t* result)
+{
+    uint8_t n = 0;
+    while (n < 7 && fdcWait(0x80, 0x80) && (fdcStatus() & 0x50) == 0x50) {
+        diskTick(12);
+        result[n++] = Ports::input(0xFD, 0x3F);
+    }
+    return n;
+}
+
+// execution phase, non-DMA: move len bytes while the FDC asks for them
+static uint32_t fdcTransfer(uint8_t* data, uint32_t len, bool toDisk)
+{
+    uint32_t n = 0;
+    while (n < len && fdcWait(0x80, 0x80)) {
+        uint8_t msr = fdcStatus();
+        if (!(msr & 0x20)) break;
+        diskTick(12);
+        if (toDisk)
+            Ports::output(0xFD, 0x3F, data[n++]);
+        else
+            data[n++] = Ports::input(0xFD, 0x3F);
+    }
+    return n;
+}
+
+static bool fdcSeek(uint8_t cyl)
+{
+    uint8_t seek[] = { 0x0F, 0x00, cyl };
+    uint8_t recalibrate[] = { 0x07, 0x00 };
+    uint8_t sense[] = { 0x08 };
+    uint8_t result[7];
+    if (cyl == 0 ? !fdcCommand(recalibrate, 2) : !fdcCommand(seek, 3)) return false;
+    if (!fdcWait(0x01, 0x00)) return false;
+    return fdcCommand(sense, 1) && fdcResult(result) == 2 && result[0] == 0x20 && result[1] == cyl;
+}
+
+static bool fdcReadTrack(uint8_t cyl, uint8_t* data)
+{
+    uint8_t read[] = { 0x46, 0x00, cyl, 0, 1, 2, BENCH_DSK_SECTORS, 0x2A, 0xFF };
+    uint8_t result[7];
+    uint32_t len = BENCH_DSK_SECTORS * 512;
+    // reads end at EOT with end of cylinder, as +3DOS expects
+    return fdcCommand(read, 9) && fdcTransfer(data, len, false) == len
+        && fdcResult(result) == 7 && result[0] == 0x40 && result[1] == 0x80;
+}
+
+// insert a synthetic DSK image and drive the FDC through the +3 ports, as
+// +3DOS does: read every track n times, in fast and normal mode, checking
+// the data, then write a sector and check it reaches storage after the
+// motor stops
+static bool benchDisk(int count)
+{
+    if (!writeBenchDisk()) {
+        printf("cannot write %s\n", BENCH_DSK_FILE);
+        return false;
+    }
+    Config::requestMachine("128K", "PLUS3", true);
+    ESPectrum::reset();
+    bool ok = FileDSK::open(BENCH_DSK_FILE);
+
+    static uint8_t track[BENCH_DSK_SECTORS * 512];
+    uint8_t specify[] = { 0x03, 0xAF, 0x03 };
+    printf("disk reads: %d x %d tracks of %d x 512 bytes\n", count, BENCH_DSK_TRACKS, BENCH_DSK_SECTORS);
+
+    for (int mode = 0; ok && mode < 2; mode++) {
+        FDC::fast = mode == 0;
+        diskStates = 0;
+        diskPolls = 0;
+        uint32_t readCalls = hostFileReadCalls;
+        uint32_t ts_start = micros();
+        Ports::output(0xFD, 0x1F, 0x08);    // motor on
+        ok = fdcCommand(specify, 3);
+        for (int n = 0; ok && n < count; n++) {
+            for (uint8_t c = 0; ok && c < BENCH_DSK_TRACKS; c++) {
+                ok = fdcSeek(c) && fdcReadTrack(c, track);
+                for (uint16_t i = 0; ok && i < sizeof(track); i++)
+                    ok = track[i] == benchDiskByte(c, i / 512 + 1, i % 512);
+            }
+        }
+        Ports::output(0xFD, 0x1F, 0x00);
+        uint32_t elapsed = micros() - ts_start;
+        double seconds = diskStates / 3500000.0;
+        printf("  %-6s: %8.1f ms emulated (%.0f KB/s), %u polls, %u us, %u storage reads\n",
+            FDC::fast ? "fast" : "normal", seconds * 1000.0,
+            count * BENCH_DSK_TRACKS * sizeof(track) / 1024.0 / seconds, diskPolls, elapsed,
+            hostFileReadCalls - readCalls);
+    }
+
+    // rewrite the last sector, inverted
+    uint8_t cyl = BENCH_DSK_TRACKS - 1;
+    uint8_t write[] = { 0x45, 0x00, cyl, 0, BENCH_DSK_SECTORS, 2, BENCH_DSK_SECTORS, 0x2A, 0xFF };
+    uint8_t result[7];
+    for (uint16_t i = 0; i < 512; i++)
+        track[i] = ~benchDiskByte(cyl, BENCH_DSK_SECTORS, i);
+    if (ok) {
+        FDC::fast = true;
+        Ports::output(0xFD, 0x1F, 0x08);
+        ok = fdcSeek(cyl) && fdcCommand(write, 9) && fdcTransfer(track, 512, true) == 512
+            && fdcResult(result) == 7 && result[1] == 0x80;
+        Ports::output(0xFD, 0x1F, 0x00);
+        uint32_t writeCalls = hostFileWriteCalls;
+        FDC::endFrame(CPU::statesPerFrame());
+        printf("  write : sector written back in %u storage writes\n", hostFileWriteCalls - writeCalls);
+    }
+    FileDSK::close();
+    if (ok) {
+        // from storage again
+        DSKSector s;
+        ok = FileDSK::open(BENCH_DSK_FILE) && FileDSK::sector(cyl, 0, BENCH_DSK_SECTORS - 1, s)
+            && s.size == 512 && memcmp(s.data, track, 512) == 0;
+        FileDSK::close();
+    }
+    VFS::remove(BENCH_DSK_FILE);
+    printf("  data  : %s\n", ok ? "OK" : "MISMATCH");
+    return ok;
+}
+
+// --bench-trd: an 80 track double sided TR-DOS disk, and a stand-in ROM
+#define BENCH_TRD_FILE "/bench.trd"
+#define BENCH_SCL_FILE "/bench.scl"
+#define BENCH_TRDOS_ROM "/bench-trdos.rom"
+#define BENCH_TRD_TRACKS 80
+
+static uint8_t benchTrdByte(uint8_t track, uint8_t side, uint8_t sector, uint16_t i)
+{
+    return (track * 3 + side * 101 + sector * 17 + i) & 0xFF;
+}
+
+static bool writeBenchFile(const char* path, const uint8_t* data, uint32_t size)
+{
+    File f = VFS::open(path, FILE_WRITE);
+    bool ok = f && writeBlockFile((uint8_t*)data, f, size) == size;
+    if (f) f.close();
+    return ok;
+}
+
+static uint8_t betaIn(uint8_t port)
+{
+    diskTick(24);
+    diskPolls++;
+    return Ports::input(port, 0x00);
+}
+
+static void betaOut(uint8_t port, uint8_t data)
+{
+    diskTick(12);
+    Ports::output(port, 0x00, data);
+}
+
+// wait for INTRQ on the system register, then read the status
+static bool betaWait(uint8_t& status)
+{
+    for (uint32_t n = 0; n < 10000000; n++) {
+        if (betaIn(0xFF) & 0x80) {
+            status = betaIn(0x1F);
+            return true;
+        }
+    }
+    return false;
+}
+
+// a sector as TR-DOS moves it: poll the system register, a byte per DRQ
+// until INTRQ
+static bool betaSector(uint8_t command, uint8_t sector, uint8_t* data, uint8_t& status)
+{
+    betaOut(0x5F, sector);
+    betaOut(0x1F, command);
+    uint16_t n = 0;
+    for (uint32_t polls = 0; polls < 10000000; polls++) {
+        uint8_t lines = betaIn(0xFF);
+        if (lines & 0x40) {
+            if (n >= TRD_SECTOR_SIZE) return false;
+            if (command & 0x20)
+                betaOut(0x7F, data[n++]);
+            else
+                data[n++] = betaIn(0x7F);
+        }
+        else if (lines & 0x80) {
+            status = betaIn(0x1F);
+            return n == TRD_SECTOR_SIZE || status != 0;
+        }
+    }
+    return false;
+}
+
+static bool betaSeek(uint8_t track, uint8_t side)
+{
+    uint8_t status;
+    // drive A, no reset, side 0 when bit 4 is set
+    betaOut(0xFF, side ? 0x2C : 0x3C);
+    betaOut(0x7F, track);
+    betaOut(0x1F, track ? 0x1C : 0x0C);     // seek or restore, verify
+    return betaWait(status) && (status & 0x10) == 0;
+}
+
+// paging: a stand-in TR-DOS ROM entered at 0x3D00 from RAM reads its own
+// first byte, goes back to RAM and reads the BASIC ROM one
+static bool benchTrdosPaging()
+{
+    static uint8_t rom[0x4000];
+    memset(rom, 0xFF, sizeof(rom));
+    rom[0] = 0xA5;
+    const uint8_t entry[] = { 0x3A, 0x00, 0x00, 0x32, 0x00, 0x81, 0xC3, 0x10, 0x80 };
+    memcpy(rom + 0x3D00, entry, sizeof(entry));
+    if (!writeBenchFile(BENCH_TRDOS_ROM, rom, sizeof(rom)) || !BetaDisk::loadRom(BENCH_TRDOS_ROM))
+        return false;
+    VFS::remove(BENCH_TRDOS_ROM);
+
+    Config::requestMachine("48K", "SINCLAIR", true);
+    ESPectrum::reset();
+    const uint8_t ram[] = { 0xC3, 0x00, 0x3D };
+    const uint8_t back[] = { 0x3A, 0x00, 0x00, 0x32, 0x01, 0x81, 0x18, 0xFE };
+    for (uint8_t i = 0; i < sizeof(ram); i++) Mem::writebyte(0x8000 + i, ram[i]);
+    for (uint8_t i = 0; i < sizeof(back); i++) Mem::writebyte(0x8010 + i, back[i]);
+    Mem::writebyte(0x8100, 0);
+    Mem::writebyte(0x8101, 0);
+    Z80::setRegPC(0x8000);
+    CPU::loop();
+    bool ok = BetaDisk::present && !BetaDisk::active
+           && Mem::readbyte(0x8100) == 0xA5 && Mem::readbyte(0x8101) == Mem::rom[0][0];
+    printf("  paging: 0x3D00 reads %02X, RAM then reads %02X: %s\n",
+        Mem::readbyte(0x8100), Mem::readbyte(0x8101), ok ? "OK" : "FAILED");
+    return ok;
+}
+
+// read a synthetic .trd n times through the WD1793 ports in fast and normal
+// mode, write a sector back, and open an .scl
+static bool benchTrd(int count)
+{
+    printf("TR-DOS disk reads: %d x %d tracks x 2 sides of %d x %d bytes\n",
+        count, BENCH_TRD_TRACKS, TRD_SECTORS, TRD_SECTOR_SIZE);
+    bool ok = benchTrdosPaging();
+
+    std::vector<uint8_t> image(BENCH_TRD_TRACKS * 2 * TRD_TRACK_SIZE);
+    for (uint32_t i = 0; i < image.size(); i++) {
+        uint32_t sector = i / TRD_SECTOR_SIZE;
+        image[i] = benchTrdByte(sector / TRD_SECTORS / 2, (sector / TRD_SECTORS) & 1,
+                                sector % TRD_SECTORS + 1, i % TRD_SECTOR_SIZE);
+    }
+    image[0x8E3] = 0x16;    // 80 tracks, double sided
+    ok = ok && writeBenchFile(BENCH_TRD_FILE, &image[0], image.size()) && FileTRD::open(BENCH_TRD_FILE);
+    BetaDisk::page(true);
+
+    uint8_t data[TRD_SECTOR_SIZE];
+    uint8_t status = 0;
+    for (int mode = 0; ok && mode < 2; mode++) {
+        BetaDisk::fast = mode == 0;
+        diskStates = 0;
+        diskPolls = 0;
+        uint32_t readCalls = hostFileReadCalls;
+        uint32_t ts_start = micros();
+        for (int n = 0; ok && n < count; n++) {
+            for (uint8_t t = 0; ok && t < BENCH_TRD_TRACKS; t++) {
+                for (uint8_t s = 0; ok && s < 2; s++) {
+                    ok = betaSeek(t, s);
+                    for (uint8_t r = 1; ok && r <= TRD_SECTORS; r++) {
+                        ok = betaSector(0x80, r, data, status) && status == 0;
+                        uint32_t offset = ((t * 2 + s) * TRD_SECTORS + r - 1) * TRD_SECTOR_SIZE;
+                        ok = ok && memcmp(data, &image[offset], TRD_SECTOR_SIZE) == 0;
+                    }
+                }
+            }
+        }
+        uint32_t elapsed = micros() - ts_start;
+        double seconds = diskStates / 3500000.0;
+        printf("  %-6s: %8.1f ms emulated (%.0f KB/s), %u polls, %u us, %u storage reads\n",
+            BetaDisk::fast ? "fast" : "normal", seconds * 1000.0,
+            count * image.size() / 1024.0 / seconds, diskPolls, elapsed, hostFileReadCalls - readCalls);
+    }
+
+    // rewrite sector 9 of the last track, side 1, inverted
+    uint8_t track = BENCH_TRD_TRACKS - 1;
+    for (uint16_t i = 0; i < TRD_SECTOR_SIZE; i++)
+        data[i] = ~benchTrdByte(track, 1, 9, i);
+    if (ok) {
+        BetaDisk::fast = true;
+        ok = betaSeek(track, 1) && betaSector(0xA0, 9, data, status) && status == 0;
+        uint32_t writeCalls = hostFileWriteCalls;
+        for (int f = 0; f < BETA_FLUSH_FRAMES; f++)
+            BetaDisk::endFrame(CPU::statesPerFrame());
+        printf("  write : sector written back in %u storage writes\n", hostFileWriteCalls - writeCalls);
+    }
+    FileTRD::close();
+    if (ok) {
+        uint8_t* s;
+        ok = FileTRD::open(BENCH_TRD_FILE) && (s = FileTRD::sector(track, 1, 9)) != NULL
+            && memcmp(s, data, TRD_SECTOR_SIZE) == 0;
+        FileTRD::close();
+    }
+    VFS::remove(BENCH_TRD_FILE);
+
+    // two files in an .scl: laid out from track 1, write protected
+    if (ok) {
+        std::vector<uint8_t> scl(9 + 2 * 14 + 3 * TRD_SECTOR_SIZE + 4, 0);
+        memcpy(&scl[0], "SINCLAIR", 8);
+        scl[8] = 2;
+        memcpy(&scl[9], "boot    B", 9);
+        scl[9 + 13] = 1;
+        memcpy(&scl[9 + 14], "game    C", 9);
+        scl[9 + 14 + 13] = 2;
+        for (uint16_t i = 0; i < 3 * TRD_SECTOR_SIZE; i++)
+            scl[9 + 28 + i] = i / TRD_SECTOR_SIZE + 1;
+        ok = writeBenchFile(BENCH_SCL_FILE, &scl[0], scl.size()) && FileTRD::open(BENCH_SCL_FILE);
+        uint8_t* catalog = ok ? FileTRD::sector(0, 0, 1) : NULL;
+        uint8_t* info = ok ? FileTRD::sector(0, 0, 9) : NULL;
+        uint8_t* second = ok ? FileTRD::sector(0, 1, 2) : NULL;
+        ok = ok && FileTRD::isWriteProtected()
+            && catalog[14] == 0 && catalog[15] == 1 && catalog[16 + 14] == 1 && catalog[16 + 15] == 1
+            && info[0xE1] == 3 && info[0xE2] == 1 && info[0xE4] == 2 && second[0] == 2;
+        ok = ok && betaSeek(0, 1) && betaSector(0xA0, 1, data, status) && status == 0x40;
+        FileTRD::close();
+        VFS::remove(BENCH_SCL_FILE);
+        printf("  scl   : catalogue and data laid out, writes refused: %s\n", ok ? "OK" : "FAILED");
+    }
+    BetaDisk::page(false);
+    printf("  data  : %s\n", ok ? "OK" : "MISMATCH");
+    return ok;
+}
+
+// open a directory catalogue as the file browser does, list it page by page,
+// then time a second open and the type-ahead lookups
+static bool listCatalog(const char* dir)
+{
+    static const char* types[] = { "other", "dir", "sna", "z80", "szx", "tap", "tzx", "rzx", "dsk", "trd" };
+    static const char* machines[] = { "", "48K", "128K" };
+
+    uint32_t readCalls = hostFileReadCalls;
+    uint32_t ts_start = micros();
+    if (!FileCatalog::open(dir)) {
+        fprintf(stderr, "Cannot open catalogue of %s\n", dir);
+        return false;
+    }
+    uint32_t openMicros = micros() - ts_start;
+    uint32_t openReads = hostFileReadCalls - readCalls;
+
+    CatalogEntry page[16];
+    for (uint16_t first = 0; first < FileCatalog::count(); first += 16) {
+        uint16_t n = FileCatalog::read(first, 16, page);
+        for (uint16_t i = 0; i < n; i++) {
+            const CatalogEntry& e = page[i];
+            printf("  %-5s %-4s %8u  %s\n", e.type < sizeof(types) / sizeof(types[0]) ? types[e.type] : "?",
+                e.machine < 3 ? machines[e.machine] : "?", e.size, e.name);
+        }
+    }
+    FileCatalog::close();
+
+    readCalls = hostFileReadCalls;
+    ts_start = micros();
+    FileCatalog::open(dir);
+    uint32_t reopenMicros = micros() - ts_start;
+    uint32_t reopenReads = hostFileReadCalls - readCalls;
+
+    readCalls = hostFileReadCalls;
+    ts_start = micros();
+    for (char c = 'a'; c <= 'z'; c++) {
+        char prefix[2] = { c, 0 };
+        FileCatalog::lowerBound(prefix);
+    }
+    uint32_t jumpMicros = (micros() - ts_start) / 26;
+    uint32_t jumpReads = (hostFileReadCalls - readCalls) / 26;
+    uint16_t count = FileCatalog::count();
+    FileCatalog::close();
+
+    printf("%s: %u entries\n", dir, count);
+    printf("  first open: %u us, %u file reads\n", openMicros, openReads);
+    printf("  open again: %u us, %u file reads\n", reopenMicros, reopenReads);
+    printf("  type-ahead: %u us, %u file reads\n", jumpMicros, jumpReads);
+    return true;
+}
+
+// read the preview of a snapshot as the file browser does, uncached and
+// cached, then check it against the screen of the loaded snapshot
+static bool checkPreview(String name)
+{
+    int slash = name.lastIndexOf('/');
+    String dir = name.substring(0, slash);
+    CatalogEntry e;
+    if (!FileCatalog::open(dir) || FileCatalog::find(name.c_str() + slash + 1) < 0) {
+        fprintf(stderr, "Cannot find %s in the catalogue\n", name.c_str());
+        return false;
+    }
+    FileCatalog::read(FileCatalog::find(name.c_str() + slash + 1), 1, &e);
+    FileCatalog::close();
+
+    uint32_t readCalls = hostFileReadCalls;
+    uint32_t ts_start = micros();
+    const uint8_t* preview = ScreenPreview::get(dir, e);
+    uint32_t readMicros = micros() - ts_start;
+    uint32_t reads = hostFileReadCalls - readCalls;
+    if (preview == NULL) {
+        fprintf(stderr, "No preview for %s\n", name.c_str());
+        return false;
+    }
+    readCalls = hostFileReadCalls;
+    ts_start = micros();
+    bool hit = ScreenPreview::get(dir, e) == preview;
+    uint32_t cachedMicros = micros() - ts_start;
+    uint32_t cachedReads = hostFileReadCalls - readCalls;
+
+    if (!loadSnapshot(name))
+        return false;
+    uint8_t expected[PREVIEW_BYTES];
+    ScreenPreview::decode(Mem::videoLatch ? Mem::ram7 : Mem::ram5, expected);
+    bool match = memcmp(preview, expected, PREVIEW_BYTES) == 0;
+
+    printf("%s: preview %ux%u\n", name.c_str(), PREVIEW_W, PREVIEW_H);
+    printf("  read   : %u us, %u file reads\n", readMicros, reads);
+    printf("  cached : %u us, %u file reads%s\n", cachedMicros, cachedReads, hit ? "" : " (MISS)");
+    printf("  screen : %s\n", match ? "OK" : "MISMATCH");
+    return hit && match;
+}
+
+static int runGolden(const char* filename)
+{
+    std::ifstream in(filename);
+    if (!in) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 2;
+    }
+    int failures = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string name, expected;
+        double seconds;
+        if (!(fields >> name >> seconds >> expected)) continue;
+
+        RunResult r;
+        if (!run(name.c_str(), seconds, r)) {
+            failures++;
+            continue;
+        }
+        report(name.c_str(), r);
+        char actual[17];
+        snprintf(actual, sizeof(actual), "%016llx", (unsigned long long)r.hash);
+        bool ok = (expected == actual);
+        printf("  golden   : %s\n", ok ? "OK" : ("MISMATCH, expected " + expected).c_str());
+        if (!ok) failures++;
+    }
+    return failures ? 1 : 0;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: zxhost [options] <snapshot>\n"
+        "       zxhost [options] --golden <file>\n"
+        "       zxhost [options] --catalog <dir>\n"
+        "\n"
+        "  <snapshot>       .sna/.z80/.szx path inside the root dir (e.g. /sna/Snake.sna),\n"
+        "                   or an .rzx recording to replay,\n"
+        "                   or " AY_DEMO_NAME " for a built-in AY register sequence\n"
+        "  --root <dir>     host directory used as SD card (default " HOST_DATA_DIR ")\n"
+        "  --rom-image <f>  host file used as the ROM flash partition, mapped like on\n"
+        "                   the device (built by tools/mkromimage.py)\n"
+        "  --seconds <n>    emulated seconds to run (default 10)\n"
+        "  --wav <file>     write beeper + AY output to a 16 bit PCM WAV file\n"
+        "  --expect <hash>  fail unless the PCM hash matches\n"
+        "  --ear <file>     replay a tape recording (WAV) into the EAR input\n"
+        "  --tap <file>     insert a .tap (path inside root dir), loaded by the ROM trap\n"
+        "  --tzx <file>     insert a .tzx (path inside root dir), played into the EAR input\n"
+        "  --psg <file>     record AY register writes to a PSG file (path inside root dir)\n"
+        "  --rzx <file>     record the input to an RZX file (path inside root dir)\n"
+        "  --scr <file>     save the screen at the end of the run (.scr)\n"
+        "  --golden <file>  run every '<snapshot> <seconds> <hash>' line of file\n"
+        "  --catalog <dir>  open the catalogue of a directory as the file browser does,\n"
+        "                   list it with timings\n"
+        "  --preview        read the browser preview of the snapshot, with timings, and\n"
+        "                   check it against the loaded screen\n"
+        "  --bench-load <n> load the snapshot n times and report the time per load\n"
+        "  --bench-save <n> save the snapshot n times as .sna, .z80 and .szx, report size and time\n"
+        "  --bench-quick <n> quick save and load the snapshot n times through the slots,\n"
+        "                   report packed size and times\n"
+        "  --bench-rewind   run the snapshot for --seconds taking rewind snapshots, report\n"
+        "                   their cost and check every one restores the state taken\n"
+        "  --bench-mem <n>  time n passes of writes over RAM with and without dirty tracking\n"
+        "  --bench-ay <n>   time n seconds of AY synthesis: FabGL square generators, one\n"
+        "                   AyChip and TurboSound\n"
+        "  --bench-switch <n> switch machines n times each way, timing each way of\n"
+        "                   getting the ROMs\n"
+        "  --bench-disk <n> read a synthetic +3 disk n times through the FDC in fast and\n"
+        "                   normal mode, check the data and a sector write\n"
+        "  --bench-trd <n>  read a synthetic TR-DOS disk n times through the WD1793 in fast\n"
+        "                   and normal mode, check ROM paging, a sector write and an .scl\n"
+        "  --verbose        show emulator log\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* root = HOST_DATA_DIR;
+    const char* snapshot = NULL;
+    const char* wavFile = NULL;
+    const char* expect = NULL;
+    const char* golden = NULL;
+    const char* earFile = NULL;
+    const char* scrFile = NULL;
+    RunOptions options;
+    double seconds = 10;
+    int benchCount = 0;
+    int benchSaveCount = 0;
+    int benchSwitchCount = 0;
+    int benchQuickCount = 0;
+    bool benchRewindRun = false;
+    int benchMemCount = 0;
+    int benchAySeconds = 0;
+    int benchDiskCount = 0;
+    int benchTrdCount = 0;
+    bool verbose = false;
+    const char* catalog = NULL;
+    bool preview = false;
+
+    for (int i = 1; i < argc; i++) {
+        String arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--root" && hasValue) root = argv[++i];
+        else if (arg == "--rom-image" && hasValue) hostPartitionFile = argv[++i];
+        else if (arg == "--seconds" && hasValue) seconds = atof(argv[++i]);
+        else if (arg == "--wav" && hasValue) wavFile = argv[++i];
+        else if (arg == "--expect" && hasValue) expect = argv[++i];
+        else if (arg == "--golden" && hasValue) golden = argv[++i];
+        else if (arg == "--bench-load" && hasValue) benchCount = atoi(argv[++i]);
+        else if (arg == "--bench-save" && hasValue) benchSaveCount = atoi(argv[++i]);
+        else if (arg == "--bench-quick" && hasValue) benchQuickCount = atoi(argv[++i]);
+        else if (arg == "--bench-rewind") benchRewindRun = true;
+        else if (arg == "--bench-mem" && hasValue) benchMemCount = atoi(argv[++i]);
+        else if (arg == "--bench-ay" && hasValue) benchAySeconds = atoi(argv[++i]);
+        else if (arg == "--bench-switch" && hasValue) benchSwitchCount = atoi(argv[++i]);
+        else if (arg == "--bench-disk" && hasValue) benchDiskCount = atoi(argv[++i]);
+        else if (arg == "--bench-trd" && hasValue) benchTrdCount = atoi(argv[++i]);
+        else if (arg == "--psg" && hasValue) options.psgFile = argv[++i];
+        else if (arg == "--rzx" && hasValue) options.rzxFile = argv[++i];
+        else if (arg == "--ear" && hasValue) earFile = argv[++i];
+        else if (arg == "--tap" && hasValue) options.tapFile = argv[++i];
+        else if (arg == "--tzx" && hasValue) options.tzxFile = argv[++i];
+        else if (arg == "--scr" && hasValue) scrFile = argv[++i];
+        else if (arg == "--catalog" && hasValue) catalog = argv[++i];
+        else if (arg == "--preview") preview = true;
+        else if (arg == "--verbose") verbose = true;
+        else if (!arg.startsWith("--") && snapshot == NULL) snapshot = argv[i];
+        else { usage(); return 2; }
+    }
+    if ((!catalog && !benchSwitchCount && !benchMemCount && !benchAySeconds && !benchDiskCount && !benchTrdCount && (snapshot == NULL) == (golden == NULL)) || seconds <= 0) {
+        usage();
+        return 2;
+    }
+
+    Serial.setQuiet(!verbose);
+    VFS::setRoot(root);
+    if (!VFS::begin()) {
+        fprintf(stderr, "cannot open storage root %s\n", root);
+        return 2;
+    }
+    hostDigitalWriteHook = digitalWriteHook;
+
+    ESPectrum::setup();
+
+    if (catalog)
+        return listCatalog(catalog) ? 0 : 2;
+    if (benchSwitchCount > 0)
+        return benchSwitch(benchSwitchCount) ? 0 : 2;
+    if (benchMemCount > 0)
+        return benchMem(benchMemCount) ? 0 : 2;
+    if (benchAySeconds > 0)
+        return benchAy(benchAySeconds) ? 0 : 2;
+    if (benchDiskCount > 0)
+        return benchDisk(benchDiskCount) ? 0 : 1;
+    if (benchTrdCount > 0)
+        return benchTrd(benchTrdCount) ? 0 : 1;
+    if (golden)
+        return runGolden(golden);
+
+    if (preview)
+        return checkPreview(snapshot) ? 0 : 1;
+    if (benchCount > 0)
+        return benchLoad(snapshot, benchCount) ? 0 : 2;
+    if (benchSaveCount > 0)
+        return benchSave(snapshot, benchSaveCount) ? 0 : 2;
+    if (benchQuickCount > 0)
+        return benchQuick(snapshot, benchQuickCount) ? 0 : 2;
+    if (benchRewindRun)
+        return benchRewind(snapshot, seconds) ? 0 : 1;
+
+    if (earFile) {
+        if (!HostEar::load(earFile))
+            return 2;
+        options.ear = true;
+    }
+
+    RunResult r;
+    if (!run(snapshot, seconds, r, options))
+        return 2;
+    report(snapshot, r);
+
+    if (wavFile) {
+        if (!HostAudio::writeWav(wavFile))
+            return 2;
+        printf("  wav      : %s\n", wavFile);
+    }
+
+    if (scrFile) {
+        if (!writeScreen(scrFile))
+            return 2;
+        printf("  screen   : %s\n", scrFile);
+    }
+
+    if (expect) {
+        char actual[17];
+        snprintf(actual, sizeof(actual), "%016llx", (unsigned long long)r.hash);
+        if (strcmp(expect, actual) != 0) {
+            printf("  expected : %s MISMATCH\n", expect);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+// Host implementations of the device-only parts the emulator core depends on:
+// machine setup without video, and no-op keyboard, OSD and wiimote functions.
+
+#include <Arduino.h>
+
+#include "hardconfig.h"
+#include "ESPectrum.h"
+#include "CPU.h"
+#include "Mem.h"
+#include "Ports.h"
+#include "Config.h"
+#include "RomPartition.h"
+#include "RomCache.h"
+#include "AySound.h"
+#include "PS2Kbd.h"
+#include "osd.h"
+#include "Wiimote2Keys.h"
+#include "Rewind.h"
+#include "FileRZX.h"
+#include "FDC.h"
+#include "BetaDisk.h"
+
+uint8_t ESPectrum::borderColor = 7;
+
+static uint8_t* allocatePage()
+{
+    return (uint8_t*)calloc(1, MEM_PG_SZ);
+}
+
+void ESPectrum::setup()
+{
+    if (!RomPartition::begin() && !RomCache::preload()) {
+        Mem::rom0 = allocatePage();
+        Mem::rom1 = allocatePage();
+        Mem::rom2 = allocatePage();
+        Mem::rom3 = allocatePage();
+    }
+
+    Mem::ram0 = allocatePage();
+    Mem::ram1 = allocatePage();
+    Mem::ram2 = allocatePage();
+    Mem::ram3 = allocatePage();
+    Mem::ram4 = allocatePage();
+    Mem::ram5 = allocatePage();
+    Mem::ram6 = allocatePage();
+    Mem::ram7 = allocatePage();
+
+    Mem::rom[0] = Mem::rom0;
+    Mem::rom[1] = Mem::rom1;
+    Mem::rom[2] = Mem::rom2;
+    Mem::rom[3] = Mem::rom3;
+
+    Mem::ram[0] = Mem::ram0;
+    Mem::ram[1] = Mem::ram1;
+    Mem::ram[2] = Mem::ram2;
+    Mem::ram[3] = Mem::ram3;
+    Mem::ram[4] = Mem::ram4;
+    Mem::ram[5] = Mem::ram5;
+    Mem::ram[6] = Mem::ram6;
+    Mem::ram[7] = Mem::ram7;
+
+    CPU::setup();
+
+    // make sure keyboard ports are FF
+    for (int t = 0; t < 32; t++) {
+        Ports::base[t] = 0x1f;
+        Ports::wii[t] = 0x1f;
+    }
+
+    AySound::initialize();
+    AySound::setStereoMode(Config::ay_stereo);
+    FDC::fast = Config::fast_disk;
+    BetaDisk::fast = Config::fast_disk;
+    BetaDisk::loadRom(TRDOS_ROM_FILE);
+
+    Config::requestMachine(Config::getArch(), Config::getRomSet(), true);
+}
+
+void ESPectrum::reset()
+{
+    ESPectrum::borderColor = 7;
+    Mem::bankLatch = 0;
+    Mem::videoLatch = 0;
+    Mem::romLatch = 0;
+    Mem::pagingLock = 0;
+    Mem::modeSP3 = 0;
+    Mem::romSP3 = 0;
+    Mem::romInUse = 0;
+
+    CPU::reset();
+    FDC::reset();
+    BetaDisk::reset();
+    Rewind::clear();
+    // a recording cannot go on past a reset, nor a playback
+    FileRZX::stop();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint8_t PS2Keyboard::keymap[256];
+uint8_t PS2Keyboard::oldmap[256];
+
+void PS2Keyboard::initialize() {}
+void PS2Keyboard::attachInterrupt() {}
+void PS2Keyboard::detachInterrupt() {}
+void PS2Keyboard::emulateKeyChange(uint8_t scancode, uint8_t isdown) {}
+
+void OSD::errorHalt(String errormsg)
+{
+    fprintf(stderr, "ERROR: %s\n", errormsg.c_str());
+    exit(2);
+}
+
+void OSD::errorPanel(String errormsg)
+{
+    fprintf(stderr, "ERROR: %s\n", errormsg.c_str());
+}
+
+void OSD::osdCenteredMsg(String msg, byte warn_level)
+{
+    Serial.printf("OSD: %s\n", msg.c_str());
+}
+
+void loadKeytableForGame(const char* sna_fn) {}
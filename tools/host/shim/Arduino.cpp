@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <chrono>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+HostDigitalWriteHook hostDigitalWriteHook = NULL;
+HostDigitalReadHook hostDigitalReadHook = NULL;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long micros()
+{
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() * 240 / 1000;
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+// emulator log goes to stderr, so stdout only carries harness results
+int HardwareSerial::printf(const char* format, ...)
+{
+    if (quiet) return 0;
+    va_list args;
+    va_start(args, format);
+    int n = vfprintf(stderr, format, args);
+    va_end(args);
+    return n;
+}
+
+size_t HardwareSerial::print(const char* s)
+{
+    if (quiet) return 0;
+    return fputs(s, stderr) < 0 ? 0 : strlen(s);
+}
+
+size_t HardwareSerial::println(const char* s)
+{
+    if (quiet) return 0;
+    return fprintf(stderr, "%s\n", s);
+}
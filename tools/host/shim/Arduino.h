@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+// Host shim: the parts of the ESP32 Arduino core used by the emulator sources,
+// so they can be compiled unchanged for the host harness (see tools/host).
+
+#ifndef HOST_Arduino_h
+#define HOST_Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define IRAM_ATTR
+
+#define LOW  0x0
+#define HIGH 0x1
+
+#define INPUT             0x01
+#define OUTPUT            0x02
+#define OUTPUT_OPEN_DRAIN 0x12
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+// time: micros() and millis() use the host clock, delays do nothing
+// so emulation runs as fast as the host allows
+unsigned long micros();
+unsigned long millis();
+static inline void delay(uint32_t ms) {}
+static inline void delayMicroseconds(uint32_t us) {}
+
+// GPIO: writes and reads are forwarded to hooks installed by the harness
+typedef void (*HostDigitalWriteHook)(uint8_t pin, uint8_t val);
+typedef int (*HostDigitalReadHook)(uint8_t pin);
+extern HostDigitalWriteHook hostDigitalWriteHook;
+extern HostDigitalReadHook hostDigitalReadHook;
+
+static inline void pinMode(uint8_t pin, uint8_t mode) {}
+static inline void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (hostDigitalWriteHook) hostDigitalWriteHook(pin, val);
+}
+static inline int digitalRead(uint8_t pin)
+{
+    return hostDigitalReadHook ? hostDigitalReadHook(pin) : HIGH;
+}
+
+// interrupts: never fire, input streams are pushed by the harness instead
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+#define digitalPinToInterrupt(p) (p)
+static inline void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {}
+static inline void detachInterrupt(uint8_t pin) {}
+
+// memory: there is no PSRAM on the host
+static inline void* ps_malloc(size_t size) { return malloc(size); }
+static inline void* ps_calloc(size_t n, size_t size) { return calloc(n, size); }
+static inline void* ps_realloc(void* ptr, size_t size) { return realloc(ptr, size); }
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    operator bool() const { return true; }
+
+    // when quiet, emulator log messages are discarded
+    void setQuiet(bool value) { quiet = value; }
+
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t print(const char* s);
+    size_t print(int value) { return print(String(value)); }
+    size_t println(const String& s) { return println(s.c_str()); }
+    size_t println(const char* s = "");
+    size_t println(int value) { return println(String(value)); }
+
+private:
+    bool quiet = false;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap() { return 4 * 1024 * 1024; }
+    uint32_t getPsramSize() { return 4 * 1024 * 1024; }
+    uint32_t getFreePsram() { return 4 * 1024 * 1024; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    // emulates the CCOUNT register of a 240 MHz core
+    uint32_t getCycleCount();
+    void restart() { exit(0); }
+};
+
+extern EspClass ESP;
+
+#endif // HOST_Arduino_h
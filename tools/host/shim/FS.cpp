@@ -0,0 +1,205 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include <FS.h>
+#include <FSImpl.h>
+
+#include <stdarg.h>
+
+uint32_t hostFileReadCalls = 0;
+uint32_t hostFileWriteCalls = 0;
+
+namespace fs
+{
+
+// a file as opened by the storage backend; only calls reaching it count as
+// storage accesses, not those served by the VFS cache above it
+class CountedFileImpl : public FileImpl
+{
+public:
+    CountedFileImpl(FileImplPtr p) : p(p) {}
+
+    size_t write(const uint8_t* buf, size_t size) { hostFileWriteCalls++; return p->write(buf, size); }
+    size_t read(uint8_t* buf, size_t size) { hostFileReadCalls++; return p->read(buf, size); }
+    void flush() { p->flush(); }
+    bool seek(uint32_t pos, SeekMode mode) { return p->seek(pos, mode); }
+    size_t position() const { return p->position(); }
+    size_t size() const { return p->size(); }
+    void close() { p->close(); }
+    time_t getLastWrite() { return p->getLastWrite(); }
+    const char* name() const { return p->name(); }
+    boolean isDirectory(void) { return p->isDirectory(); }
+    void rewindDirectory(void) { p->rewindDirectory(); }
+    operator bool() { return *p; }
+
+    FileImplPtr openNextFile(const char* mode)
+    {
+        FileImplPtr next = p->openNextFile(mode);
+        return next ? FileImplPtr(new CountedFileImpl(next)) : next;
+    }
+
+private:
+    FileImplPtr p;
+};
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size)
+{
+    if (!*this) return 0;
+    return _p->read(buf, size);
+}
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t size)
+{
+    if (!*this) return 0;
+    return _p->write(buf, size);
+}
+
+int File::printf(const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n < 0) return 0;
+    if (n >= (int)sizeof(text)) n = sizeof(text) - 1;
+    return write((const uint8_t*)text, n);
+}
+
+int File::available()
+{
+    if (!*this) return 0;
+    return size() - position();
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    return *this && _p->seek(pos, mode);
+}
+
+size_t File::position() const
+{
+    return *this ? _p->position() : 0;
+}
+
+size_t File::size() const
+{
+    return *this ? _p->size() : 0;
+}
+
+time_t File::getLastWrite()
+{
+    return *this ? _p->getLastWrite() : 0;
+}
+
+void File::flush()
+{
+    if (*this) _p->flush();
+}
+
+void File::close()
+{
+    if (_p) {
+        _p->close();
+        _p = NULL;
+    }
+}
+
+const char* File::name() const
+{
+    return _p ? _p->name() : "";
+}
+
+bool File::isDirectory() const
+{
+    return *this && _p->isDirectory();
+}
+
+File File::openNextFile(const char* mode)
+{
+    if (!*this) return File();
+    return File(_p->openNextFile(mode));
+}
+
+void File::rewindDirectory()
+{
+    if (*this) _p->rewindDirectory();
+}
+
+File::operator bool() const
+{
+    return _p && *_p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+File FS::open(const char* path, const char* mode)
+{
+    if (!_impl) return File();
+    FileImplPtr p = _impl->open(path, mode);
+    return p ? File(FileImplPtr(new CountedFileImpl(p))) : File();
+}
+
+bool FS::exists(const char* path)
+{
+    return _impl && _impl->exists(path);
+}
+
+bool FS::remove(const char* path)
+{
+    return _impl && _impl->remove(path);
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo)
+{
+    return _impl && _impl->rename(pathFrom, pathTo);
+}
+
+bool FS::mkdir(const char* path)
+{
+    return _impl && _impl->mkdir(path);
+}
+
+bool FS::rmdir(const char* path)
+{
+    return _impl && _impl->rmdir(path);
+}
+
+} // namespace fs
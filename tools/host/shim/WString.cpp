@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#include "WString.h"
+#include <ctype.h>
+#include <stdlib.h>
+
+static std::string toBase(unsigned long value, unsigned char base, bool negative)
+{
+    std::string digits;
+    do {
+        digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[value % base]);
+        value /= base;
+    } while (value);
+    if (negative) digits.insert(digits.begin(), '-');
+    return digits;
+}
+
+String::String(unsigned char value, unsigned char base) : s(toBase(value, base, false)) {}
+String::String(unsigned int value, unsigned char base) : s(toBase(value, base, false)) {}
+String::String(unsigned long value, unsigned char base) : s(toBase(value, base, false)) {}
+
+String::String(int value, unsigned char base)
+    : s(base == 10 && value < 0 ? toBase(-(long)value, 10, true) : toBase((unsigned int)value, base, false)) {}
+
+String::String(long value, unsigned char base)
+    : s(base == 10 && value < 0 ? toBase(-value, 10, true) : toBase((unsigned long)value, base, false)) {}
+
+bool String::endsWith(const String& suffix) const
+{
+    if (suffix.s.length() > s.length()) return false;
+    return s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t pos = s.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& str, unsigned int from) const
+{
+    size_t pos = s.find(str.s, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const
+{
+    size_t pos = s.rfind(c);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String& str) const
+{
+    size_t pos = s.rfind(str.s);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const
+{
+    return substring(from, s.length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to) { unsigned int t = from; from = to; to = t; }
+    if (from >= s.length()) return String();
+    if (to > s.length()) to = s.length();
+    return String(s.substr(from, to - from));
+}
+
+void String::replace(const String& find, const String& replacement)
+{
+    if (find.s.empty()) return;
+    size_t pos = 0;
+    while ((pos = s.find(find.s, pos)) != std::string::npos) {
+        s.replace(pos, find.s.length(), replacement.s);
+        pos += replacement.s.length();
+    }
+}
+
+void String::replace(char find, char replacement)
+{
+    for (char& c : s) if (c == find) c = replacement;
+}
+
+void String::trim()
+{
+    size_t begin = 0, end = s.length();
+    while (begin < end && isspace((unsigned char)s[begin])) begin++;
+    while (end > begin && isspace((unsigned char)s[end - 1])) end--;
+    s = s.substr(begin, end - begin);
+}
+
+void String::toLowerCase()
+{
+    for (char& c : s) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase()
+{
+    for (char& c : s) c = toupper((unsigned char)c);
+}
+
+long String::toInt() const
+{
+    return strtol(s.c_str(), NULL, 10);
+}
+
+String operator+(const String& lhs, const String& rhs) { String r(lhs); r.concat(rhs); return r; }
+String operator+(const String& lhs, const char* rhs)   { String r(lhs); r.concat(rhs); return r; }
+String operator+(const char* lhs, const String& rhs)   { String r(lhs); r.concat(rhs); return r; }
+String operator+(const String& lhs, char rhs)          { String r(lhs); r.concat(rhs); return r; }
+String operator+(const String& lhs, int rhs)           { return lhs + String(rhs); }
+String operator+(const String& lhs, unsigned int rhs)  { return lhs + String(rhs); }
+String operator+(const String& lhs, long rhs)          { return lhs + String(rhs); }
+String operator+(const String& lhs, unsigned long rhs) { return lhs + String(rhs); }
@@ -0,0 +1,6 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef int gpio_num_t;
+typedef int gpio_mode_t;
+#define GPIO_NUM_MAX 40
@@ -0,0 +1,29 @@
+// Host shim: I2S driver calls made by FabGL's SoundGenerator; nothing is played.
+
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef int i2s_mode_t;
+typedef int i2s_comm_format_t;
+typedef int i2s_channel_fmt_t;
+
+enum {
+    I2S_NUM_0 = 0,
+    I2S_MODE_MASTER = 1, I2S_MODE_TX = 4, I2S_MODE_DAC_BUILT_IN = 16,
+    I2S_BITS_PER_SAMPLE_16BIT = 16,
+    I2S_COMM_FORMAT_STAND_I2S = 1, I2S_COMM_FORMAT_I2S_MSB = 2,
+    I2S_CHANNEL_FMT_RIGHT_LEFT = 0, I2S_CHANNEL_FMT_ONLY_RIGHT = 3,
+    I2S_DAC_CHANNEL_RIGHT_EN = 1, I2S_DAC_CHANNEL_BOTH_EN = 3,
+    I2S_CHANNEL_MONO = 1, I2S_CHANNEL_STEREO = 2,
+    I2S_PIN_NO_CHANGE = -1
+};
+
+typedef struct {
+    int mode, sample_rate, bits_per_sample, communication_format, channel_format;
+    int intr_alloc_flags, dma_buf_count, dma_buf_len, use_apll, tx_desc_auto_clear, fixed_mclk;
+} i2s_config_t;
+
+static inline int i2s_driver_install(int, const i2s_config_t*, int, void*) { return 0; }
+static inline int i2s_set_dac_mode(int) { return 0; }
+static inline int i2s_set_clk(int, uint32_t, int, int) { return 0; }
+static inline int i2s_write(int, const void*, size_t size, size_t* written, TickType_t) { *written = size; return 0; }
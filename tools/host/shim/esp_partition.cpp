@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZX-ESPectrum - ZX Spectrum emulator for ESP32
+//
+// Copyright (c) 2020, 2021 David Crespo [dcrespo3d]
+// https://github.com/dcrespo3d/ZX-ESPectrum-Wiimote
+//
+// Based on previous work by Ramón Martinez, Jorge Fuertes and many others
+// https://github.com/rampa069/ZX-ESPectrum
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+// Host shim: a flash data partition backed by a host file, mapped with mmap
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_partition.h"
+
+const char* hostPartitionFile = NULL;
+
+static esp_partition_t partition;
+static int partitionFd = -1;
+
+#define MAX_MAPPINGS 4
+static void* mappings[MAX_MAPPINGS];
+static size_t mappingSizes[MAX_MAPPINGS];
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+    esp_partition_subtype_t subtype, const char* label)
+{
+    if (hostPartitionFile == NULL || type != ESP_PARTITION_TYPE_DATA)
+        return NULL;
+
+    if (partitionFd < 0) {
+        partitionFd = open(hostPartitionFile, O_RDONLY);
+        if (partitionFd < 0)
+            return NULL;
+    }
+    struct stat st;
+    if (fstat(partitionFd, &st) != 0)
+        return NULL;
+
+    partition.type = type;
+    partition.subtype = subtype;
+    partition.address = 0;
+    partition.size = st.st_size;
+    strncpy(partition.label, label ? label : "", sizeof(partition.label) - 1);
+    partition.encrypted = false;
+    return &partition;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* part, size_t offset, size_t size,
+    spi_flash_mmap_memory_t memory, const void** out_ptr, spi_flash_mmap_handle_t* out_handle)
+{
+    if (part != &partition || partitionFd < 0 || offset + size > part->size)
+        return ESP_ERR_NOT_FOUND;
+
+    for (spi_flash_mmap_handle_t h = 0; h < MAX_MAPPINGS; h++) {
+        if (mappings[h] != NULL) continue;
+        // mmap offsets must be page aligned, like the 64 KB MMU pages on the device
+        size_t skip = offset % sysconf(_SC_PAGESIZE);
+        void* p = mmap(NULL, size + skip, PROT_READ, MAP_PRIVATE, partitionFd, offset - skip);
+        if (p == MAP_FAILED)
+            return ESP_FAIL;
+        mappings[h] = p;
+        mappingSizes[h] = size + skip;
+        *out_ptr = (const uint8_t*)p + skip;
+        *out_handle = h;
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+    if (handle < MAX_MAPPINGS && mappings[handle] != NULL) {
+        munmap(mappings[handle], mappingSizes[handle]);
+        mappings[handle] = NULL;
+    }
+}
@@ -0,0 +1,49 @@
+// Host shim: FreeRTOS and heap_caps calls used by the emulator and FabGL.
+// Tasks are never started; the harness drives everything from its own loop.
+
+#ifndef HOST_FreeRTOS_h
+#define HOST_FreeRTOS_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void* QueueHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY 0xffffffff
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+static inline void vSemaphoreDelete(SemaphoreHandle_t) {}
+static inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return (SemaphoreHandle_t)1; }
+static inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+static inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+
+static inline BaseType_t xTaskCreate(void (*)(void*), const char*, uint32_t, void*, int, TaskHandle_t*) { return pdPASS; }
+static inline BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, int, TaskHandle_t*, int) { return pdPASS; }
+static inline void vTaskDelete(TaskHandle_t) {}
+static inline void vTaskDelay(TickType_t) {}
+static inline void xTaskNotifyGive(TaskHandle_t) {}
+static inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+static inline int xPortGetCoreID() { return 1; }
+
+static inline QueueHandle_t xQueueCreate(uint32_t, uint32_t) { return 0; }
+static inline BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t) { return pdTRUE; }
+static inline BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+static inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // HOST_FreeRTOS_h
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# ZX-ESPectrum - build the ROM image for the "romsets" flash partition
+#
+# Packs every ROM set under data/rom/<arch>/<romset>/<n>.rom into one image,
+# which the emulator maps straight from flash (see RomPartition.h for the
+# layout and ROM_PARTITION in hardconfig.h). Flash it at the offset of the
+# partition in partitions.csv:
+#
+#   python3 tools/mkromimage.py data/rom romsets.bin
+#   esptool.py --chip esp32 write_flash 0x3C0000 romsets.bin
+#
+# The host harness maps the same file: zxhost --rom-image romsets.bin ...
+
+import os
+import struct
+import sys
+
+ROM_SIZE = 0x4000
+HEADER_SIZE = 16
+SET_SIZE = 32
+VERSION = 1
+MAX_ROMS = 4
+
+
+def romsets(romdir):
+    for arch in sorted(os.listdir(romdir)):
+        archdir = os.path.join(romdir, arch)
+        if not os.path.isdir(archdir):
+            continue
+        for romset in sorted(os.listdir(archdir)):
+            setdir = os.path.join(archdir, romset)
+            roms = []
+            while os.path.isfile(os.path.join(setdir, "%d.rom" % len(roms))):
+                roms.append(os.path.join(setdir, "%d.rom" % len(roms)))
+            if roms:
+                yield arch, romset, roms
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: mkromimage.py <rom dir> <image>")
+
+    sets = list(romsets(sys.argv[1]))
+    # ROMs start at the first flash sector after the set table
+    offset = (HEADER_SIZE + len(sets) * SET_SIZE + 0xFFF) & ~0xFFF
+
+    table = b""
+    data = b""
+    for arch, romset, roms in sets:
+        if len(arch) > 8 or len(romset) > 16 or len(roms) > MAX_ROMS:
+            sys.exit("cannot store %s/%s" % (arch, romset))
+        table += struct.pack("<8s16sB3xI", arch.encode(), romset.encode(),
+                             len(roms), offset + len(data))
+        for rom in roms:
+            with open(rom, "rb") as f:
+                data += f.read(ROM_SIZE).ljust(ROM_SIZE, b"\xff")
+        print("%-5s %-10s %u ROMs" % (arch, romset, len(roms)))
+
+    header = struct.pack("<4sHH8x", b"ZXRS", VERSION, len(sets))
+    image = (header + table).ljust(offset, b"\xff") + data
+    with open(sys.argv[2], "wb") as f:
+        f.write(image)
+    print("%s: %u bytes" % (sys.argv[2], len(image)))
+
+
+if __name__ == "__main__":
+    main()